@@ -32,12 +32,31 @@
  *
  *****************************************************************************/
 
+/* The MP4_CREATE_* bits are passed to MP4Create() and MP4CreateEx(), the
+ * MP4_CLOSE_* bits to MP4Close() and the MP4_READ_* bits to MP4ReadEx().
+ * Each set is numbered on its own and their values overlap, so bits of one
+ * set mean nothing, or something else, where another set is expected. */
+
 /** Bit: enable 64-bit data-atoms. */
 #define MP4_CREATE_64BIT_DATA 0x01
 /** Bit: enable 64-bit time-atoms. @note Incompatible with QuickTime. */
 #define MP4_CREATE_64BIT_TIME 0x02
+/** Bit: write sample data past the page cache (O_DIRECT) where the file system supports it. */
+#define MP4_CREATE_DIRECT_IO 0x04
+/** Bit: write the samples as movie fragments, each a moof and mdat pair, after an up-front moov. */
+#define MP4_CREATE_FRAGMENTED 0x08
 /** Bit: do not recompute avg/max bitrates on file close. @note See http://code.google.com/p/mp4v2/issues/detail?id=66 */
 #define MP4_CLOSE_DO_NOT_COMPUTE_BITRATE 0x01
+/** Bit: memory-map the file read-only instead of using buffered stream I/O. */
+#define MP4_READ_MMAP 0x01
+/** Bit: read through offset-based pread(2) so samples may be read concurrently. */
+#define MP4_READ_PREAD 0x02
+/** Bit: skip sample table bodies on open and decode each on first use. */
+#define MP4_READ_LAZY 0x04
+/** Bit: keep large sample tables in their on-disk form and decode entries on use. */
+#define MP4_READ_PAGED_TABLES 0x08
+/** Bit: keep decoded sample size and chunk offset tables bit-packed in memory. */
+#define MP4_READ_PACKED_TABLES 0x10
 
 /** Enumeration of file modes for custom file provider. */
 typedef enum MP4FileMode_e
@@ -124,6 +143,8 @@ void MP4Close(
  *      data or time atoms. Valid bits may be any combination of:
  *          @li #MP4_CREATE_64BIT_DATA
  *          @li #MP4_CREATE_64BIT_TIME
+ *          @li #MP4_CREATE_DIRECT_IO
+ *          @li #MP4_CREATE_FRAGMENTED
  *
  *  @return On success a handle of the newly created file for use in subsequent
  *      calls to the library. On error, #MP4_INVALID_FILE_HANDLE.
@@ -139,6 +160,20 @@ MP4FileHandle MP4Create(
  *
  *  MP4CreateEx is an extended version of MP4Create().
  *
+ *  With #MP4_CREATE_FRAGMENTED the ftyp and moov atoms are written ahead of
+ *  the first fragment and the samples follow as movie fragments, so memory
+ *  use is bounded by one fragment rather than growing with the file, and a
+ *  file cut short loses at most the fragment being buffered. Tracks must all
+ *  be added before the first fragment is written. See
+ *  MP4SetFragmentDuration() and MP4WriteFragment(). On close a <b>sidx</b>
+ *  indexing the fragments by the times of the first video track (or of the
+ *  first track) is written ahead of them, and an <b>mfra</b> with a
+ *  <b>tfra</b> per track at the end of the file. So that neither grows
+ *  with the file, the <b>sidx</b> has at most 512 references, each for a
+ *  run of 1, 2, 4 or more fragments as they add up, and a <b>tfra</b> at
+ *  most 1024 entries, for every fragment that starts with a sync sample
+ *  or, as they add up, every 2nd, 4th and so on of them.
+ *
  *  @param fileName pathname of the file to be created.
  *      On Windows, this should be a UTF-8 encoded string.
  *      On other platforms, it should be an 8-bit encoding that is
@@ -148,6 +183,8 @@ MP4FileHandle MP4Create(
  *      data or time atoms. Valid bits may be any combination of:
  *          @li #MP4_CREATE_64BIT_DATA
  *          @li #MP4_CREATE_64BIT_TIME
+ *          @li #MP4_CREATE_DIRECT_IO
+ *          @li #MP4_CREATE_FRAGMENTED
  *  @param add_ftyp if true an <b>ftyp</b> atom is automatically created.
  *  @param add_iods if true an <b>iods</b> atom is automatically created.
  *  @param majorBrand <b>ftyp</b> brand identifier.
@@ -195,6 +232,7 @@ MP4FileHandle MP4CreateEx(
  *      data or time atoms. Valid bits may be any combination of:
  *          @li #MP4_CREATE_64BIT_DATA
  *          @li #MP4_CREATE_64BIT_TIME
+ *          @li #MP4_CREATE_FRAGMENTED
  *
  *  @return On success a handle of the newly created file for use in subsequent
  *      calls to the library. On error, #MP4_INVALID_FILE_HANDLE.
@@ -223,6 +261,7 @@ MP4FileHandle MP4CreateCallbacks(
  *      data or time atoms. Valid bits may be any combination of:
  *          @li #MP4_CREATE_64BIT_DATA
  *          @li #MP4_CREATE_64BIT_TIME
+ *          @li #MP4_CREATE_FRAGMENTED
  *  @param add_ftyp if true an <b>ftyp</b> atom is automatically created.
  *  @param add_iods if true an <b>iods</b> atom is automatically created.
  *  @param majorBrand <b>ftyp</b> brand identifier.
@@ -468,6 +507,51 @@ bool MP4Optimize(
     const char* fileName,
     const char* newFileName DEFAULT(NULL) );
 
+/** Package an existing mp4 file as fragmented mp4 segments.
+ *
+ *  MP4Segment writes the ftyp and moov of the file, with empty sample
+ *  tables and an mvex, as an init segment and its samples as media
+ *  segments of one moof and mdat each, numbered from 1. Segments start at
+ *  sync samples of the first video track, or else of the first track,
+ *  once the one before lasts at least @p duration; the other tracks are
+ *  cut at the same decode time. Concatenating the init segment and the
+ *  media segments in order yields a fragmented mp4 file.
+ *
+ *  Segments are written in parallel by a pool of worker threads that
+ *  read their samples from the file in contiguous runs.
+ *
+ *  Files with sample groups (<b>sbgp</b>, <b>sgpd</b>), sub-sample
+ *  information (<b>subs</b>) or sample auxiliary information (<b>saiz</b>,
+ *  <b>saio</b>) in their sample tables are refused, as the fragments would
+ *  not carry them.
+ *
+ *  @param fileName pathname of the (existing) file to segment.
+ *      On Windows, this should be a UTF-8 encoded string.
+ *      On other platforms, it should be an 8-bit encoding that is
+ *      appropriate for the platform, locale, file system, etc.
+ *      (prefer to use UTF-8 when possible).
+ *  @param initFileName pathname of the init segment.
+ *  @param segmentFileNameFormat pathname of the media segments as a
+ *      printf format with a single %u conversion for the segment number,
+ *      e.g. "video-%05u.m4s".
+ *  @param duration minimum duration of the segments in milliseconds.
+ *  @param numWorkers number of segments written at a time, 0 for one per
+ *      processor.
+ *  @param pNumSegments if not NULL, set to the number of media segments.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4CreateEx() for fragmented files written sample by sample.
+ */
+MP4V2_EXPORT
+bool MP4Segment(
+    const char* fileName,
+    const char* initFileName,
+    const char* segmentFileNameFormat,
+    MP4Duration duration,
+    uint32_t    numWorkers DEFAULT(0),
+    uint32_t*   pNumSegments DEFAULT(NULL) );
+
 /** Read an existing mp4 file.
  *
  *  MP4Read is the first call that should be used when you want to just
@@ -476,6 +560,9 @@ bool MP4Optimize(
  *  information is loaded into memory. Note that actual track samples are not
  *  read into memory until MP4ReadSample() is called.
  *
+ *  Samples in movie fragments (moof atoms) are numbered on from those in the
+ *  track's sample tables, so a fragmented file reads like any other.
+ *
  *  @param fileName pathname of the file to be read.
  *      On Windows, this should be a UTF-8 encoded string.
  *      On other platforms, it should be an 8-bit encoding that is
@@ -489,6 +576,62 @@ MP4V2_EXPORT
 MP4FileHandle MP4Read(
     const char* fileName );
 
+/** Read an existing mp4 file with extra options.
+ *
+ *  MP4ReadEx is an extended version of MP4Read().
+ *
+ *  @param fileName pathname of the file to be read.
+ *      On Windows, this should be a UTF-8 encoded string.
+ *      On other platforms, it should be an 8-bit encoding that is
+ *      appropriate for the platform, locale, file system, etc.
+ *      (prefer to use UTF-8 when possible).
+ *  @param flags bitmask that allows the user to set extra options for
+ *      opening the file.
+ *          @li #MP4_READ_MMAP map the whole file into memory once; samples
+ *              are then served from the page cache and, where the API
+ *              allows it, without copying. Only available on POSIX
+ *              platforms, elsewhere the flag is ignored.
+ *          @li #MP4_READ_PREAD read through a positionless provider built
+ *              on pread(2). Only available on POSIX platforms, elsewhere
+ *              the flag is ignored.
+ *          @li #MP4_READ_LAZY record only the position of the sample
+ *              tables (stts, ctts, stsc, stsz, stco, co64, stss) while
+ *              parsing and decode each one the first time its values are
+ *              needed. Opening then takes time proportional to the number
+ *              of atoms rather than the number of samples, which suits
+ *              callers that only want durations, codecs or tags. In a
+ *              fragmented file with a <b>sidx</b> or <b>mfra</b> reading
+ *              also stops at the first <b>moof</b>: MP4ReadSampleFromTime()
+ *              and the track duration then read only the fragments they
+ *              need, while looking samples up by id reads them all first.
+ *          @li #MP4_READ_PAGED_TABLES leave large sample tables (more
+ *              than 16384 entries) as the big-endian bytes found in the
+ *              file and decode entries as they are looked up. Combined with
+ *              #MP4_READ_MMAP the tables are read from the mapping and take
+ *              no memory of their own; otherwise each table pages in a few
+ *              blocks of entries at a time. Tables that are modified are
+ *              decoded in full first.
+ *          @li #MP4_READ_PACKED_TABLES store the stsz sample sizes and
+ *              stco/co64 chunk offsets that are decoded in blocks of 64
+ *              entries, each holding the differences to its smallest entry
+ *              in as few bits as needed. Lookups stay constant time and
+ *              the tables typically shrink to a third or less. Tables left
+ *              on disk by #MP4_READ_PAGED_TABLES are not affected.
+ *
+ *      With #MP4_READ_MMAP or #MP4_READ_PREAD, once MP4ReadEx() has
+ *      returned, MP4ReadSample() and MP4ReadSampleView() may be called
+ *      from several threads at once on the same handle, for the same or
+ *      different tracks; deferred tables are then decoded under a lock.
+ *      All other calls must still be serialized by the caller.
+ *
+ *  @return On success a handle of the file for use in subsequent calls to
+ *      the library. On error, #MP4_INVALID_FILE_HANDLE.
+ */
+MP4V2_EXPORT
+MP4FileHandle MP4ReadEx(
+    const char* fileName,
+    uint32_t    flags );
+
 /** Read an existing mp4 file.
  *
  *  @deprecated The file provider API is deprecated since MP4v2 2.1.0. Please
@@ -546,6 +689,199 @@ MP4FileHandle MP4ReadCallbacks(
     const MP4IOCallbacks* callbacks,
     void*                 handle DEFAULT(NULL) );
 
+/** Set the size of the read-ahead buffer.
+ *
+ *  MP4SetReadBufferSize sets the size of the window used to buffer reads
+ *  from the underlying file, custom file provider or I/O callbacks. Small
+ *  reads made while parsing atoms and reading samples are then satisfied
+ *  from memory rather than by one provider call each. The default is 64KB.
+ *
+ *  When applied to an open file the current buffer contents are discarded.
+ *  When applied globally, the setting takes effect for files opened
+ *  afterwards.
+ *
+ *  @param size the buffer size in bytes. Values are clamped to the range
+ *      64KB to 4MB; 0 disables read-ahead buffering.
+ *  @param hFile specifies the mp4 file to which the operation applies,
+ *      otherwise applies to the global default.
+ *
+ *  @see MP4GetReadBufferSize()
+ */
+MP4V2_EXPORT
+void MP4SetReadBufferSize(
+    uint32_t      size,
+    MP4FileHandle hFile DEFAULT(MP4_INVALID_FILE_HANDLE) );
+
+/** Get the size of the read-ahead buffer.
+ *
+ *  @param hFile specifies the mp4 file to query, otherwise the global
+ *      default is returned.
+ *
+ *  @return the read-ahead buffer size in bytes, 0 if buffering is disabled.
+ *
+ *  @see MP4SetReadBufferSize()
+ */
+MP4V2_EXPORT
+uint32_t MP4GetReadBufferSize(
+    MP4FileHandle hFile DEFAULT(MP4_INVALID_FILE_HANDLE) );
+
+/** Block cache counters.
+ *
+ *  The hit rate is <b>hits</b> / (<b>hits</b> + <b>misses</b>).
+ *
+ *  @see MP4GetBlockCacheStats()
+ */
+typedef struct MP4BlockCacheStats_s
+{
+    uint64_t hits;       /**< blocks served from the cache */
+    uint64_t misses;     /**< blocks fetched from the provider */
+    uint64_t reads;      /**< read calls made to the provider */
+    uint64_t bytesRead;  /**< bytes returned by the provider */
+    uint64_t evictions;  /**< blocks dropped to stay within capacity */
+} MP4BlockCacheStats;
+
+/** Configure the block cache for custom I/O.
+ *
+ *  MP4SetBlockCache enables an LRU cache of fixed-size blocks in front of
+ *  custom file providers and I/O callbacks (see MP4ReadProvider() and
+ *  MP4ReadCallbacks()), for I/O where every call is a costly round trip.
+ *  Reads that need several uncached adjacent blocks fetch them with a
+ *  single provider read, and seeks are only passed on when the provider
+ *  has to be called. Writes go through to the provider.
+ *
+ *  The setting takes effect for files opened afterwards. The cache is
+ *  disabled by default; regular files are never cached.
+ *
+ *  @param blockSize the block size in bytes; 0 disables the cache.
+ *  @param capacity the maximum number of bytes to keep cached. At least
+ *      one block is always kept.
+ *
+ *  @see MP4GetBlockCacheStats()
+ */
+MP4V2_EXPORT
+void MP4SetBlockCache(
+    uint32_t blockSize,
+    uint64_t capacity );
+
+/** Get block cache counters of a file.
+ *
+ *  @param hFile handle of file to query.
+ *  @param stats populated with the counters since the file was opened.
+ *
+ *  @return <b>true</b> on success, <b>false</b> if the file was opened
+ *      without a block cache.
+ *
+ *  @see MP4SetBlockCache()
+ */
+MP4V2_EXPORT
+bool MP4GetBlockCacheStats(
+    MP4FileHandle       hFile,
+    MP4BlockCacheStats* stats );
+
+/** Enumeration of provider operations reported by I/O statistics. */
+typedef enum MP4IOOp_e
+{
+    MP4_IO_OP_READ,  /**< read from the file, custom provider or I/O callbacks */
+    MP4_IO_OP_WRITE, /**< write to the file, custom provider or I/O callbacks */
+    MP4_IO_OP_SEEK   /**< seek in the file, custom provider or I/O callbacks */
+} MP4IOOp;
+
+/** Number of buckets of each latency histogram in #MP4IOStats. */
+#define MP4_IO_LATENCY_BUCKETS 24
+
+/** I/O statistics of an mp4 file.
+ *
+ *  The <b>read</b>, <b>write</b> and <b>seek</b> counters count requests
+ *  made by the library while parsing, reading and writing, most of which
+ *  are served by read-ahead buffering. The <b>provider</b> counters count
+ *  the operations that actually reached the file, custom file provider or
+ *  I/O callbacks, and only these are timed.
+ *
+ *  Bucket 0 of a latency histogram counts operations that took less than
+ *  1 microsecond, bucket <em>i</em> those that took at least
+ *  2<sup><em>i</em>-1</sup> and less than 2<sup><em>i</em></sup>
+ *  microseconds. The last bucket also counts everything slower.
+ *
+ *  @see MP4GetIOStats()
+ */
+typedef struct MP4IOStats_s
+{
+    uint64_t readCalls;          /**< read requests */
+    uint64_t readBytes;          /**< bytes requested by reads */
+    uint64_t writeCalls;         /**< write requests */
+    uint64_t writeBytes;         /**< bytes requested by writes */
+    uint64_t seekCalls;          /**< seek requests */
+
+    uint64_t providerReads;      /**< provider read operations */
+    uint64_t providerReadBytes;  /**< bytes returned by provider reads */
+    uint64_t providerWrites;     /**< provider write operations */
+    uint64_t providerWriteBytes; /**< bytes accepted by provider writes */
+    uint64_t providerSeeks;      /**< provider seek operations */
+
+    uint64_t readTime;           /**< nanoseconds spent in provider reads */
+    uint64_t writeTime;          /**< nanoseconds spent in provider writes */
+    uint64_t seekTime;           /**< nanoseconds spent in provider seeks */
+
+    uint64_t readLatency[MP4_IO_LATENCY_BUCKETS];  /**< provider read latencies */
+    uint64_t writeLatency[MP4_IO_LATENCY_BUCKETS]; /**< provider write latencies */
+    uint64_t seekLatency[MP4_IO_LATENCY_BUCKETS];  /**< provider seek latencies */
+
+    uint64_t peakBufferBytes;    /**< peak memory held by I/O and sample buffers */
+} MP4IOStats;
+
+/** Prototype for a function invoked for every provider operation.
+ *
+ *  The function may be invoked concurrently for files read from several
+ *  threads (see #MP4_READ_PREAD).
+ *
+ *  @param userData the pointer given to MP4SetIOTraceCallback().
+ *  @param op the operation.
+ *  @param offset file offset the operation started at.
+ *  @param size number of bytes transferred, 0 for seeks.
+ *  @param duration time spent in the operation, in nanoseconds.
+ */
+typedef void (*MP4IOTraceCallback)(
+    void*    userData,
+    MP4IOOp  op,
+    int64_t  offset,
+    int64_t  size,
+    uint64_t duration );
+
+/** Get I/O statistics of a file.
+ *
+ *  MP4GetIOStats reports counters accumulated since the file was opened,
+ *  telling apart parse-bound, seek-bound and bandwidth-bound workloads.
+ *
+ *  @param hFile handle of file to query.
+ *  @param stats populated with the statistics.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4SetIOTraceCallback()
+ */
+MP4V2_EXPORT
+bool MP4GetIOStats(
+    MP4FileHandle hFile,
+    MP4IOStats*   stats );
+
+/** Set a function to be invoked for every provider operation.
+ *
+ *  When applied globally, the callback is installed on files opened
+ *  afterwards, including those opened internally by MP4Optimize().
+ *
+ *  @param callback the function to invoke, or NULL to disable tracing.
+ *  @param userData passed to @p callback unchanged.
+ *  @param hFile specifies the mp4 file to which the operation applies,
+ *      otherwise applies to the global default.
+ *
+ *  @see MP4GetIOStats()
+ */
+MP4V2_EXPORT
+void MP4SetIOTraceCallback(
+    MP4IOTraceCallback callback,
+    void*              userData DEFAULT(NULL),
+    MP4FileHandle      hFile DEFAULT(MP4_INVALID_FILE_HANDLE) );
+
 /** @} ***********************************************************************/
 
 #endif /* MP4V2_FILE_H */
@@ -47,6 +47,60 @@ typedef enum MP4SampleDependencyType_e {
     _MP4_SDT_RESERVED                     = 0x80 /**< reserved */
 } MP4SampleDependencyType;
 
+/** Read-only view of a track sample.
+ *
+ *  Filled in by MP4ReadSampleView() and handed back to the library with
+ *  MP4ReleaseSampleView(). All times are in the track's timescale.
+ */
+typedef struct MP4SampleView_s
+{
+    const uint8_t* bytes;              /**< sample data, must not be modified or freed */
+    uint32_t       numBytes;           /**< size of sample data in bytes */
+    MP4Timestamp   startTime;          /**< decoding timestamp */
+    MP4Duration    duration;           /**< sample duration */
+    MP4Duration    renderingOffset;    /**< composition time offset */
+    bool           isSyncSample;       /**< sync/random access flag */
+    bool           hasDependencyFlags; /**< true if the track carries sdtp information */
+    uint32_t       dependencyFlags;    /**< bitmask of #MP4SampleDependencyType values */
+    void*          reserved;           /**< library use only */
+} MP4SampleView;
+
+/** Per-sample descriptor filled in by MP4ReadSamples().
+ *
+ *  All times are in the track's timescale.
+ */
+typedef struct MP4SampleInfo_s
+{
+    uint32_t     offset;          /**< offset of sample data in the caller's buffer */
+    uint32_t     numBytes;        /**< size of sample data in bytes */
+    MP4Timestamp startTime;       /**< decoding timestamp */
+    MP4Duration  duration;        /**< sample duration */
+    MP4Duration  renderingOffset; /**< composition time offset */
+    bool         isSyncSample;    /**< sync/random access flag */
+    uint32_t     dependencyFlags; /**< bitmask of #MP4SampleDependencyType values, 0 if unknown */
+} MP4SampleInfo;
+
+/** Opaque sample iterator, see MP4SampleIteratorCreate(). */
+typedef struct MP4SampleIterator_s MP4SampleIterator;
+
+/** Description of a track sample filled in by MP4SampleIteratorNext().
+ *
+ *  All times are in the track's timescale.
+ */
+typedef struct MP4SampleRecord_s
+{
+    MP4SampleId  sampleId;               /**< id of the sample */
+    uint64_t     offset;                 /**< file offset of the sample data */
+    uint32_t     numBytes;               /**< size of sample data in bytes */
+    MP4Timestamp startTime;              /**< decoding timestamp */
+    MP4Duration  duration;               /**< sample duration */
+    MP4Duration  renderingOffset;        /**< composition time offset as stored */
+    MP4Timestamp presentationTime;       /**< decoding timestamp plus signed composition offset */
+    bool         isSyncSample;           /**< sync/random access flag */
+    uint32_t     dependencyFlags;        /**< bitmask of #MP4SampleDependencyType values, 0 if unknown */
+    uint32_t     sampleDescriptionIndex; /**< 1-based index of the sample description (stsd entry) */
+} MP4SampleRecord;
+
 /** Retrieves external sample file name.
  *
  *  MP4GetSampleFileURL retrieves the filename for
@@ -141,6 +195,155 @@ bool MP4ReadSample(
     MP4Duration*  pRenderingOffset DEFAULT(NULL),
     bool*         pIsSyncSample DEFAULT(NULL) );
 
+/** Read a track sample without copying it.
+ *
+ *  MP4ReadSampleView is similar to MP4ReadSample() except that the caller
+ *  never owns the sample data. If the file was opened with #MP4_READ_MMAP
+ *  the view points directly into the mapped file; otherwise the sample is
+ *  read into a buffer from a per-file pool which is recycled once the view
+ *  is released. Either way no allocation happens per sample in steady
+ *  state.
+ *
+ *  Every successful call must be paired with a call to
+ *  MP4ReleaseSampleView() before the file is closed. Any number of views
+ *  may be outstanding at a time.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param sampleId specifies which sample is to be read.
+ *      Caveat: the first sample has id <b>1</b> not <b>0</b>.
+ *  @param view pointer to a structure receiving the sample data and its
+ *      timing, sync and dependency information.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4ReleaseSampleView()
+ *  @see MP4ReadSample()
+ */
+MP4V2_EXPORT
+bool MP4ReadSampleView(
+    MP4FileHandle  hFile,
+    MP4TrackId     trackId,
+    MP4SampleId    sampleId,
+    MP4SampleView* view );
+
+/** Release a sample view.
+ *
+ *  MP4ReleaseSampleView returns the resources held by a view obtained from
+ *  MP4ReadSampleView() to the library. The view's data pointer is invalid
+ *  afterwards. Releasing an already released or zeroed view is harmless.
+ *
+ *  @param hFile handle of file the view was read from.
+ *  @param view the view to release.
+ *
+ *  @see MP4ReadSampleView()
+ */
+MP4V2_EXPORT
+void MP4ReleaseSampleView(
+    MP4FileHandle  hFile,
+    MP4SampleView* view );
+
+/** Read a run of consecutive track samples.
+ *
+ *  MP4ReadSamples reads up to <b>numSamples</b> samples starting at
+ *  <b>firstSampleId</b> into a single caller supplied buffer, packed back
+ *  to back in decoding order. Samples that are contiguous in the file, as
+ *  is typical for the samples of one chunk, are fetched with a single read
+ *  instead of one seek and read per sample.
+ *
+ *  Reading stops early at the end of the track or when the next sample
+ *  would not fit into the remaining buffer space.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param firstSampleId id of the first sample to read.
+ *      Caveat: the first sample has id <b>1</b> not <b>0</b>.
+ *  @param numSamples maximum number of samples to read.
+ *  @param pBytes buffer receiving the sample data.
+ *  @param numBytes size of <b>pBytes</b> in bytes.
+ *  @param pSampleInfo array of at least <b>numSamples</b> entries receiving
+ *      the position of each sample in <b>pBytes</b> and its timing, sync
+ *      and dependency information.
+ *
+ *  @return the number of samples read; 0 on failure or if the first sample
+ *      does not fit into <b>pBytes</b>.
+ *
+ *  @see MP4ReadSample()
+ */
+MP4V2_EXPORT
+uint32_t MP4ReadSamples(
+    MP4FileHandle  hFile,
+    MP4TrackId     trackId,
+    MP4SampleId    firstSampleId,
+    uint32_t       numSamples,
+    uint8_t*       pBytes,
+    uint32_t       numBytes,
+    MP4SampleInfo* pSampleInfo );
+
+/** Create an iterator over the samples of a track.
+ *
+ *  MP4SampleIteratorCreate returns an iterator positioned on the first
+ *  sample of a track. Each MP4SampleIteratorNext() then describes one
+ *  sample in decoding order, with all of its timing, size, position and
+ *  flags, in constant time. It is the cheapest way to walk a whole track:
+ *  calling MP4GetSampleTime(), MP4GetSampleSize(), MP4GetSampleSync() and
+ *  friends per sample looks every table up separately.
+ *
+ *  The iterator does not read sample data. Use the record's offset and
+ *  size, or pass its sample id to MP4ReadSample() or MP4ReadSampleView().
+ *  Each iterator must be used by one thread at a time and destroyed with
+ *  MP4SampleIteratorDestroy() before the file is closed. A file may have
+ *  any number of iterators.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *
+ *  @return On success, the new iterator. On error, NULL.
+ */
+MP4V2_EXPORT
+MP4SampleIterator* MP4SampleIteratorCreate(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId );
+
+/** Describe the next sample of an iterator.
+ *
+ *  @param iterator iterator from MP4SampleIteratorCreate().
+ *  @param record receives the description of the sample.
+ *
+ *  @return <b>true</b> if a sample was described, <b>false</b> at the end
+ *      of the track or on error.
+ */
+MP4V2_EXPORT
+bool MP4SampleIteratorNext(
+    MP4SampleIterator* iterator,
+    MP4SampleRecord*   record );
+
+/** Move an iterator to a sample.
+ *
+ *  MP4SampleIteratorSeek makes the next MP4SampleIteratorNext() describe
+ *  <b>sampleId</b>. Seeking uses binary searches of the sample tables and
+ *  is much more expensive than a step, but independent of the distance.
+ *
+ *  @param iterator iterator from MP4SampleIteratorCreate().
+ *  @param sampleId id of the sample to move to.
+ *      Caveat: the first sample has id <b>1</b> not <b>0</b>.
+ *
+ *  @return <b>true</b> on success, <b>false</b> if there is no such
+ *      sample, in which case the iterator is at the end.
+ */
+MP4V2_EXPORT
+bool MP4SampleIteratorSeek(
+    MP4SampleIterator* iterator,
+    MP4SampleId        sampleId );
+
+/** Destroy a sample iterator.
+ *
+ *  @param iterator iterator from MP4SampleIteratorCreate(), may be NULL.
+ */
+MP4V2_EXPORT
+void MP4SampleIteratorDestroy(
+    MP4SampleIterator* iterator );
+
 /** Read a track sample based on a specified time.
  *
  *  MP4ReadSampleFromTime is similar to MP4ReadSample() except the sample
@@ -315,6 +518,136 @@ bool MP4WriteSampleDependency(
     bool           isSyncSample,
     uint32_t       dependencyFlags );
 
+/** Set the duration of movie fragments.
+ *
+ *  MP4SetFragmentDuration sets how much media goes into each movie fragment
+ *  of a file created with #MP4_CREATE_FRAGMENTED. A fragment is cut before a
+ *  sync sample of the reference track, which is the first video track or
+ *  else the first track, once the samples buffered for that track span at
+ *  least @p duration. A duration of 0 starts a fragment at every sync sample
+ *  of the reference track. The default is two seconds.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param duration minimum fragment duration in the movie timescale.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4WriteFragment()
+ */
+MP4V2_EXPORT
+bool MP4SetFragmentDuration(
+    MP4FileHandle hFile,
+    MP4Duration   duration );
+
+/** Write out the current movie fragment.
+ *
+ *  MP4WriteFragment writes the samples buffered since the last fragment, or
+ *  the last chunk (see MP4SetChunkDuration()), of a file created with
+ *  #MP4_CREATE_FRAGMENTED as one moof and mdat pair, without waiting for the
+ *  next fragment boundary, and ends the fragment. The first fragment is
+ *  preceded by the ftyp and moov atoms. Sample dependency flags given to
+ *  MP4WriteSampleDependency() go into the sample flags of the fragment.
+ *
+ *  @param hFile handle of file for operation.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4SetFragmentDuration()
+ */
+MP4V2_EXPORT
+bool MP4WriteFragment(
+    MP4FileHandle hFile );
+
+/** Set the duration of the chunks of movie fragments.
+ *
+ *  MP4SetChunkDuration splits each movie fragment of a file created with
+ *  #MP4_CREATE_FRAGMENTED into chunks, each a moof and mdat pair of its own,
+ *  as for low-latency CMAF. A chunk is written by the MP4WriteSample() call
+ *  that brings the samples buffered for the reference track (see
+ *  MP4SetFragmentDuration()) to at least @p duration, so its media can be
+ *  sent on before the rest of the fragment exists; a duration of 0 makes a
+ *  chunk of every sample of the reference track. Only the first chunk of a
+ *  fragment starts with a sync sample, and the <b>sidx</b> written on close
+ *  still indexes whole fragments. With #MP4_INVALID_DURATION, the default,
+ *  every fragment is a single chunk.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param duration minimum chunk duration in the movie timescale.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4SetChunkCallback()
+ */
+MP4V2_EXPORT
+bool MP4SetChunkDuration(
+    MP4FileHandle hFile,
+    MP4Duration   duration );
+
+/** A run of the bytes of a chunk, see #MP4ChunkInfo. */
+typedef struct MP4ChunkPiece_s
+{
+    const uint8_t* bytes;    /**< valid until the callback returns */
+    uint64_t       numBytes; /**< size of the run in bytes */
+} MP4ChunkPiece;
+
+/** Description of the bytes of a fragmented file just written, passed to
+ *  an #MP4ChunkCallback.
+ *
+ *  The bytes come in pieces that follow one another in the file: for a
+ *  chunk, the moof and mdat header first and then the sample data of each
+ *  track as it was buffered, for the init segment a single piece.
+ *
+ *  Times are in the timescale of the reference track.
+ */
+typedef struct MP4ChunkInfo_s
+{
+    const MP4ChunkPiece* pieces;          /**< the atoms written, valid until the callback returns */
+    uint32_t             numPieces;       /**< number of pieces */
+    uint64_t             numBytes;        /**< size of the atoms in bytes, of all pieces */
+    uint64_t             fileOffset;      /**< where the atoms start in the file */
+    bool                 isInitSegment;   /**< the atoms are the ftyp and moov ahead of all chunks */
+    bool                 isFragmentStart; /**< the chunk starts a movie fragment */
+    uint32_t             sequenceNumber;  /**< sequence number in the moof of the chunk */
+    MP4TrackId           trackId;         /**< the reference track */
+    MP4Timestamp         startTime;       /**< decoding timestamp of the first sample of the chunk */
+    MP4Duration          duration;        /**< duration of the samples of the chunk */
+} MP4ChunkInfo;
+
+/** Prototype for a function invoked as each chunk of a fragmented file is
+ *  written.
+ *
+ *  @param userData the pointer given to MP4SetChunkCallback().
+ *  @param info the chunk; its bytes are those just written to the file.
+ */
+typedef void (*MP4ChunkCallback)(
+    void*               userData,
+    const MP4ChunkInfo* info );
+
+/** Set a function to be invoked as each chunk of a fragmented file is
+ *  written.
+ *
+ *  The callback receives the init segment ahead of the first chunk and
+ *  then every moof and mdat pair, whether written by MP4WriteSample(),
+ *  MP4WriteFragment() or MP4Close(), so they can be sent on without reading
+ *  the file back. The sample data is not copied for the callback: it is
+ *  handed over in the buffers it was written from, one piece per track,
+ *  after the moof and mdat header. The callback must not call into the
+ *  library for the same file.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param callback the function to invoke, or NULL for none.
+ *  @param userData passed to @p callback unchanged.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ *
+ *  @see MP4SetChunkDuration()
+ */
+MP4V2_EXPORT
+bool MP4SetChunkCallback(
+    MP4FileHandle    hFile,
+    MP4ChunkCallback callback,
+    void*            userData DEFAULT(NULL) );
+
 /** Make a copy of a sample.
  *
  *  MP4CopySample creates a new sample based on an existing sample. Note that
@@ -475,6 +808,61 @@ MP4SampleId MP4GetSampleIdFromTime(
     MP4Timestamp  when,
     bool          wantSyncSample DEFAULT(false) );
 
+/** Get the sample displayed at a presentation time.
+ *
+ *  MP4GetSampleIdFromPresentationTime returns the sample whose presentation
+ *  interval contains the specified time. Unlike MP4GetSampleIdFromTime(),
+ *  which works on decoding times, this takes the rendering offsets of the
+ *  composition time to sample table into account, so with B frames the
+ *  result is the frame actually shown at <b>when</b>. A sample is shown from
+ *  its composition time until the next one in presentation order starts;
+ *  the last sample is shown for its duration.
+ *
+ *  The first call sorts all samples of the track by composition time; later
+ *  calls are binary searches. The edit list is not applied. Negative
+ *  rendering offsets are honoured, composition times before zero count
+ *  as zero.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param when presentation time in track timescale.
+ *
+ *  @return On success, the sample id displayed at the specified time.
+ *      Before the first or after the last sample, or on error,
+ *      #MP4_INVALID_SAMPLE_ID.
+ *
+ *  @see MP4GetPresentationOrder()
+ */
+MP4V2_EXPORT
+MP4SampleId MP4GetSampleIdFromPresentationTime(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    MP4Timestamp  when );
+
+/** Get the samples of a track in presentation order.
+ *
+ *  MP4GetPresentationOrder copies the ids of all samples of a track into
+ *  <b>pSampleIds</b>, sorted by composition time (decoding time plus
+ *  rendering offset), with ties in decoding order. Call it with a NULL array
+ *  first to learn how many there are.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param pSampleIds array that receives at most <b>maxSampleIds</b> ids,
+ *      may be NULL.
+ *  @param maxSampleIds capacity of <b>pSampleIds</b>.
+ *
+ *  @return The number of samples in the track. On error, <b>0</b>.
+ *
+ *  @see MP4GetSampleIdFromPresentationTime()
+ */
+MP4V2_EXPORT
+uint32_t MP4GetPresentationOrder(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    MP4SampleId*  pSampleIds,
+    uint32_t      maxSampleIds );
+
 /** Get start time of track sample.
  *
  *  MP4GetSampleTime returns the start time of the specified sample from
@@ -604,6 +992,73 @@ int8_t MP4GetSampleSync(
     MP4TrackId    trackId,
     MP4SampleId   sampleId );
 
+/** Get the next sync sample.
+ *
+ *  MP4GetNextSyncSample returns the first sample at or after the specified
+ *  sample whose sync/random access flag is true. Together with
+ *  MP4GetPrevSyncSample() this allows stepping from keyframe to keyframe.
+ *  Both are binary searches of the sync sample table.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param sampleId id of sample to start from. Caveat: the first sample has
+ *      id <b>1</b>, not <b>0</b>.
+ *
+ *  @return On success, the id of the sync sample. If there is no sync
+ *      sample at or after <b>sampleId</b>, or on error,
+ *      #MP4_INVALID_SAMPLE_ID.
+ */
+MP4V2_EXPORT
+MP4SampleId MP4GetNextSyncSample(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    MP4SampleId   sampleId );
+
+/** Get the previous sync sample.
+ *
+ *  MP4GetPrevSyncSample returns the last sample at or before the specified
+ *  sample whose sync/random access flag is true, which is where decoding has
+ *  to start to display <b>sampleId</b>. A player seeking to a time can pass
+ *  the result of MP4GetSampleIdFromTime().
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param sampleId id of sample to start from. Ids past the last sample are
+ *      treated as the last sample.
+ *
+ *  @return On success, the id of the sync sample. If there is no sync
+ *      sample at or before <b>sampleId</b>, or on error,
+ *      #MP4_INVALID_SAMPLE_ID.
+ */
+MP4V2_EXPORT
+MP4SampleId MP4GetPrevSyncSample(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    MP4SampleId   sampleId );
+
+/** Get the ids of all sync samples.
+ *
+ *  MP4GetSyncSampleList copies the ids of the sync samples of a track, in
+ *  increasing order, into <b>pSampleIds</b>. A track without a sync sample
+ *  table has every sample marked sync. Call it with a NULL array first to
+ *  learn how many there are.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param pSampleIds array that receives at most <b>maxSampleIds</b> ids,
+ *      may be NULL.
+ *  @param maxSampleIds capacity of <b>pSampleIds</b>.
+ *
+ *  @return The total number of sync samples in the track, which may exceed
+ *      <b>maxSampleIds</b>. On error, <b>0</b>.
+ */
+MP4V2_EXPORT
+uint32_t MP4GetSyncSampleList(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    MP4SampleId*  pSampleIds,
+    uint32_t      maxSampleIds );
+
 /** @} ***********************************************************************/
 
 #endif /* MP4V2_SAMPLE_H */
@@ -599,6 +599,66 @@ bool MP4SetTrackDurationPerChunk(
     MP4TrackId    trackId,
     MP4Duration   duration );
 
+/** Track access patterns, see MP4SetTrackAccessPattern(). */
+typedef enum MP4TrackAccessPattern_e
+{
+    MP4_ACCESS_RANDOM,        /**< no particular order, nothing is prefetched (default) */
+    MP4_ACCESS_SEQUENTIAL,    /**< all samples are read in decoding order */
+    MP4_ACCESS_KEYFRAMES_ONLY /**< only sync samples are read, in decoding order */
+} MP4TrackAccessPattern;
+
+/** Declare how the samples of a track will be read.
+ *
+ *  MP4SetTrackAccessPattern lets the library read ahead on behalf of the
+ *  caller. For #MP4_ACCESS_SEQUENTIAL the next few chunks of the track, and
+ *  for #MP4_ACCESS_KEYFRAMES_ONLY the next few sync samples, are loaded by
+ *  a small pool of background threads while the caller is busy with the
+ *  current sample. MP4ReadSample() and MP4ReadSampleView() then take the
+ *  data from memory. Reading out of the declared order is still correct,
+ *  it merely loses the benefit.
+ *
+ *  Prefetching applies to files opened for reading by name, with or
+ *  without #MP4_READ_PREAD. Files opened with #MP4_READ_MMAP, through
+ *  custom I/O or for writing accept the hint but do not prefetch.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param pattern the expected access pattern.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ */
+MP4V2_EXPORT
+bool MP4SetTrackAccessPattern(
+    MP4FileHandle         hFile,
+    MP4TrackId            trackId,
+    MP4TrackAccessPattern pattern );
+
+/** Set how finely sample positions within chunks are indexed.
+ *
+ *  Locating a sample in the file means finding its chunk, which is a binary
+ *  search over the sample-to-chunk table, and adding up the sizes of the
+ *  samples before it in that chunk. For random access into tracks with many
+ *  samples per chunk, such as audio, that sum dominates. The library keeps
+ *  the position within its chunk of every @p interval-th sample (4 bytes
+ *  each) once the first such lookup happens, so no more than
+ *  @p interval - 1 sizes are added up per lookup.
+ *
+ *  An interval of 1 makes every lookup constant time at 4 bytes per sample,
+ *  larger intervals save memory, and 0 disables the index. The default is
+ *  16. Sequential reading does not build the index.
+ *
+ *  @param hFile handle of file for operation.
+ *  @param trackId id of track for operation.
+ *  @param interval samples per index entry, 0 for no index.
+ *
+ *  @return <b>true</b> on success, <b>false</b> on failure.
+ */
+MP4V2_EXPORT
+bool MP4SetTrackSampleOffsetIndex(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    uint32_t      interval );
+
 /**
  *  @param hFile handle of file for operation.
  *  @param trackId id of track for operation.
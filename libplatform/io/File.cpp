@@ -4,6 +4,17 @@ namespace mp4v2 { namespace platform { namespace io {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool
+FileProvider::readAt( Size pos, void* buffer, Size size, Size& nin )
+{
+    if( seek( pos ))
+        return true;
+
+    return read( buffer, size, nin );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 File::File( const std::string& name_, Mode mode_, FileProvider* provider_ )
     : _name     ( name_ )
     , _isOpen   ( false )
@@ -147,6 +158,38 @@ File::getSize( Size& nout )
     return _provider.getSize( nout );
 }
 
+const uint8_t*
+File::mapping( Size pos, Size size )
+{
+    if( !_isOpen )
+        return NULL;
+
+    return _provider.mapping( pos, size );
+}
+
+bool
+File::readAt( Size pos, void* buffer, Size size, Size& nin )
+{
+    nin = 0;
+
+    if( !_isOpen )
+        return true;
+
+    if( _provider.isPositionless() )
+        return _provider.readAt( pos, buffer, size, nin );
+
+    if( seek( pos ))
+        return true;
+
+    return read( buffer, size, nin );
+}
+
+bool
+File::isPositionless()
+{
+    return _isOpen && _provider.isPositionless();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 CustomFileProvider::CustomFileProvider( const MP4FileProvider& provider )
@@ -272,4 +315,236 @@ CallbacksFileProvider::getSize( Size& nout )
 
 ///////////////////////////////////////////////////////////////////////////////
 
+CachedFileProvider::CachedFileProvider( FileProvider& provider, uint32_t blockSize, uint64_t capacity )
+    : _provider    ( provider )
+    , _blockSize   ( max( blockSize, (uint32_t)1 ))
+    , _maxBlocks   ( max( (Size)(capacity / _blockSize), (Size)1 ))
+    , _pos         ( 0 )
+    , _providerPos ( -1 )
+{
+    memset( &_stats, 0, sizeof(_stats) );
+}
+
+CachedFileProvider::~CachedFileProvider()
+{
+    delete &_provider;
+}
+
+bool
+CachedFileProvider::open( const std::string& name, Mode mode )
+{
+    clear();
+    _pos = 0;
+    _providerPos = -1;
+
+    return _provider.open( name, mode );
+}
+
+bool
+CachedFileProvider::seek( Size pos )
+{
+    if( pos < 0 )
+        return true;
+
+    _pos = pos;
+    return false;
+}
+
+bool
+CachedFileProvider::read( void* buffer, Size size, Size& nin )
+{
+    uint8_t* out = (uint8_t*)buffer;
+
+    nin = 0;
+    while( nin < size ) {
+        const Size index  = _pos / _blockSize;
+        const Size offset = _pos % _blockSize;
+
+        const Block* block = lookup( index );
+        if( block ) {
+            _stats.hits++;
+        }
+        else {
+            // extend the fetch over every adjacent block this read
+            // still needs that isn't cached either
+            const Size last = (_pos + (size - nin) - 1) / _blockSize;
+            Size count = 1;
+            while( index + count <= last && count < _maxBlocks && !_blocks.count( index + count ))
+                count++;
+
+            if( fetch( index, count ))
+                return true;
+
+            block = lookup( index );
+            if( !block )
+                break;
+        }
+
+        if( offset >= (Size)block->data.size() )
+            break;
+
+        const Size n = min( (Size)block->data.size() - offset, size - nin );
+        memcpy( out + nin, &block->data[offset], (size_t)n );
+        nin += n;
+        _pos += n;
+    }
+
+    return false;
+}
+
+bool
+CachedFileProvider::write( const void* buffer, Size size, Size& nout )
+{
+    invalidate( _pos, size );
+
+    if( seekProvider( _pos ))
+        return true;
+
+    if( _provider.write( buffer, size, nout )) {
+        _providerPos = -1;
+        return true;
+    }
+
+    _pos += nout;
+    _providerPos = _pos;
+    return false;
+}
+
+bool
+CachedFileProvider::truncate( Size size )
+{
+    clear();
+    _providerPos = -1;
+
+    return _provider.truncate( size );
+}
+
+bool
+CachedFileProvider::close()
+{
+    clear();
+    return _provider.close();
+}
+
+bool
+CachedFileProvider::getSize( Size& nout )
+{
+    return _provider.getSize( nout );
+}
+
+const CachedFileProvider::Block*
+CachedFileProvider::lookup( Size index )
+{
+    BlockMap::iterator it = _blocks.find( index );
+    if( it == _blocks.end() )
+        return NULL;
+
+    _lru.splice( _lru.begin(), _lru, it->second );
+    return &*it->second;
+}
+
+/**
+ * Fetch @p count blocks starting at block @p first with one provider read.
+ *
+ * Blocks past the end of the file are not cached, so a lookup of them
+ * after the fetch fails.
+ */
+bool
+CachedFileProvider::fetch( Size first, Size count )
+{
+    if( seekProvider( first * _blockSize ))
+        return true;
+
+    vector<uint8_t> data( (size_t)(count * _blockSize) );
+
+    // providers are allowed to return short reads before the end of file
+    Size fill = 0;
+    while( fill < (Size)data.size() ) {
+        Size nin = 0;
+        _stats.reads++;
+        if( _provider.read( &data[fill], (Size)data.size() - fill, nin )) {
+            _providerPos = -1;
+            return true;
+        }
+        if( nin == 0 )
+            break;
+        fill += nin;
+    }
+
+    _stats.bytesRead += fill;
+    _providerPos = first * _blockSize + fill;
+
+    for( Size i = 0; i < count && i * _blockSize < fill; i++ ) {
+        const Size begin = i * _blockSize;
+        const Size end   = min( begin + _blockSize, fill );
+
+        _lru.push_front( Block() );
+        _lru.front().index = first + i;
+        _lru.front().data.assign( data.begin() + begin, data.begin() + end );
+
+        BlockMap::iterator it = _blocks.find( first + i );
+        if( it != _blocks.end() )
+            _lru.erase( it->second );
+        _blocks[first + i] = _lru.begin();
+        _stats.misses++;
+    }
+
+    while( (Size)_lru.size() > _maxBlocks ) {
+        _blocks.erase( _lru.back().index );
+        _lru.pop_back();
+        _stats.evictions++;
+    }
+
+    return false;
+}
+
+bool
+CachedFileProvider::seekProvider( Size pos )
+{
+    if( pos == _providerPos )
+        return false;
+
+    if( _provider.seek( pos )) {
+        _providerPos = -1;
+        return true;
+    }
+
+    _providerPos = pos;
+    return false;
+}
+
+void
+CachedFileProvider::invalidate( Size pos, Size size )
+{
+    if( _blocks.empty() )
+        return;
+
+    // the last block is short if it ends the file, and a write at or
+    // beyond it changes its length even without overlapping it
+    const Size first = pos / _blockSize;
+    const Size last  = (pos + max( size, (Size)1 ) - 1) / _blockSize;
+
+    BlockMap::iterator it = _blocks.lower_bound( first );
+    if( it != _blocks.begin() ) {
+        BlockMap::iterator prev = it;
+        --prev;
+        if( (Size)prev->second->data.size() < _blockSize )
+            it = prev;
+    }
+
+    while( it != _blocks.end() && it->first <= last ) {
+        _lru.erase( it->second );
+        _blocks.erase( it++ );
+    }
+}
+
+void
+CachedFileProvider::clear()
+{
+    _lru.clear();
+    _blocks.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 }}} // namespace mp4v2::platform::io
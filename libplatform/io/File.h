@@ -9,6 +9,9 @@ class MP4V2_EXPORT FileProvider
 {
 public:
     static FileProvider& standard();
+    static FileProvider& direct();
+    static FileProvider& mapped();
+    static FileProvider& positionless();
 
 public:
     //! file operation mode flags
@@ -33,6 +36,17 @@ public:
     virtual bool close() = 0;
     virtual bool getSize( Size& nout ) = 0;
 
+    //! zero-copy access to file contents; NULL unless the provider
+    //! keeps the range [pos, pos+size) resident in memory
+    virtual const uint8_t* mapping( Size pos, Size size ) { return NULL; }
+
+    //! read at an absolute offset; the default seeks then reads
+    virtual bool readAt( Size pos, void* buffer, Size size, Size& nin );
+
+    //! true if readAt() leaves the stream position alone and may be
+    //! called from several threads at once
+    virtual bool isPositionless() { return false; }
+
 protected:
     FileProvider() { }
 };
@@ -188,6 +202,52 @@ public:
 
     bool getSize( Size& nout );
 
+    ///////////////////////////////////////////////////////////////////////////
+    //!
+    //! Get a pointer to file contents without copying.
+    //!
+    //! Only providers that keep the file resident in memory support this,
+    //! e.g. FileProvider::mapped(). The pointer remains valid until the file
+    //! is closed and must not be written to.
+    //!
+    //! @param pos offset of the first byte in the file.
+    //! @param size number of bytes that must be accessible.
+    //!
+    //! @return pointer to the byte at @p pos, or NULL if not supported.
+    //!
+    ///////////////////////////////////////////////////////////////////////////
+
+    const uint8_t* mapping( Size pos, Size size );
+
+    ///////////////////////////////////////////////////////////////////////////
+    //!
+    //! Binary read at an absolute offset.
+    //!
+    //! With a positionless provider (see isPositionless()) the file
+    //! position is neither used nor changed and concurrent calls are safe.
+    //! Otherwise this is equivalent to seek() followed by read().
+    //!
+    //! @param pos offset in bytes to read from.
+    //! @param buffer storage for data read from file.
+    //! @param size maximum number of bytes to read from file.
+    //! @param nin output indicating number of bytes read from file.
+    //!
+    //! @return true on failure, false on success.
+    //!
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool readAt( Size pos, void* buffer, Size size, Size& nin );
+
+    ///////////////////////////////////////////////////////////////////////////
+    //!
+    //! Check whether the provider supports concurrent readAt().
+    //!
+    //! @return true if readAt() does not depend on the file position.
+    //!
+    ///////////////////////////////////////////////////////////////////////////
+
+    bool isPositionless();
+
 private:
     std::string   _name;
     bool          _isOpen;
@@ -249,6 +309,72 @@ private:
     void*          _handle;
 };
 
+///////////////////////////////////////////////////////////////////////////////
+///
+/// LRU block cache in front of another provider.
+///
+/// Meant for providers where every call is expensive (custom providers and
+/// I/O callbacks backed by network or object storage). Reads are served
+/// from fixed-size blocks; a read touching several uncached blocks fetches
+/// the whole run of adjacent misses with a single provider read. Seeks are
+/// deferred until the provider actually has to be called. Writes go
+/// straight through and drop the blocks they overlap.
+///
+/// The wrapped provider must be new-allocated and is deleted with the cache.
+///
+///////////////////////////////////////////////////////////////////////////////
+
+class CachedFileProvider : public FileProvider
+{
+public:
+    //! counters since the provider was constructed
+    struct Stats {
+        uint64_t hits;       //!< blocks served from the cache
+        uint64_t misses;     //!< blocks fetched from the provider
+        uint64_t reads;      //!< read calls made to the provider
+        uint64_t bytesRead;  //!< bytes returned by the provider
+        uint64_t evictions;  //!< blocks dropped to stay within capacity
+    };
+
+    CachedFileProvider( FileProvider& provider, uint32_t blockSize, uint64_t capacity );
+    ~CachedFileProvider();
+
+    bool open( const std::string& name, Mode mode );
+    bool seek( Size pos );
+    bool read( void* buffer, Size size, Size& nin );
+    bool write( const void* buffer, Size size, Size& nout );
+    bool truncate( Size size );
+    bool close();
+    bool getSize( Size& nout );
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Block {
+        Size            index;
+        vector<uint8_t> data;   // shorter than _blockSize only at end of file
+    };
+
+    typedef std::list<Block>                  BlockList;
+    typedef std::map<Size, BlockList::iterator> BlockMap;
+
+    const Block* lookup( Size index );
+    bool fetch( Size first, Size count );
+    bool seekProvider( Size pos );
+    void invalidate( Size pos, Size size );
+    void clear();
+
+private:
+    FileProvider& _provider;
+    const Size    _blockSize;
+    const Size    _maxBlocks;
+    Size          _pos;
+    Size          _providerPos;  // -1 if unknown
+    BlockList     _lru;          // most recently used first
+    BlockMap      _blocks;
+    Stats         _stats;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }}} // namespace mp4v2::platform::io
@@ -1,4 +1,6 @@
 #include "libplatform/impl.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace mp4v2 { namespace platform { namespace io {
 
@@ -7,7 +9,8 @@ namespace mp4v2 { namespace platform { namespace io {
 class StandardFileProvider : public FileProvider
 {
 public:
-    StandardFileProvider();
+    StandardFileProvider( bool direct = false );
+    ~StandardFileProvider();
 
     bool open( const std::string& name, Mode mode );
     bool seek( Size pos );
@@ -18,77 +21,186 @@ public:
     bool getSize( Size& nout );
 
 private:
-    bool         _seekg;
-    bool         _seekp;
-    std::fstream _fstream;
-    std::string  _name;
+    bool flush();
+    bool drain();
+    bool writeAt( int fd, Size pos, const uint8_t* buffer, Size size );
+    bool writeDirect( Size pos, const uint8_t* buffer, Size size );
+
+private:
+    // writes are coalesced in _wbuf, which holds _wlen bytes destined
+    // for file offset _wpos starting at index _woff; it is flushed before
+    // anything that needs to observe the file contents or moves away from
+    // its end
+    static const Size WRITE_BUFFER_SIZE = 1024 * 1024;
+
+    // with direct I/O, index 0 of _wbuf always corresponds to a file
+    // offset that is a multiple of DIRECT_ALIGN, so that whole blocks of
+    // the buffer can be handed to _dfd as they are
+    static const Size DIRECT_ALIGN = 4096;
+
+    bool     _direct;
+    int      _fd;
+    int      _dfd;
+    Size     _pos;
+    uint8_t* _wbuf;
+    Size     _wpos;
+    Size     _woff;
+    Size     _wlen;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-StandardFileProvider::StandardFileProvider()
-    : _seekg ( false )
-    , _seekp ( false )
+const FileProvider::Size StandardFileProvider::WRITE_BUFFER_SIZE;
+const FileProvider::Size StandardFileProvider::DIRECT_ALIGN;
+
+StandardFileProvider::StandardFileProvider( bool direct )
+    : _direct ( direct )
+    , _fd     ( -1 )
+    , _dfd    ( -1 )
+    , _pos    ( 0 )
+    , _wbuf   ( NULL )
+    , _wpos   ( 0 )
+    , _woff   ( 0 )
+    , _wlen   ( 0 )
+{
+}
+
+StandardFileProvider::~StandardFileProvider()
 {
+    free( _wbuf );
 }
 
 bool
 StandardFileProvider::open( const std::string& name, Mode mode )
 {
-    ios::openmode om = ios::binary;
+    int flags;
     switch( mode ) {
         case MODE_UNDEFINED:
         case MODE_READ:
         default:
-            om |= ios::in;
-            _seekg = true;
-            _seekp = false;
+            flags = O_RDONLY;
             break;
 
         case MODE_MODIFY:
-            om |= ios::in | ios::out;
-            _seekg = true;
-            _seekp = true;
+            flags = O_RDWR;
             break;
 
         case MODE_CREATE:
-            om |= ios::in | ios::out | ios::trunc;
-            _seekg = true;
-            _seekp = true;
+            flags = O_RDWR | O_CREAT | O_TRUNC;
             break;
     }
 
-    _fstream.open( name.c_str(), om );
-    _name = name;
-    return _fstream.fail();
+    _fd = ::open( name.c_str(), flags, 0666 );
+    _pos = 0;
+    _wlen = 0;
+    if( _fd == -1 )
+        return true;
+
+    // a second descriptor carries the aligned bulk of sequential writes
+    // past the page cache; filesystems that refuse it (tmpfs on older
+    // kernels) simply leave every write buffered
+    if( _direct && flags != O_RDONLY ) {
+#if defined( O_DIRECT )
+        _dfd = ::open( name.c_str(), O_WRONLY | O_DIRECT );
+#elif defined( F_NOCACHE )
+        _dfd = ::open( name.c_str(), O_WRONLY );
+        if( _dfd != -1 && fcntl( _dfd, F_NOCACHE, 1 ) == -1 ) {
+            ::close( _dfd );
+            _dfd = -1;
+        }
+#endif
+    }
+
+    return false;
 }
 
 bool
 StandardFileProvider::seek( Size pos )
 {
-    if( _seekg )
-        _fstream.seekg( pos, ios::beg );
-    if( _seekp )
-        _fstream.seekp( pos, ios::beg );
-    return _fstream.fail();
+    if( pos < 0 )
+        return true;
+
+    if( pos != _pos && flush() )
+        return true;
+
+    _pos = pos;
+    return false;
 }
 
 bool
 StandardFileProvider::read( void* buffer, Size size, Size& nin )
 {
-    _fstream.read( (char*)buffer, size );
-    if( _fstream.fail() )
+    if( flush() )
         return true;
-    nin = _fstream.gcount();
+
+    nin = 0;
+    while( nin < size ) {
+        ssize_t n = ::pread( _fd, (uint8_t*)buffer + nin, (size_t)(size - nin), (off_t)(_pos + nin) );
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return true;
+        }
+        if( n == 0 )
+            break;
+        nin += n;
+    }
+
+    _pos += nin;
     return false;
 }
 
 bool
 StandardFileProvider::write( const void* buffer, Size size, Size& nout )
 {
-    _fstream.write( (const char*)buffer, size );
-    if( _fstream.fail() )
+    // a write that does not continue the buffered run starts a new one
+    if( _wlen && _pos != _wpos + _wlen && flush() )
+        return true;
+
+    if( !_wbuf && posix_memalign( (void**)&_wbuf, DIRECT_ALIGN, WRITE_BUFFER_SIZE ) != 0 ) {
+        _wbuf = NULL;
         return true;
+    }
+
+    if( !_wlen ) {
+        _wpos = _pos;
+        _woff = _dfd == -1 ? 0 : _pos % DIRECT_ALIGN;
+    }
+
+    if( _dfd == -1 ) {
+        if( _woff + _wlen + size > WRITE_BUFFER_SIZE && flush() )
+            return true;
+
+        if( size >= WRITE_BUFFER_SIZE ) {
+            if( writeAt( _fd, _pos, (const uint8_t*)buffer, size ))
+                return true;
+        }
+        else {
+            if( !_wlen ) {
+                _wpos = _pos;
+                _woff = 0;
+            }
+            memcpy( _wbuf + _woff + _wlen, buffer, (size_t)size );
+            _wlen += size;
+        }
+    }
+    else {
+        // everything goes through the aligned buffer, which drains its
+        // whole blocks whenever it fills up
+        const uint8_t* p = (const uint8_t*)buffer;
+        for( Size left = size; left > 0; ) {
+            Size n = std::min( left, WRITE_BUFFER_SIZE - _woff - _wlen );
+            memcpy( _wbuf + _woff + _wlen, p, (size_t)n );
+            _wlen += n;
+            p += n;
+            left -= n;
+
+            if( _woff + _wlen == WRITE_BUFFER_SIZE && drain() )
+                return true;
+        }
+    }
+
+    _pos += size;
     nout = size;
     return false;
 }
@@ -96,38 +208,397 @@ StandardFileProvider::write( const void* buffer, Size size, Size& nout )
 bool
 StandardFileProvider::truncate( Size size )
 {
-    // close the file prior to truncating it
-    _fstream.close();
-
-    // truncate the file using the POSIX truncate function
-    if( ::truncate( _name.c_str(), size ) != 0)
+    if( flush() )
         return true;
 
-    // reopen the file and seek to the new end
-    _fstream.clear();
-    _fstream.open( _name.c_str(), ios::binary | ios::in | ios::out);
-    if ( _fstream.fail() )
+    if( ::ftruncate( _fd, (off_t)size ) != 0 )
         return true;
 
-    return seek( size );
+    _pos = size;
+    return false;
 }
 
 bool
 StandardFileProvider::close()
 {
-    _fstream.close();
-    return _fstream.fail();
+    if( _fd == -1 )
+        return false;
+
+    bool failed = flush();
+    if( _dfd != -1 ) {
+        failed = ::close( _dfd ) != 0 || failed;
+        _dfd = -1;
+    }
+    failed = ::close( _fd ) != 0 || failed;
+    _fd = -1;
+    return failed;
 }
 
 bool
 StandardFileProvider::getSize( Size& nout )
 {
-    bool retval;
+    if( flush() )
+        return true;
+
+    struct stat st;
+    if( fstat( _fd, &st ) != 0 )
+        return true;
+
+    nout = st.st_size;
+    return false;
+}
+
+bool
+StandardFileProvider::flush()
+{
+    if( !_wlen )
+        return false;
+
+    bool failed = _dfd != -1 && drain();
+
+    // whatever is left does not fill a block and is written buffered
+    if( !failed && _wlen )
+        failed = writeAt( _fd, _wpos, _wbuf + _woff, _wlen );
+
+    _wlen = 0;
+    return failed;
+}
+
+/**
+ * Write the whole blocks of the buffered run through the direct
+ * descriptor and keep the trailing partial block buffered.
+ *
+ * A partial leading block (a run that started at an unaligned offset,
+ * e.g. the first chunk after the mdat header) is written buffered.
+ */
+bool
+StandardFileProvider::drain()
+{
+    const Size base = _wpos - _woff;
+    const Size end  = _woff + _wlen;
+    const Size head = _woff ? std::min( DIRECT_ALIGN, end ) : 0;
+    const Size body = end - end % DIRECT_ALIGN;
+
+    if( head && writeAt( _fd, _wpos, _wbuf + _woff, head - _woff )) {
+        _wlen = 0;
+        return true;
+    }
+
+    if( body > head && writeDirect( base + head, _wbuf + head, body - head )) {
+        _wlen = 0;
+        return true;
+    }
+
+    const Size done = std::max( head, body );
+    _wlen = end - done;
+    if( _wlen )
+        memmove( _wbuf, _wbuf + done, (size_t)_wlen );
+
+    _wpos = base + done;
+    _woff = 0;
+    return false;
+}
+
+bool
+StandardFileProvider::writeAt( int fd, Size pos, const uint8_t* buffer, Size size )
+{
+    Size nout = 0;
+    while( nout < size ) {
+        ssize_t n = ::pwrite( fd, buffer + nout, (size_t)(size - nout), (off_t)(pos + nout) );
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return true;
+        }
+        nout += n;
+    }
+
+    return false;
+}
+
+bool
+StandardFileProvider::writeDirect( Size pos, const uint8_t* buffer, Size size )
+{
+    if( !writeAt( _dfd, pos, buffer, size ))
+        return false;
 
-    // getFileSize will log if it fails
-    retval = FileSystem::getFileSize( _name, nout );
+    if( errno != EINVAL )
+        return true;
 
-    return retval;
+    // the filesystem accepted O_DIRECT at open but not our alignment;
+    // stay buffered from here on
+    ::close( _dfd );
+    _dfd = -1;
+    return writeAt( _fd, pos, buffer, size );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+class MappedFileProvider : public FileProvider
+{
+public:
+    MappedFileProvider();
+
+    bool open( const std::string& name, Mode mode );
+    bool seek( Size pos );
+    bool read( void* buffer, Size size, Size& nin );
+    bool write( const void* buffer, Size size, Size& nout );
+    bool truncate( Size size );
+    bool close();
+    bool getSize( Size& nout );
+
+    const uint8_t* mapping( Size pos, Size size );
+    bool readAt( Size pos, void* buffer, Size size, Size& nin );
+    bool isPositionless() { return true; }
+
+private:
+    int      _fd;
+    uint8_t* _map;
+    Size     _size;
+    Size     _pos;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+MappedFileProvider::MappedFileProvider()
+    : _fd   ( -1 )
+    , _map  ( NULL )
+    , _size ( 0 )
+    , _pos  ( 0 )
+{
+}
+
+bool
+MappedFileProvider::open( const std::string& name, Mode mode )
+{
+    // mappings are strictly read-only
+    if( mode != MODE_READ && mode != MODE_UNDEFINED )
+        return true;
+
+    _fd = ::open( name.c_str(), O_RDONLY );
+    if( _fd == -1 )
+        return true;
+
+    struct stat st;
+    if( fstat( _fd, &st ) != 0 ) {
+        close();
+        return true;
+    }
+
+    _size = st.st_size;
+    _pos  = 0;
+
+    // an empty file cannot be mapped but is still a valid (if useless) file
+    if( _size == 0 )
+        return false;
+
+    void* map = mmap( NULL, (size_t)_size, PROT_READ, MAP_SHARED, _fd, 0 );
+    if( map == MAP_FAILED ) {
+        close();
+        return true;
+    }
+
+    _map = (uint8_t*)map;
+
+    // sample data is mostly consumed front to back
+    posix_madvise( _map, (size_t)_size, POSIX_MADV_SEQUENTIAL );
+    return false;
+}
+
+bool
+MappedFileProvider::seek( Size pos )
+{
+    if( pos < 0 )
+        return true;
+
+    _pos = pos;
+    return false;
+}
+
+bool
+MappedFileProvider::read( void* buffer, Size size, Size& nin )
+{
+    if( readAt( _pos, buffer, size, nin ))
+        return true;
+
+    _pos += nin;
+    return false;
+}
+
+bool
+MappedFileProvider::readAt( Size pos, void* buffer, Size size, Size& nin )
+{
+    nin = 0;
+    if( pos < 0 )
+        return true;
+    if( pos >= _size )
+        return false;
+
+    nin = min( size, _size - pos );
+    memcpy( buffer, _map + pos, (size_t)nin );
+    return false;
+}
+
+bool
+MappedFileProvider::write( const void* buffer, Size size, Size& nout )
+{
+    return true;
+}
+
+bool
+MappedFileProvider::truncate( Size size )
+{
+    return true;
+}
+
+bool
+MappedFileProvider::close()
+{
+    bool failed = false;
+
+    if( _map ) {
+        failed = munmap( _map, (size_t)_size ) != 0;
+        _map = NULL;
+    }
+
+    if( _fd != -1 ) {
+        failed = ::close( _fd ) != 0 || failed;
+        _fd = -1;
+    }
+
+    return failed;
+}
+
+bool
+MappedFileProvider::getSize( Size& nout )
+{
+    nout = _size;
+    return false;
+}
+
+const uint8_t*
+MappedFileProvider::mapping( Size pos, Size size )
+{
+    if( !_map || pos < 0 || size < 0 || pos + size > _size )
+        return NULL;
+
+    return _map + pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+class PreadFileProvider : public FileProvider
+{
+public:
+    PreadFileProvider();
+
+    bool open( const std::string& name, Mode mode );
+    bool seek( Size pos );
+    bool read( void* buffer, Size size, Size& nin );
+    bool write( const void* buffer, Size size, Size& nout );
+    bool truncate( Size size );
+    bool close();
+    bool getSize( Size& nout );
+
+    bool readAt( Size pos, void* buffer, Size size, Size& nin );
+    bool isPositionless() { return true; }
+
+private:
+    int  _fd;
+    Size _pos;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+PreadFileProvider::PreadFileProvider()
+    : _fd  ( -1 )
+    , _pos ( 0 )
+{
+}
+
+bool
+PreadFileProvider::open( const std::string& name, Mode mode )
+{
+    // shared offsets only make sense while nobody writes
+    if( mode != MODE_READ && mode != MODE_UNDEFINED )
+        return true;
+
+    _fd = ::open( name.c_str(), O_RDONLY );
+    _pos = 0;
+    return _fd == -1;
+}
+
+bool
+PreadFileProvider::seek( Size pos )
+{
+    if( pos < 0 )
+        return true;
+
+    _pos = pos;
+    return false;
+}
+
+bool
+PreadFileProvider::read( void* buffer, Size size, Size& nin )
+{
+    if( readAt( _pos, buffer, size, nin ))
+        return true;
+
+    _pos += nin;
+    return false;
+}
+
+bool
+PreadFileProvider::readAt( Size pos, void* buffer, Size size, Size& nin )
+{
+    nin = 0;
+    while( nin < size ) {
+        ssize_t n = ::pread( _fd, (uint8_t*)buffer + nin, (size_t)(size - nin), (off_t)(pos + nin) );
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return true;
+        }
+        if( n == 0 )
+            break;
+        nin += n;
+    }
+
+    return false;
+}
+
+bool
+PreadFileProvider::write( const void* buffer, Size size, Size& nout )
+{
+    return true;
+}
+
+bool
+PreadFileProvider::truncate( Size size )
+{
+    return true;
+}
+
+bool
+PreadFileProvider::close()
+{
+    if( _fd == -1 )
+        return false;
+
+    bool failed = ::close( _fd ) != 0;
+    _fd = -1;
+    return failed;
+}
+
+bool
+PreadFileProvider::getSize( Size& nout )
+{
+    struct stat st;
+    if( fstat( _fd, &st ) != 0 )
+        return true;
+
+    nout = st.st_size;
+    return false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -138,6 +609,24 @@ FileProvider::standard()
     return *new StandardFileProvider();
 }
 
+FileProvider&
+FileProvider::direct()
+{
+    return *new StandardFileProvider( true );
+}
+
+FileProvider&
+FileProvider::mapped()
+{
+    return *new MappedFileProvider();
+}
+
+FileProvider&
+FileProvider::positionless()
+{
+    return *new PreadFileProvider();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }}} // namespace mp4v2::platform::io
@@ -264,6 +264,27 @@ FileProvider::standard()
     return *new StandardFileProvider();
 }
 
+FileProvider&
+FileProvider::direct()
+{
+    // no unbuffered write path on this platform yet
+    return *new StandardFileProvider();
+}
+
+FileProvider&
+FileProvider::mapped()
+{
+    // no mapping support on this platform yet; reads go through stdio
+    return *new StandardFileProvider();
+}
+
+FileProvider&
+FileProvider::positionless()
+{
+    // no pread equivalent wired up yet; readAt() falls back to seek+read
+    return *new StandardFileProvider();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }}} // namespace mp4v2::platform::io
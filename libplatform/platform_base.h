@@ -3,6 +3,9 @@
 
 ///////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -10,6 +13,7 @@
 #include <list>
 #include <locale>
 #include <map>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
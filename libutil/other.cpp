@@ -103,4 +103,83 @@ fileFetchSummaryInfo( MP4FileHandle file, FileSummaryInfo& info )
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void
+ioStatsAccumulate( MP4IOStats& stats, MP4IOOp op, int64_t size, uint64_t duration )
+{
+    const uint32_t bucket = MP4IOLatencyBucket( duration );
+
+    switch( op ) {
+        case MP4_IO_OP_READ:
+            stats.providerReads++;
+            stats.providerReadBytes += size;
+            stats.readTime += duration;
+            stats.readLatency[bucket]++;
+            break;
+
+        case MP4_IO_OP_WRITE:
+            stats.providerWrites++;
+            stats.providerWriteBytes += size;
+            stats.writeTime += duration;
+            stats.writeLatency[bucket]++;
+            break;
+
+        case MP4_IO_OP_SEEK:
+        default:
+            stats.providerSeeks++;
+            stats.seekTime += duration;
+            stats.seekLatency[bucket]++;
+            break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void
+ioStatsHistogram( ostringstream& report, const char* name, const uint64_t* latency )
+{
+    bool any = false;
+    for( uint32_t i = 0; i < MP4_IO_LATENCY_BUCKETS; i++ ) {
+        if( !latency[i] )
+            continue;
+
+        if( !any )
+            report << "  " << setw(14) << left << name;
+        any = true;
+
+        // bucket i holds operations under 2^i us, the last one the rest
+        if( i == MP4_IO_LATENCY_BUCKETS - 1 )
+            report << " >=" << (UINT64_C(1) << (i - 1)) << "us:" << latency[i];
+        else
+            report << " <" << (UINT64_C(1) << i) << "us:" << latency[i];
+    }
+
+    if( any )
+        report << '\n';
+}
+
+string
+ioStatsReport( const MP4IOStats& stats )
+{
+    ostringstream report;
+
+    report << "I/O statistics\n"
+           << "  requests      reads " << stats.readCalls << " (" << stats.readBytes << " bytes)"
+           << ", writes " << stats.writeCalls << " (" << stats.writeBytes << " bytes)"
+           << ", seeks " << stats.seekCalls << '\n'
+           << "  provider      reads " << stats.providerReads << " (" << stats.providerReadBytes << " bytes"
+           << ", " << fixed << setprecision(3) << stats.readTime / 1e6 << " ms)"
+           << ", writes " << stats.providerWrites << " (" << stats.providerWriteBytes << " bytes"
+           << ", " << stats.writeTime / 1e6 << " ms)"
+           << ", seeks " << stats.providerSeeks << " (" << stats.seekTime / 1e6 << " ms)\n"
+           << "  peak buffers  " << stats.peakBufferBytes << " bytes\n";
+
+    ioStatsHistogram( report, "read latency", stats.readLatency );
+    ioStatsHistogram( report, "write latency", stats.writeLatency );
+    ioStatsHistogram( report, "seek latency", stats.seekLatency );
+
+    return report.str();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 }} // namespace mp4v2::util
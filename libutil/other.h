@@ -33,6 +33,26 @@ struct MP4V2_EXPORT FileSummaryInfo {
 MP4V2_EXPORT
 bool fileFetchSummaryInfo( MP4FileHandle file, FileSummaryInfo& info );
 
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Accumulate a provider operation into I/O statistics.
+///
+/// This function adds an operation as reported to an MP4IOTraceCallback to
+/// the provider counters and latency histograms of <b>stats</b>, for jobs
+/// such as MP4Optimize() that do not expose a file handle.
+///
+MP4V2_EXPORT
+void ioStatsAccumulate( MP4IOStats& stats, MP4IOOp op, int64_t size, uint64_t duration );
+
+///////////////////////////////////////////////////////////////////////////////
+///
+/// Format I/O statistics.
+///
+/// @return a multi-line human-readable report of <b>stats</b>.
+///
+MP4V2_EXPORT
+string ioStatsReport( const MP4IOStats& stats );
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }} // namespace mp4v2::util
@@ -149,6 +149,21 @@ void MP4RootAtom::FinishOptimalWrite()
     ASSERT(oldSize == newSize);
 }
 
+void MP4RootAtom::ReadPendingChildAtoms(uint64_t start, uint64_t end)
+{
+    const uint64_t fileEnd = m_end;
+    m_end = end;
+    m_File.SetPosition(start);
+    try {
+        ReadChildAtoms();
+    }
+    catch (...) {
+        m_end = fileEnd;
+        throw;
+    }
+    m_end = fileEnd;
+}
+
 uint32_t MP4RootAtom::GetLastMdatIndex()
 {
     for (int32_t i = m_pChildAtoms.Size() - 1; i >= 0; i--) {
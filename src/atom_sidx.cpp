@@ -0,0 +1,97 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4SidxAtom::MP4SidxAtom(MP4File &file)
+        : MP4Atom(file, "sidx")
+{
+    AddVersionAndFlags();   /* 0, 1 */
+    AddProperty( /* 2 */
+        new MP4Integer32Property(*this, "referenceId"));
+    AddProperty( /* 3 */
+        new MP4Integer32Property(*this, "timescale"));
+}
+
+void MP4SidxAtom::AddProperties(uint8_t version)
+{
+    if (version == 1) {
+        AddProperty( /* 4 */
+            new MP4Integer64Property(*this, "earliestPresentationTime"));
+        AddProperty( /* 5 */
+            new MP4Integer64Property(*this, "firstOffset"));
+    } else {
+        AddProperty( /* 4 */
+            new MP4Integer32Property(*this, "earliestPresentationTime"));
+        AddProperty( /* 5 */
+            new MP4Integer32Property(*this, "firstOffset"));
+    }
+    AddReserved(*this, "reserved", 2); /* 6 */
+
+    MP4Integer16Property* pCount =
+        new MP4Integer16Property(*this, "referenceCount");
+    AddProperty(pCount); /* 7 */
+
+    MP4TableProperty* pTable =
+        new MP4TableProperty(*this, "references", pCount);
+    AddProperty(pTable); /* 8 */
+
+    pTable->AddProperty(
+        new MP4BitfieldProperty(*this, "referenceType", 1));
+    pTable->AddProperty(
+        new MP4BitfieldProperty(*this, "referencedSize", 31));
+    pTable->AddProperty(
+        new MP4Integer32Property(*this, "subsegmentDuration"));
+    pTable->AddProperty(
+        new MP4BitfieldProperty(*this, "startsWithSap", 1));
+    pTable->AddProperty(
+        new MP4BitfieldProperty(*this, "sapType", 3));
+    pTable->AddProperty(
+        new MP4BitfieldProperty(*this, "sapDeltaTime", 28));
+}
+
+void MP4SidxAtom::Generate()
+{
+    // an index of a long recording soon outgrows 32 bits of time
+    SetVersion(1);
+    AddProperties(1);
+
+    MP4Atom::Generate();
+}
+
+void MP4SidxAtom::Read()
+{
+    /* read atom version, flags, referenceId and timescale */
+    bool success = ReadProperties(0, 4);
+
+    if (success) {
+        /* need to create the properties based on the atom version */
+        AddProperties(GetVersion());
+
+        /* now we can read the remaining properties */
+        ReadProperties(4);
+    }
+
+    Skip(); // to end of atom
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
@@ -259,6 +259,15 @@ MP4StandardAtom::MP4StandardAtom (MP4File &file, const char *type) : MP4Atom(fil
         AddProperty( /* 2 */
             new MP4Integer32Property(*this, "sequenceNumber"));
 
+    } else if (ATOMID(type) == ATOMID("mfra")) {
+        ExpectChildAtom("tfra", Optional, Many);
+        ExpectChildAtom("mfro", Required, OnlyOne);
+
+    } else if (ATOMID(type) == ATOMID("mfro")) {
+        AddVersionAndFlags();   /* 0, 1 */
+        AddProperty( /* 2 */
+            new MP4Integer32Property(*this, "size"));
+
     } else if (ATOMID(type) == ATOMID("minf")) {
         ExpectChildAtom("vmhd", Optional, OnlyOne);
         ExpectChildAtom("smhd", Optional, OnlyOne);
@@ -399,6 +408,7 @@ MP4StandardAtom::MP4StandardAtom (MP4File &file, const char *type) : MP4Atom(fil
 
     } else if (ATOMID(type) == ATOMID("traf")) {
         ExpectChildAtom("tfhd", Required, OnlyOne);
+        ExpectChildAtom("tfdt", Optional, OnlyOne);
         ExpectChildAtom("trun", Optional, Many);
 
     } else if (ATOMID(type) == ATOMID("trak")) {
@@ -49,6 +49,12 @@ void MP4StblAtom::Generate()
     // as usual
     MP4Atom::Generate();
 
+    // stsz is optional only because stz2 may replace it, but
+    // the write path always records sample sizes in stsz
+    MP4Atom* pStszAtom = CreateAtom(m_File, this, "stsz");
+    AddChildAtom(pStszAtom);
+    pStszAtom->Generate();
+
     // but we also need one of the chunk offset atoms
     MP4Atom* pChunkOffsetAtom;
     if (m_File.Use64Bits(GetType())) {
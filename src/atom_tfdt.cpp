@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4TfdtAtom::MP4TfdtAtom(MP4File &file)
+        : MP4Atom(file, "tfdt")
+{
+    AddVersionAndFlags();   /* 0, 1 */
+}
+
+void MP4TfdtAtom::AddProperties(uint8_t version)
+{
+    if (version == 1) {
+        AddProperty( /* 2 */
+            new MP4Integer64Property(*this, "baseMediaDecodeTime"));
+    } else {
+        AddProperty( /* 2 */
+            new MP4Integer32Property(*this, "baseMediaDecodeTime"));
+    }
+}
+
+void MP4TfdtAtom::Generate()
+{
+    // fragments of long tracks soon outgrow 32 bits of decode time
+    SetVersion(1);
+    AddProperties(1);
+
+    MP4Atom::Generate();
+}
+
+void MP4TfdtAtom::Read()
+{
+    /* read atom version and flags */
+    bool success = ReadProperties(0, 2);
+
+    if (success) {
+        /* need to create the properties based on the atom version */
+        AddProperties(GetVersion());
+
+        /* now we can read the remaining properties */
+        ReadProperties(2);
+    }
+
+    Skip(); // to end of atom
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
@@ -0,0 +1,111 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    // the traf, trun and sample numbers take (lengthSize + 1) bytes each
+    MP4Property*
+    NumberProperty( MP4Atom& atom, const char* name, uint64_t lengthSize )
+    {
+        switch( lengthSize ) {
+            case 0:  return new MP4Integer8Property( atom, name );
+            case 1:  return new MP4Integer16Property( atom, name );
+            case 2:  return new MP4Integer24Property( atom, name );
+            default: return new MP4Integer32Property( atom, name );
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4TfraAtom::MP4TfraAtom(MP4File &file)
+        : MP4Atom(file, "tfra")
+{
+    AddVersionAndFlags();   /* 0, 1 */
+    AddProperty( /* 2 */
+        new MP4Integer32Property(*this, "trackId"));
+    AddProperty( /* 3 */
+        new MP4BitfieldProperty(*this, "reserved", 26));
+    AddProperty( /* 4 */
+        new MP4BitfieldProperty(*this, "lengthSizeOfTrafNum", 2));
+    AddProperty( /* 5 */
+        new MP4BitfieldProperty(*this, "lengthSizeOfTrunNum", 2));
+    AddProperty( /* 6 */
+        new MP4BitfieldProperty(*this, "lengthSizeOfSampleNum", 2));
+    AddProperty( /* 7 */
+        new MP4Integer32Property(*this, "numberOfEntry"));
+}
+
+void MP4TfraAtom::AddProperties(uint8_t version)
+{
+    MP4TableProperty* pTable =
+        new MP4TableProperty(*this, "entries",
+                             (MP4Integer32Property *)m_pProperties[7]);
+    AddProperty(pTable); /* 8 */
+
+    if (version == 1) {
+        pTable->AddProperty(
+            new MP4Integer64Property(*this, "time"));
+        pTable->AddProperty(
+            new MP4Integer64Property(*this, "moofOffset"));
+    } else {
+        pTable->AddProperty(
+            new MP4Integer32Property(*this, "time"));
+        pTable->AddProperty(
+            new MP4Integer32Property(*this, "moofOffset"));
+    }
+
+    pTable->AddProperty(NumberProperty(*this, "trafNumber",
+        ((MP4BitfieldProperty*)m_pProperties[4])->GetValue()));
+    pTable->AddProperty(NumberProperty(*this, "trunNumber",
+        ((MP4BitfieldProperty*)m_pProperties[5])->GetValue()));
+    pTable->AddProperty(NumberProperty(*this, "sampleNumber",
+        ((MP4BitfieldProperty*)m_pProperties[6])->GetValue()));
+}
+
+void MP4TfraAtom::Generate()
+{
+    // 64-bit times and offsets, one byte for each of the numbers
+    SetVersion(1);
+    AddProperties(1);
+
+    MP4Atom::Generate();
+}
+
+void MP4TfraAtom::Read()
+{
+    /* read atom version, flags, trackId, number sizes and count */
+    bool success = ReadProperties(0, 8);
+
+    if (success) {
+        /* need to create the properties based on the version and sizes */
+        AddProperties(GetVersion());
+
+        /* now we can read the remaining properties */
+        ReadProperties(8);
+    }
+
+    Skip(); // to end of atom
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
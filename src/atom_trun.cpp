@@ -69,6 +69,14 @@ void MP4TrunAtom::AddProperties(uint32_t flags)
     }
 }
 
+void MP4TrunAtom::Generate()
+{
+    MP4Atom::Generate();
+
+    /* the flags set beforehand choose the optional properties */
+    AddProperties(GetFlags());
+}
+
 void MP4TrunAtom::Read()
 {
     /* read atom version, flags, and sampleCount */
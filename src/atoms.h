@@ -69,6 +69,9 @@ public:
     void BeginOptimalWrite();
     void FinishOptimalWrite();
 
+    // the child atoms in [start, end) left unread on open
+    void ReadPendingChildAtoms(uint64_t start, uint64_t end);
+
 protected:
     uint32_t GetLastMdatIndex();
     void WriteAtomType(const char* type, bool onlyOne);
@@ -495,6 +498,19 @@ private:
     MP4SdtpAtom &operator= ( const MP4SdtpAtom &src );
 };
 
+class MP4SidxAtom : public MP4Atom {
+public:
+    MP4SidxAtom(MP4File &file);
+    void Generate();
+    void Read();
+protected:
+    void AddProperties(uint8_t version);
+private:
+    MP4SidxAtom();
+    MP4SidxAtom( const MP4SidxAtom &src );
+    MP4SidxAtom &operator= ( const MP4SidxAtom &src );
+};
+
 class MP4SmiAtom : public MP4Atom {
 public:
     MP4SmiAtom(MP4File &file);
@@ -602,9 +618,23 @@ private:
     MP4FtabAtom &operator= ( const MP4FtabAtom &src );
 };
 
+class MP4TfdtAtom : public MP4Atom {
+public:
+    MP4TfdtAtom(MP4File &file);
+    void Generate();
+    void Read();
+protected:
+    void AddProperties(uint8_t version);
+private:
+    MP4TfdtAtom();
+    MP4TfdtAtom( const MP4TfdtAtom &src );
+    MP4TfdtAtom &operator= ( const MP4TfdtAtom &src );
+};
+
 class MP4TfhdAtom : public MP4Atom {
 public:
     MP4TfhdAtom(MP4File &file);
+    void Generate();
     void Read();
 protected:
     void AddProperties(uint32_t flags);
@@ -614,6 +644,19 @@ private:
     MP4TfhdAtom &operator= ( const MP4TfhdAtom &src );
 };
 
+class MP4TfraAtom : public MP4Atom {
+public:
+    MP4TfraAtom(MP4File &file);
+    void Generate();
+    void Read();
+protected:
+    void AddProperties(uint8_t version);
+private:
+    MP4TfraAtom();
+    MP4TfraAtom( const MP4TfraAtom &src );
+    MP4TfraAtom &operator= ( const MP4TfraAtom &src );
+};
+
 class MP4TkhdAtom : public MP4Atom {
 public:
     MP4TkhdAtom(MP4File &file);
@@ -630,6 +673,7 @@ private:
 class MP4TrunAtom : public MP4Atom {
 public:
     MP4TrunAtom(MP4File &file);
+    void Generate();
     void Read();
 protected:
     void AddProperties(uint32_t flags);
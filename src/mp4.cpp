@@ -60,6 +60,33 @@ static MP4File  *ConstructMP4File ( void )
     return pFile;
 }
 
+// what MP4Read(), MP4ReadEx() and MP4ReadProvider() come down to
+static MP4FileHandle ReadMP4File( const char* fileName, const MP4FileProvider* fileProvider, uint32_t flags )
+{
+    if (!fileName)
+        return MP4_INVALID_FILE_HANDLE;
+
+    MP4File *pFile = ConstructMP4File();
+    if (!pFile)
+        return MP4_INVALID_FILE_HANDLE;
+
+    try {
+        pFile->Read( fileName, fileProvider, NULL, NULL, flags );
+        return (MP4FileHandle)pFile;
+    }
+    catch( Exception* x ) {
+        mp4v2::impl::log.errorf(*x);
+        delete x;
+    }
+    catch( ... ) {
+        mp4v2::impl::log.errorf("%s: \"%s\": failed", __FUNCTION__,
+                                fileName );
+    }
+
+    delete pFile;
+    return MP4_INVALID_FILE_HANDLE;
+}
+
 extern "C" {
 
 const char* MP4GetFilename( MP4FileHandle hFile )
@@ -92,17 +119,30 @@ MP4FileHandle MP4Read( const char* fileName )
     return MP4ReadProvider( fileName, NULL );
 }
 
+MP4FileHandle MP4ReadEx( const char* fileName, uint32_t flags )
+{
+    return ReadMP4File( fileName, NULL, flags );
+}
+
 MP4FileHandle MP4ReadProvider( const char* fileName, const MP4FileProvider* fileProvider )
 {
-    if (!fileName)
+    return ReadMP4File( fileName, fileProvider, 0 );
+}
+
+MP4FileHandle MP4ReadCallbacks( const MP4IOCallbacks* callbacks, void* handle )
+{
+    if (!callbacks)
         return MP4_INVALID_FILE_HANDLE;
 
     MP4File *pFile = ConstructMP4File();
     if (!pFile)
         return MP4_INVALID_FILE_HANDLE;
 
+    pFile->Logger().setLogCallback(callbacks->log_callback, handle);
+    pFile->Logger().setVerbosity(callbacks->log_level);
+
     try {
-        pFile->Read( fileName, fileProvider, NULL, NULL );
+        pFile->Read( NULL, NULL, callbacks, handle );
         return (MP4FileHandle)pFile;
     }
     catch( Exception* x ) {
@@ -110,29 +150,52 @@ MP4FileHandle MP4ReadProvider( const char* fileName, const MP4FileProvider* file
         delete x;
     }
     catch( ... ) {
-        mp4v2::impl::log.errorf("%s: \"%s\": failed", __FUNCTION__,
-                                fileName );
+        mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
     }
 
     delete pFile;
     return MP4_INVALID_FILE_HANDLE;
 }
 
-MP4FileHandle MP4ReadCallbacks( const MP4IOCallbacks* callbacks, void* handle )
+///////////////////////////////////////////////////////////////////////////////
+
+void MP4SetReadBufferSize( uint32_t size, MP4FileHandle hFile )
 {
-    if (!callbacks)
-        return MP4_INVALID_FILE_HANDLE;
+    try {
+        if( MP4_IS_VALID_FILE_HANDLE( hFile ))
+            ((MP4File*)hFile)->SetReadBufferSize( size );
+        else
+            MP4File::SetDefaultReadBufferSize( size );
+    }
+    catch( Exception* x ) {
+        mp4v2::impl::log.errorf(*x);
+        delete x;
+    }
+    catch( ... ) {
+        mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
+    }
+}
 
-    MP4File *pFile = ConstructMP4File();
-    if (!pFile)
-        return MP4_INVALID_FILE_HANDLE;
+uint32_t MP4GetReadBufferSize( MP4FileHandle hFile )
+{
+    if( MP4_IS_VALID_FILE_HANDLE( hFile ))
+        return ((MP4File*)hFile)->GetReadBufferSize();
+    return MP4File::GetDefaultReadBufferSize();
+}
 
-    pFile->Logger().setLogCallback(callbacks->log_callback, handle);
-    pFile->Logger().setVerbosity(callbacks->log_level);
+void MP4SetBlockCache( uint32_t blockSize, uint64_t capacity )
+{
+    MP4File::SetDefaultBlockCache( blockSize, capacity );
+}
+
+bool MP4GetIOStats( MP4FileHandle hFile, MP4IOStats* stats )
+{
+    if( !MP4_IS_VALID_FILE_HANDLE( hFile ) || !stats )
+        return false;
 
     try {
-        pFile->Read( NULL, NULL, callbacks, handle );
-        return (MP4FileHandle)pFile;
+        ((MP4File*)hFile)->GetIOStats( *stats );
+        return true;
     }
     catch( Exception* x ) {
         mp4v2::impl::log.errorf(*x);
@@ -142,8 +205,34 @@ MP4FileHandle MP4ReadCallbacks( const MP4IOCallbacks* callbacks, void* handle )
         mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
     }
 
-    delete pFile;
-    return MP4_INVALID_FILE_HANDLE;
+    return false;
+}
+
+void MP4SetIOTraceCallback( MP4IOTraceCallback callback, void* userData, MP4FileHandle hFile )
+{
+    if( MP4_IS_VALID_FILE_HANDLE( hFile ))
+        ((MP4File*)hFile)->SetIOTraceCallback( callback, userData );
+    else
+        MP4File::SetDefaultIOTraceCallback( callback, userData );
+}
+
+bool MP4GetBlockCacheStats( MP4FileHandle hFile, MP4BlockCacheStats* stats )
+{
+    if( !MP4_IS_VALID_FILE_HANDLE( hFile ) || !stats )
+        return false;
+
+    try {
+        return ((MP4File*)hFile)->GetBlockCacheStats( stats );
+    }
+    catch( Exception* x ) {
+        mp4v2::impl::log.errorf(*x);
+        delete x;
+    }
+    catch( ... ) {
+        mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
+    }
+
+    return false;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -329,6 +418,35 @@ MP4FileHandle MP4ModifyCallbacks(const MP4IOCallbacks* callbacks,
         return false;
     }
 
+    bool MP4Segment(const char* fileName,
+                    const char* initFileName,
+                    const char* segmentFileNameFormat,
+                    MP4Duration duration,
+                    uint32_t    numWorkers,
+                    uint32_t*   pNumSegments)
+    {
+        if (fileName == NULL || initFileName == NULL || segmentFileNameFormat == NULL)
+            return false;
+
+        try {
+            MP4Segmenter segmenter(fileName, duration);
+            segmenter.Write(initFileName, segmentFileNameFormat, numWorkers);
+            if (pNumSegments)
+                *pNumSegments = segmenter.GetNumberOfSegments();
+            return true;
+        }
+        catch( Exception* x ) {
+            mp4v2::impl::log.errorf(*x);
+            delete x;
+        }
+        catch( ... ) {
+            mp4v2::impl::log.errorf("%s(%s,%s,%s) failed", __FUNCTION__,
+                                    fileName, initFileName, segmentFileNameFormat );
+        }
+
+        return false;
+    }
+
     void MP4Close(MP4FileHandle hFile, uint32_t  flags)
     {
         if( !MP4_IS_VALID_FILE_HANDLE( hFile ))
@@ -3332,6 +3450,153 @@ MP4FileHandle MP4ModifyCallbacks(const MP4IOCallbacks* callbacks,
         return false;
     }
 
+    bool MP4ReadSampleView(
+        MP4FileHandle  hFile,
+        MP4TrackId     trackId,
+        MP4SampleId    sampleId,
+        MP4SampleView* view )
+    {
+        if (!view)
+            return false;
+
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                ((MP4File*)hFile)->ReadSampleView( trackId, sampleId, *view );
+                return true;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        memset( view, 0, sizeof(*view) );
+        return false;
+    }
+
+    void MP4ReleaseSampleView(
+        MP4FileHandle  hFile,
+        MP4SampleView* view )
+    {
+        if (!view)
+            return;
+
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                ((MP4File*)hFile)->ReleaseSampleView( *view );
+                return;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+    }
+
+    uint32_t MP4ReadSamples(
+        MP4FileHandle  hFile,
+        MP4TrackId     trackId,
+        MP4SampleId    firstSampleId,
+        uint32_t       numSamples,
+        uint8_t*       pBytes,
+        uint32_t       numBytes,
+        MP4SampleInfo* pSampleInfo )
+    {
+        if (!pBytes || !pSampleInfo)
+            return 0;
+
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->ReadSamples(
+                           trackId,
+                           firstSampleId,
+                           numSamples,
+                           pBytes,
+                           numBytes,
+                           pSampleInfo );
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return 0;
+    }
+
+    MP4SampleIterator* MP4SampleIteratorCreate(
+        MP4FileHandle hFile,
+        MP4TrackId    trackId )
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                MP4SampleCursor* cursor =
+                    new MP4SampleCursor( *((MP4File*)hFile)->GetTrack( trackId ));
+                cursor->Seek( 1 );
+                return (MP4SampleIterator*)cursor;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return NULL;
+    }
+
+    bool MP4SampleIteratorNext(
+        MP4SampleIterator* iterator,
+        MP4SampleRecord*   record )
+    {
+        if (iterator && record) {
+            try {
+                return ((MP4SampleCursor*)iterator)->Next( *record );
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
+    bool MP4SampleIteratorSeek(
+        MP4SampleIterator* iterator,
+        MP4SampleId        sampleId )
+    {
+        if (iterator) {
+            try {
+                return ((MP4SampleCursor*)iterator)->Seek( sampleId );
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
+    void MP4SampleIteratorDestroy(
+        MP4SampleIterator* iterator )
+    {
+        delete (MP4SampleCursor*)iterator;
+    }
+
     bool MP4ReadSampleFromTime(
         /* input parameters */
         MP4FileHandle hFile,
@@ -3347,13 +3612,9 @@ MP4FileHandle MP4ModifyCallbacks(const MP4IOCallbacks* callbacks,
     {
         if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
             try {
-                MP4SampleId sampleId =
-                    ((MP4File*)hFile)->GetSampleIdFromTime(
-                        trackId, when, false);
-
-                ((MP4File*)hFile)->ReadSample(
+                ((MP4File*)hFile)->ReadSampleFromTime(
                     trackId,
-                    sampleId,
+                    when,
                     ppBytes,
                     pNumBytes,
                     pStartTime,
@@ -3439,6 +3700,85 @@ MP4FileHandle MP4ModifyCallbacks(const MP4IOCallbacks* callbacks,
         return false;
     }
 
+    bool MP4SetFragmentDuration(
+        MP4FileHandle hFile,
+        MP4Duration   duration )
+    {
+        if( MP4_IS_VALID_FILE_HANDLE( hFile )) {
+            try {
+                ((MP4File*)hFile)->SetFragmentDuration( duration );
+                return true;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
+    bool MP4WriteFragment( MP4FileHandle hFile )
+    {
+        if( MP4_IS_VALID_FILE_HANDLE( hFile )) {
+            try {
+                ((MP4File*)hFile)->WriteFragment();
+                return true;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
+    bool MP4SetChunkDuration(
+        MP4FileHandle hFile,
+        MP4Duration   duration )
+    {
+        if( MP4_IS_VALID_FILE_HANDLE( hFile )) {
+            try {
+                ((MP4File*)hFile)->SetChunkDuration( duration );
+                return true;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
+    bool MP4SetChunkCallback(
+        MP4FileHandle    hFile,
+        MP4ChunkCallback callback,
+        void*            userData )
+    {
+        if( MP4_IS_VALID_FILE_HANDLE( hFile )) {
+            try {
+                ((MP4File*)hFile)->SetChunkCallback( callback, userData );
+                return true;
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return false;
+    }
+
     bool MP4CopySample(
         MP4FileHandle srcFile,
         MP4TrackId    srcTrackId,
@@ -3688,6 +4028,113 @@ MP4FileHandle MP4ModifyCallbacks(const MP4IOCallbacks* callbacks,
         return -1;
     }
 
+    MP4SampleId MP4GetNextSyncSample(
+        MP4FileHandle hFile,
+        MP4TrackId trackId,
+        MP4SampleId sampleId)
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->GetNextSyncSample(
+                           trackId, sampleId);
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return MP4_INVALID_SAMPLE_ID;
+    }
+
+    MP4SampleId MP4GetPrevSyncSample(
+        MP4FileHandle hFile,
+        MP4TrackId trackId,
+        MP4SampleId sampleId)
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->GetPrevSyncSample(
+                           trackId, sampleId);
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return MP4_INVALID_SAMPLE_ID;
+    }
+
+    uint32_t MP4GetSyncSampleList(
+        MP4FileHandle hFile,
+        MP4TrackId trackId,
+        MP4SampleId* pSampleIds,
+        uint32_t maxSampleIds)
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->GetSyncSampleList(
+                           trackId, pSampleIds, maxSampleIds);
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return 0;
+    }
+
+    MP4SampleId MP4GetSampleIdFromPresentationTime(
+        MP4FileHandle hFile,
+        MP4TrackId trackId,
+        MP4Timestamp when)
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->GetSampleIdFromPresentationTime(
+                           trackId, when);
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return MP4_INVALID_SAMPLE_ID;
+    }
+
+    uint32_t MP4GetPresentationOrder(
+        MP4FileHandle hFile,
+        MP4TrackId trackId,
+        MP4SampleId* pSampleIds,
+        uint32_t maxSampleIds)
+    {
+        if (MP4_IS_VALID_FILE_HANDLE(hFile)) {
+            try {
+                return ((MP4File*)hFile)->GetPresentationOrder(
+                           trackId, pSampleIds, maxSampleIds);
+            }
+            catch( Exception* x ) {
+                mp4v2::impl::log.errorf(*x);
+                delete x;
+            }
+            catch( ... ) {
+                mp4v2::impl::log.errorf( "%s: failed", __FUNCTION__ );
+            }
+        }
+        return 0;
+    }
+
 
     uint64_t MP4ConvertFromMovieDuration(
         MP4FileHandle hFile,
@@ -4962,4 +5409,54 @@ bool MP4SetTrackDurationPerChunk(
 
 ///////////////////////////////////////////////////////////////////////////////
 
+bool MP4SetTrackAccessPattern(
+    MP4FileHandle         hFile,
+    MP4TrackId            trackId,
+    MP4TrackAccessPattern pattern )
+{
+    if( !MP4_IS_VALID_FILE_HANDLE( hFile ))
+        return false;
+
+    try {
+        ((MP4File*)hFile)->SetTrackAccessPattern( trackId, pattern );
+        return true;
+    }
+    catch( Exception* x ) {
+        mp4v2::impl::log.errorf(*x);
+        delete x;
+    }
+    catch( ... ) {
+        mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MP4SetTrackSampleOffsetIndex(
+    MP4FileHandle hFile,
+    MP4TrackId    trackId,
+    uint32_t      interval )
+{
+    if( !MP4_IS_VALID_FILE_HANDLE( hFile ))
+        return false;
+
+    try {
+        ((MP4File*)hFile)->SetTrackSampleOffsetIndex( trackId, interval );
+        return true;
+    }
+    catch( Exception* x ) {
+        mp4v2::impl::log.errorf(*x);
+        delete x;
+    }
+    catch( ... ) {
+        mp4v2::impl::log.errorf("%s: failed", __FUNCTION__ );
+    }
+
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 } // extern "C"
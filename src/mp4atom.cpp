@@ -56,6 +56,8 @@ MP4Atom::MP4Atom(MP4File& file, const char* type)
     m_size = 0;
     m_pParentAtom = NULL;
     m_depth = 0xFF;
+    m_deferred = false;
+    m_materializing = false;
 }
 
 MP4Atom::~MP4Atom()
@@ -186,6 +188,14 @@ MP4Atom* MP4Atom::ReadAtom(MP4File& file, MP4Atom* pParentAtom)
     file.ReadBytes((uint8_t*)&type[0], 4);
     type[4] = '\0';
 
+    // the moofs of a file that indexes them are left for later
+    if (ATOMID(type) == ATOMID("moof") && pParentAtom->GetParentAtom() == NULL &&
+            file.DefersMovieFragments()) {
+        file.SetPosition(pos);
+        pParentAtom->SetEnd(pos);
+        return NULL;
+    }
+
     // extended size
     const bool largesizeMode = (dataSize == 1);
     if (dataSize == 1) {
@@ -287,6 +297,12 @@ MP4Atom* MP4Atom::ReadAtom(MP4File& file, MP4Atom* pParentAtom)
         return pAtom;
     }
 
+    // leave the bulk of the sample tables on disk until they are used
+    if (file.DefersAtomBodies() && IsDeferrableType(type)) {
+        pAtom->Defer();
+        return pAtom;
+    }
+
     try {
         pAtom->Read();
     }
@@ -315,6 +331,20 @@ bool MP4Atom::IsReasonableType(const char* type)
     return false;
 }
 
+bool MP4Atom::IsDeferrableType(const char* type)
+{
+    // leaf atoms whose size grows with the number of samples and whose
+    // properties are all integers that exist before the body is read
+    const uint32_t id = ATOMID(type);
+    return id == ATOMID("co64")
+        || id == ATOMID("ctts")
+        || id == ATOMID("stco")
+        || id == ATOMID("stsc")
+        || id == ATOMID("stss")
+        || id == ATOMID("stsz")
+        || id == ATOMID("stts");
+}
+
 // generic read
 void MP4Atom::Read()
 {
@@ -342,6 +372,47 @@ void MP4Atom::Skip()
     m_File.SetPosition(m_end);
 }
 
+void MP4Atom::Defer()
+{
+    m_deferred.store(true, std::memory_order_release);
+    for (uint32_t i = 0; i < m_pProperties.Size(); i++) {
+        m_pProperties[i]->SetDeferred();
+    }
+
+    Skip(); // to end of atom
+}
+
+void MP4Atom::Materialize()
+{
+    std::lock_guard<std::recursive_mutex> lock( m_File.GetDeferredAtomMutex() );
+
+    // a property of ours touched while we read, e.g. by MP4StscAtom::Read()
+    if (!IsDeferred() || m_materializing) {
+        return;
+    }
+
+    log.verbose1f("\"%s\": Materialize: %s at 0x%" PRIx64,
+                  m_File.GetFilename().c_str(), m_type, m_start);
+
+    m_materializing = true;
+    try {
+        m_File.ReadDeferredAtom(*this);
+    }
+    catch (Exception* x) {
+        // leave whatever was read; a broken table reads as a short one
+        log.errorf(*x);
+        delete x;
+    }
+    m_materializing = false;
+
+    // only now let other threads past the unlocked checks; the release
+    // stores publish the values read above to their acquire loads
+    for (uint32_t i = 0; i < m_pProperties.Size(); i++) {
+        m_pProperties[i]->SetDeferred(false);
+    }
+    m_deferred.store(false, std::memory_order_release);
+}
+
 MP4Atom* MP4Atom::FindAtom(const char* name)
 {
     if (!IsMe(name)) {
@@ -615,6 +686,10 @@ void MP4Atom::Rewrite()
 
 void MP4Atom::BeginWrite(bool use64)
 {
+    if (IsDeferred()) {
+        Materialize();
+    }
+
     m_start = m_File.GetPosition();
     //use64 = m_File.Use64Bits();
     if (use64) {
@@ -744,6 +819,10 @@ void MP4Atom::SetFlags(uint32_t flags)
 
 void MP4Atom::Dump(uint8_t indent, bool dumpImplicits)
 {
+    if (IsDeferred()) {
+        Materialize();
+    }
+
     if ( m_type[0] != '\0' ) {
         // create list of ancestors
         list<string> tlist;
@@ -1128,6 +1207,8 @@ MP4Atom::factory( MP4File &file, MP4Atom* parent, const char* type )
                 return new MP4AmrAtom( file, type );
             if( ATOMID(type) == ATOMID("sdtp") )
                 return new MP4SdtpAtom(file);
+            if( ATOMID(type) == ATOMID("sidx") )
+                return new MP4SidxAtom(file);
             if( ATOMID(type) == ATOMID("stbl") )
                 return new MP4StblAtom(file);
             if( ATOMID(type) == ATOMID("stsd") )
@@ -1157,8 +1238,12 @@ MP4Atom::factory( MP4File &file, MP4Atom* parent, const char* type )
                 return new MP4Tx3gAtom(file);
             if( ATOMID(type) == ATOMID("tkhd") )
                 return new MP4TkhdAtom(file);
+            if( ATOMID(type) == ATOMID("tfdt") )
+                return new MP4TfdtAtom(file);
             if( ATOMID(type) == ATOMID("tfhd") )
                 return new MP4TfhdAtom(file);
+            if( ATOMID(type) == ATOMID("tfra") )
+                return new MP4TfraAtom(file);
             if( ATOMID(type) == ATOMID("trun") )
                 return new MP4TrunAtom(file);
             if( ATOMID(type) == ATOMID("twos") )
@@ -67,6 +67,7 @@ public:
     static MP4Atom* ReadAtom( MP4File& file, MP4Atom* pParentAtom );
     static MP4Atom* CreateAtom( MP4File& file, MP4Atom* parent, const char* type );
     static bool IsReasonableType( const char* type );
+    static bool IsDeferrableType( const char* type );
     const char* GetReasonableType() {
         return IsReasonableType(GetType()) ? GetType() : "????";
     };
@@ -220,6 +221,13 @@ public:
 
     void Skip();
 
+    // skip the body now and read it the first time a property value is used
+    void Defer();
+    void Materialize();
+    bool IsDeferred() {
+        return m_deferred.load(std::memory_order_acquire);
+    }
+
     virtual void Generate();
     virtual void Read();
     virtual void BeginWrite(bool use64 = false);
@@ -282,6 +290,9 @@ protected:
     MP4Atom*    m_pParentAtom;
     uint8_t m_depth;
 
+    std::atomic<bool> m_deferred;
+    bool        m_materializing;
+
     MP4PropertyArray    m_pProperties;
     MP4AtomInfoArray    m_pChildAtomInfos;
     MP4AtomArray        m_pChildAtoms;
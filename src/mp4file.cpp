@@ -53,8 +53,32 @@ MP4File::MP4File( ) :
 void MP4File::Init()
 {
     m_pRootAtom = NULL;
+    m_deferAtomBodies = false;
+    m_pageSampleTables = false;
+    m_packSampleTables = false;
     m_odTrackId = MP4_INVALID_TRACK_ID;
 
+    m_fragmentDuration = MP4_INVALID_DURATION;
+    m_fragmentSequenceNumber = 0;
+    m_initSegmentWritten = false;
+    m_chunkDuration = MP4_INVALID_DURATION;
+    m_fragmentStarted = false;
+    m_fragmentWrittenDuration = 0;
+    m_chunkCallback = NULL;
+    m_chunkCallbackUserData = NULL;
+    m_pChunkBuffer = NULL;
+    m_chunkBufferSize = 0;
+    m_segmentIndexPosition = 0;
+    m_fragmentsPerReference = 1;
+    m_lastReferenceFragments = 0;
+    m_separateSegments = false;
+
+    m_deferMovieFragments = false;
+    m_hasPendingFragments = false;
+    m_indexingPendingFragments = false;
+    m_pendingFragmentsStart = 0;
+    m_pendingFragmentsEnd = 0;
+
     m_useIsma = false;
 
     m_pModificationProperty = NULL;
@@ -65,6 +89,25 @@ void MP4File::Init()
     m_memoryBufferSize = 0;
     m_memoryBufferPosition = 0;
 
+    m_readBuffer = NULL;
+    m_readBufferSize = s_defaultReadBufferSize;
+    m_readBufferAhead = 0;
+    m_readBufferFile = NULL;
+    m_readBufferOffset = 0;
+    m_readBufferFill = 0;
+    m_readBufferPosition = 0;
+    m_readBufferParsing = false;
+
+    m_prefetcher = NULL;
+    m_prefetchFile = NULL;
+    m_fileIsStandard = false;
+
+    m_blockCache = NULL;
+
+    ResetIOStats();
+    m_ioTraceCallback = s_ioTraceCallback;
+    m_ioTraceUserData = s_ioTraceUserData;
+
     m_numReadBits = 0;
     m_bufReadBits = 0;
     m_numWriteBits = 0;
@@ -76,10 +119,20 @@ void MP4File::Init()
 
 MP4File::~MP4File()
 {
+    for( map<uint64_t, MP4Atom*>::iterator it = m_pendingFragments.begin(); it != m_pendingFragments.end(); it++ )
+        delete it->second;
     delete m_pRootAtom;
     for( uint32_t i = 0; i < m_pTracks.Size(); i++ )
         delete m_pTracks[i];
     MP4Free( m_memoryBuffer ); // just in case
+    MP4Free( m_pChunkBuffer );
+    MP4Free( m_readBuffer );
+    delete m_prefetcher;
+    delete m_prefetchFile;
+    for( size_t i = 0; i < m_sampleViewBuffers.size(); i++ ) {
+        MP4Free( m_sampleViewBuffers[i]->data );
+        delete m_sampleViewBuffers[i];
+    }
     delete m_file;
 }
 
@@ -95,9 +148,12 @@ MP4File::GetFilename() const
     return m_file->name;
 }
 
-void MP4File::Read( const char* fileName, const MP4FileProvider* provider, const MP4IOCallbacks* callbacks, void* handle )
+void MP4File::Read( const char* fileName, const MP4FileProvider* provider, const MP4IOCallbacks* callbacks, void* handle, uint32_t flags )
 {
-    Open( fileName, File::MODE_READ, provider, callbacks, handle );
+    Open( fileName, File::MODE_READ, provider, callbacks, handle, flags );
+    m_deferAtomBodies = (flags & MP4_READ_LAZY) != 0;
+    m_pageSampleTables = (flags & MP4_READ_PAGED_TABLES) != 0;
+    m_packSampleTables = (flags & MP4_READ_PACKED_TABLES) != 0;
     ReadFromFile();
     CacheProperties();
 }
@@ -114,25 +170,35 @@ void MP4File::Create( const char*           fileName,
                       uint32_t              supportedBrandsCount )
 {
     m_createFlags = flags;
-    Open( fileName, File::MODE_CREATE, NULL, callbacks, handle );
+    Open( fileName, File::MODE_CREATE, NULL, callbacks, handle, flags );
 
     // generate a skeletal atom tree
     m_pRootAtom = MP4Atom::CreateAtom(*this, NULL, NULL);
     m_pRootAtom->Generate();
 
-    if (add_ftyp != 0) {
+    if (add_ftyp != 0 && majorBrand == NULL && IsFragmentedWrite()) {
+        // tfdt and default-base-is-moof come with the iso6 brand
+        char iso6[] = "iso6";
+        char isom[] = "isom";
+        char* brands[] = { iso6, isom };
+        MakeFtypAtom(iso6, 0, brands, 2);
+    } else if (add_ftyp != 0) {
         MakeFtypAtom(majorBrand, minorVersion,
                      supportedBrands, supportedBrandsCount);
     }
 
     CacheProperties();
 
-    // create mdat, and insert it after ftyp, and before moov
-    (void)InsertChildAtom(m_pRootAtom, "mdat",
-                          add_ftyp != 0 ? 1 : 0);
+    // nothing of a fragmented file is written before its first fragment,
+    // see WriteInitSegment()
+    if (!IsFragmentedWrite()) {
+        // create mdat, and insert it after ftyp, and before moov
+        (void)InsertChildAtom(m_pRootAtom, "mdat",
+                              add_ftyp != 0 ? 1 : 0);
 
-    // start writing
-    m_pRootAtom->BeginWrite();
+        // start writing
+        m_pRootAtom->BeginWrite();
+    }
     if (add_iods != 0) {
         (void)AddChildAtom("moov", "iods");
     }
@@ -317,6 +383,8 @@ void MP4File::Optimize( const char* srcFileName, const char* dstFileName )
 
     }
     catch (...) {
+        DiscardReadBuffer( false );
+
         // cleanup and rethrow.  Without this, we'd leak memory and an open file handle(s).
        if(src == NULL && dst == NULL)
             delete m_file;// We didn't make it far enough to have m_file go to src or dst.
@@ -328,6 +396,7 @@ void MP4File::Optimize( const char* srcFileName, const char* dstFileName )
     }
 
     // cleanup
+    DiscardReadBuffer( false );
     delete dst;
     delete src;
     m_file = NULL;
@@ -337,6 +406,163 @@ void MP4File::Optimize( const char* srcFileName, const char* dstFileName )
         Rename( dname.c_str(), srcFileName );
 }
 
+// Reads the moov of srcFileName without its sample tables and keeps it
+// as the moov of movie fragments written to files of their own; the
+// samples go in through WriteSample() between BeginMediaSegment() and
+// EndMediaSegment()
+void MP4File::ReadSegmentTemplate( const char* srcFileName )
+{
+    Read( srcFileName, NULL, NULL, NULL, MP4_READ_LAZY );
+
+    // nothing but the ftyp and moov go to the init segment
+    for( uint32_t i = m_pRootAtom->GetNumberOfChildAtoms(); i > 0; i-- ) {
+        MP4Atom* pAtom = m_pRootAtom->GetChildAtom( i - 1 );
+        if( ATOMID( pAtom->GetType() ) != ATOMID( "ftyp" ) &&
+                ATOMID( pAtom->GetType() ) != ATOMID( "moov" )) {
+            m_pRootAtom->DeleteChildAtom( pAtom );
+            delete pAtom;
+        }
+    }
+    if( MP4Atom* pMvexAtom = FindAtom( "moov.mvex" )) {
+        pMvexAtom->GetParentAtom()->DeleteChildAtom( pMvexAtom );
+        delete pMvexAtom;
+    }
+
+    // tfdt comes with the iso6 brand
+    MP4FtypAtom* ftyp = (MP4FtypAtom*)FindAtom( "ftyp" );
+    if( ftyp ) {
+        uint32_t numBrands = ftyp->compatibleBrands.GetCount();
+        bool hasIso6 = !strcmp( ftyp->majorBrand.GetValue(), "iso6" );
+        for( uint32_t i = 0; i < numBrands && !hasIso6; i++ )
+            hasIso6 = !strcmp( ftyp->compatibleBrands.GetValue( i ), "iso6" );
+        if( !hasIso6 ) {
+            ftyp->compatibleBrands.SetCount( numBrands + 1 );
+            ftyp->compatibleBrands.SetValue( "iso6", numBrands );
+        }
+    }
+    else {
+        char iso6[] = "iso6";
+        char isom[] = "isom";
+        char* brands[] = { iso6, isom };
+        MakeFtypAtom( iso6, 0, brands, 2 );
+    }
+
+    // empty sample tables and zero durations, as in a fragmented write
+    if( m_pDurationProperty )
+        m_pDurationProperty->SetValue( 0 );
+    for( uint32_t i = 0; ; i++ ) {
+        char trackName[32];
+        snprintf( trackName, sizeof(trackName), "moov.trak[%u]", i );
+        MP4Atom* pTrakAtom = FindAtom( trackName );
+        if( !pTrakAtom )
+            break;
+
+        MP4IntegerProperty* pProperty = NULL;
+        if( pTrakAtom->FindProperty( "trak.tkhd.duration", (MP4Property**)&pProperty ))
+            pProperty->SetValue( 0 );
+        if( pTrakAtom->FindProperty( "trak.mdia.mdhd.duration", (MP4Property**)&pProperty ))
+            pProperty->SetValue( 0 );
+
+        MP4Atom* pStblAtom = pTrakAtom->FindAtom( "trak.mdia.minf.stbl" );
+        if( !pStblAtom )
+            continue;
+
+        // the fragments carry only what trun has room for, so refuse
+        // tables of sample groups, sub-samples and auxiliary information
+        // rather than drop them
+        static const char* const unsupported[] = { "sbgp", "sgpd", "subs", "saiz", "saio" };
+        for( uint32_t j = 0; j < pStblAtom->GetNumberOfChildAtoms(); j++ ) {
+            const char* type = pStblAtom->GetChildAtom( j )->GetType();
+            for( size_t k = 0; k < sizeof(unsupported) / sizeof(unsupported[0]); k++ ) {
+                if( ATOMID( type ) == ATOMID( unsupported[k] )) {
+                    ostringstream msg;
+                    msg << "cannot segment " << srcFileName << ": track " << i + 1
+                        << " has " << type;
+                    throw new EXCEPTION( msg.str() );
+                }
+            }
+        }
+
+        for( uint32_t j = pStblAtom->GetNumberOfChildAtoms(); j > 0; j-- ) {
+            MP4Atom* pAtom = pStblAtom->GetChildAtom( j - 1 );
+            if( ATOMID( pAtom->GetType() ) != ATOMID( "stsd" )) {
+                pStblAtom->DeleteChildAtom( pAtom );
+                delete pAtom;
+            }
+        }
+        (void)AddChildAtom( pStblAtom, "stts" );
+        (void)AddChildAtom( pStblAtom, "stsc" );
+        (void)AddChildAtom( pStblAtom, "stsz" );
+        (void)AddChildAtom( pStblAtom, "stco" );
+    }
+
+    // and tracks that know nothing of the tables just dropped
+    for( uint32_t i = 0; i < m_pTracks.Size(); i++ )
+        delete m_pTracks[i];
+    m_pTracks.Resize( 0 );
+    m_trakIds.Resize( 0 );
+    m_odTrackId = MP4_INVALID_TRACK_ID;
+    GenerateTracks();
+
+    // the sample tables are the only atoms a lazy read defers, so with
+    // them gone nothing is left to read from the source
+    m_deferAtomBodies = false;
+    DiscardReadBuffer( false );
+    delete m_file;
+    m_file = NULL;
+
+    m_createFlags |= MP4_CREATE_FRAGMENTED;
+    m_separateSegments = true;
+}
+
+// Writes the ftyp and moov of the template to fileName
+void MP4File::WriteInitSegment( const char* fileName )
+{
+    Open( fileName, File::MODE_CREATE );
+    try {
+        WriteInitSegment();
+    }
+    catch( ... ) {
+        delete m_file;
+        m_file = NULL;
+        throw;
+    }
+    delete m_file;
+    m_file = NULL;
+}
+
+// Starts a media segment in fileName whose moof gets sequenceNumber;
+// the tracks of the template pick up from where their
+// SetFragmentStartTime() put them
+void MP4File::BeginMediaSegment( const char* fileName, uint32_t sequenceNumber )
+{
+    Open( fileName, File::MODE_CREATE );
+
+    // the moov is in the init segment, see WriteInitSegment()
+    m_initSegmentWritten = true;
+    m_fragmentSequenceNumber = sequenceNumber - 1;
+    m_fragmentStarted = false;
+    m_fragmentWrittenDuration = 0;
+    m_segmentReferences.clear();
+    m_fragmentsPerReference = 1;
+    m_lastReferenceFragments = 0;
+}
+
+// Writes the samples of the media segment as one moof and mdat pair
+void MP4File::EndMediaSegment()
+{
+    try {
+        WriteFragment();
+    }
+    catch( ... ) {
+        delete m_file;
+        m_file = NULL;
+        throw;
+    }
+    delete m_file;
+    m_file = NULL;
+}
+
 void MP4File::RewriteMdat( File& src, File& dst )
 {
     uint32_t numTracks = m_pTracks.Size();
@@ -406,7 +632,8 @@ void MP4File::Open( const char*            fileName,
                     File::Mode             mode,
                     const MP4FileProvider* fileProvider,
                     const MP4IOCallbacks*  callbacks,
-                    void*                  handle )
+                    void*                  handle,
+                    uint32_t               flags )
 {
     ASSERT( !m_file );
 
@@ -418,6 +645,21 @@ void MP4File::Open( const char*            fileName,
         name = "<callbacks>";
         provider = new io::CallbacksFileProvider( *callbacks, handle );
     }
+    else if ((flags & MP4_CREATE_DIRECT_IO) && mode == File::MODE_CREATE)
+        provider = &io::FileProvider::direct();
+    else if ((flags & MP4_READ_MMAP) && mode == File::MODE_READ)
+        provider = &io::FileProvider::mapped();
+    else if ((flags & MP4_READ_PREAD) && mode == File::MODE_READ)
+        provider = &io::FileProvider::positionless();
+
+    m_fileIsStandard = !provider;
+
+    // every call into these may be a round trip, so serve them from blocks
+    m_blockCache = NULL;
+    if( (fileProvider || callbacks) && s_blockCacheBlockSize ) {
+        m_blockCache = new io::CachedFileProvider( *provider, s_blockCacheBlockSize, s_blockCacheCapacity );
+        provider = m_blockCache;
+    }
 
     m_file = new File( name, mode, provider );
     if( m_file->open() ) {
@@ -454,11 +696,60 @@ void MP4File::ReadFromFile()
     m_pRootAtom->SetSize(fileSize);
     m_pRootAtom->SetEnd(fileSize);
 
-    m_pRootAtom->Read();
+    // a lazy reader stops at the first moof if the fragments can be found
+    // without reading them all, see DefersMovieFragments()
+    uint64_t mfraStart = 0;
+    m_pendingFragmentsEnd = fileSize;
+    if( DefersAtomBodies() && !IsWriteMode() ) {
+        mfraStart = FindRandomAccessIndex();
+        if( mfraStart ) {
+            m_pendingFragmentsEnd = mfraStart;
+            m_pRootAtom->SetEnd(m_pendingFragmentsEnd);
+        }
+        m_deferMovieFragments = true;
+        SetPosition(0);
+    }
+
+    // buffer the atom tree regardless of mode, then hand the provider
+    // back in sync so that subsequent writes land where expected
+    m_readBufferParsing = true;
+    try {
+        m_pRootAtom->Read();
+    }
+    catch( ... ) {
+        m_readBufferParsing = false;
+        m_deferMovieFragments = false;
+        DiscardReadBuffer( false );
+        throw;
+    }
+    m_readBufferParsing = false;
+    if( IsWriteMode() )
+        DiscardReadBuffer();
+
+    m_deferMovieFragments = false;
+    m_pendingFragmentsStart = m_pRootAtom->GetEnd();
+    m_pRootAtom->SetEnd(fileSize);
+
+    // a sidx finds the moofs with a few bytes per fragment, so the tfras,
+    // which take some twenty per fragment and track, are left with them
+    if( mfraStart && (m_pendingFragmentsStart == m_pendingFragmentsEnd ||
+                      !m_pRootAtom->FindChildAtom("sidx")) ) {
+        SetPosition(mfraStart);
+        m_pRootAtom->AddChildAtom(MP4Atom::ReadAtom(*this, m_pRootAtom));
+    }
 
     // create MP4Track's for any tracks in the file
     GenerateTracks();
 
+    // and give them the samples of any movie fragments
+    IndexFragments();
+
+    // or where to look for them
+    if( m_pendingFragmentsStart < m_pendingFragmentsEnd ) {
+        m_hasPendingFragments = true;
+        IndexRandomAccessPoints();
+    }
+
     // Log any parsing errors we collected along the way
     LogParsingErrors();
 }
@@ -504,75 +795,969 @@ void MP4File::GenerateTracks()
                 }
             }
 
-            // Log an error if there are duplicate OD tracks
-            if (isODTrack) {
-                if (m_odTrackId == MP4_INVALID_TRACK_ID) {
-                    m_odTrackId = trackID;
-                } else {
-                    AddParsingError(m_pRootAtom, SPECIFICATION_ERROR, "Multiple OD tracks present", MP4_LOG_WARNING);
-                }
-            }
+            // Log an error if there are duplicate OD tracks
+            if (isODTrack) {
+                if (m_odTrackId == MP4_INVALID_TRACK_ID) {
+                    m_odTrackId = trackID;
+                } else {
+                    AddParsingError(m_pRootAtom, SPECIFICATION_ERROR, "Multiple OD tracks present", MP4_LOG_WARNING);
+                }
+            }
+
+            m_trakIds.Add(trackID);
+        }
+
+        MP4Track* pTrack = NULL;
+        try {
+            if (isHintTrack) {
+                pTrack = new MP4RtpHintTrack(*this, *pTrakAtom);
+            } else {
+                pTrack = new MP4Track(*this, *pTrakAtom);
+            }
+            m_pTracks.Add(pTrack);
+        }
+        catch( Exception* x ) {
+            log.errorf(*x);
+            delete x;
+        }
+
+        trackIndex++;
+    }
+}
+
+void MP4File::IndexFragments()
+{
+    uint32_t numAtoms = m_pRootAtom->GetNumberOfChildAtoms();
+    for (uint32_t i = 0; i < numAtoms; i++) {
+        MP4Atom* pAtom = m_pRootAtom->GetChildAtom(i);
+        if (ATOMID(pAtom->GetType()) == ATOMID("moof")) {
+            IndexMovieFragment(*pAtom);
+        }
+    }
+}
+
+void MP4File::IndexMovieFragment(MP4Atom& moofAtom)
+{
+    // unless tfhd says otherwise the data of the first traf is relative to
+    // the moof, and that of every other traf follows on from the previous
+    uint64_t dataOffset = moofAtom.GetStart();
+
+    uint32_t numAtoms = moofAtom.GetNumberOfChildAtoms();
+    for (uint32_t i = 0; i < numAtoms; i++) {
+        MP4Atom* pTrafAtom = moofAtom.GetChildAtom(i);
+        if (ATOMID(pTrafAtom->GetType()) != ATOMID("traf")) {
+            continue;
+        }
+
+        MP4Integer32Property* pTrackIdProperty = NULL;
+        if (!pTrafAtom->FindProperty("traf.tfhd.trackId",
+                                     (MP4Property**)&pTrackIdProperty)) {
+            continue;
+        }
+
+        MP4Track* pTrack = NULL;
+        for (uint32_t j = 0; j < m_pTracks.Size() && pTrack == NULL; j++) {
+            if (m_pTracks[j]->GetId() == pTrackIdProperty->GetValue()) {
+                pTrack = m_pTracks[j];
+            }
+        }
+        if (pTrack == NULL) {
+            std::string errorMsg = std::string("Track fragment of unknown track id ") + std::to_string(pTrackIdProperty->GetValue());
+            AddParsingError(pTrafAtom, SPECIFICATION_ERROR, errorMsg);
+            continue;
+        }
+
+        dataOffset = pTrack->AddTrackFragment(*pTrafAtom, moofAtom.GetStart(), dataOffset);
+    }
+}
+
+// The start of the mfra at the end of the file, found through the mfro
+// that closes it; 0 if there is none
+uint64_t MP4File::FindRandomAccessIndex()
+{
+    uint64_t fileSize = GetSize();
+    if (fileSize < 16) {
+        return 0;
+    }
+
+    uint8_t type[4];
+    SetPosition(fileSize - 16);
+    uint32_t mfroSize = ReadUInt32();
+    ReadBytes(type, 4);
+    if (mfroSize != 16 || memcmp(type, "mfro", 4) != 0) {
+        return 0;
+    }
+    (void)ReadUInt32();     // version and flags
+    uint32_t mfraSize = ReadUInt32();
+    if (mfraSize < 8 + 16 || mfraSize > fileSize) {
+        return 0;
+    }
+
+    uint64_t mfraStart = fileSize - mfraSize;
+    SetPosition(mfraStart);
+    uint32_t size = ReadUInt32();
+    ReadBytes(type, 4);
+    if (size != mfraSize || memcmp(type, "mfra", 4) != 0) {
+        return 0;
+    }
+    return mfraStart;
+}
+
+// Gives the tracks the moofs where the tfras of the mfra and the sidxs
+// ahead of the first moof say their times start. A sidx speaks for its
+// reference track only; it also serves as a starting point for the tracks
+// without a tfra, though a moof need not carry every track: the search
+// goes on through the moofs that follow one without the track, and walks
+// back a point from one whose samples start past the time, see
+// MP4Track::FindPendingFragmentSample()
+void MP4File::IndexRandomAccessPoints()
+{
+    MP4Atom* pMfraAtom = m_pRootAtom->FindChildAtom("mfra");
+    uint32_t numAtoms = pMfraAtom ? pMfraAtom->GetNumberOfChildAtoms() : 0;
+    for (uint32_t i = 0; i < numAtoms; i++) {
+        MP4Atom* pTfraAtom = pMfraAtom->GetChildAtom(i);
+        MP4IntegerProperty* pTrackId = NULL;
+        MP4IntegerProperty* pCount = NULL;
+        MP4IntegerProperty* pTime = NULL;
+        MP4IntegerProperty* pMoofOffset = NULL;
+        if (ATOMID(pTfraAtom->GetType()) != ATOMID("tfra") ||
+                !pTfraAtom->FindProperty("tfra.trackId", (MP4Property**)&pTrackId) ||
+                !pTfraAtom->FindProperty("tfra.numberOfEntry", (MP4Property**)&pCount) ||
+                !pTfraAtom->FindProperty("tfra.entries.time", (MP4Property**)&pTime) ||
+                !pTfraAtom->FindProperty("tfra.entries.moofOffset", (MP4Property**)&pMoofOffset)) {
+            continue;
+        }
+
+        MP4Track* pTrack = NULL;
+        for (uint32_t j = 0; j < m_pTracks.Size() && pTrack == NULL; j++) {
+            if (m_pTracks[j]->GetId() == pTrackId->GetValue()) {
+                pTrack = m_pTracks[j];
+            }
+        }
+        if (pTrack == NULL) {
+            continue;
+        }
+
+        uint32_t numEntries = min((uint32_t)pCount->GetValue(), pTime->GetCount());
+        for (uint32_t j = 0; j < numEntries; j++) {
+            pTrack->AddRandomAccessPoint(pTime->GetValue(j), pMoofOffset->GetValue(j));
+        }
+    }
+
+    vector<bool> hasTfra(m_pTracks.Size());
+    for (uint32_t j = 0; j < m_pTracks.Size(); j++) {
+        hasTfra[j] = m_pTracks[j]->HasRandomAccessPoints();
+    }
+
+    numAtoms = m_pRootAtom->GetNumberOfChildAtoms();
+    for (uint32_t i = 0; i < numAtoms; i++) {
+        MP4Atom* pSidxAtom = m_pRootAtom->GetChildAtom(i);
+        MP4IntegerProperty* pReferenceId = NULL;
+        MP4IntegerProperty* pTimescale = NULL;
+        MP4IntegerProperty* pTime = NULL;
+        MP4IntegerProperty* pFirstOffset = NULL;
+        MP4IntegerProperty* pReferenceType = NULL;
+        MP4IntegerProperty* pSize = NULL;
+        MP4IntegerProperty* pDuration = NULL;
+        if (ATOMID(pSidxAtom->GetType()) != ATOMID("sidx") ||
+                !pSidxAtom->FindProperty("sidx.referenceId", (MP4Property**)&pReferenceId) ||
+                !pSidxAtom->FindProperty("sidx.timescale", (MP4Property**)&pTimescale) ||
+                !pSidxAtom->FindProperty("sidx.earliestPresentationTime", (MP4Property**)&pTime) ||
+                !pSidxAtom->FindProperty("sidx.firstOffset", (MP4Property**)&pFirstOffset) ||
+                !pSidxAtom->FindProperty("sidx.references.referenceType", (MP4Property**)&pReferenceType) ||
+                !pSidxAtom->FindProperty("sidx.references.referencedSize", (MP4Property**)&pSize) ||
+                !pSidxAtom->FindProperty("sidx.references.subsegmentDuration", (MP4Property**)&pDuration) ||
+                pTimescale->GetValue() == 0) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < m_pTracks.Size(); j++) {
+            MP4Track* pTrack = m_pTracks[j];
+            if (hasTfra[j] || (pTrack->GetId() != pReferenceId->GetValue() &&
+                               pTrack->HasRandomAccessPoints())) {
+                continue;
+            }
+
+            // the subsegments follow one another from firstOffset past the sidx
+            uint64_t offset = pSidxAtom->GetEnd() + pFirstOffset->GetValue();
+            MP4Timestamp time = pTime->GetValue();
+            for (uint32_t k = 0; k < pSize->GetCount(); k++) {
+                // a reference to a further sidx is not followed
+                if (pReferenceType->GetValue(k) != 0) {
+                    break;
+                }
+                pTrack->AddRandomAccessPoint(
+                    MP4ConvertTime(time, pTimescale->GetValue(), pTrack->GetTimeScale()), offset);
+                offset += pSize->GetValue(k);
+                time += pDuration->GetValue(k);
+            }
+        }
+    }
+}
+
+// Whether the root atoms should be read only up to the first moof, which
+// is when a lazy reader has an mfra or sidx to find the moofs by
+bool MP4File::DefersMovieFragments()
+{
+    return m_deferMovieFragments &&
+           (m_pendingFragmentsEnd < GetSize() || m_pRootAtom->FindChildAtom("sidx") != NULL);
+}
+
+// Reads the root atoms left unread on open and numbers the samples of
+// their moofs as if they had been read then
+void MP4File::IndexPendingFragments()
+{
+    std::lock_guard<std::recursive_mutex> lock( m_deferredAtomMutex );
+
+    if (!m_hasPendingFragments || m_indexingPendingFragments) {
+        return;
+    }
+    m_indexingPendingFragments = true;
+
+    log.verbose1f("\"%s\": IndexPendingFragments: 0x%" PRIx64 " to 0x%" PRIx64,
+                  GetFilename().c_str(), m_pendingFragmentsStart, m_pendingFragmentsEnd);
+
+    // an mfra read on open is put back after the moofs, else it is read
+    // along with them
+    MP4Atom* pMfraAtom = m_pRootAtom->FindChildAtom("mfra");
+    uint64_t end = pMfraAtom ? m_pendingFragmentsEnd : GetSize();
+    if (pMfraAtom) {
+        m_pRootAtom->DeleteChildAtom(pMfraAtom);
+    }
+
+    uint32_t firstAtom = m_pRootAtom->GetNumberOfChildAtoms();
+    size_t firstError = m_parsingErrors.size();
+
+    SuspendedIO io;
+    SuspendIO( io );
+    try {
+        ((MP4RootAtom*)m_pRootAtom)->ReadPendingChildAtoms(m_pendingFragmentsStart, end);
+    }
+    catch (Exception* x) {
+        // index whatever was read
+        log.errorf(*x);
+        delete x;
+    }
+    ResumeIO( io, NULL );
+
+    if (pMfraAtom) {
+        m_pRootAtom->AddChildAtom(pMfraAtom);
+    }
+
+    uint32_t numAtoms = m_pRootAtom->GetNumberOfChildAtoms();
+    for (uint32_t i = firstAtom; i < numAtoms; i++) {
+        MP4Atom* pAtom = m_pRootAtom->GetChildAtom(i);
+        if (ATOMID(pAtom->GetType()) == ATOMID("moof")) {
+            IndexMovieFragment(*pAtom);
+        }
+    }
+
+    list<ParsingError>::iterator error = m_parsingErrors.begin();
+    advance(error, firstError);
+    for (; error != m_parsingErrors.end(); error++) {
+        error->atom->LogAtomError(error->category, error->errorMsg, error->level);
+    }
+
+    // only now let other threads past HasPendingFragments(), whose acquire
+    // load pairs with this release store and so sees the samples indexed
+    m_indexingPendingFragments = false;
+    m_hasPendingFragments.store(false, std::memory_order_release);
+}
+
+// The moof at offset among the root atoms left unread on open, read on
+// its own and kept until the file is closed; NULL if there is none
+MP4Atom* MP4File::ReadPendingFragment(uint64_t offset)
+{
+    if (offset < m_pendingFragmentsStart || offset + 8 > m_pendingFragmentsEnd) {
+        return NULL;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock( m_deferredAtomMutex );
+
+    map<uint64_t, MP4Atom*>::iterator it = m_pendingFragments.find(offset);
+    if (it != m_pendingFragments.end()) {
+        return it->second;
+    }
+
+    SuspendedIO io;
+    SuspendIO( io );
+
+    // bounded like the root atom would bound it
+    const uint64_t rootEnd = m_pRootAtom->GetEnd();
+    m_pRootAtom->SetEnd(m_pendingFragmentsEnd);
+
+    MP4Atom* pMoofAtom = NULL;
+    Exception* failure = NULL;
+    try {
+        uint8_t type[4];
+        SetPosition(offset + 4);
+        ReadBytes(type, 4);
+        if (memcmp(type, "moof", 4) == 0) {
+            SetPosition(offset);
+            pMoofAtom = MP4Atom::ReadAtom(*this, m_pRootAtom);
+        }
+    }
+    catch (Exception* x) {
+        failure = x;
+    }
+
+    m_pRootAtom->SetEnd(rootEnd);
+    ResumeIO( io, failure );
+
+    if (pMoofAtom != NULL) {
+        m_pendingFragments[offset] = pMoofAtom;
+    }
+    return pMoofAtom;
+}
+
+// The offset of the first moof after moofAtom, going by the headers of
+// the atoms in between; 0 if there is none
+uint64_t MP4File::GetNextPendingFragment(MP4Atom& moofAtom)
+{
+    std::lock_guard<std::recursive_mutex> lock( m_deferredAtomMutex );
+
+    SuspendedIO io;
+    SuspendIO( io );
+
+    uint64_t next = 0;
+    Exception* failure = NULL;
+    try {
+        uint64_t pos = moofAtom.GetEnd();
+        while (pos + 8 <= m_pendingFragmentsEnd) {
+            uint8_t type[4];
+            SetPosition(pos);
+            uint64_t size = ReadUInt32();
+            ReadBytes(type, 4);
+            if (memcmp(type, "moof", 4) == 0) {
+                next = pos;
+                break;
+            }
+            if (size == 1) {
+                size = ReadUInt64();
+            }
+            else if (size == 0) {
+                size = m_pendingFragmentsEnd - pos;
+            }
+            if (size < 8) {
+                break;
+            }
+            pos += size;
+        }
+    }
+    catch (Exception* x) {
+        failure = x;
+    }
+
+    ResumeIO( io, failure );
+    return next;
+}
+
+// Indexes the samples of trackId in a moof read by ReadPendingFragment();
+// false if they lack the tfdt that places them in time
+bool MP4File::IndexPendingFragment(MP4Atom& moofAtom, MP4TrackId trackId, MP4FragmentIndex& index)
+{
+    // as in IndexMovieFragment(), with the trafs of the other tracks only
+    // indexed to learn where their data ends
+    uint64_t dataOffset = moofAtom.GetStart();
+
+    uint32_t numAtoms = moofAtom.GetNumberOfChildAtoms();
+    for (uint32_t i = 0; i < numAtoms; i++) {
+        MP4Atom* pTrafAtom = moofAtom.GetChildAtom(i);
+        if (ATOMID(pTrafAtom->GetType()) != ATOMID("traf")) {
+            continue;
+        }
+
+        MP4Integer32Property* pTrackIdProperty = NULL;
+        if (!pTrafAtom->FindProperty("traf.tfhd.trackId",
+                                     (MP4Property**)&pTrackIdProperty)) {
+            continue;
+        }
+
+        if (pTrackIdProperty->GetValue() == trackId) {
+            if (pTrafAtom->FindAtom("traf.tfdt") == NULL) {
+                return false;
+            }
+            dataOffset = index.AddTrackFragment(*pTrafAtom, moofAtom.GetStart(), dataOffset);
+            continue;
+        }
+
+        MP4Track* pTrack = NULL;
+        for (uint32_t j = 0; j < m_pTracks.Size() && pTrack == NULL; j++) {
+            if (m_pTracks[j]->GetId() == pTrackIdProperty->GetValue()) {
+                pTrack = m_pTracks[j];
+            }
+        }
+        if (pTrack != NULL) {
+            MP4FragmentIndex otherIndex(pTrack->FindTrexAtom(), 0);
+            dataOffset = otherIndex.AddTrackFragment(*pTrafAtom, moofAtom.GetStart(), dataOffset);
+        }
+    }
+    return true;
+}
+
+void MP4File::CacheProperties()
+{
+    if (!FindAtom("moov.mvhd")) {
+        return;
+    }
+
+    FindIntegerProperty("moov.mvhd.modificationTime",
+                        (MP4Property**)&m_pModificationProperty);
+
+    FindIntegerProperty("moov.mvhd.timeScale",
+                        (MP4Property**)&m_pTimeScaleProperty);
+
+    FindIntegerProperty("moov.mvhd.duration",
+                        (MP4Property**)&m_pDurationProperty);
+}
+
+void MP4File::AddParsingError(MP4Atom *atom, const std::string& category, const std::string& errorMsg, MP4LogLevel level)
+{
+    ParsingError error;
+    error.atom = atom;
+    error.category = category;
+    error.errorMsg = errorMsg;
+    error.level = level;
+    m_parsingErrors.push_back(error);
+}
+
+void MP4File::LogParsingErrors()
+{
+    for (auto& error : m_parsingErrors) {
+        error.atom->LogAtomError(error.category, error.errorMsg, error.level);
+    }
+}
+
+void MP4File::BeginWrite()
+{
+    m_pRootAtom->BeginWrite();
+}
+
+void MP4File::FinishWrite(uint32_t options)
+{
+    // the moov went out ahead of the first fragment, so all that is
+    // left is the last one
+    if (IsFragmentedWrite()) {
+        WriteFragment();
+        WriteRandomAccessIndex();
+        WriteSegmentIndex();
+        return;
+    }
+
+    RemoveEmptyUserData();
+
+    // for all tracks, flush chunking buffers
+    for( uint32_t i = 0; i < m_pTracks.Size(); i++ ) {
+        ASSERT( m_pTracks[i] );
+        m_pTracks[i]->FinishWrite(options);
+    }
+
+    // ask root atom to write
+    m_pRootAtom->FinishWrite();
+
+    // check if we can move the moov atom to the front
+    MoveMoovAtomToFront();
+
+    // finished all writes, if position < size then the file has
+    // shrunk and we first mark the remaining bytes with a free
+    // atom, then attempt to truncate
+    uint64_t endPosition = GetPosition();
+    if( endPosition < GetSize() ) {
+        MP4RootAtom* root = (MP4RootAtom*)FindAtom( "" );
+        ASSERT( root );
+
+        // compute size of free atom; always has 8 bytes of overhead
+        uint64_t size = GetSize() - GetPosition();
+        if( size < 8 )
+            size = 0;
+        else
+            size -= 8;
+
+        MP4FreeAtom* freeAtom = (MP4FreeAtom*)MP4Atom::CreateAtom( *this, NULL, "free" );
+        ASSERT( freeAtom );
+        freeAtom->SetSize( size );
+        root->AddChildAtom( freeAtom );
+        freeAtom->Write();
+
+        // now attempt to truncate the file at the previous end position
+        // this is done after marking the area as free, because if truncate
+        // fails it may leave the file inaccessible, preventing us from
+        // inserting the free atom afterwards
+        m_file->truncate(endPosition);
+    }
+}
+
+// references a sidx has room for before fragments share them; a version
+// 1 sidx takes 40 bytes and 12 more for each reference
+static const uint32_t s_segmentIndexCapacity = 512;
+
+static uint64_t SegmentIndexSize(uint32_t numReferences)
+{
+    return 40 + 12 * (uint64_t)numReferences;
+}
+
+void MP4File::SetFragmentDuration(MP4Duration duration)
+{
+    PROTECT_WRITE_OPERATION();
+    m_fragmentDuration = duration;
+}
+
+void MP4File::SetChunkDuration(MP4Duration duration)
+{
+    PROTECT_WRITE_OPERATION();
+    m_chunkDuration = duration;
+}
+
+void MP4File::SetChunkCallback(MP4ChunkCallback callback, void* userData)
+{
+    PROTECT_WRITE_OPERATION();
+    m_chunkCallback = callback;
+    m_chunkCallbackUserData = userData;
+}
+
+// fragments are cut at sync samples of the first video track, or else
+// of the first track
+MP4Track* MP4File::GetFragmentReferenceTrack()
+{
+    for (uint32_t i = 0; i < m_pTracks.Size(); i++) {
+        if (strequal(m_pTracks[i]->GetType(), MP4_VIDEO_TRACK_TYPE)) {
+            return m_pTracks[i];
+        }
+    }
+    return m_pTracks.Size() > 0 ? m_pTracks[0] : NULL;
+}
+
+// writes out the buffered fragment if the sync sample about to be
+// written to pTrack should start the next one
+void MP4File::StartFragmentAt(MP4Track* pTrack, bool isSyncSample)
+{
+    // a media segment goes out whole, see EndMediaSegment()
+    if (m_separateSegments) {
+        return;
+    }
+
+    if (!isSyncSample || pTrack != GetFragmentReferenceTrack()) {
+        return;
+    }
+
+    // chunks of the fragment may have gone out already
+    MP4Duration trackDuration = m_fragmentWrittenDuration + pTrack->GetFragmentDuration();
+    if (trackDuration == 0 && pTrack->GetFragmentSampleCount() == 0) {
+        return;
+    }
+
+    MP4Duration fragmentDuration = m_fragmentDuration;
+    if (fragmentDuration == MP4_INVALID_DURATION) {
+        fragmentDuration = 2 * GetTimeScale();
+    }
+    MP4Duration bufferedDuration = MP4ConvertTime(trackDuration,
+                                   pTrack->GetTimeScale(), GetTimeScale());
+    if (bufferedDuration >= fragmentDuration) {
+        WriteFragment();
+    }
+}
+
+// writes out the buffered samples as a chunk of the current fragment if
+// the sample just written to pTrack completes one
+void MP4File::EndChunkAt(MP4Track* pTrack)
+{
+    if (m_chunkDuration == MP4_INVALID_DURATION ||
+            pTrack != GetFragmentReferenceTrack()) {
+        return;
+    }
+
+    MP4Duration bufferedDuration = MP4ConvertTime(pTrack->GetFragmentDuration(),
+                                   pTrack->GetTimeScale(), GetTimeScale());
+    if (bufferedDuration >= m_chunkDuration) {
+        WriteChunk();
+    }
+}
+
+// With a chunk callback the atoms written from here to EndChunkBuffer()
+// are gathered in memory; returns the file offset they will go to
+uint64_t MP4File::BeginChunkBuffer()
+{
+    uint64_t fileOffset = GetPosition();
+    if (m_chunkCallback) {
+        // the memory buffer owns the chunk buffer until it is disabled
+        EnableMemoryBuffer(m_pChunkBuffer, m_chunkBufferSize);
+        m_pChunkBuffer = NULL;
+        m_chunkPieces.clear();
+    }
+    return fileOffset;
+}
+
+// Writes the gathered atoms out, as the first piece of the chunk
+void MP4File::EndChunkBuffer()
+{
+    if (!m_chunkCallback) {
+        return;
+    }
+
+    // WriteBytes() may have grown the buffer beyond what it was given
+    uint64_t numBytes = 0;
+    DisableMemoryBuffer(&m_pChunkBuffer, &numBytes);
+    m_chunkBufferSize = max(m_chunkBufferSize, numBytes);
+
+    // in pieces WriteBytes() can take
+    for (uint64_t written = 0; written < numBytes; ) {
+        uint32_t pieceSize = (uint32_t)min(numBytes - written, (uint64_t)0x80000000);
+        WriteBytes(m_pChunkBuffer + written, pieceSize);
+        written += pieceSize;
+    }
+
+    AddChunkPiece(m_pChunkBuffer, numBytes);
+}
+
+// Adds bytes written after the gathered atoms to the chunk; they must
+// stay put until SendChunk()
+void MP4File::AddChunkPiece(const uint8_t* pBytes, uint64_t numBytes)
+{
+    if (!m_chunkCallback || numBytes == 0) {
+        return;
+    }
+
+    MP4ChunkPiece piece;
+    piece.bytes = pBytes;
+    piece.numBytes = numBytes;
+    m_chunkPieces.push_back(piece);
+}
+
+// Hands the pieces of the chunk to the callback
+void MP4File::SendChunk(MP4ChunkInfo& info)
+{
+    if (!m_chunkCallback) {
+        return;
+    }
+
+    info.pieces = m_chunkPieces.empty() ? NULL : &m_chunkPieces[0];
+    info.numPieces = (uint32_t)m_chunkPieces.size();
+    info.numBytes = 0;
+    for (size_t i = 0; i < m_chunkPieces.size(); i++) {
+        info.numBytes += m_chunkPieces[i].numBytes;
+    }
+    m_chunkCallback(m_chunkCallbackUserData, &info);
+}
 
-            m_trakIds.Add(trackID);
-        }
+// Drops the gathered atoms after a failure
+void MP4File::AbortChunkBuffer()
+{
+    if (m_chunkCallback && m_memoryBuffer) {
+        DisableMemoryBuffer(&m_pChunkBuffer, NULL);
+    }
+}
 
-        MP4Track* pTrack = NULL;
-        try {
-            if (isHintTrack) {
-                pTrack = new MP4RtpHintTrack(*this, *pTrakAtom);
-            } else {
-                pTrack = new MP4Track(*this, *pTrakAtom);
-            }
-            m_pTracks.Add(pTrack);
+void MP4File::WriteInitSegment()
+{
+    // a trex for each track announces that fragments follow
+    MP4Atom* pMvexAtom = AddChildAtom("moov", "mvex");
+    for (uint32_t i = 0; i < m_pTracks.Size(); i++) {
+        MP4Atom* pTrexAtom = AddChildAtom(pMvexAtom, "trex");
+        MP4IntegerProperty* pProperty = NULL;
+        pTrexAtom->FindProperty("trex.trackId", (MP4Property**)&pProperty);
+        ASSERT(pProperty);
+        pProperty->SetValue(m_pTracks[i]->GetId());
+        pTrexAtom->FindProperty("trex.defaultSampleDesriptionIndex", (MP4Property**)&pProperty);
+        ASSERT(pProperty);
+        pProperty->SetValue(1);
+    }
+
+    RemoveEmptyUserData();
+
+    MP4ChunkInfo info;
+    memset(&info, 0, sizeof(info));
+    info.fileOffset = BeginChunkBuffer();
+    info.isInitSegment = true;
+    uint64_t start = GetPosition();
+    try {
+        // the sample tables are empty and the durations zero; the
+        // fragments carry all the samples
+        for (uint32_t i = 0; i < m_pRootAtom->GetNumberOfChildAtoms(); i++) {
+            m_pRootAtom->GetChildAtom(i)->Write();
         }
-        catch( Exception* x ) {
-            log.errorf(*x);
-            delete x;
+
+        // and room for the sidx that indexes them, see WriteSegmentIndex()
+        if (!m_separateSegments) {
+            MP4Atom* pFreeAtom = MP4Atom::CreateAtom(*this, NULL, "free");
+            pFreeAtom->SetSize(SegmentIndexSize(s_segmentIndexCapacity) - 8);
+            m_pRootAtom->AddChildAtom(pFreeAtom);
+            m_segmentIndexPosition = info.fileOffset + (GetPosition() - start);
+            pFreeAtom->Write();
         }
+    }
+    catch (...) {
+        AbortChunkBuffer();
+        throw;
+    }
+    EndChunkBuffer();
+    SendChunk(info);
 
-        trackIndex++;
+    m_initSegmentWritten = true;
+}
+
+// Adds a fragment to the sidx references. A reference holds one fragment
+// or, once s_segmentIndexCapacity of them are in use, twice as many as
+// before, so the references never outgrow the room left for the sidx
+void MP4File::AddSegmentReference(uint64_t size, MP4Timestamp presentationTime, bool startsWithSap)
+{
+    if (!m_segmentReferences.empty() && m_lastReferenceFragments < m_fragmentsPerReference) {
+        m_segmentReferences.back().size += size;
+        m_lastReferenceFragments++;
+        return;
+    }
+
+    if (m_segmentReferences.size() == s_segmentIndexCapacity) {
+        for (size_t i = 0; i < s_segmentIndexCapacity / 2; i++) {
+            m_segmentReferences[i] = m_segmentReferences[2 * i];
+            m_segmentReferences[i].size += m_segmentReferences[2 * i + 1].size;
+        }
+        m_segmentReferences.resize(s_segmentIndexCapacity / 2);
+        m_fragmentsPerReference *= 2;
     }
+
+    SegmentReference reference;
+    reference.size = size;
+    reference.presentationTime = presentationTime;
+    reference.startsWithSap = startsWithSap;
+    m_segmentReferences.push_back(reference);
+    m_lastReferenceFragments = 1;
 }
 
-void MP4File::CacheProperties()
+// Writes the sidx into the room left for it after the moov, one
+// reference for each run of fragments of AddSegmentReference(); the time
+// of each is that of the reference track
+void MP4File::WriteSegmentIndex()
 {
-    if (!FindAtom("moov.mvhd")) {
+    if (m_segmentReferences.empty()) {
         return;
     }
 
-    FindIntegerProperty("moov.mvhd.modificationTime",
-                        (MP4Property**)&m_pModificationProperty);
+    MP4Track* pTrack = GetFragmentReferenceTrack();
+    const size_t numReferences = m_segmentReferences.size();
+
+    MP4Atom* pSidxAtom = MP4Atom::CreateAtom(*this, NULL, "sidx");
+    pSidxAtom->Generate();
+
+    MP4IntegerProperty* pProperty = NULL;
+    pSidxAtom->FindProperty("sidx.referenceId", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(pTrack->GetId());
+    pSidxAtom->FindProperty("sidx.timescale", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(pTrack->GetTimeScale());
+    pSidxAtom->FindProperty("sidx.earliestPresentationTime", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(m_segmentReferences[0].presentationTime);
+
+    MP4Integer16Property* pCount = NULL;
+    MP4BitfieldProperty* pReferenceType = NULL;
+    MP4BitfieldProperty* pSize = NULL;
+    MP4Integer32Property* pDuration = NULL;
+    MP4BitfieldProperty* pStartsWithSap = NULL;
+    MP4BitfieldProperty* pSapType = NULL;
+    MP4BitfieldProperty* pSapDeltaTime = NULL;
+    pSidxAtom->FindProperty("sidx.referenceCount", (MP4Property**)&pCount);
+    pSidxAtom->FindProperty("sidx.references.referenceType", (MP4Property**)&pReferenceType);
+    pSidxAtom->FindProperty("sidx.references.referencedSize", (MP4Property**)&pSize);
+    pSidxAtom->FindProperty("sidx.references.subsegmentDuration", (MP4Property**)&pDuration);
+    pSidxAtom->FindProperty("sidx.references.startsWithSap", (MP4Property**)&pStartsWithSap);
+    pSidxAtom->FindProperty("sidx.references.sapType", (MP4Property**)&pSapType);
+    pSidxAtom->FindProperty("sidx.references.sapDeltaTime", (MP4Property**)&pSapDeltaTime);
+    ASSERT(pCount && pReferenceType && pSize && pDuration && pStartsWithSap && pSapType && pSapDeltaTime);
+
+    for (size_t i = 0; i < numReferences; i++) {
+        const SegmentReference& reference = m_segmentReferences[i];
+        const uint64_t size = reference.size;
+
+        // the last subsegment lasts until the end of the track
+        MP4Timestamp endTime = (i + 1 < numReferences)
+            ? m_segmentReferences[i + 1].presentationTime
+            : max(pTrack->GetDuration(), reference.presentationTime);
+        MP4Duration duration = endTime > reference.presentationTime
+            ? endTime - reference.presentationTime : 0;
+
+        if (size > 0x7FFFFFFF || duration > 0xFFFFFFFF) {
+            log.warningf("%s: \"%s\": fragments too large to index, no sidx written",
+                         __FUNCTION__, GetFilename().c_str());
+            delete pSidxAtom;
+            return;
+        }
 
-    FindIntegerProperty("moov.mvhd.timeScale",
-                        (MP4Property**)&m_pTimeScaleProperty);
+        pCount->IncrementValue();
+        pReferenceType->AddValue(0);
+        pSize->AddValue(size);
+        pDuration->AddValue((uint32_t)duration);
+        pStartsWithSap->AddValue(reference.startsWithSap ? 1 : 0);
+        pSapType->AddValue(reference.startsWithSap ? 1 : 0);
+        pSapDeltaTime->AddValue(0);
+    }
 
-    FindIntegerProperty("moov.mvhd.duration",
-                        (MP4Property**)&m_pDurationProperty);
+    // whatever room is left stays free, between the sidx and the first moof
+    const uint64_t leftover = SegmentIndexSize(s_segmentIndexCapacity) - SegmentIndexSize((uint32_t)numReferences);
+    pSidxAtom->FindProperty("sidx.firstOffset", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(leftover);
+
+    m_pRootAtom->AddChildAtom(pSidxAtom);
+
+    const uint64_t endPosition = GetPosition();
+    SetPosition(m_segmentIndexPosition);
+    pSidxAtom->Write();
+    if (leftover > 0) {
+        MP4Atom* pFreeAtom = MP4Atom::CreateAtom(*this, NULL, "free");
+        pFreeAtom->SetSize(leftover - 8);
+        m_pRootAtom->AddChildAtom(pFreeAtom);
+        pFreeAtom->Write();
+    }
+    SetPosition(endPosition);
 }
 
-void MP4File::AddParsingError(MP4Atom *atom, const std::string& category, const std::string& errorMsg, MP4LogLevel level)
+// Writes an mfra with the random access points of each track at the end
+// of the file, closed by the mfro that lets readers find it from there
+void MP4File::WriteRandomAccessIndex()
 {
-    ParsingError error;
-    error.atom = atom;
-    error.category = category;
-    error.errorMsg = errorMsg;
-    error.level = level;
-    m_parsingErrors.push_back(error);
+    MP4Atom* pMfraAtom = MP4Atom::CreateAtom(*this, NULL, "mfra");
+    pMfraAtom->Generate();
+
+    for (uint32_t i = 0; i < m_pTracks.Size(); i++) {
+        MP4Atom* pTfraAtom = m_pTracks[i]->GenerateRandomAccessTable(*pMfraAtom);
+        if (pTfraAtom != NULL) {
+            // ahead of the mfro
+            pMfraAtom->InsertChildAtom(pTfraAtom, pMfraAtom->GetNumberOfChildAtoms() - 1);
+        }
+    }
+    if (pMfraAtom->GetNumberOfChildAtoms() == 1) {
+        delete pMfraAtom;
+        return;
+    }
+    m_pRootAtom->AddChildAtom(pMfraAtom);
+
+    // the mfro holds the size of the mfra, so it is written twice
+    uint64_t mfraStart = GetPosition();
+    pMfraAtom->Write();
+    MP4IntegerProperty* pSize = NULL;
+    pMfraAtom->FindProperty("mfra.mfro.size", (MP4Property**)&pSize);
+    ASSERT(pSize);
+    pSize->SetValue(GetPosition() - mfraStart);
+    SetPosition(mfraStart);
+    pMfraAtom->Write();
 }
 
-void MP4File::LogParsingErrors()
+void MP4File::WriteFragment()
 {
-    for (auto& error : m_parsingErrors) {
-        error.atom->LogAtomError(error.category, error.errorMsg, error.level);
+    PROTECT_WRITE_OPERATION();
+
+    if (!IsFragmentedWrite()) {
+        throw new EXCEPTION("file is not being written as movie fragments");
     }
+
+    WriteChunk();
+
+    // the next chunk starts a fragment of its own
+    m_fragmentStarted = false;
+    m_fragmentWrittenDuration = 0;
 }
 
-void MP4File::BeginWrite()
+// Writes the samples buffered since the last chunk as one moof and mdat
+// pair; the first chunk of a fragment gets the sidx reference and the
+// random access points, the ones after it only add to its size. Only the
+// moof and the mdat header are gathered for a chunk callback, the sample
+// data is written from the chunk buffers of the tracks and handed to the
+// callback in them
+void MP4File::WriteChunk()
 {
-    m_pRootAtom->BeginWrite();
+    if (!m_initSegmentWritten) {
+        WriteInitSegment();
+    }
+
+    // tracks with nothing buffered sit this chunk out
+    vector<MP4Track*> tracks;
+    uint64_t dataSize = 0;
+    for (uint32_t i = 0; i < m_pTracks.Size(); i++) {
+        if (m_pTracks[i]->GetFragmentSampleCount() > 0) {
+            tracks.push_back(m_pTracks[i]);
+            dataSize += m_pTracks[i]->GetFragmentDataSize();
+        }
+    }
+    if (tracks.empty()) {
+        return;
+    }
+
+    MP4Track* pReferenceTrack = GetFragmentReferenceTrack();
+    MP4ChunkInfo info;
+    memset(&info, 0, sizeof(info));
+    info.isFragmentStart = !m_fragmentStarted;
+    info.trackId = pReferenceTrack->GetId();
+    info.startTime = pReferenceTrack->GetFragmentStartTime();
+    info.duration = pReferenceTrack->GetFragmentDuration();
+    info.fileOffset = BeginChunkBuffer();
+
+    MP4Atom* pMoofAtom = MP4Atom::CreateAtom(*this, NULL, "moof");
+    try {
+        pMoofAtom->Generate();
+
+        MP4Integer32Property* pSequenceNumber = NULL;
+        pMoofAtom->FindProperty("moof.mfhd.sequenceNumber",
+                                (MP4Property**)&pSequenceNumber);
+        ASSERT(pSequenceNumber);
+        info.sequenceNumber = ++m_fragmentSequenceNumber;
+        pSequenceNumber->SetValue(info.sequenceNumber);
+
+        vector<MP4Integer32Property*> dataOffsets;
+        for (size_t i = 0; i < tracks.size(); i++) {
+            dataOffsets.push_back(tracks[i]->GenerateTrackFragment(*pMoofAtom));
+        }
+
+        // the data offsets count from the start of the moof, so it is
+        // written once to learn its size and again with them filled in
+        uint64_t moofStart = GetPosition();
+        pMoofAtom->Write();
+        uint64_t dataOffset = GetPosition() - moofStart + 8;
+        if (dataOffset + dataSize > 0x7FFFFFFF) {
+            throw new EXCEPTION("movie fragment too large");
+        }
+        for (size_t i = 0; i < tracks.size(); i++) {
+            dataOffsets[i]->SetValue((uint32_t)dataOffset);
+            dataOffset += tracks[i]->GetFragmentDataSize();
+        }
+        SetPosition(moofStart);
+        pMoofAtom->Write();
+
+        // what the sidx and the tfras will need of the fragment
+        uint64_t size = GetPosition() - moofStart + 8 + dataSize;
+        if (m_fragmentStarted) {
+            m_segmentReferences.back().size += size;
+        } else {
+            AddSegmentReference(size, pReferenceTrack->GetFragmentPresentationTime(),
+                                pReferenceTrack->IsFragmentSyncStart());
+            for (size_t i = 0; i < tracks.size(); i++) {
+                tracks[i]->AddFragmentRandomAccessPoint(info.fileOffset, (uint32_t)i + 1);
+            }
+        }
+
+        WriteUInt32((uint32_t)(8 + dataSize));
+        WriteBytes((uint8_t*)"mdat", 4);
+    }
+    catch (...) {
+        delete pMoofAtom;
+        AbortChunkBuffer();
+        throw;
+    }
+    delete pMoofAtom;
+
+    // a written chunk buffer keeps its bytes until the next sample
+    EndChunkBuffer();
+    for (size_t i = 0; i < tracks.size(); i++) {
+        AddChunkPiece(tracks[i]->GetFragmentData(), tracks[i]->GetFragmentDataSize());
+        tracks[i]->WriteChunkBuffer();
+    }
+    SendChunk(info);
+
+    m_fragmentStarted = true;
+    m_fragmentWrittenDuration += info.duration;
 }
 
-void MP4File::FinishWrite(uint32_t options)
+void MP4File::RemoveEmptyUserData()
 {
     // remove empty moov.udta.meta.ilst
     if( MP4Atom* ilst = FindAtom( "moov.udta.meta.ilst" ) ) {
@@ -614,46 +1799,6 @@ void MP4File::FinishWrite(uint32_t options)
             delete udta;
         }
     }
-
-    // for all tracks, flush chunking buffers
-    for( uint32_t i = 0; i < m_pTracks.Size(); i++ ) {
-        ASSERT( m_pTracks[i] );
-        m_pTracks[i]->FinishWrite(options);
-    }
-
-    // ask root atom to write
-    m_pRootAtom->FinishWrite();
-
-    // check if we can move the moov atom to the front
-    MoveMoovAtomToFront();
-
-    // finished all writes, if position < size then the file has
-    // shrunk and we first mark the remaining bytes with a free
-    // atom, then attempt to truncate
-    uint64_t endPosition = GetPosition();
-    if( endPosition < GetSize() ) {
-        MP4RootAtom* root = (MP4RootAtom*)FindAtom( "" );
-        ASSERT( root );
-
-        // compute size of free atom; always has 8 bytes of overhead
-        uint64_t size = GetSize() - GetPosition();
-        if( size < 8 )
-            size = 0;
-        else
-            size -= 8;
-
-        MP4FreeAtom* freeAtom = (MP4FreeAtom*)MP4Atom::CreateAtom( *this, NULL, "free" );
-        ASSERT( freeAtom );
-        freeAtom->SetSize( size );
-        root->AddChildAtom( freeAtom );
-        freeAtom->Write();
-
-        // now attempt to truncate the file at the previous end position
-        // this is done after marking the area as free, because if truncate
-        // fails it may leave the file inaccessible, preventing us from
-        // inserting the free atom afterwards
-        m_file->truncate(endPosition);
-    }
 }
 
 void MP4File::MoveMoovAtomToFront()
@@ -732,6 +1877,7 @@ void MP4File::UpdateDuration(MP4Duration duration)
 
 void MP4File::Dump( bool dumpImplicits )
 {
+    IndexPendingFragments();
     log.dump(0, MP4_LOG_VERBOSE1, "\"%s\": Dumping meta-information...", m_file->name.c_str() );
     m_pRootAtom->Dump( 0, dumpImplicits);
 }
@@ -743,8 +1889,16 @@ void MP4File::Close(uint32_t options)
         FinishWrite(options);
     }
 
+    // workers may still be reading from the file
+    delete m_prefetcher;
+    m_prefetcher = NULL;
+    delete m_prefetchFile;
+    m_prefetchFile = NULL;
+
+    DiscardReadBuffer( false );
     delete m_file;
     m_file = NULL;
+    m_blockCache = NULL;
 }
 
 void MP4File::Rename(const char* oldFileName, const char* newFileName)
@@ -992,6 +2146,10 @@ void MP4File::SetIntegerProperty(const char* name, uint64_t value)
     FindIntegerProperty(name, &pProperty, &index);
 
     ((MP4IntegerProperty*)pProperty)->SetValue(value, index);
+
+    for (uint32_t i = 0; i < m_pTracks.Size(); i++) {
+        m_pTracks[i]->PropertyChanged(pProperty);
+    }
 }
 
 void MP4File::FindFloatProperty(const char* name,
@@ -1151,6 +2309,10 @@ MP4TrackId MP4File::AddTrack(const char* type, uint32_t timeScale)
 {
     PROTECT_WRITE_OPERATION();
 
+    if (m_initSegmentWritten) {
+        throw new EXCEPTION("tracks cannot be added once movie fragments are written");
+    }
+
     // create and add new trak atom
     MP4Atom* pTrakAtom = AddChildAtom("moov", "trak");
     ASSERT(pTrakAtom);
@@ -3240,6 +4402,43 @@ bool MP4File::GetSampleSync(MP4TrackId trackId, MP4SampleId sampleId)
     return m_pTracks[FindTrackIndex(trackId)]->IsSyncSample(sampleId);
 }
 
+MP4SampleId MP4File::GetNextSyncSample(MP4TrackId trackId, MP4SampleId sampleId)
+{
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    if (sampleId == MP4_INVALID_SAMPLE_ID || sampleId > pTrack->GetNumberOfSamples()) {
+        return MP4_INVALID_SAMPLE_ID;
+    }
+    return pTrack->GetNextSyncSample(sampleId);
+}
+
+MP4SampleId MP4File::GetPrevSyncSample(MP4TrackId trackId, MP4SampleId sampleId)
+{
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    if (sampleId == MP4_INVALID_SAMPLE_ID) {
+        return MP4_INVALID_SAMPLE_ID;
+    }
+    return pTrack->GetPrevSyncSample(min(sampleId, pTrack->GetNumberOfSamples()));
+}
+
+uint32_t MP4File::GetSyncSampleList(MP4TrackId trackId,
+                                    MP4SampleId* pSampleIds, uint32_t maxSampleIds)
+{
+    return m_pTracks[FindTrackIndex(trackId)]->
+           GetSyncSampleList(pSampleIds, pSampleIds ? maxSampleIds : 0);
+}
+
+MP4SampleId MP4File::GetSampleIdFromPresentationTime(MP4TrackId trackId, MP4Timestamp when)
+{
+    return m_pTracks[FindTrackIndex(trackId)]->GetSampleIdFromPresentationTime(when);
+}
+
+uint32_t MP4File::GetPresentationOrder(MP4TrackId trackId,
+                                       MP4SampleId* pSampleIds, uint32_t maxSampleIds)
+{
+    return m_pTracks[FindTrackIndex(trackId)]->
+           GetPresentationOrder(pSampleIds, pSampleIds ? maxSampleIds : 0);
+}
+
 const char* MP4File::GetSampleFileURL(MP4TrackId trackId, MP4SampleId sampleId)
 {
     return m_pTracks[FindTrackIndex(trackId)]->GetSampleFileURL(sampleId);
@@ -3255,7 +4454,8 @@ void MP4File::ReadSample(
     MP4Duration*  pRenderingOffset,
     bool*         pIsSyncSample,
     bool*         hasDependencyFlags,
-    uint32_t*     dependencyFlags )
+    uint32_t*     dependencyFlags,
+    bool*         pIsMapped )
 {
     m_pTracks[FindTrackIndex(trackId)]->ReadSample(
         sampleId,
@@ -3266,7 +4466,156 @@ void MP4File::ReadSample(
         pRenderingOffset,
         pIsSyncSample,
         hasDependencyFlags,
-        dependencyFlags );
+        dependencyFlags,
+        pIsMapped );
+}
+
+void MP4File::ReadSampleFromTime(
+    MP4TrackId    trackId,
+    MP4Timestamp  when,
+    uint8_t**     ppBytes,
+    uint32_t*     pNumBytes,
+    MP4Timestamp* pStartTime,
+    MP4Duration*  pDuration,
+    MP4Duration*  pRenderingOffset,
+    bool*         pIsSyncSample )
+{
+    // samples of fragments left on disk are found by time alone
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    if( pTrack->ReadPendingFragmentSample( when, ppBytes, pNumBytes, pStartTime,
+                                           pDuration, pRenderingOffset, pIsSyncSample ))
+        return;
+
+    ReadSample(
+        trackId,
+        GetSampleIdFromTime( trackId, when, false ),
+        ppBytes,
+        pNumBytes,
+        pStartTime,
+        pDuration,
+        pRenderingOffset,
+        pIsSyncSample );
+}
+
+void MP4File::ReadSampleView(
+    MP4TrackId     trackId,
+    MP4SampleId    sampleId,
+    MP4SampleView& view )
+{
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    memset( &view, 0, sizeof(view) );
+
+    if( sampleId == MP4_INVALID_SAMPLE_ID || sampleId > pTrack->GetNumberOfSamples() )
+        throw new EXCEPTION("invalid sample id");
+
+    uint32_t sampleSize = pTrack->GetSampleSize( sampleId );
+
+    // a mapped sample needs no backing buffer at all
+    uint8_t* pBytes = NULL;
+    uint32_t numBytes = 0;
+    bool isMapped = false;
+
+    SampleViewBuffer* buffer = NULL;
+    if( !m_file->mapping( 0, 0 )) {
+        buffer = AcquireSampleViewBuffer();
+        if( buffer->size < sampleSize ) {
+            TrackBufferMemory( (int64_t)sampleSize - buffer->size );
+            buffer->data = (uint8_t*)MP4Realloc( buffer->data, sampleSize );
+            buffer->size = sampleSize;
+        }
+
+        pBytes = buffer->data;
+        numBytes = buffer->size;
+    }
+
+    try {
+        pTrack->ReadSample(
+            sampleId,
+            &pBytes,
+            &numBytes,
+            &view.startTime,
+            &view.duration,
+            &view.renderingOffset,
+            &view.isSyncSample,
+            &view.hasDependencyFlags,
+            &view.dependencyFlags,
+            buffer ? NULL : &isMapped );
+    }
+    catch( ... ) {
+        if( buffer )
+            RecycleSampleViewBuffer( buffer );
+        memset( &view, 0, sizeof(view) );
+        throw;
+    }
+
+    // samples kept in an unmapped external file come back malloc'd,
+    // adopt that memory into the pool so release works the same way
+    if( !buffer && !isMapped && pBytes ) {
+        buffer = AcquireSampleViewBuffer();
+        TrackBufferMemory( (int64_t)numBytes - buffer->size );
+        MP4Free( buffer->data );
+        buffer->data = pBytes;
+        buffer->size = numBytes;
+    }
+
+    if( numBytes != sampleSize ) {
+        if( buffer )
+            RecycleSampleViewBuffer( buffer );
+        memset( &view, 0, sizeof(view) );
+        throw new EXCEPTION("sample could not be read");
+    }
+
+    view.bytes = pBytes;
+    view.numBytes = numBytes;
+    view.reserved = buffer;
+}
+
+uint32_t MP4File::ReadSamples(
+    MP4TrackId     trackId,
+    MP4SampleId    firstSampleId,
+    uint32_t       numSamples,
+    uint8_t*       pBytes,
+    uint32_t       numBytes,
+    MP4SampleInfo* pSampleInfo )
+{
+    return m_pTracks[FindTrackIndex(trackId)]->ReadSamples(
+        firstSampleId,
+        numSamples,
+        pBytes,
+        numBytes,
+        pSampleInfo );
+}
+
+MP4File::SampleViewBuffer* MP4File::AcquireSampleViewBuffer()
+{
+    std::lock_guard<std::mutex> lock( m_sampleViewMutex );
+
+    if( !m_freeSampleViewBuffers.empty() ) {
+        SampleViewBuffer* buffer = m_freeSampleViewBuffers.back();
+        m_freeSampleViewBuffers.pop_back();
+        return buffer;
+    }
+
+    SampleViewBuffer* buffer = new SampleViewBuffer;
+    buffer->data = NULL;
+    buffer->size = 0;
+    m_sampleViewBuffers.push_back( buffer );
+    return buffer;
+}
+
+void MP4File::RecycleSampleViewBuffer( SampleViewBuffer* buffer )
+{
+    std::lock_guard<std::mutex> lock( m_sampleViewMutex );
+    m_freeSampleViewBuffers.push_back( buffer );
+}
+
+void MP4File::ReleaseSampleView( MP4SampleView& view )
+{
+    SampleViewBuffer* buffer = (SampleViewBuffer*)view.reserved;
+    if( buffer )
+        RecycleSampleViewBuffer( buffer );
+
+    memset( &view, 0, sizeof(view) );
 }
 
 void MP4File::WriteSample(
@@ -3278,8 +4627,15 @@ void MP4File::WriteSample(
     bool           isSyncSample )
 {
     PROTECT_WRITE_OPERATION();
-    m_pTracks[FindTrackIndex(trackId)]->WriteSample(
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    if (IsFragmentedWrite()) {
+        StartFragmentAt(pTrack, isSyncSample);
+    }
+    pTrack->WriteSample(
         pBytes, numBytes, duration, renderingOffset, isSyncSample );
+    if (IsFragmentedWrite()) {
+        EndChunkAt(pTrack);
+    }
     m_pModificationProperty->SetValue( MP4GetAbsTimestamp() );
 }
 
@@ -3293,8 +4649,15 @@ void MP4File::WriteSampleDependency(
     uint32_t       dependencyFlags )
 {
     PROTECT_WRITE_OPERATION();
-    m_pTracks[FindTrackIndex(trackId)]->WriteSampleDependency(
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    if (IsFragmentedWrite()) {
+        StartFragmentAt(pTrack, isSyncSample);
+    }
+    pTrack->WriteSampleDependency(
         pBytes, numBytes, duration, renderingOffset, isSyncSample, dependencyFlags );
+    if (IsFragmentedWrite()) {
+        EndChunkAt(pTrack);
+    }
     m_pModificationProperty->SetValue( MP4GetAbsTimestamp() );
 }
 
@@ -3748,7 +5111,8 @@ void MP4File::SetTrackTimeScale(MP4TrackId trackId, uint32_t value)
 
 MP4Duration MP4File::GetTrackDuration(MP4TrackId trackId)
 {
-    return GetTrackIntegerProperty(trackId, "mdia.mdhd.duration");
+    // includes any movie fragments
+    return m_pTracks[FindTrackIndex(trackId)]->GetDuration();
 }
 
 uint8_t MP4File::GetTrackEsdsObjectTypeId(MP4TrackId trackId)
@@ -4516,6 +5880,60 @@ void MP4File::SetTrackDurationPerChunk( MP4TrackId trackId, MP4Duration duration
     m_pTracks[FindTrackIndex(trackId)]->SetDurationPerChunk( duration );
 }
 
+void MP4File::SetTrackAccessPattern( MP4TrackId trackId, MP4TrackAccessPattern pattern )
+{
+    switch( pattern ) {
+        case MP4_ACCESS_RANDOM:
+        case MP4_ACCESS_SEQUENTIAL:
+        case MP4_ACCESS_KEYFRAMES_ONLY:
+            break;
+
+        default:
+            throw new EXCEPTION("invalid access pattern");
+    }
+
+    MP4Track* pTrack = m_pTracks[FindTrackIndex(trackId)];
+    pTrack->SetAccessPattern( pattern );
+
+    if( pattern == MP4_ACCESS_RANDOM ) {
+        if( m_prefetcher )
+            m_prefetcher->Forget( trackId );
+        return;
+    }
+
+    // prefetching is only worth it for files read through system calls;
+    // a mapping is served by the page cache, writers change the layout
+    if( m_prefetcher || m_file->mode != File::MODE_READ || m_file->mapping( 0, 0 ))
+        return;
+
+    File* file = m_file;
+    if( !file->isPositionless() ) {
+        // workers need a handle of their own to read alongside the caller
+        if( !m_fileIsStandard )
+            return;
+
+        m_prefetchFile = new File( m_file->name, File::MODE_READ, &io::FileProvider::positionless() );
+        if( m_prefetchFile->open() || !m_prefetchFile->isPositionless() ) {
+            delete m_prefetchFile;
+            m_prefetchFile = NULL;
+            return;
+        }
+        file = m_prefetchFile;
+    }
+
+    m_prefetcher = new MP4Prefetcher( *file );
+}
+
+MP4Prefetcher* MP4File::GetPrefetcher()
+{
+    return m_prefetcher;
+}
+
+void MP4File::SetTrackSampleOffsetIndex( MP4TrackId trackId, uint32_t interval )
+{
+    m_pTracks[FindTrackIndex(trackId)]->SetSampleOffsetIndexInterval( interval );
+}
+
 void MP4File::CopySample(
     MP4File*    srcFile,
     MP4TrackId  srcTrackId,
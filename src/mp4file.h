@@ -44,6 +44,7 @@ class MP4StringProperty;
 class MP4BytesProperty;
 class MP4Descriptor;
 class MP4DescriptorProperty;
+class MP4Prefetcher;
 
 class MP4File
 {
@@ -79,7 +80,8 @@ public:
     void Read( const char*            fileName,
                const MP4FileProvider* provider,
                const MP4IOCallbacks*  callbacks,
-               void*                  handle );
+               void*                  handle,
+               uint32_t               flags = 0 );
 
     void Create( const char*           fileName,
                  const MP4IOCallbacks* callbacks,
@@ -97,6 +99,14 @@ public:
                  void*                 handle );
 
     void Optimize( const char* srcFileName, const char* dstFileName = NULL );
+
+    // init and media segments written to files of their own, with the
+    // moov of srcFileName as the template, see MP4Segmenter
+    void ReadSegmentTemplate( const char* srcFileName );
+    void WriteInitSegment( const char* fileName );
+    void BeginMediaSegment( const char* fileName, uint32_t sequenceNumber );
+    void EndMediaSegment();
+
     bool CopyClose( const string& copyFileName );
     void Dump( bool dumpImplicits = false );
     void Close(uint32_t flags = 0);
@@ -239,6 +249,21 @@ public:
     bool GetSampleSync(
         MP4TrackId trackId, MP4SampleId sampleId);
 
+    MP4SampleId GetNextSyncSample(
+        MP4TrackId trackId, MP4SampleId sampleId);
+
+    MP4SampleId GetPrevSyncSample(
+        MP4TrackId trackId, MP4SampleId sampleId);
+
+    uint32_t GetSyncSampleList(
+        MP4TrackId trackId, MP4SampleId* pSampleIds, uint32_t maxSampleIds);
+
+    MP4SampleId GetSampleIdFromPresentationTime(
+        MP4TrackId trackId, MP4Timestamp when);
+
+    uint32_t GetPresentationOrder(
+        MP4TrackId trackId, MP4SampleId* pSampleIds, uint32_t maxSampleIds);
+
     const char* GetSampleFileURL(MP4TrackId trackId, MP4SampleId sampleId);
 
     void ReadSample(
@@ -253,7 +278,35 @@ public:
         MP4Duration*  pRenderingOffset = NULL,
         bool*         pIsSyncSample = NULL,
         bool*         hasDependencyFlags = NULL,
-        uint32_t*     dependencyFlags = NULL );
+        uint32_t*     dependencyFlags = NULL,
+        bool*         pIsMapped = NULL );
+
+    void ReadSampleFromTime(
+        // input parameters
+        MP4TrackId trackId,
+        MP4Timestamp when,
+        // output parameters
+        uint8_t**     ppBytes,
+        uint32_t*     pNumBytes,
+        MP4Timestamp* pStartTime = NULL,
+        MP4Duration*  pDuration = NULL,
+        MP4Duration*  pRenderingOffset = NULL,
+        bool*         pIsSyncSample = NULL );
+
+    void ReadSampleView(
+        MP4TrackId     trackId,
+        MP4SampleId    sampleId,
+        MP4SampleView& view );
+
+    void ReleaseSampleView( MP4SampleView& view );
+
+    uint32_t ReadSamples(
+        MP4TrackId     trackId,
+        MP4SampleId    firstSampleId,
+        uint32_t       numSamples,
+        uint8_t*       pBytes,
+        uint32_t       numBytes,
+        MP4SampleInfo* pSampleInfo );
 
     void WriteSample(
         MP4TrackId     trackId,
@@ -272,6 +325,16 @@ public:
         bool           isSyncSample,
         uint32_t       dependencyFlags );
 
+    // movie fragment writing, see MP4_CREATE_FRAGMENTED
+    bool IsFragmentedWrite() {
+        return (m_createFlags & MP4_CREATE_FRAGMENTED) != 0;
+    }
+    void SetFragmentDuration( MP4Duration duration );
+    void SetChunkDuration( MP4Duration duration );
+    void SetChunkCallback( MP4ChunkCallback callback, void* userData );
+    void WriteFragment();
+    MP4Track* GetFragmentReferenceTrack();
+
     void SetSampleRenderingOffset(
         MP4TrackId  trackId,
         MP4SampleId sampleId,
@@ -280,6 +343,10 @@ public:
     MP4Duration GetTrackDurationPerChunk( MP4TrackId );
     void        SetTrackDurationPerChunk( MP4TrackId, MP4Duration );
 
+    void SetTrackAccessPattern( MP4TrackId, MP4TrackAccessPattern );
+    void SetTrackSampleOffsetIndex( MP4TrackId, uint32_t interval );
+    MP4Prefetcher* GetPrefetcher();
+
     /* track level convenience functions */
 
     MP4TrackId AddSystemsTrack(const char* type, uint32_t timeScale = 1000 );
@@ -815,6 +882,9 @@ public:
 
     void ReadBytes( uint8_t* buf, uint32_t bufsiz, File* file = NULL );
     void PeekBytes( uint8_t* buf, uint32_t bufsiz, File* file = NULL );
+    void ReadBytesAt( uint64_t pos, uint8_t* buf, uint32_t bufsiz, File* file = NULL );
+    const uint8_t* GetMappedBytes( uint64_t pos, uint32_t bufsiz, File* file = NULL );
+    void ReadBytesAside( uint64_t pos, uint8_t* buf, uint32_t bufsiz );
 
     uint8_t ReadUInt8();
     uint16_t ReadUInt16();
@@ -865,8 +935,55 @@ public:
     void DisableMemoryBuffer(
         uint8_t** ppBytes = NULL, uint64_t* pNumBytes = NULL);
 
+    uint32_t GetReadBufferSize();
+    void SetReadBufferSize( uint32_t size );
+
+    static uint32_t GetDefaultReadBufferSize();
+    static void SetDefaultReadBufferSize( uint32_t size );
+
+    static void SetDefaultBlockCache( uint32_t blockSize, uint64_t capacity );
+    bool GetBlockCacheStats( MP4BlockCacheStats* stats );
+
+    void GetIOStats( MP4IOStats& stats );
+    void SetIOTraceCallback( MP4IOTraceCallback callback, void* userData );
+    static void SetDefaultIOTraceCallback( MP4IOTraceCallback callback, void* userData );
+
+    // account for memory held by I/O and sample buffers
+    void TrackBufferMemory( int64_t delta );
+
     bool IsWriteMode();
 
+    // true if sample table bodies are skipped on open and read on first use
+    bool DefersAtomBodies() {
+        return m_deferAtomBodies;
+    }
+    std::recursive_mutex& GetDeferredAtomMutex() {
+        return m_deferredAtomMutex;
+    }
+    void ReadDeferredAtom( MP4Atom& atom );
+
+    // with MP4_READ_LAZY the moofs of a file with a sidx or mfra are left
+    // on disk on open; they are read one at a time to find a sample by
+    // time, and all of them once samples are asked for by number
+    bool DefersMovieFragments();
+    bool HasPendingFragments() {
+        return m_hasPendingFragments.load(std::memory_order_acquire);
+    }
+    void IndexPendingFragments();
+    MP4Atom* ReadPendingFragment( uint64_t offset );
+    uint64_t GetNextPendingFragment( MP4Atom& moofAtom );
+    bool IndexPendingFragment( MP4Atom& moofAtom, MP4TrackId trackId, MP4FragmentIndex& index );
+
+    // true if large sample tables are left on disk and decoded per entry
+    bool PagesSampleTables() {
+        return m_pageSampleTables;
+    }
+
+    // true if decoded sample size and chunk offset tables are bit-packed
+    bool PacksSampleTables() {
+        return m_packSampleTables;
+    }
+
     MP4Track* GetTrack(MP4TrackId trackId);
 
     void UpdateDuration(MP4Duration duration);
@@ -915,12 +1032,42 @@ protected:
                File::Mode             mode,
                const MP4FileProvider* provider = NULL,
                const MP4IOCallbacks*  callbacks = NULL,
-               void*                  handle = NULL );
+               void*                  handle = NULL,
+               uint32_t               flags = 0 );
 
     void ReadFromFile();
     void GenerateTracks();
+    void IndexFragments();
+    void IndexMovieFragment( MP4Atom& moofAtom );
+    uint64_t FindRandomAccessIndex();
+    void IndexRandomAccessPoints();
+
+    // timed provider operations feeding m_ioStats
+    bool ProviderRead( File* file, void* buf, File::Size size, File::Size& nin );
+    bool ProviderReadAt( File* file, uint64_t pos, void* buf, File::Size size, File::Size& nin );
+    bool ProviderWrite( File* file, const void* buf, File::Size size, File::Size& nout );
+    bool ProviderSeek( File* file, uint64_t pos );
+    void RecordProviderIO( MP4IOOp op, int64_t offset, int64_t size, uint64_t start );
+    void ResetIOStats();
+
+    bool UseReadBuffer( File* file );
+    void ReadBufferedBytes( uint8_t* buf, uint32_t bufsiz, File* file );
+    void DiscardReadBuffer( bool restorePosition = true );
     void BeginWrite();
     void FinishWrite(uint32_t options);
+    void RemoveEmptyUserData();
+    void WriteInitSegment();
+    void AddSegmentReference(uint64_t size, MP4Timestamp presentationTime, bool startsWithSap);
+    void WriteSegmentIndex();
+    void WriteRandomAccessIndex();
+    void StartFragmentAt( MP4Track* pTrack, bool isSyncSample );
+    void EndChunkAt( MP4Track* pTrack );
+    void WriteChunk();
+    uint64_t BeginChunkBuffer();
+    void EndChunkBuffer();
+    void AddChunkPiece( const uint8_t* pBytes, uint64_t numBytes );
+    void SendChunk( MP4ChunkInfo& info );
+    void AbortChunkBuffer();
     void CacheProperties();
     void RewriteMdat( File& src, File& dst );
     bool ShallHaveIods();
@@ -1025,6 +1172,75 @@ protected:
     uint64_t m_fileOriginalSize;
     uint32_t m_createFlags;
 
+    // movie fragment writing; m_fragmentDuration is in the movie
+    // timescale, MP4_INVALID_DURATION for the default
+    MP4Duration m_fragmentDuration;
+    uint32_t    m_fragmentSequenceNumber;
+    bool        m_initSegmentWritten;
+
+    // each fragment goes out as chunks of at least m_chunkDuration (movie
+    // timescale, MP4_INVALID_DURATION for one chunk); m_fragmentStarted
+    // once the first chunk of the current fragment is written and
+    // m_fragmentWrittenDuration is what its chunks hold of the reference
+    // track, in the timescale of that track
+    MP4Duration      m_chunkDuration;
+    bool             m_fragmentStarted;
+    MP4Duration      m_fragmentWrittenDuration;
+
+    // with a chunk callback the atoms of each chunk are gathered in
+    // m_pChunkBuffer, which is kept from one chunk to the next, and the
+    // callback gets them and the sample data as m_chunkPieces
+    MP4ChunkCallback      m_chunkCallback;
+    void*                 m_chunkCallbackUserData;
+    uint8_t*              m_pChunkBuffer;
+    uint64_t              m_chunkBufferSize;
+    vector<MP4ChunkPiece> m_chunkPieces;
+
+    // a sidx for the fragments goes in the free atom reserved at
+    // m_segmentIndexPosition once they are all written; one reference
+    // per run of m_fragmentsPerReference fragments, in the timescale of
+    // the reference track, see AddSegmentReference()
+    struct SegmentReference {
+        uint64_t     size;
+        MP4Timestamp presentationTime;
+        bool         startsWithSap;
+    };
+    uint64_t                 m_segmentIndexPosition;
+    vector<SegmentReference> m_segmentReferences;
+    uint32_t                 m_fragmentsPerReference;
+    uint32_t                 m_lastReferenceFragments;  // in the last one
+
+    // set by ReadSegmentTemplate(): the init segment leaves no room for
+    // a sidx and each media segment is a single fragment
+    bool                     m_separateSegments;
+
+    // root atoms in [m_pendingFragmentsStart, m_pendingFragmentsEnd)
+    // not yet read, and the moofs among them read on their own by offset
+    bool                     m_deferMovieFragments;
+    std::atomic<bool>        m_hasPendingFragments;
+    bool                     m_indexingPendingFragments;
+    uint64_t                 m_pendingFragmentsStart;
+    uint64_t                 m_pendingFragmentsEnd;
+    map<uint64_t, MP4Atom*>  m_pendingFragments;
+
+    bool                 m_deferAtomBodies;
+    bool                 m_pageSampleTables;
+    bool                 m_packSampleTables;
+    std::recursive_mutex m_deferredAtomMutex;
+
+    // see MP4File::SuspendIO()
+    struct SuspendedIO {
+        uint8_t* memoryBuffer;
+        uint64_t memoryBufferSize;
+        uint64_t memoryBufferPosition;
+        uint8_t  numReadBits;
+        uint8_t  bufReadBits;
+        uint64_t position;
+    };
+
+    void SuspendIO( SuspendedIO& io );
+    void ResumeIO( SuspendedIO& io, Exception* failure );
+
     MP4Atom*          m_pRootAtom;
     MP4Integer32Array m_trakIds;
     MP4TrackArray     m_pTracks;
@@ -1041,6 +1257,62 @@ protected:
     uint64_t    m_memoryBufferPosition;
     uint64_t    m_memoryBufferSize;
 
+    // read-ahead window over m_readBufferFile
+    static uint32_t s_defaultReadBufferSize;
+    uint8_t*    m_readBuffer;
+    uint32_t    m_readBufferSize;
+    uint32_t    m_readBufferAhead;
+    File*       m_readBufferFile;
+    uint64_t    m_readBufferOffset;
+    uint32_t    m_readBufferFill;
+    uint32_t    m_readBufferPosition;
+    bool        m_readBufferParsing;
+
+    // background loading for tracks with a non-random access pattern;
+    // m_prefetchFile is a private positionless handle if m_file isn't one
+    MP4Prefetcher* m_prefetcher;
+    File*          m_prefetchFile;
+    bool           m_fileIsStandard;
+
+    // block cache in front of custom providers and I/O callbacks;
+    // owned by m_file
+    static uint32_t          s_blockCacheBlockSize;
+    static uint64_t          s_blockCacheCapacity;
+    io::CachedFileProvider*  m_blockCache;
+
+    // I/O accounting; provider operations and buffer memory may be
+    // recorded from concurrent readers, hence the atomics
+    struct IOCounters {
+        std::atomic<uint64_t> readCalls;
+        std::atomic<uint64_t> readBytes;
+        std::atomic<uint64_t> writeCalls;
+        std::atomic<uint64_t> writeBytes;
+        std::atomic<uint64_t> seekCalls;
+        std::atomic<uint64_t> calls[3];   // indexed by MP4IOOp
+        std::atomic<uint64_t> bytes[3];
+        std::atomic<uint64_t> time[3];
+        std::atomic<uint64_t> latency[3][MP4_IO_LATENCY_BUCKETS];
+        std::atomic<int64_t>  bufferBytes;
+        std::atomic<int64_t>  peakBufferBytes;
+    };
+    static MP4IOTraceCallback s_ioTraceCallback;
+    static void*              s_ioTraceUserData;
+    IOCounters                m_ioStats;
+    MP4IOTraceCallback        m_ioTraceCallback;
+    void*                     m_ioTraceUserData;
+
+    // pinned buffers backing sample views of unmapped files
+    struct SampleViewBuffer {
+        uint8_t* data;
+        uint32_t size;
+    };
+    vector<SampleViewBuffer*> m_sampleViewBuffers;
+    vector<SampleViewBuffer*> m_freeSampleViewBuffers;
+    std::mutex                m_sampleViewMutex;
+
+    SampleViewBuffer* AcquireSampleViewBuffer();
+    void RecycleSampleViewBuffer( SampleViewBuffer* buffer );
+
     // bit read/write buffering
     uint8_t m_numReadBits;
     uint8_t m_bufReadBits;
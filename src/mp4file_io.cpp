@@ -28,6 +28,24 @@ namespace impl {
 
 // MP4File low level IO support
 
+uint32_t MP4File::s_defaultReadBufferSize = 64 * 1024;
+uint32_t MP4File::s_blockCacheBlockSize = 0;
+uint64_t MP4File::s_blockCacheCapacity = 0;
+MP4IOTraceCallback MP4File::s_ioTraceCallback = NULL;
+void* MP4File::s_ioTraceUserData = NULL;
+
+// a fresh window reads this much ahead and doubles on every sequential
+// refill up to the buffer size
+static const uint32_t s_minReadAhead = 4 * 1024;
+
+static uint32_t clampReadBufferSize( uint32_t size )
+{
+    // 0 disables read-ahead, anything else is kept to a sane window
+    if( size == 0 )
+        return 0;
+    return max( min( size, (uint32_t)(4 * 1024 * 1024) ), (uint32_t)(64 * 1024) );
+}
+
 uint64_t MP4File::GetPosition( File* file )
 {
     if( m_memoryBuffer )
@@ -37,6 +55,9 @@ uint64_t MP4File::GetPosition( File* file )
         file = m_file;
 
     ASSERT( file );
+    if( file == m_readBufferFile )
+        return m_readBufferOffset + m_readBufferPosition;
+
     return file->position;
 }
 
@@ -52,8 +73,19 @@ void MP4File::SetPosition( uint64_t pos, File* file )
     if( !file )
         file = m_file;
 
+    m_ioStats.seekCalls.fetch_add( 1, std::memory_order_relaxed );
+
     ASSERT( file );
-    if( file->seek( pos ))
+    if( file == m_readBufferFile ) {
+        // seeks within the read-ahead window never reach the provider
+        if( pos >= m_readBufferOffset && pos <= m_readBufferOffset + m_readBufferFill ) {
+            m_readBufferPosition = (uint32_t)(pos - m_readBufferOffset);
+            return;
+        }
+        m_readBufferFile = NULL;
+    }
+
+    if( ProviderSeek( file, pos ))
         throw new PLATFORM_EXCEPTION("seek failed", sys::getLastError());
 }
 
@@ -90,9 +122,17 @@ void MP4File::ReadBytes( uint8_t* buf, uint32_t bufsiz, File* file )
     if( !file )
         file = m_file;
 
+    m_ioStats.readCalls.fetch_add( 1, std::memory_order_relaxed );
+    m_ioStats.readBytes.fetch_add( bufsiz, std::memory_order_relaxed );
+
     ASSERT( file );
+    if( UseReadBuffer( file )) {
+        ReadBufferedBytes( buf, bufsiz, file );
+        return;
+    }
+
     File::Size nin;
-    if( file->read( buf, bufsiz, nin ))
+    if( ProviderRead( file, buf, bufsiz, nin ))
         throw new PLATFORM_EXCEPTION("read failed", sys::getLastError());
     if( nin != bufsiz )
         throw new EXCEPTION("not enough bytes, reached end-of-file");
@@ -105,6 +145,410 @@ void MP4File::PeekBytes( uint8_t* buf, uint32_t bufsiz, File* file )
     SetPosition( pos, file );
 }
 
+void MP4File::ReadBytesAt( uint64_t pos, uint8_t* buf, uint32_t bufsiz, File* file )
+{
+    if( !file )
+        file = m_file;
+
+    ASSERT( file );
+    if( m_memoryBuffer || !file->isPositionless() ) {
+        SetPosition( pos, file );
+        ReadBytes( buf, bufsiz, file );
+        return;
+    }
+
+    m_ioStats.readCalls.fetch_add( 1, std::memory_order_relaxed );
+    m_ioStats.readBytes.fetch_add( bufsiz, std::memory_order_relaxed );
+
+    // positionless providers bypass the read-ahead window, which is
+    // shared state and must not be touched from concurrent readers
+    File::Size nin;
+    if( ProviderReadAt( file, pos, buf, bufsiz, nin ))
+        throw new PLATFORM_EXCEPTION("read failed", sys::getLastError());
+    if( nin != bufsiz )
+        throw new EXCEPTION("not enough bytes, reached end-of-file");
+}
+
+const uint8_t* MP4File::GetMappedBytes( uint64_t pos, uint32_t bufsiz, File* file )
+{
+    if( m_memoryBuffer )
+        return NULL;
+
+    if( !file )
+        file = m_file;
+
+    ASSERT( file );
+    return file->mapping( pos, bufsiz );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// MP4File provider accounting
+//
+// Every operation that reaches the provider goes through one of these so
+// that it is counted, timed and traced.
+
+static uint64_t ioClock()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+bool MP4File::ProviderRead( File* file, void* buf, File::Size size, File::Size& nin )
+{
+    const int64_t pos = file->position;
+    const uint64_t start = ioClock();
+    nin = 0;
+    const bool failed = file->read( buf, size, nin );
+    RecordProviderIO( MP4_IO_OP_READ, pos, nin, start );
+    return failed;
+}
+
+bool MP4File::ProviderReadAt( File* file, uint64_t pos, void* buf, File::Size size, File::Size& nin )
+{
+    const uint64_t start = ioClock();
+    nin = 0;
+    const bool failed = file->readAt( pos, buf, size, nin );
+    RecordProviderIO( MP4_IO_OP_READ, pos, nin, start );
+    return failed;
+}
+
+bool MP4File::ProviderWrite( File* file, const void* buf, File::Size size, File::Size& nout )
+{
+    const int64_t pos = file->position;
+    const uint64_t start = ioClock();
+    nout = 0;
+    const bool failed = file->write( buf, size, nout );
+    RecordProviderIO( MP4_IO_OP_WRITE, pos, nout, start );
+    return failed;
+}
+
+bool MP4File::ProviderSeek( File* file, uint64_t pos )
+{
+    const uint64_t start = ioClock();
+    const bool failed = file->seek( pos );
+    RecordProviderIO( MP4_IO_OP_SEEK, pos, 0, start );
+    return failed;
+}
+
+void MP4File::RecordProviderIO( MP4IOOp op, int64_t offset, int64_t size, uint64_t start )
+{
+    const uint64_t duration = ioClock() - start;
+    const uint32_t bucket = MP4IOLatencyBucket( duration );
+
+    m_ioStats.calls[op].fetch_add( 1, std::memory_order_relaxed );
+    m_ioStats.bytes[op].fetch_add( size, std::memory_order_relaxed );
+    m_ioStats.time[op].fetch_add( duration, std::memory_order_relaxed );
+    m_ioStats.latency[op][bucket].fetch_add( 1, std::memory_order_relaxed );
+
+    if( m_ioTraceCallback )
+        m_ioTraceCallback( m_ioTraceUserData, op, offset, size, duration );
+}
+
+void MP4File::TrackBufferMemory( int64_t delta )
+{
+    const int64_t now = m_ioStats.bufferBytes.fetch_add( delta, std::memory_order_relaxed ) + delta;
+
+    int64_t peak = m_ioStats.peakBufferBytes.load( std::memory_order_relaxed );
+    while( now > peak && !m_ioStats.peakBufferBytes.compare_exchange_weak( peak, now, std::memory_order_relaxed ))
+        ;
+}
+
+void MP4File::ResetIOStats()
+{
+    m_ioStats.readCalls = 0;
+    m_ioStats.readBytes = 0;
+    m_ioStats.writeCalls = 0;
+    m_ioStats.writeBytes = 0;
+    m_ioStats.seekCalls = 0;
+    for( uint32_t op = 0; op < 3; op++ ) {
+        m_ioStats.calls[op] = 0;
+        m_ioStats.bytes[op] = 0;
+        m_ioStats.time[op] = 0;
+        for( uint32_t i = 0; i < MP4_IO_LATENCY_BUCKETS; i++ )
+            m_ioStats.latency[op][i] = 0;
+    }
+    m_ioStats.bufferBytes = 0;
+    m_ioStats.peakBufferBytes = 0;
+}
+
+void MP4File::GetIOStats( MP4IOStats& stats )
+{
+    stats.readCalls          = m_ioStats.readCalls;
+    stats.readBytes          = m_ioStats.readBytes;
+    stats.writeCalls         = m_ioStats.writeCalls;
+    stats.writeBytes         = m_ioStats.writeBytes;
+    stats.seekCalls          = m_ioStats.seekCalls;
+    stats.providerReads      = m_ioStats.calls[MP4_IO_OP_READ];
+    stats.providerReadBytes  = m_ioStats.bytes[MP4_IO_OP_READ];
+    stats.providerWrites     = m_ioStats.calls[MP4_IO_OP_WRITE];
+    stats.providerWriteBytes = m_ioStats.bytes[MP4_IO_OP_WRITE];
+    stats.providerSeeks      = m_ioStats.calls[MP4_IO_OP_SEEK];
+    stats.readTime           = m_ioStats.time[MP4_IO_OP_READ];
+    stats.writeTime          = m_ioStats.time[MP4_IO_OP_WRITE];
+    stats.seekTime           = m_ioStats.time[MP4_IO_OP_SEEK];
+
+    for( uint32_t i = 0; i < MP4_IO_LATENCY_BUCKETS; i++ ) {
+        stats.readLatency[i]  = m_ioStats.latency[MP4_IO_OP_READ][i];
+        stats.writeLatency[i] = m_ioStats.latency[MP4_IO_OP_WRITE][i];
+        stats.seekLatency[i]  = m_ioStats.latency[MP4_IO_OP_SEEK][i];
+    }
+
+    stats.peakBufferBytes = (uint64_t)max( m_ioStats.peakBufferBytes.load(), (int64_t)0 );
+}
+
+void MP4File::SetIOTraceCallback( MP4IOTraceCallback callback, void* userData )
+{
+    m_ioTraceCallback = callback;
+    m_ioTraceUserData = userData;
+}
+
+void MP4File::SetDefaultIOTraceCallback( MP4IOTraceCallback callback, void* userData )
+{
+    s_ioTraceCallback = callback;
+    s_ioTraceUserData = userData;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// MP4File read-ahead buffering
+//
+// Atom parsing decodes most properties a few bytes at a time, so without
+// buffering every table entry costs a provider read. While a window is
+// active the provider position sits at the end of the window and the
+// logical position is tracked here; the provider is only touched again
+// when a read or seek leaves the window.
+
+bool MP4File::UseReadBuffer( File* file )
+{
+    if( m_readBufferSize == 0 )
+        return false;
+
+    // a mapped file is already in memory, copying it twice gains nothing
+    if( file->mapping( 0, 0 ))
+        return false;
+
+    // in write modes data may change underneath us, so only buffer
+    // while the atom tree is being read
+    return file->mode == File::MODE_READ || m_readBufferParsing;
+}
+
+void MP4File::ReadBufferedBytes( uint8_t* buf, uint32_t bufsiz, File* file )
+{
+    if( file != m_readBufferFile ) {
+        DiscardReadBuffer();
+
+        if( !m_readBuffer ) {
+            m_readBuffer = (uint8_t*)MP4Malloc( m_readBufferSize );
+            TrackBufferMemory( m_readBufferSize );
+        }
+
+        m_readBufferFile     = file;
+        m_readBufferOffset   = file->position;
+        m_readBufferFill     = 0;
+        m_readBufferPosition = 0;
+
+        // windows are usually opened by a seek; start small so jumping
+        // between interleaved tracks doesn't pull in a full window each
+        m_readBufferAhead = min( s_minReadAhead, m_readBufferSize );
+    }
+
+    for( ;; ) {
+        uint32_t avail = m_readBufferFill - m_readBufferPosition;
+        if( bufsiz <= avail ) {
+            memcpy( buf, &m_readBuffer[m_readBufferPosition], bufsiz );
+            m_readBufferPosition += bufsiz;
+            return;
+        }
+
+        memcpy( buf, &m_readBuffer[m_readBufferPosition], avail );
+        buf += avail;
+        bufsiz -= avail;
+
+        // window is exhausted, provider position is at its end
+        if( m_readBufferFill > 0 )
+            m_readBufferAhead = min( 2 * m_readBufferAhead, m_readBufferSize );
+
+        m_readBufferOffset  += m_readBufferFill;
+        m_readBufferFill     = 0;
+        m_readBufferPosition = 0;
+
+        File::Size nin;
+        if( bufsiz >= m_readBufferAhead ) {
+            // large reads bypass the window entirely
+            if( ProviderRead( file, buf, bufsiz, nin ))
+                throw new PLATFORM_EXCEPTION("read failed", sys::getLastError());
+            m_readBufferOffset += nin;
+            if( nin != bufsiz )
+                throw new EXCEPTION("not enough bytes, reached end-of-file");
+            return;
+        }
+
+        // never ask the provider for more than the file holds
+        uint64_t want = m_readBufferAhead;
+        if( (uint64_t)file->size > m_readBufferOffset )
+            want = min( want, (uint64_t)file->size - m_readBufferOffset );
+        if( want < bufsiz )
+            want = bufsiz;
+
+        if( ProviderRead( file, m_readBuffer, want, nin ))
+            throw new PLATFORM_EXCEPTION("read failed", sys::getLastError());
+        m_readBufferFill = (uint32_t)nin;
+        if( m_readBufferFill < bufsiz )
+            throw new EXCEPTION("not enough bytes, reached end-of-file");
+    }
+}
+
+void MP4File::DiscardReadBuffer( bool restorePosition )
+{
+    File* file = m_readBufferFile;
+    if( !file )
+        return;
+
+    m_readBufferFile = NULL;
+
+    // move the provider back to where the caller believes it is
+    uint64_t pos = m_readBufferOffset + m_readBufferPosition;
+    if( restorePosition && (uint64_t)file->position != pos ) {
+        if( ProviderSeek( file, pos ))
+            throw new PLATFORM_EXCEPTION("seek failed", sys::getLastError());
+    }
+}
+
+uint32_t MP4File::GetReadBufferSize()
+{
+    return m_readBufferSize;
+}
+
+void MP4File::SetReadBufferSize( uint32_t size )
+{
+    DiscardReadBuffer();
+
+    if( m_readBuffer )
+        TrackBufferMemory( -(int64_t)m_readBufferSize );
+
+    MP4Free( m_readBuffer );
+    m_readBuffer = NULL;
+    m_readBufferSize = clampReadBufferSize( size );
+}
+
+uint32_t MP4File::GetDefaultReadBufferSize()
+{
+    return s_defaultReadBufferSize;
+}
+
+void MP4File::SetDefaultReadBufferSize( uint32_t size )
+{
+    s_defaultReadBufferSize = clampReadBufferSize( size );
+}
+
+void MP4File::SetDefaultBlockCache( uint32_t blockSize, uint64_t capacity )
+{
+    s_blockCacheBlockSize = blockSize;
+    s_blockCacheCapacity = capacity;
+}
+
+bool MP4File::GetBlockCacheStats( MP4BlockCacheStats* stats )
+{
+    if( !m_blockCache )
+        return false;
+
+    const io::CachedFileProvider::Stats& s = m_blockCache->stats();
+    stats->hits = s.hits;
+    stats->misses = s.misses;
+    stats->reads = s.reads;
+    stats->bytesRead = s.bytesRead;
+    stats->evictions = s.evictions;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Out-of-band reads
+//
+// Deferred atoms and paged tables are read whenever their values are first
+// needed, which may be in the middle of anything else, such as parsing a
+// hint sample out of the memory buffer. These reads go to the file and the
+// I/O state of the interrupted operation is put back afterwards.
+
+void MP4File::SuspendIO( SuspendedIO& io )
+{
+    io.memoryBuffer = m_memoryBuffer;
+    io.memoryBufferSize = m_memoryBufferSize;
+    io.memoryBufferPosition = m_memoryBufferPosition;
+    io.numReadBits = m_numReadBits;
+    io.bufReadBits = m_bufReadBits;
+
+    m_memoryBuffer = NULL;
+    m_numReadBits = 0;
+
+    io.position = GetPosition();
+}
+
+void MP4File::ResumeIO( SuspendedIO& io, Exception* failure )
+{
+    try {
+        SetPosition( io.position );
+    }
+    catch( Exception* x ) {
+        if( failure )
+            delete x;
+        else
+            failure = x;
+    }
+
+    m_memoryBuffer = io.memoryBuffer;
+    m_memoryBufferSize = io.memoryBufferSize;
+    m_memoryBufferPosition = io.memoryBufferPosition;
+    m_numReadBits = io.numReadBits;
+    m_bufReadBits = io.bufReadBits;
+
+    if( failure )
+        throw failure;
+}
+
+void MP4File::ReadDeferredAtom( MP4Atom& atom )
+{
+    SuspendedIO io;
+    SuspendIO( io );
+
+    Exception* failure = NULL;
+    try {
+        SetPosition( atom.GetEnd() - atom.GetSize() );
+        atom.Read();
+    }
+    catch( Exception* x ) {
+        failure = x;
+    }
+
+    ResumeIO( io, failure );
+}
+
+void MP4File::ReadBytesAside( uint64_t pos, uint8_t* buf, uint32_t bufsiz )
+{
+    // concurrent readers may share the file, and don't need saving
+    if( !m_memoryBuffer && m_file->isPositionless() ) {
+        ReadBytesAt( pos, buf, bufsiz );
+        return;
+    }
+
+    SuspendedIO io;
+    SuspendIO( io );
+
+    Exception* failure = NULL;
+    try {
+        SetPosition( pos );
+        ReadBytes( buf, bufsiz );
+    }
+    catch( Exception* x ) {
+        failure = x;
+    }
+
+    ResumeIO( io, failure );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void MP4File::EnableMemoryBuffer( uint8_t* pBytes, uint64_t numBytes )
 {
     ASSERT( !m_memoryBuffer );
@@ -121,6 +565,7 @@ void MP4File::EnableMemoryBuffer( uint8_t* pBytes, uint64_t numBytes )
         m_memoryBuffer = (uint8_t*)MP4Malloc(m_memoryBufferSize);
     }
     m_memoryBufferPosition = 0;
+    TrackBufferMemory( m_memoryBufferSize );
 }
 
 void MP4File::DisableMemoryBuffer( uint8_t** ppBytes, uint64_t* pNumBytes )
@@ -134,6 +579,8 @@ void MP4File::DisableMemoryBuffer( uint8_t** ppBytes, uint64_t* pNumBytes )
         *pNumBytes = m_memoryBufferPosition;
     }
 
+    TrackBufferMemory( -(int64_t)m_memoryBufferSize );
+
     m_memoryBuffer = NULL;
     m_memoryBufferSize = 0;
     m_memoryBufferPosition = 0;
@@ -148,6 +595,7 @@ void MP4File::WriteBytes( uint8_t* buf, uint32_t bufsiz, File* file )
 
     if( m_memoryBuffer ) {
         if( m_memoryBufferPosition + bufsiz > m_memoryBufferSize ) {
+            TrackBufferMemory( m_memoryBufferSize + 2 * bufsiz );
             m_memoryBufferSize = 2 * (m_memoryBufferSize + bufsiz);
             m_memoryBuffer = (uint8_t*)MP4Realloc( m_memoryBuffer, m_memoryBufferSize );
         }
@@ -159,9 +607,15 @@ void MP4File::WriteBytes( uint8_t* buf, uint32_t bufsiz, File* file )
     if( !file )
         file = m_file;
 
+    m_ioStats.writeCalls.fetch_add( 1, std::memory_order_relaxed );
+    m_ioStats.writeBytes.fetch_add( bufsiz, std::memory_order_relaxed );
+
     ASSERT( file );
+    if( file == m_readBufferFile )
+        DiscardReadBuffer();
+
     File::Size nout;
-    if( file->write( buf, bufsiz, nout ))
+    if( ProviderWrite( file, buf, bufsiz, nout ))
         throw new PLATFORM_EXCEPTION("write failed", sys::getLastError());
     if( nout != bufsiz )
         throw new EXCEPTION("not all bytes written");
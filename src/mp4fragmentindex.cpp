@@ -0,0 +1,417 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+    // the value of an optional integer property, or defaultValue
+    uint64_t
+    OptionalValue( MP4Atom& atom, const char* name, uint64_t defaultValue, bool* pFound = NULL )
+    {
+        MP4Property* pProperty = NULL;
+        const bool found = atom.FindProperty( name, &pProperty ) && pProperty &&
+                           pProperty->GetType() <= Integer64Property;
+        if( pFound )
+            *pFound = found;
+        return found ? ((MP4IntegerProperty*)pProperty)->GetValue() : defaultValue;
+    }
+
+    MP4Integer32Property*
+    OptionalColumn( MP4Atom& atom, const char* name )
+    {
+        MP4Property* pProperty = NULL;
+        if( !atom.FindProperty( name, &pProperty ))
+            return NULL;
+        return (MP4Integer32Property*)pProperty;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4FragmentIndex::MP4FragmentIndex( MP4Atom* pTrexAtom, MP4Timestamp startTime )
+    : m_numSamples                 ( 0 )
+    , m_startTime                  ( startTime )
+    , m_endTime                    ( startTime )
+    , m_maxSampleSize              ( 0 )
+    , m_totalOfSampleSizes         ( 0 )
+    , m_trexSampleDescriptionIndex ( 1 )
+    , m_trexDuration               ( 0 )
+    , m_trexSize                   ( 0 )
+    , m_trexFlags                  ( 0 )
+    , m_cursorRun                  ( (uint32_t)-1 )
+    , m_cursorSample               ( 0 )
+    , m_cursorOffset               ( 0 )
+    , m_cursorTime                 ( 0 )
+{
+    if( pTrexAtom ) {
+        m_trexSampleDescriptionIndex = (uint32_t)OptionalValue( *pTrexAtom, "trex.defaultSampleDesriptionIndex", 1 );
+        m_trexDuration = (uint32_t)OptionalValue( *pTrexAtom, "trex.defaultSampleDuration", 0 );
+        m_trexSize     = (uint32_t)OptionalValue( *pTrexAtom, "trex.defaultSampleSize", 0 );
+        m_trexFlags    = (uint32_t)OptionalValue( *pTrexAtom, "trex.defaultSampleFlags", 0 );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint64_t
+MP4FragmentIndex::AddTrackFragment( MP4Atom& trafAtom, uint64_t moofOffset, uint64_t dataOffset )
+{
+    MP4Atom* pTfhdAtom = trafAtom.FindAtom( "traf.tfhd" );
+    if( !pTfhdAtom )
+        return dataOffset;
+    MP4Atom& tfhd = *pTfhdAtom;
+
+    // the base the data offsets of the truns count from, see 8.8.7.1 of
+    // ISO/IEC 14496-12: by default where the data of the previous traf ended
+    uint64_t baseDataOffset = dataOffset;
+    const uint32_t tfhdFlags = tfhd.GetFlags();
+    if( tfhdFlags & 0x01 )
+        baseDataOffset = OptionalValue( tfhd, "tfhd.baseDataOffset", baseDataOffset );
+    else if( tfhdFlags & 0x020000 ) // default-base-is-moof
+        baseDataOffset = moofOffset;
+    dataOffset = baseDataOffset;
+
+    Run run;
+    run.sampleDescriptionIndex = (uint32_t)OptionalValue( tfhd, "tfhd.sampleDescriptionIndex", m_trexSampleDescriptionIndex );
+    run.defaultDuration        = (uint32_t)OptionalValue( tfhd, "tfhd.defaultSampleDuration", m_trexDuration );
+    run.defaultSize            = (uint32_t)OptionalValue( tfhd, "tfhd.defaultSampleSize", m_trexSize );
+    run.defaultFlags           = (uint32_t)OptionalValue( tfhd, "tfhd.defaultSampleFlags", m_trexFlags );
+
+    // without tfdt the fragment follows on from the previous one
+    MP4Atom* pTfdtAtom = trafAtom.FindAtom( "traf.tfdt" );
+    if( pTfdtAtom )
+        m_endTime = OptionalValue( *pTfdtAtom, "tfdt.baseMediaDecodeTime", m_endTime );
+
+    const uint32_t numChildren = trafAtom.GetNumberOfChildAtoms();
+    for( uint32_t i = 0; i < numChildren; i++ ) {
+        MP4Atom& trun = *trafAtom.GetChildAtom( i );
+        if( ATOMID(trun.GetType()) != ATOMID("trun") )
+            continue;
+
+        run.sampleCount = (uint32_t)OptionalValue( trun, "trun.sampleCount", 0 );
+        if( run.sampleCount == 0 )
+            continue;
+
+        // a trun without data offset continues where the previous one ended
+        bool hasDataOffset;
+        const int32_t runOffset = (int32_t)OptionalValue( trun, "trun.dataOffset", 0, &hasDataOffset );
+        if( hasDataOffset )
+            dataOffset = baseDataOffset + (int64_t)runOffset;
+
+        run.firstSampleFlags = (uint32_t)OptionalValue( trun, "trun.firstSampleFlags", 0, &run.hasFirstSampleFlags );
+
+        run.pDuration        = OptionalColumn( trun, "trun.samples.sampleDuration" );
+        run.pSize            = OptionalColumn( trun, "trun.samples.sampleSize" );
+        run.pFlags           = OptionalColumn( trun, "trun.samples.sampleFlags" );
+        run.pRenderingOffset = OptionalColumn( trun, "trun.samples.sampleCompositionTimeOffset" );
+
+        // a truncated table cannot be trusted for any of its samples
+        if( (run.pDuration && run.pDuration->GetCount() < run.sampleCount) ||
+            (run.pSize && run.pSize->GetCount() < run.sampleCount) ||
+            (run.pFlags && run.pFlags->GetCount() < run.sampleCount) ||
+            (run.pRenderingOffset && run.pRenderingOffset->GetCount() < run.sampleCount) )
+        {
+            trun.GetFile().AddParsingError( &trun, MALFORMED_ATOM_ERROR("trun"), "Fewer sample entries than sampleCount" );
+            continue;
+        }
+
+        run.firstSample = m_numSamples;
+        run.dataOffset  = dataOffset;
+        run.startTime   = m_endTime;
+
+        uint64_t runSize = (uint64_t)run.sampleCount * run.defaultSize;
+        uint32_t runMaxSampleSize = run.defaultSize;
+        if( run.pSize ) {
+            runSize = 0;
+            runMaxSampleSize = 0;
+            for( uint32_t j = 0; j < run.sampleCount; j++ ) {
+                const uint32_t size = run.pSize->GetValue( j );
+                runSize += size;
+                runMaxSampleSize = max( runMaxSampleSize, size );
+            }
+        }
+
+        // the last fragment of a recording cut short may lack its data
+        if( dataOffset + runSize > trun.GetFile().GetSize() ) {
+            trun.GetFile().AddParsingError( &trun, MALFORMED_ATOM_ERROR("trun"), "Sample data extends past the end of the file" );
+            break;
+        }
+        m_maxSampleSize = max( m_maxSampleSize, runMaxSampleSize );
+
+        MP4Duration runDuration = (MP4Duration)run.sampleCount * run.defaultDuration;
+        if( run.pDuration ) {
+            runDuration = 0;
+            for( uint32_t j = 0; j < run.sampleCount; j++ )
+                runDuration += run.pDuration->GetValue( j );
+        }
+
+        m_runs.push_back( run );
+        m_numSamples += run.sampleCount;
+        m_totalOfSampleSizes += runSize;
+        m_endTime += runDuration;
+        dataOffset += runSize;
+    }
+
+    return dataOffset;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+MP4FragmentIndex::FindRun( uint32_t index )
+{
+    // the last run starting at or before index
+    uint32_t first = 0;
+    for( uint32_t count = (uint32_t)m_runs.size(); count > 0; ) {
+        const uint32_t half = count / 2;
+        if( m_runs[first + half].firstSample <= index ) {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else {
+            count = half;
+        }
+    }
+    return first - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool
+MP4FragmentIndex::Locate( uint32_t index )
+{
+    if( index >= m_numSamples )
+        return false;
+
+    // stay in the cursor's run or step into the next one, as sequential
+    // access does; otherwise search for the run and walk into it
+    uint32_t runIndex = m_cursorRun;
+    if( runIndex >= m_runs.size() || index < m_runs[runIndex].firstSample + m_cursorSample ) {
+        runIndex = FindRun( index );
+    }
+    else if( index >= m_runs[runIndex].firstSample + m_runs[runIndex].sampleCount ) {
+        runIndex++;
+        if( index >= m_runs[runIndex].firstSample + m_runs[runIndex].sampleCount )
+            runIndex = FindRun( index );
+    }
+
+    const Run& run = m_runs[runIndex];
+    if( runIndex != m_cursorRun || index < run.firstSample + m_cursorSample ) {
+        m_cursorRun    = runIndex;
+        m_cursorSample = 0;
+        m_cursorOffset = run.dataOffset;
+        m_cursorTime   = run.startTime;
+    }
+
+    const uint32_t sample = index - run.firstSample;
+    if( !run.pSize ) {
+        m_cursorOffset = run.dataOffset + (uint64_t)sample * run.defaultSize;
+    }
+    else {
+        for( uint32_t i = m_cursorSample; i < sample; i++ )
+            m_cursorOffset += run.pSize->GetValue( i );
+    }
+    if( !run.pDuration ) {
+        m_cursorTime = run.startTime + (MP4Timestamp)sample * run.defaultDuration;
+    }
+    else {
+        for( uint32_t i = m_cursorSample; i < sample; i++ )
+            m_cursorTime += run.pDuration->GetValue( i );
+    }
+    m_cursorSample = sample;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+MP4FragmentIndex::GetSampleSize( uint32_t index )
+{
+    if( !Locate( index ))
+        return 0;
+    return m_runs[m_cursorRun].Size( m_cursorSample );
+}
+
+uint64_t
+MP4FragmentIndex::GetSampleFileOffset( uint32_t index )
+{
+    if( !Locate( index ))
+        return (uint64_t)-1;
+    return m_cursorOffset;
+}
+
+void
+MP4FragmentIndex::GetSampleTimes( uint32_t index, MP4Timestamp* pStartTime, MP4Duration* pDuration )
+{
+    if( !Locate( index )) {
+        if( pStartTime )
+            *pStartTime = MP4_INVALID_TIMESTAMP;
+        if( pDuration )
+            *pDuration = MP4_INVALID_DURATION;
+        return;
+    }
+
+    if( pStartTime )
+        *pStartTime = m_cursorTime;
+    if( pDuration )
+        *pDuration = m_runs[m_cursorRun].Duration( m_cursorSample );
+}
+
+MP4Duration
+MP4FragmentIndex::GetSampleRenderingOffset( uint32_t index )
+{
+    if( !Locate( index ))
+        return MP4_INVALID_DURATION;
+
+    // as with ctts the raw 32 bits, version 1 truns give them as signed
+    const Run& run = m_runs[m_cursorRun];
+    return run.pRenderingOffset ? run.pRenderingOffset->GetValue( m_cursorSample ) : 0;
+}
+
+uint32_t
+MP4FragmentIndex::GetSampleFlags( uint32_t index )
+{
+    if( !Locate( index ))
+        return 0;
+    return m_runs[m_cursorRun].Flags( m_cursorSample );
+}
+
+uint32_t
+MP4FragmentIndex::GetSampleDescriptionIndex( uint32_t index )
+{
+    if( !Locate( index ))
+        return 0;
+    return m_runs[m_cursorRun].sampleDescriptionIndex;
+}
+
+bool
+MP4FragmentIndex::IsSyncSample( uint32_t index )
+{
+    if( !Locate( index ))
+        return false;
+    return IsSyncSampleFlags( m_runs[m_cursorRun].Flags( m_cursorSample ));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+MP4FragmentIndex::GetSampleFromTime( MP4Timestamp when )
+{
+    if( m_runs.empty() || when < m_runs[0].startTime || when >= m_endTime )
+        return (uint32_t)-1;
+
+    // the last run starting at or before when
+    uint32_t first = 0;
+    for( uint32_t count = (uint32_t)m_runs.size(); count > 0; ) {
+        const uint32_t half = count / 2;
+        if( m_runs[first + half].startTime <= when ) {
+            first += half + 1;
+            count -= half + 1;
+        }
+        else {
+            count = half;
+        }
+    }
+    const Run& run = m_runs[first - 1];
+
+    MP4Timestamp time = run.startTime;
+    for( uint32_t i = 0; i < run.sampleCount; i++ ) {
+        const uint32_t duration = run.Duration( i );
+        if( !run.pDuration && duration ) {
+            // constant durations, jump straight to the sample
+            const uint64_t skip = (when - time) / duration;
+            if( skip >= run.sampleCount )
+                break;
+            return run.firstSample + (uint32_t)skip;
+        }
+        if( when < time + duration )
+            return run.firstSample + i;
+        time += duration;
+    }
+
+    // in a gap left by tfdt before the next run
+    if( first < m_runs.size() )
+        return m_runs[first].firstSample;
+    return (uint32_t)-1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+MP4FragmentIndex::GetNextSyncSample( uint32_t index )
+{
+    if( index >= m_numSamples )
+        return (uint32_t)-1;
+
+    for( uint32_t r = FindRun( index ); r < m_runs.size(); r++ ) {
+        const Run& run = m_runs[r];
+        uint32_t i = index > run.firstSample ? index - run.firstSample : 0;
+
+        // without a flags column all but the first sample share the default
+        if( !run.pFlags ) {
+            if( i == 0 && IsSyncSampleFlags( run.Flags( 0 )))
+                return run.firstSample;
+            if( IsSyncSampleFlags( run.defaultFlags ) && run.sampleCount > 1 )
+                return run.firstSample + max( i, (uint32_t)1 );
+            continue;
+        }
+
+        for( ; i < run.sampleCount; i++ ) {
+            if( IsSyncSampleFlags( run.pFlags->GetValue( i )))
+                return run.firstSample + i;
+        }
+    }
+
+    return (uint32_t)-1;
+}
+
+uint32_t
+MP4FragmentIndex::GetPrevSyncSample( uint32_t index )
+{
+    if( m_runs.empty() )
+        return (uint32_t)-1;
+    if( index >= m_numSamples )
+        index = m_numSamples - 1;
+
+    for( uint32_t r = FindRun( index ) + 1; r-- > 0; ) {
+        const Run& run = m_runs[r];
+        const uint32_t last = min( index - run.firstSample, run.sampleCount - 1 );
+
+        if( !run.pFlags ) {
+            if( last > 0 && IsSyncSampleFlags( run.defaultFlags ))
+                return run.firstSample + last;
+            if( IsSyncSampleFlags( run.Flags( 0 )))
+                return run.firstSample;
+            continue;
+        }
+
+        for( uint32_t i = last + 1; i-- > 0; ) {
+            if( IsSyncSampleFlags( run.pFlags->GetValue( i )))
+                return run.firstSample + i;
+        }
+    }
+
+    return (uint32_t)-1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
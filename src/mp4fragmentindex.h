@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MP4V2_IMPL_MP4FRAGMENTINDEX_H
+#define MP4V2_IMPL_MP4FRAGMENTINDEX_H
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Sample index of one track over the movie fragments of a file.
+ *
+ * Every trun of the track becomes one run holding its data offset, decode
+ * time and the defaults that apply to it from tfhd and trex. Per-sample
+ * values are only looked up in the trun tables for the columns the trun
+ * actually carries, so fragments that lean on the defaults cost a few
+ * dozen bytes each. Samples are numbered from 0 in the order they were
+ * added; the track puts them after the samples of its own sample tables.
+ *
+ * Lookups keep a cursor on the last sample visited, so walking the
+ * samples in order is constant time and a random lookup is a binary
+ * search over the runs plus a walk within one trun.
+ */
+class MP4FragmentIndex
+{
+public:
+    MP4FragmentIndex( MP4Atom* pTrexAtom, MP4Timestamp startTime );
+
+    // index the truns of a traf of this track, whose sample data starts
+    // at dataOffset unless tfhd says otherwise; returns the end of its data
+    uint64_t AddTrackFragment( MP4Atom& trafAtom, uint64_t moofOffset, uint64_t dataOffset );
+
+    uint32_t     GetNumberOfSamples()    { return m_numSamples; }
+    MP4Timestamp GetStartTime()          { return m_startTime; }
+    MP4Timestamp GetEndTime()            { return m_endTime; }
+    uint32_t     GetMaxSampleSize()      { return m_maxSampleSize; }
+    uint64_t     GetTotalOfSampleSizes() { return m_totalOfSampleSizes; }
+
+    // per-sample lookups, index is 0-based within the fragments
+    uint32_t    GetSampleSize( uint32_t index );
+    uint64_t    GetSampleFileOffset( uint32_t index );
+    void        GetSampleTimes( uint32_t index, MP4Timestamp* pStartTime, MP4Duration* pDuration );
+    MP4Duration GetSampleRenderingOffset( uint32_t index );
+    uint32_t    GetSampleFlags( uint32_t index );
+    uint32_t    GetSampleDescriptionIndex( uint32_t index );
+    bool        IsSyncSample( uint32_t index );
+
+    // the sample playing at when, (uint32_t)-1 if none
+    uint32_t    GetSampleFromTime( MP4Timestamp when );
+
+    // inclusive of index; (uint32_t)-1 if there is none
+    uint32_t    GetNextSyncSample( uint32_t index );
+    uint32_t    GetPrevSyncSample( uint32_t index );
+
+    static bool IsSyncSampleFlags( uint32_t flags ) {
+        return (flags & 0x00010000) == 0; // sample_is_non_sync_sample
+    }
+
+    // the sdtp byte carried in bits 20-27 of the sample flags
+    static uint8_t DependencyFlags( uint32_t flags ) {
+        return (uint8_t)(flags >> 20);
+    }
+
+private:
+    struct Run {
+        uint32_t     firstSample;
+        uint32_t     sampleCount;
+        uint64_t     dataOffset;        // of the first sample
+        MP4Timestamp startTime;         // decode time of the first sample
+        uint32_t     sampleDescriptionIndex;
+        uint32_t     defaultDuration;
+        uint32_t     defaultSize;
+        uint32_t     defaultFlags;
+        uint32_t     firstSampleFlags;
+        bool         hasFirstSampleFlags;
+
+        // columns of the trun sample table, NULL where a default applies
+        MP4Integer32Property* pDuration;
+        MP4Integer32Property* pSize;
+        MP4Integer32Property* pFlags;
+        MP4Integer32Property* pRenderingOffset;
+
+        uint32_t Duration( uint32_t i ) const {
+            return pDuration ? pDuration->GetValue( i ) : defaultDuration;
+        }
+        uint32_t Size( uint32_t i ) const {
+            return pSize ? pSize->GetValue( i ) : defaultSize;
+        }
+        uint32_t Flags( uint32_t i ) const {
+            if( pFlags )
+                return pFlags->GetValue( i );
+            return (i == 0 && hasFirstSampleFlags) ? firstSampleFlags : defaultFlags;
+        }
+    };
+
+    // position the cursor on index; false if out of range
+    bool Locate( uint32_t index );
+
+    // the run holding index, by binary search
+    uint32_t FindRun( uint32_t index );
+
+private:
+    vector<Run>  m_runs;
+    uint32_t     m_numSamples;
+    MP4Timestamp m_startTime;
+    MP4Timestamp m_endTime;             // decode end of the last run
+    uint32_t     m_maxSampleSize;
+    uint64_t     m_totalOfSampleSizes;
+
+    // trex defaults
+    uint32_t     m_trexSampleDescriptionIndex;
+    uint32_t     m_trexDuration;
+    uint32_t     m_trexSize;
+    uint32_t     m_trexFlags;
+
+    // lookup cursor
+    uint32_t     m_cursorRun;
+    uint32_t     m_cursorSample;        // within the run
+    uint64_t     m_cursorOffset;
+    MP4Timestamp m_cursorTime;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4FRAGMENTINDEX_H
@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+const uint32_t MP4PackedArray::BLOCK_SIZE;
+
+void MP4PackedArray::AddBlock( const uint64_t* values, uint32_t count )
+{
+    uint64_t lo = values[0];
+    uint64_t hi = values[0];
+    for( uint32_t i = 1; i < count; i++ ) {
+        lo = min( lo, values[i] );
+        hi = max( hi, values[i] );
+    }
+
+    uint8_t bits = 0;
+    for( uint64_t range = hi - lo; range; range >>= 1 )
+        bits++;
+
+    Block block;
+    block.base = lo;
+    block.word = (uint32_t)m_words.size();
+    block.bits = bits;
+    m_blocks.push_back( block );
+
+    if( bits == 0 )
+        return;
+
+    // a full block of BLOCK_SIZE deltas takes exactly bits words
+    m_words.resize( m_words.size() + ((uint64_t)count * bits + 63) / 64, 0 );
+    uint64_t* words = &m_words[block.word];
+
+    for( uint32_t i = 0; i < count; i++ ) {
+        const uint64_t delta = values[i] - lo;
+        const uint32_t bit = i * bits;
+        const uint32_t shift = bit % 64;
+
+        words[bit / 64] |= delta << shift;
+        if( shift + bits > 64 )
+            words[bit / 64 + 1] |= delta >> (64 - shift);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MP4V2_IMPL_MP4PACKEDARRAY_H
+#define MP4V2_IMPL_MP4PACKEDARRAY_H
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Read-only array of integers in bit-packed blocks.
+ *
+ * Every block of BLOCK_SIZE values stores its smallest value as a base and
+ * the differences to it in as few bits as the block needs. Sample sizes of
+ * a stream vary over a small range and the chunk offsets within a block
+ * are close to each other, so stsz and stco/co64 entries shrink to 1-3
+ * bytes from 4 or 8. Any value is decoded in constant time.
+ */
+class MP4PackedArray
+{
+public:
+    static const uint32_t BLOCK_SIZE = 64;
+
+    template<class type> MP4PackedArray( const type* values, uint32_t count )
+        : m_count( count )
+    {
+        uint64_t block[BLOCK_SIZE];
+        for( uint32_t first = 0; first < count; first += BLOCK_SIZE ) {
+            const uint32_t n = min( BLOCK_SIZE, count - first );
+            for( uint32_t i = 0; i < n; i++ )
+                block[i] = values[first + i];
+            AddBlock( block, n );
+        }
+    }
+
+    uint32_t Size() {
+        return m_count;
+    }
+
+    uint64_t Get( uint32_t index ) {
+        if( index >= m_count ) {
+            ostringstream msg;
+            msg << "illegal array index: " << index << " of " << m_count;
+            throw new PLATFORM_EXCEPTION(msg.str().c_str(), ERANGE);
+        }
+
+        const Block& block = m_blocks[index / BLOCK_SIZE];
+        if( block.bits == 0 )
+            return block.base;
+
+        const uint32_t bit = (index % BLOCK_SIZE) * block.bits;
+        const uint64_t* word = &m_words[block.word + bit / 64];
+        const uint32_t shift = bit % 64;
+
+        uint64_t delta = word[0] >> shift;
+        if( shift + block.bits > 64 )
+            delta |= word[1] << (64 - shift);
+        if( block.bits < 64 )
+            delta &= ((uint64_t)1 << block.bits) - 1;
+
+        return block.base + delta;
+    }
+
+    // bytes held, for comparison with the unpacked array
+    uint64_t GetMemorySize() {
+        return m_blocks.size() * sizeof(Block) + m_words.size() * sizeof(uint64_t);
+    }
+
+private:
+    struct Block {
+        uint64_t base;
+        uint32_t word;  // index of the first word of the block in m_words
+        uint8_t  bits;  // bits per delta, 0 if all values are equal
+    };
+
+    void AddBlock( const uint64_t* values, uint32_t count );
+
+private:
+    uint32_t         m_count;
+    vector<Block>    m_blocks;
+    vector<uint64_t> m_words;
+
+private:
+    MP4PackedArray();
+    MP4PackedArray( const MP4PackedArray &src );
+    MP4PackedArray &operator= ( const MP4PackedArray &src );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4PACKEDARRAY_H
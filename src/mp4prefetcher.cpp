@@ -0,0 +1,197 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4Prefetcher::MP4Prefetcher( File& file, uint32_t numWorkers )
+    : m_file ( file )
+    , m_stop ( false )
+{
+    ASSERT( file.isPositionless() );
+
+    for( uint32_t i = 0; i < numWorkers; i++ )
+        m_workers.push_back( std::thread( &MP4Prefetcher::Work, this ));
+}
+
+MP4Prefetcher::~MP4Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+        m_queue.clear();
+    }
+    m_wake.notify_all();
+
+    for( size_t i = 0; i < m_workers.size(); i++ )
+        m_workers[i].join();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MP4Prefetcher::Request( MP4TrackId trackId, uint64_t offset, uint32_t size )
+{
+    if( size == 0 )
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        TrackRanges& ranges = m_tracks[trackId];
+
+        std::map<uint64_t, RangePtr>::iterator found = ranges.byOffset.find( offset );
+        if( found != ranges.byOffset.end() ) {
+            // the window is short, see Retire()
+            std::deque<RangePtr>::iterator it = std::find( ranges.byRequest.begin(),
+                                                           ranges.byRequest.end(), found->second );
+            ranges.byRequest.erase( it );
+            ranges.byRequest.push_back( found->second );
+            return;
+        }
+
+        RangePtr range( new Range );
+        range->trackId = trackId;
+        range->offset  = offset;
+        range->size    = size;
+        range->state   = STATE_QUEUED;
+
+        ranges.byOffset[offset] = range;
+        ranges.byRequest.push_back( range );
+        m_queue.push_back( range );
+    }
+    m_wake.notify_one();
+}
+
+void MP4Prefetcher::Retire( MP4TrackId trackId, uint32_t numRanges )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    std::map<MP4TrackId, TrackRanges>::iterator track = m_tracks.find( trackId );
+    if( track == m_tracks.end() )
+        return;
+
+    // queued ranges are simply skipped by the workers once dropped here,
+    // loading ones stay alive through the worker's reference
+    TrackRanges& ranges = track->second;
+    while( ranges.byRequest.size() > numRanges ) {
+        ranges.byOffset.erase( ranges.byRequest.front()->offset );
+        ranges.byRequest.pop_front();
+    }
+
+    if( ranges.byRequest.empty() )
+        m_tracks.erase( track );
+}
+
+void MP4Prefetcher::Forget( MP4TrackId trackId )
+{
+    Retire( trackId, 0 );
+}
+
+bool MP4Prefetcher::Read( MP4TrackId trackId, uint64_t offset, uint8_t* pBytes, uint32_t numBytes )
+{
+    RangePtr found;
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        std::map<MP4TrackId, TrackRanges>::iterator track = m_tracks.find( trackId );
+        if( track == m_tracks.end() )
+            return false;
+
+        // the range starting last at or before offset
+        std::map<uint64_t, RangePtr>& byOffset = track->second.byOffset;
+        std::map<uint64_t, RangePtr>::iterator it = byOffset.upper_bound( offset );
+        if( it == byOffset.begin() )
+            return false;
+        --it;
+
+        if( offset + numBytes > it->second->offset + it->second->size )
+            return false;
+        found = it->second;
+
+        // the caller needs it now, so load it here rather than wait for
+        // a worker to get around to it
+        if( found->state == STATE_QUEUED ) {
+            found->state = STATE_LOADING;
+            lock.unlock();
+            Load( found );
+            lock.lock();
+        }
+
+        while( found->state == STATE_LOADING )
+            m_loaded.wait( lock );
+
+        if( found->state != STATE_READY )
+            return false;
+    }
+
+    // ready ranges are immutable and kept alive by our reference
+    memcpy( pBytes, &found->data[offset - found->offset], numBytes );
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MP4Prefetcher::Work()
+{
+    for( ;; ) {
+        RangePtr range;
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            while( !m_stop && m_queue.empty() )
+                m_wake.wait( lock );
+
+            if( m_stop )
+                return;
+
+            range = m_queue.front();
+            m_queue.pop_front();
+
+            // claimed by a reader or dropped since it was queued
+            if( range->state != STATE_QUEUED || range.use_count() == 1 )
+                continue;
+
+            range->state = STATE_LOADING;
+        }
+
+        Load( range );
+    }
+}
+
+void MP4Prefetcher::Load( const RangePtr& range )
+{
+    State state = STATE_FAILED;
+    try {
+        range->data.resize( range->size );
+
+        File::Size nin;
+        if( !m_file.readAt( range->offset, &range->data[0], range->size, nin ) && nin == range->size )
+            state = STATE_READY;
+    }
+    catch( ... ) {
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        range->state = state;
+    }
+    m_loaded.notify_all();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MP4V2_IMPL_MP4PREFETCHER_H
+#define MP4V2_IMPL_MP4PREFETCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Background loader for byte ranges of a file opened with a positionless
+ * provider.
+ *
+ * Tracks request the ranges they expect to read next (chunks for
+ * sequential readers, sync samples for keyframe scanners); a small pool
+ * of worker threads loads them with File::readAt() while the caller is
+ * busy with the current sample, and ReadSample() then copies from memory.
+ *
+ * Each track keeps only the ranges it requested last, see Retire(), so
+ * the memory held stays bounded however the chunks are laid out.
+ */
+class MP4Prefetcher
+{
+public:
+    MP4Prefetcher( File& file, uint32_t numWorkers = 2 );
+    ~MP4Prefetcher();
+
+    // queue [offset, offset+size) of trackId unless already known, in
+    // which case it counts as requested again
+    void Request( MP4TrackId trackId, uint64_t offset, uint32_t size );
+
+    // drop all but the numRanges ranges of trackId requested last
+    void Retire( MP4TrackId trackId, uint32_t numRanges );
+
+    // drop all ranges of trackId
+    void Forget( MP4TrackId trackId );
+
+    // copy [offset, offset+size) if it lies within a requested range,
+    // waiting for or performing the load as needed; false on a miss
+    bool Read( MP4TrackId trackId, uint64_t offset, uint8_t* pBytes, uint32_t numBytes );
+
+private:
+    enum State {
+        STATE_QUEUED,
+        STATE_LOADING,
+        STATE_READY,
+        STATE_FAILED
+    };
+
+    struct Range {
+        MP4TrackId      trackId;
+        uint64_t        offset;
+        uint32_t        size;
+        State           state;
+        vector<uint8_t> data;
+    };
+
+    typedef std::shared_ptr<Range> RangePtr;
+
+    struct TrackRanges {
+        std::map<uint64_t, RangePtr> byOffset;
+        std::deque<RangePtr>         byRequest;  // oldest request first
+    };
+
+    void Work();
+    void Load( const RangePtr& range );
+
+private:
+    File&                    m_file;
+    vector<std::thread>      m_workers;
+    std::mutex               m_mutex;
+    std::condition_variable  m_wake;     // signalled when work is queued
+    std::condition_variable  m_loaded;   // signalled when a load completes
+    std::map<MP4TrackId, TrackRanges> m_tracks;
+    std::deque<RangePtr>     m_queue;
+    bool                     m_stop;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4PREFETCHER_H
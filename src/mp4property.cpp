@@ -32,6 +32,12 @@ MP4Property::MP4Property(MP4Atom& parentAtom, const char* name)
     m_name = name;
     m_readOnly = false;
     m_implicit = false;
+    m_deferred = false;
+}
+
+void MP4Property::Materialize()
+{
+    m_parentAtom.Materialize();
 }
 
 bool MP4Property::FindProperty(const char* name,
@@ -154,11 +160,11 @@ template<> void MP4Integer8Property::Dump(uint8_t indent,
     if (index != 0)
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s[%u] = %u (0x%02x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, index, m_values[index], m_values[index]);
+                 m_name, index, GetValue(index), GetValue(index));
     else
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s = %u (0x%02x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, m_values[index], m_values[index]);
+                 m_name, GetValue(index), GetValue(index));
 }
 
 template<> void MP4Integer16Property::Dump(uint8_t indent,
@@ -170,11 +176,11 @@ template<> void MP4Integer16Property::Dump(uint8_t indent,
     if (index != 0)
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s[%u] = %u (0x%04x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, index, m_values[index], m_values[index]);
+                 m_name, index, GetValue(index), GetValue(index));
     else
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s = %u (0x%04x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, m_values[index], m_values[index]);
+                 m_name, GetValue(index), GetValue(index));
 }
 
 template<> void MP4Integer24Property::Dump(uint8_t indent,
@@ -186,11 +192,11 @@ template<> void MP4Integer24Property::Dump(uint8_t indent,
     if (index != 0)
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s[%u] = %u (0x%06x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, index, m_values[index], m_values[index]);
+                 m_name, index, GetValue(index), GetValue(index));
     else
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s = %u (0x%06x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, m_values[index], m_values[index]);
+                 m_name, GetValue(index), GetValue(index));
 }
 
 template<> void MP4Integer32Property::Dump(uint8_t indent,
@@ -202,11 +208,11 @@ template<> void MP4Integer32Property::Dump(uint8_t indent,
     if (index != 0)
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s[%u] = %u (0x%08x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, index, m_values[index], m_values[index]);
+                 m_name, index, GetValue(index), GetValue(index));
     else
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s = %u (0x%08x)",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, m_values[index], m_values[index]);
+                 m_name, GetValue(index), GetValue(index));
 }
 
 template<> void MP4Integer64Property::Dump(uint8_t indent,
@@ -218,11 +224,11 @@ template<> void MP4Integer64Property::Dump(uint8_t indent,
     if (index != 0)
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s[%u] = %" PRIu64 " (0x%016" PRIx64 ")",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, index, m_values[index], m_values[index]);
+                 m_name, index, GetValue(index), GetValue(index));
     else
         log.dump(indent, MP4_LOG_VERBOSE1, "\"%s\": %s = %" PRIu64 " (0x%016" PRIx64 ")",
                  m_parentAtom.GetFile().GetFilename().c_str(),
-                 m_name, m_values[index], m_values[index]);
+                 m_name, GetValue(index), GetValue(index));
 }
 
 // MP4BitfieldProperty
@@ -716,6 +722,7 @@ MP4TableProperty::MP4TableProperty(MP4Atom& parentAtom, const char* name, MP4Int
 {
     m_pCountProperty = pCountProperty;
     m_pCountProperty->SetReadOnly();
+    m_pPager = NULL;
 }
 
 MP4TableProperty::~MP4TableProperty()
@@ -723,6 +730,7 @@ MP4TableProperty::~MP4TableProperty()
     for (uint32_t i = 0; i < m_pProperties.Size(); i++) {
         delete m_pProperties[i];
     }
+    delete m_pPager;
 }
 
 void MP4TableProperty::AddProperty(MP4Property* pProperty)
@@ -734,6 +742,14 @@ void MP4TableProperty::AddProperty(MP4Property* pProperty)
     pProperty->SetCount(0);
 }
 
+void MP4TableProperty::SetDeferred(bool value)
+{
+    MP4Property::SetDeferred(value);
+    for (uint32_t i = 0; i < m_pProperties.Size(); i++) {
+        m_pProperties[i]->SetDeferred(value);
+    }
+}
+
 bool MP4TableProperty::FindProperty(const char *name,
                                     MP4Property** ppProperty, uint32_t* pIndex)
 {
@@ -803,14 +819,201 @@ void MP4TableProperty::Read(MP4File& file, uint32_t index)
 
     uint32_t numEntries = GetCount();
 
+    if (ReadPaged(file, numEntries)) {
+        return;
+    }
+
     /* for each property set size */
     for (uint32_t j = 0; j < numProperties; j++) {
         m_pProperties[j]->SetCount(numEntries);
     }
 
-    for (uint32_t i = 0; i < numEntries; i++) {
-        ReadEntry(file, i);
+    if (!ReadBulk(file, numEntries)) {
+        for (uint32_t i = 0; i < numEntries; i++) {
+            ReadEntry(file, i);
+        }
+    }
+
+    // sample sizes and chunk offsets are kept bit-packed, see MP4PackedArray
+    const uint32_t atomId = ATOMID(m_parentAtom.GetType());
+    if (file.PacksSampleTables() && numEntries > MP4PackedArray::BLOCK_SIZE &&
+        (atomId == ATOMID("stsz") || atomId == ATOMID("stco") || atomId == ATOMID("co64")))
+    {
+        for (uint32_t j = 0; j < numProperties; j++) {
+            if (!m_pProperties[j]->IsImplicit()) {
+                ((MP4IntegerProperty*)m_pProperties[j])->Pack();
+            }
+        }
+    }
+}
+
+// bytes taken in the file by a value of an integer property, 0 otherwise
+static uint32_t IntegerPropertySize(MP4PropertyType type)
+{
+    switch (type) {
+    case Integer8Property:  return 1;
+    case Integer16Property: return 2;
+    case Integer24Property: return 3;
+    case Integer32Property: return 4;
+    case Integer64Property: return 8;
+    default:                return 0;
+    }
+}
+
+// Leave a large sample table in the file, see MP4TablePager
+bool MP4TableProperty::ReadPaged(MP4File& file, uint32_t numEntries)
+{
+    if (!file.PagesSampleTables() || !MP4Atom::IsDeferrableType(m_parentAtom.GetType())) {
+        return false;
+    }
+    if (numEntries <= MP4TablePager::BLOCK_ROWS * MP4TablePager::NUM_BLOCKS) {
+        return false;
+    }
+
+    uint32_t rowSize = 0;
+    for (uint32_t j = 0; j < m_pProperties.Size(); j++) {
+        if (m_pProperties[j]->IsImplicit()) {
+            continue;
+        }
+        uint32_t valueSize = IntegerPropertySize(m_pProperties[j]->GetType());
+        if (valueSize == 0) {
+            return false;
+        }
+        rowSize += valueSize;
+    }
+
+    // a truncated table is read entry by entry to report where it ends
+    uint64_t start = file.GetPosition();
+    if (rowSize == 0 || start + (uint64_t)rowSize * numEntries > m_parentAtom.GetEnd()) {
+        return false;
+    }
+
+    delete m_pPager;
+    m_pPager = new MP4TablePager(file, start, rowSize, numEntries);
+
+    uint32_t offset = 0;
+    for (uint32_t j = 0; j < m_pProperties.Size(); j++) {
+        MP4IntegerProperty* pProperty = (MP4IntegerProperty*)m_pProperties[j];
+        if (pProperty->IsImplicit()) {
+            pProperty->SetCount(numEntries);
+            continue;
+        }
+        pProperty->SetPager(m_pPager, offset);
+        offset += IntegerPropertySize(pProperty->GetType());
     }
+
+    file.SetPosition(start + (uint64_t)rowSize * numEntries);
+    return true;
+}
+
+// Sample tables are read and written in large blocks rather than one
+// value at a time; rows are split into the columns afterwards.
+
+static const uint32_t BULK_BLOCK_SIZE = 1 << 20;
+
+// bytes per row if the table can be handled by ReadBulk/WriteBulk, else 0;
+// *pValueSize gets the width shared by all columns, 0 if they differ
+uint32_t MP4TableProperty::GetBulkRowSize(uint32_t numEntries, uint32_t* pValueSize)
+{
+    const char* type = m_parentAtom.GetType();
+    if (numEntries == 0 || !(MP4Atom::IsDeferrableType(type) ||
+        ATOMID(type) == ATOMID("elst") || ATOMID(type) == ATOMID("trun")))
+    {
+        return 0;
+    }
+
+    uint32_t rowSize = 0;
+    *pValueSize = 0;
+    for (uint32_t j = 0; j < m_pProperties.Size(); j++) {
+        if (m_pProperties[j]->IsImplicit()) {
+            continue;
+        }
+        uint32_t valueSize = IntegerPropertySize(m_pProperties[j]->GetType());
+        if (valueSize == 0) {
+            return 0;
+        }
+        if (rowSize == 0) {
+            *pValueSize = valueSize;
+        } else if (valueSize != *pValueSize) {
+            *pValueSize = 0;
+        }
+        rowSize += valueSize;
+    }
+    if (*pValueSize != 4 && *pValueSize != 8) {
+        *pValueSize = 0;
+    }
+    return rowSize;
+}
+
+bool MP4TableProperty::ReadBulk(MP4File& file, uint32_t numEntries)
+{
+    uint32_t valueSize;
+    uint32_t rowSize = GetBulkRowSize(numEntries, &valueSize);
+
+    // a truncated table is read entry by entry to report where it ends
+    if (rowSize == 0 || file.GetPosition() + (uint64_t)rowSize * numEntries > m_parentAtom.GetEnd()) {
+        return false;
+    }
+
+    uint32_t blockRows = max(BULK_BLOCK_SIZE / rowSize, (uint32_t)1);
+    vector<uint8_t> block((size_t)min(blockRows, numEntries) * rowSize);
+
+    for (uint32_t first = 0; first < numEntries; first += blockRows) {
+        uint32_t count = min(blockRows, numEntries - first);
+        file.ReadBytes(&block[0], count * rowSize);
+
+        // columns of one width are swapped in a single pass over the block
+        if (valueSize == 4) {
+            MP4ConvertBigEndian32(&block[0], &block[0], count * rowSize / 4);
+        } else if (valueSize == 8) {
+            MP4ConvertBigEndian64(&block[0], &block[0], count * rowSize / 8);
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t j = 0; j < m_pProperties.Size(); j++) {
+            MP4IntegerProperty* pProperty = (MP4IntegerProperty*)m_pProperties[j];
+            if (pProperty->IsImplicit()) {
+                continue;
+            }
+            pProperty->ReadRows(&block[0], rowSize, offset, first, count, valueSize != 0);
+            offset += IntegerPropertySize(pProperty->GetType());
+        }
+    }
+    return true;
+}
+
+bool MP4TableProperty::WriteBulk(MP4File& file, uint32_t numEntries)
+{
+    uint32_t valueSize;
+    uint32_t rowSize = GetBulkRowSize(numEntries, &valueSize);
+    if (rowSize == 0) {
+        return false;
+    }
+
+    uint32_t blockRows = max(BULK_BLOCK_SIZE / rowSize, (uint32_t)1);
+    vector<uint8_t> block((size_t)min(blockRows, numEntries) * rowSize);
+
+    for (uint32_t first = 0; first < numEntries; first += blockRows) {
+        uint32_t count = min(blockRows, numEntries - first);
+
+        uint32_t offset = 0;
+        for (uint32_t j = 0; j < m_pProperties.Size(); j++) {
+            MP4IntegerProperty* pProperty = (MP4IntegerProperty*)m_pProperties[j];
+            if (pProperty->IsImplicit()) {
+                continue;
+            }
+            pProperty->WriteRows(&block[0], rowSize, offset, first, count, valueSize != 0);
+            offset += IntegerPropertySize(pProperty->GetType());
+        }
+
+        if (valueSize == 4) {
+            MP4ConvertBigEndian32(&block[0], &block[0], count * rowSize / 4);
+        } else if (valueSize == 8) {
+            MP4ConvertBigEndian64(&block[0], &block[0], count * rowSize / 8);
+        }
+        file.WriteBytes(&block[0], count * rowSize);
+    }
+    return true;
 }
 
 void MP4TableProperty::ReadEntry(MP4File& file, uint32_t index)
@@ -847,6 +1050,10 @@ void MP4TableProperty::Write(MP4File& file, uint32_t index)
         ASSERT(m_pProperties[0]->GetCount() == numEntries);
     }
 
+    if (WriteBulk(file, numEntries)) {
+        return;
+    }
+
     for (uint32_t i = 0; i < numEntries; i++) {
         WriteEntry(file, i);
     }
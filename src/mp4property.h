@@ -78,6 +78,15 @@ public:
         m_implicit = value;
     }
 
+    // values not yet read from the file, see MP4Atom::Materialize(); the
+    // release store pairs with the acquire load of readers that skip its lock
+    bool IsDeferred() {
+        return m_deferred.load(std::memory_order_acquire);
+    }
+    virtual void SetDeferred(bool value = true) {
+        m_deferred.store(value, std::memory_order_release);
+    }
+
     virtual uint32_t GetCount() = 0;
     virtual void SetCount(uint32_t count) = 0;
 
@@ -93,11 +102,15 @@ public:
     virtual bool FindProperty(const char* name,
                               MP4Property** ppProperty, uint32_t* pIndex = NULL);
 
+protected:
+    void Materialize();
+
 protected:
     MP4Atom& m_parentAtom;
     const char* m_name;
     bool m_readOnly;
     bool m_implicit;
+    std::atomic<bool> m_deferred;
 
 private:
     MP4Property();
@@ -110,9 +123,38 @@ typedef MP4Array<MP4Property*> MP4PropertyArray;
 class MP4IntegerProperty : public MP4Property {
 protected:
     MP4IntegerProperty(MP4Atom& parentAtom, const char* name)
-            : MP4Property(parentAtom, name) { };
+            : MP4Property(parentAtom, name)
+            , m_pPager(NULL)
+            , m_pagerOffset(0)
+            , m_pPacked(NULL) { };
 
 public:
+    ~MP4IntegerProperty() {
+        delete m_pPacked;
+    }
+
+    // values are decoded from the rows of pPager, at offset within a row
+    virtual void SetPager(MP4TablePager* pPager, uint32_t offset) = 0;
+    bool IsPaged() {
+        return m_pPager != NULL;
+    }
+
+    // move the values into an MP4PackedArray
+    virtual void Pack() = 0;
+    bool IsPacked() {
+        return m_pPacked != NULL;
+    }
+
+    // decode values first..first+count-1 from rows of rowSize bytes, each
+    // holding this column at offset; hostOrder if the rows were converted
+    // with MP4ConvertBigEndian32/64 already
+    virtual void ReadRows(const uint8_t* rows, uint32_t rowSize, uint32_t offset,
+                          uint32_t first, uint32_t count, bool hostOrder) = 0;
+
+    // the reverse of ReadRows
+    virtual void WriteRows(uint8_t* rows, uint32_t rowSize, uint32_t offset,
+                           uint32_t first, uint32_t count, bool hostOrder) = 0;
+
     uint64_t GetValue(uint32_t index = 0);
 
     void SetValue(uint64_t value, uint32_t index = 0);
@@ -123,6 +165,11 @@ public:
 
     void IncrementValue(int32_t increment = 1, uint32_t index = 0);
 
+protected:
+    MP4TablePager*  m_pPager;
+    uint32_t        m_pagerOffset;
+    MP4PackedArray* m_pPacked;
+
 private:
     MP4IntegerProperty();
     MP4IntegerProperty ( const MP4IntegerProperty &src );
@@ -149,42 +196,110 @@ public:
     }
 
     uint32_t GetCount() {
+        if (IsDeferred()) Materialize();
+        if (m_pPager) return m_pPager->GetNumRows();
+        if (m_pPacked) return m_pPacked->Size();
         return m_values.Size();
     }
 
     void SetCount(uint32_t count) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked) Unpack();
         m_values.Resize(count);
     }
 
     type GetValue(uint32_t index = 0) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager) return m_pPager->GetValue<type, size>(index, m_pagerOffset);
+        if (m_pPacked) return (type)m_pPacked->Get(index);
         return m_values[index];
     }
 
     void SetValue(type value, uint32_t index = 0) {
+        if (IsDeferred()) Materialize();
         if (m_readOnly) { 
             ostringstream msg;
             msg << "property is read-only: " << m_name;
             throw new PLATFORM_EXCEPTION(msg.str().c_str(), EACCES);
         }
+        if (m_pPager || m_pPacked) Unpack();
         m_values[index] = value;
     }
 
     void AddValue(type value) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked) Unpack();
         m_values.Add(value);
     }
 
     void InsertValue(type value, uint32_t index) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked) Unpack();
         m_values.Insert(value, index);
     }
 
     void DeleteValue(uint32_t index) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked) Unpack();
         m_values.Delete(index);
     }
 
     void IncrementValue(int32_t increment = 1, uint32_t index = 0) {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked) Unpack();
         m_values[index] += increment;
     }
 
+    void SetPager(MP4TablePager* pPager, uint32_t offset) {
+        m_values.Resize(0);
+        m_pPager = pPager;
+        m_pagerOffset = offset;
+    }
+
+    void Pack() {
+        if (IsDeferred()) Materialize();
+        if (m_pPager || m_pPacked || m_values.Size() == 0) return;
+        m_pPacked = new MP4PackedArray(&m_values[0], m_values.Size());
+        m_values.Resize(0);
+    }
+
+    void ReadRows(const uint8_t* rows, uint32_t rowSize, uint32_t offset,
+                  uint32_t first, uint32_t count, bool hostOrder) {
+        if (count == 0) return;
+        type* values = &m_values[first];
+        rows += offset;
+        if (hostOrder) {
+            ASSERT(size == 8 * sizeof(type));
+            if (rowSize == sizeof(type)) {
+                memcpy(values, rows, count * sizeof(type));
+                return;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                memcpy(&values[i], rows + i * rowSize, sizeof(type));
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            values[i] = MP4DecodeBigEndian<type, size>(rows + i * rowSize);
+        }
+    }
+
+    void WriteRows(uint8_t* rows, uint32_t rowSize, uint32_t offset,
+                   uint32_t first, uint32_t count, bool hostOrder) {
+        rows += offset;
+        if (hostOrder) {
+            ASSERT(size == 8 * sizeof(type));
+            for (uint32_t i = 0; i < count; i++) {
+                type value = GetValue(first + i);
+                memcpy(rows + i * rowSize, &value, sizeof(type));
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            MP4EncodeBigEndian<type, size>(GetValue(first + i), rows + i * rowSize);
+        }
+    }
+
     void Read(MP4File& file, uint32_t index = 0) {
         if (m_implicit) {
             return;
@@ -196,12 +311,26 @@ public:
         if (m_implicit) {
             return;
         }
-        file.WriteUInt<type, size>(m_values[index]);
+        file.WriteUInt<type, size>(GetValue(index));
     }
 
     void Dump(uint8_t indent,
         bool dumpImplicits, uint32_t index = 0);
 
+protected:
+    // decode every value before the values are changed
+    void Unpack() {
+        uint32_t count = GetCount();
+        m_values.Resize(count);
+        for (uint32_t i = 0; i < count; i++) {
+            m_values[i] = GetValue(i);
+        }
+
+        delete m_pPacked;
+        m_pPacked = NULL;
+        m_pPager = NULL;
+    }
+
 protected:
     MP4Array<type> m_values;
 
@@ -552,6 +681,12 @@ public:
         return m_pProperties[index];
     }
 
+    void SetDeferred(bool value = true);
+
+    MP4TablePager* GetPager() {
+        return m_pPager;
+    }
+
     virtual uint32_t GetCount() {
         return m_pCountProperty->GetValue();
     }
@@ -574,9 +709,16 @@ protected:
     bool FindContainedProperty(const char* name,
                                MP4Property** ppProperty, uint32_t* pIndex);
 
+protected:
+    bool ReadPaged(MP4File& file, uint32_t numEntries);
+    bool ReadBulk(MP4File& file, uint32_t numEntries);
+    bool WriteBulk(MP4File& file, uint32_t numEntries);
+    uint32_t GetBulkRowSize(uint32_t numEntries, uint32_t* pValueSize);
+
 protected:
     MP4IntegerProperty* m_pCountProperty;
     MP4PropertyArray    m_pProperties;
+    MP4TablePager*      m_pPager;
 
 private:
     MP4TableProperty();
@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4SampleCursor::MP4SampleCursor( MP4Track& track )
+    : m_track      ( track )
+    , m_sampleId   ( MP4_INVALID_SAMPLE_ID )
+    , m_sttsIndex  ( 0 )
+    , m_sttsLeft   ( 0 )
+    , m_decodeTime ( 0 )
+    , m_cttsIndex  ( 0 )
+    , m_cttsLeft   ( 0 )
+    , m_stscIndex  ( 0 )
+    , m_chunkId    ( 0 )
+    , m_chunkLeft  ( 0 )
+    , m_offset     ( 0 )
+    , m_stssIndex  ( 0 )
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MP4SampleCursor::Seek( MP4SampleId sampleId )
+{
+    MP4Track& t = m_track;
+
+    m_sampleId = MP4_INVALID_SAMPLE_ID;
+    if( !t.m_hasSampleTables || sampleId == MP4_INVALID_SAMPLE_ID || sampleId > t.GetNumberOfSamples() )
+        return false;
+
+    // the lookups below build indexes and update per-track caches
+    std::lock_guard<std::mutex> lock( t.m_readMutex );
+
+    // movie fragments keep their own cursor
+    if( t.GetFragmentSample( sampleId ) != (uint32_t)-1 ) {
+        m_sampleId = sampleId;
+        return true;
+    }
+
+    // stts, through the cumulative index
+    if( !t.BuildSttsIndex() )
+        return false;
+    const uint32_t numStts = t.m_pSttsCountProperty->GetValue();
+    uint32_t sttsIndex = 0;
+    for( uint32_t count = numStts; count > 0; ) {
+        const uint32_t half = count / 2;
+        if( t.m_sttsIndex[sttsIndex + half + 1].sampleId <= sampleId ) {
+            sttsIndex += half + 1;
+            count -= half + 1;
+        }
+        else {
+            count = half;
+        }
+    }
+    if( sttsIndex >= numStts || sampleId >= t.m_sttsIndex[numStts].sampleId )
+        return false;
+
+    const MP4SampleId sttsFirst = t.m_sttsIndex[sttsIndex].sampleId;
+    m_sttsIndex  = sttsIndex;
+    m_sttsLeft   = t.m_pSttsSampleCountProperty->GetValue( sttsIndex ) - (sampleId - sttsFirst);
+    m_decodeTime = t.m_sttsIndex[sttsIndex].startTime +
+                   (MP4Timestamp)(sampleId - sttsFirst) * t.m_pSttsSampleDeltaProperty->GetValue( sttsIndex );
+
+    // ctts, if any
+    m_cttsIndex = 0;
+    m_cttsLeft  = 0;
+    if( t.m_pCttsCountProperty && t.m_pCttsCountProperty->GetValue() ) {
+        MP4SampleId cttsFirst;
+        const uint32_t cttsIndex = t.GetSampleCttsIndex( sampleId, &cttsFirst );
+        if( cttsIndex != (uint32_t)-1 ) {
+            m_cttsIndex = cttsIndex;
+            m_cttsLeft  = t.m_pCttsSampleCountProperty->GetValue( cttsIndex ) - (sampleId - cttsFirst);
+        }
+        else {
+            m_cttsIndex = t.m_pCttsCountProperty->GetValue();
+        }
+    }
+
+    // stsc and the chunk offset
+    const uint32_t stscIndex = t.GetSampleStscIndex( sampleId );
+    if( stscIndex == (uint32_t)-1 )
+        return false;
+
+    const uint32_t samplesPerChunk = t.m_pStscSamplesPerChunkProperty->GetValue( stscIndex );
+    if( samplesPerChunk == 0 )
+        return false;
+
+    const MP4SampleId stscFirst = t.m_pStscFirstSampleProperty->GetValue( stscIndex );
+    m_stscIndex = stscIndex;
+    m_chunkId   = t.m_pStscFirstChunkProperty->GetValue( stscIndex ) + (sampleId - stscFirst) / samplesPerChunk;
+    m_chunkLeft = samplesPerChunk - (sampleId - stscFirst) % samplesPerChunk;
+    m_offset    = t.GetSampleFileOffset( sampleId );
+    if( m_offset == (uint64_t)-1 )
+        return false;
+
+    // stss, the first sync sample at or after sampleId
+    m_stssIndex = 0;
+    if( t.m_pStssCountProperty ) {
+        for( uint32_t count = t.m_pStssCountProperty->GetValue(); count > 0; ) {
+            const uint32_t half = count / 2;
+            if( t.m_pStssSampleProperty->GetValue( m_stssIndex + half ) < sampleId ) {
+                m_stssIndex += half + 1;
+                count -= half + 1;
+            }
+            else {
+                count = half;
+            }
+        }
+    }
+
+    m_sampleId = sampleId;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MP4SampleCursor::Next( MP4SampleRecord& record )
+{
+    MP4Track& t = m_track;
+
+    if( m_sampleId == MP4_INVALID_SAMPLE_ID || m_sampleId > t.GetNumberOfSamples() )
+        return false;
+
+    const uint32_t fragmentSample = t.GetFragmentSample( m_sampleId );
+    if( fragmentSample != (uint32_t)-1 )
+        return NextFragmentSample( fragmentSample, record );
+
+    // step into the next stts, ctts and stsc entries where needed
+    while( m_sttsLeft == 0 ) {
+        if( ++m_sttsIndex >= t.m_pSttsCountProperty->GetValue() )
+            return false;
+        m_sttsLeft = t.m_pSttsSampleCountProperty->GetValue( m_sttsIndex );
+    }
+
+    if( m_cttsLeft == 0 && t.m_pCttsCountProperty ) {
+        const uint32_t numCtts = t.m_pCttsCountProperty->GetValue();
+        while( m_cttsLeft == 0 && m_cttsIndex + 1 < numCtts )
+            m_cttsLeft = t.m_pCttsSampleCountProperty->GetValue( ++m_cttsIndex );
+    }
+
+    while( m_chunkLeft == 0 ) {
+        if( ++m_chunkId > t.GetNumberOfChunks() )
+            return false;
+
+        const uint32_t numStsc = t.m_pStscCountProperty->GetValue();
+        while( m_stscIndex + 1 < numStsc &&
+               t.m_pStscFirstChunkProperty->GetValue( m_stscIndex + 1 ) <= m_chunkId )
+        {
+            m_stscIndex++;
+        }
+        m_chunkLeft = t.m_pStscSamplesPerChunkProperty->GetValue( m_stscIndex );
+        m_offset    = t.m_pChunkOffsetProperty->GetValue( m_chunkId - 1 );
+    }
+
+    record.sampleId  = m_sampleId;
+    record.offset    = m_offset;
+    record.numBytes  = t.GetSampleSize( m_sampleId );
+    record.startTime = m_decodeTime;
+    record.duration  = t.m_pSttsSampleDeltaProperty->GetValue( m_sttsIndex );
+
+    record.renderingOffset = 0;
+    if( m_cttsLeft )
+        record.renderingOffset = t.m_pCttsSampleOffsetProperty->GetValue( m_cttsIndex );
+    // ctts offsets are taken as signed, as in version 1 ctts
+    const int64_t presentationTime = (int64_t)m_decodeTime + (int32_t)record.renderingOffset;
+    record.presentationTime = (MP4Timestamp)max( presentationTime, (int64_t)0 );
+
+    record.isSyncSample = true;
+    if( t.m_pStssCountProperty ) {
+        record.isSyncSample = m_stssIndex < t.m_pStssCountProperty->GetValue() &&
+                              t.m_pStssSampleProperty->GetValue( m_stssIndex ) == m_sampleId;
+        if( record.isSyncSample )
+            m_stssIndex++;
+    }
+
+    record.dependencyFlags = 0;
+    if( m_sampleId <= t.m_sdtpLog.size() )
+        record.dependencyFlags = (uint8_t)t.m_sdtpLog[m_sampleId - 1];
+
+    record.sampleDescriptionIndex = t.m_pStscSampleDescrIndexProperty->GetValue( m_stscIndex );
+
+    m_decodeTime += record.duration;
+    m_sttsLeft--;
+    if( m_cttsLeft )
+        m_cttsLeft--;
+    m_chunkLeft--;
+    m_offset += record.numBytes;
+    m_sampleId++;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool MP4SampleCursor::NextFragmentSample( uint32_t fragmentSample, MP4SampleRecord& record )
+{
+    MP4FragmentIndex& index = *m_track.m_pFragmentIndex;
+
+    // each lookup steps the cursor of the index, which is shared by every
+    // reader of the track; taken in order it only moves along one run
+    std::lock_guard<std::mutex> lock( m_track.m_readMutex );
+
+    record.sampleId  = m_sampleId;
+    record.offset    = index.GetSampleFileOffset( fragmentSample );
+    record.numBytes  = index.GetSampleSize( fragmentSample );
+    index.GetSampleTimes( fragmentSample, &record.startTime, &record.duration );
+
+    record.renderingOffset = index.GetSampleRenderingOffset( fragmentSample );
+    const int64_t presentationTime = (int64_t)record.startTime + (int32_t)record.renderingOffset;
+    record.presentationTime = (MP4Timestamp)max( presentationTime, (int64_t)0 );
+
+    const uint32_t flags = index.GetSampleFlags( fragmentSample );
+    record.isSyncSample           = MP4FragmentIndex::IsSyncSampleFlags( flags );
+    record.dependencyFlags        = MP4FragmentIndex::DependencyFlags( flags );
+    record.sampleDescriptionIndex = index.GetSampleDescriptionIndex( fragmentSample );
+
+    m_sampleId++;
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
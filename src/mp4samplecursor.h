@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef MP4V2_IMPL_MP4SAMPLECURSOR_H
+#define MP4V2_IMPL_MP4SAMPLECURSOR_H
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Walks the samples of a track in decoding order.
+ *
+ * Keeps a position in each of the stts, ctts, stsc, stco/co64 and stss
+ * tables, so stepping to the next sample is constant time instead of a
+ * lookup per table and per sample. Seek() repositions all of them with the
+ * track's binary searches. Samples of movie fragments are left to the
+ * cursor of the track's MP4FragmentIndex. Backs the MP4SampleIterator C API.
+ */
+class MP4SampleCursor
+{
+public:
+    MP4SampleCursor( MP4Track& track );
+
+    // position on sampleId; false if there is no such sample
+    bool Seek( MP4SampleId sampleId );
+
+    // describe the current sample and move past it; false at the end
+    bool Next( MP4SampleRecord& record );
+
+private:
+    bool NextFragmentSample( uint32_t fragmentSample, MP4SampleRecord& record );
+
+private:
+    MP4Track&    m_track;
+    MP4SampleId  m_sampleId;    // sample returned by the next Next(), 0 if none
+
+    uint32_t     m_sttsIndex;
+    uint32_t     m_sttsLeft;    // samples of the stts entry from m_sampleId on
+    MP4Timestamp m_decodeTime;
+
+    uint32_t     m_cttsIndex;
+    uint32_t     m_cttsLeft;    // likewise for ctts, 0 without ctts
+
+    uint32_t     m_stscIndex;
+    MP4ChunkId   m_chunkId;
+    uint32_t     m_chunkLeft;   // samples of the chunk from m_sampleId on
+    uint64_t     m_offset;      // file offset of m_sampleId
+
+    uint32_t     m_stssIndex;   // first stss entry not before m_sampleId
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4SAMPLECURSOR_H
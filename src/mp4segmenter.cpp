@@ -0,0 +1,242 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+// samples read from the source per MP4File::ReadSamples() call, at most
+static const uint32_t s_readSamples = 1024;
+static const uint32_t s_readBufferSize = 4 << 20;
+
+// true if format has a single conversion, and that is a %u
+static bool IsSegmentFileNameFormat( const char* format )
+{
+    uint32_t numConversions = 0;
+    for( const char* p = format; *p; p++ ) {
+        if( *p != '%' )
+            continue;
+        if( p[1] == '%' ) {
+            p++;
+            continue;
+        }
+        p++;
+        while( *p && strchr( "-+ #0123456789", *p ))
+            p++;
+        if( *p != 'u' )
+            return false;
+        numConversions++;
+    }
+    return numConversions == 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+MP4Segmenter::MP4Segmenter( const char* srcFileName, MP4Duration duration )
+    : m_srcFileName ( srcFileName )
+    , m_numSegments ( 0 )
+    , m_bufferSize  ( s_readBufferSize )
+    , m_nextSegment ( 0 )
+    , m_failure     ( NULL )
+{
+    if( duration == 0 )
+        throw new EXCEPTION("segment duration is zero");
+
+    // the workers read side by side through the one handle
+    m_src.Read( srcFileName, NULL, NULL, NULL, MP4_READ_PREAD );
+    Plan( duration );
+}
+
+MP4Segmenter::~MP4Segmenter()
+{
+    delete m_failure;
+}
+
+// Finds the first sample of each segment in every track
+void MP4Segmenter::Plan( MP4Duration duration )
+{
+    MP4Track* pReference = m_src.GetFragmentReferenceTrack();
+    if( !pReference || pReference->GetNumberOfSamples() == 0 )
+        throw new EXCEPTION("no samples to segment");
+
+    const uint32_t numSamples = pReference->GetNumberOfSamples();
+    const uint32_t timeScale = pReference->GetTimeScale();
+
+    vector<MP4SampleId> syncSamples( pReference->GetSyncSampleList( NULL, 0 ));
+    if( !syncSamples.empty() )
+        pReference->GetSyncSampleList( &syncSamples[0], (uint32_t)syncSamples.size() );
+
+    // segments of the reference track, and the decode times they start at
+    vector<MP4SampleId> referenceBoundaries( 1, 1 );
+    vector<MP4Timestamp> startTimes( 1 );
+    pReference->GetSampleTimes( 1, &startTimes[0], NULL );
+    for( size_t i = 0; i < syncSamples.size(); i++ ) {
+        if( syncSamples[i] <= referenceBoundaries.back() || syncSamples[i] > numSamples )
+            continue;
+
+        MP4Timestamp startTime;
+        pReference->GetSampleTimes( syncSamples[i], &startTime, NULL );
+        if( MP4ConvertTime( startTime - startTimes.back(), timeScale, 1000 ) >= duration ) {
+            referenceBoundaries.push_back( syncSamples[i] );
+            startTimes.push_back( startTime );
+        }
+    }
+    referenceBoundaries.push_back( numSamples + 1 );
+    m_numSegments = (uint32_t)startTimes.size();
+
+    // the other tracks start their segments at the first sample at or
+    // after those times
+    for( uint32_t i = 0; i < m_src.GetNumberOfTracks(); i++ ) {
+        MP4TrackId trackId = m_src.FindTrackId( i );
+        MP4Track* pTrack = m_src.GetTrack( trackId );
+        m_trackIds.push_back( trackId );
+        m_bufferSize = max( m_bufferSize, pTrack->GetMaxSampleSize() );
+
+        if( pTrack == pReference ) {
+            m_boundaries.push_back( referenceBoundaries );
+            continue;
+        }
+
+        const uint32_t numTrackSamples = pTrack->GetNumberOfSamples();
+        vector<MP4SampleId> boundaries( 1, 1 );
+        for( size_t j = 1; j < startTimes.size(); j++ ) {
+            MP4Timestamp when = MP4ConvertTime( startTimes[j], timeScale, pTrack->GetTimeScale() );
+            MP4SampleId sampleId = numTrackSamples > 0
+                ? pTrack->GetSampleIdFromTime( when ) : MP4_INVALID_SAMPLE_ID;
+            if( sampleId == MP4_INVALID_SAMPLE_ID ) {
+                sampleId = numTrackSamples + 1;
+            } else {
+                MP4Timestamp startTime;
+                pTrack->GetSampleTimes( sampleId, &startTime, NULL );
+                if( startTime < when )
+                    sampleId++;
+            }
+            boundaries.push_back( max( sampleId, boundaries.back() ));
+        }
+        boundaries.push_back( numTrackSamples + 1 );
+        m_boundaries.push_back( boundaries );
+    }
+}
+
+void MP4Segmenter::Write( const char* initFileName, const char* segmentFileNameFormat,
+                          uint32_t numWorkers )
+{
+    if( !IsSegmentFileNameFormat( segmentFileNameFormat ))
+        throw new EXCEPTION("segment file name format needs a single %u");
+    m_segmentFileNameFormat = segmentFileNameFormat;
+
+    {
+        MP4File writer;
+        writer.ReadSegmentTemplate( m_srcFileName.c_str() );
+        writer.WriteInitSegment( initFileName );
+    }
+
+    if( numWorkers == 0 )
+        numWorkers = max( std::thread::hardware_concurrency(), 1u );
+    numWorkers = min( numWorkers, m_numSegments );
+
+    log.verbose1f("\"%s\": Write: %u segments with %u workers",
+                  m_srcFileName.c_str(), m_numSegments, numWorkers);
+
+    m_nextSegment = 0;
+    vector<std::thread> workers;
+    for( uint32_t i = 0; i < numWorkers; i++ )
+        workers.push_back( std::thread( &MP4Segmenter::Work, this ));
+    for( size_t i = 0; i < workers.size(); i++ )
+        workers[i].join();
+
+    if( m_failure ) {
+        Exception* x = m_failure;
+        m_failure = NULL;
+        throw x;
+    }
+}
+
+// Takes segments in order until there are none left or one failed
+void MP4Segmenter::Work()
+{
+    try {
+        MP4File writer;
+        writer.ReadSegmentTemplate( m_srcFileName.c_str() );
+
+        vector<uint8_t> buffer( m_bufferSize );
+        vector<MP4SampleInfo> info( s_readSamples );
+        while( true ) {
+            uint32_t segment;
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                if( m_failure || m_nextSegment == m_numSegments )
+                    return;
+                segment = m_nextSegment++;
+            }
+            WriteSegment( writer, segment, buffer, info );
+        }
+    }
+    catch( Exception* x ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if( m_failure )
+            delete x;
+        else
+            m_failure = x;
+    }
+    catch( ... ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if( !m_failure )
+            m_failure = new EXCEPTION("segment could not be written");
+    }
+}
+
+void MP4Segmenter::WriteSegment( MP4File& writer, uint32_t segment,
+                                 vector<uint8_t>& buffer, vector<MP4SampleInfo>& info )
+{
+    vector<char> fileName( snprintf( NULL, 0, m_segmentFileNameFormat.c_str(), segment + 1 ) + 1 );
+    snprintf( &fileName[0], fileName.size(), m_segmentFileNameFormat.c_str(), segment + 1 );
+
+    writer.BeginMediaSegment( &fileName[0], segment + 1 );
+    for( size_t i = 0; i < m_trackIds.size(); i++ ) {
+        MP4SampleId sampleId = m_boundaries[i][segment];
+        const MP4SampleId endSampleId = m_boundaries[i][segment + 1];
+
+        while( sampleId < endSampleId ) {
+            uint32_t numSamples = m_src.ReadSamples( m_trackIds[i], sampleId,
+                                  min( endSampleId - sampleId, s_readSamples ),
+                                  buffer.data(), m_bufferSize, info.data() );
+            if( numSamples == 0 )
+                throw new EXCEPTION("samples could not be read");
+
+            // the tfdt of the track
+            if( sampleId == m_boundaries[i][segment] )
+                writer.GetTrack( m_trackIds[i] )->SetFragmentStartTime( info[0].startTime );
+
+            for( uint32_t j = 0; j < numSamples; j++ ) {
+                writer.WriteSampleDependency( m_trackIds[i], buffer.data() + info[j].offset,
+                                              info[j].numBytes, info[j].duration,
+                                              info[j].renderingOffset, info[j].isSyncSample,
+                                              info[j].dependencyFlags );
+            }
+            sampleId += numSamples;
+        }
+    }
+    writer.EndMediaSegment();
+
+    log.verbose2f("\"%s\": WriteSegment: %s", m_srcFileName.c_str(), &fileName[0]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
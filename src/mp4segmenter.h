@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MP4V2_IMPL_MP4SEGMENTER_H
+#define MP4V2_IMPL_MP4SEGMENTER_H
+
+#include <mutex>
+#include <thread>
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Packager of a progressive file into an init segment and media segments
+ * of movie fragments, each in a file of its own.
+ *
+ * Segments start at sync samples of the fragment reference track (see
+ * MP4File::GetFragmentReferenceTrack()) once the previous one lasts the
+ * requested duration; the other tracks are cut at the same decode time.
+ * Since a segment only needs its stretch of the sample tables, a pool of
+ * workers writes them side by side: all read through one positionless
+ * handle of the source with MP4File::ReadSamples(), which coalesces
+ * adjacent samples, and each writes through an MP4File of its own built
+ * by MP4File::ReadSegmentTemplate().
+ */
+class MP4Segmenter
+{
+public:
+    // duration of the segments in milliseconds
+    MP4Segmenter( const char* srcFileName, MP4Duration duration );
+    ~MP4Segmenter();
+
+    // write the init segment and the media segments, named by a format
+    // with a single %u for their number from 1; numWorkers 0 for one per
+    // processor
+    void Write( const char* initFileName, const char* segmentFileNameFormat,
+                uint32_t numWorkers = 0 );
+
+    uint32_t GetNumberOfSegments() {
+        return m_numSegments;
+    }
+
+private:
+    void Plan( MP4Duration duration );
+    void Work();
+    void WriteSegment( MP4File& writer, uint32_t segment,
+                       vector<uint8_t>& buffer, vector<MP4SampleInfo>& info );
+
+private:
+    string             m_srcFileName;
+    string             m_segmentFileNameFormat;
+    MP4File            m_src;
+
+    // per track, the first sample of each segment and one past the last
+    vector<MP4TrackId>           m_trackIds;
+    vector<vector<MP4SampleId> > m_boundaries;
+    uint32_t                     m_numSegments;
+    uint32_t                     m_bufferSize;
+
+    std::mutex         m_mutex;
+    uint32_t           m_nextSegment;
+    Exception*         m_failure;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4SEGMENTER_H
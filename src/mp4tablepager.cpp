@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "src/impl.h"
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+const uint32_t MP4TablePager::BLOCK_ROWS;
+const uint32_t MP4TablePager::NUM_BLOCKS;
+
+MP4TablePager::MP4TablePager( MP4File& file, uint64_t offset, uint32_t rowSize, uint32_t numRows )
+    : m_file     ( file )
+    , m_offset   ( offset )
+    , m_rowSize  ( rowSize )
+    , m_numRows  ( numRows )
+    , m_mapped   ( file.GetMappedBytes( offset, rowSize * numRows ))
+    , m_useCount ( 0 )
+{
+    ASSERT( rowSize > 0 && numRows > 0 );
+
+    for( uint32_t i = 0; i < NUM_BLOCKS; i++ ) {
+        m_blocks[i].index   = numeric_limits<uint32_t>::max();
+        m_blocks[i].lastUse = 0;
+        m_blocks[i].data    = NULL;
+    }
+    m_lastBlock = &m_blocks[0];
+}
+
+MP4TablePager::~MP4TablePager()
+{
+    for( uint32_t i = 0; i < NUM_BLOCKS; i++ ) {
+        if( !m_blocks[i].data )
+            continue;
+        MP4Free( m_blocks[i].data );
+        m_file.TrackBufferMemory( -(int64_t)(BLOCK_ROWS * m_rowSize) );
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void MP4TablePager::LoadBlock( uint32_t block )
+{
+    Block* victim = &m_blocks[0];
+    for( uint32_t i = 0; i < NUM_BLOCKS; i++ ) {
+        if( m_blocks[i].index == block ) {
+            m_lastBlock = &m_blocks[i];
+            m_lastBlock->lastUse = ++m_useCount;
+            return;
+        }
+        if( m_blocks[i].lastUse < victim->lastUse )
+            victim = &m_blocks[i];
+    }
+
+    if( !victim->data ) {
+        victim->data = (uint8_t*)MP4Malloc( BLOCK_ROWS * m_rowSize );
+        m_file.TrackBufferMemory( BLOCK_ROWS * m_rowSize );
+    }
+
+    const uint32_t first = block * BLOCK_ROWS;
+    const uint32_t rows = min( BLOCK_ROWS, m_numRows - first );
+
+    // forget the block first, it is garbage if the read throws
+    victim->index = numeric_limits<uint32_t>::max();
+    m_file.ReadBytesAside( m_offset + (uint64_t)first * m_rowSize, victim->data, rows * m_rowSize );
+
+    victim->index = block;
+    victim->lastUse = ++m_useCount;
+    m_lastBlock = victim;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef MP4V2_IMPL_MP4TABLEPAGER_H
+#define MP4V2_IMPL_MP4TABLEPAGER_H
+
+namespace mp4v2 { namespace impl {
+
+///////////////////////////////////////////////////////////////////////////////
+
+class MP4File;
+
+/**
+ * On-disk bytes of a sample table, read on demand.
+ *
+ * The rows of a large stsz, stco, co64, stss, ... table are left in their
+ * big-endian file representation and the columns of the table decode the
+ * entries they are asked for. For a mapped file the rows are addressed in
+ * the mapping; otherwise a few blocks of rows are paged in at a time, so
+ * the resident size of the table stays bounded however long the file is.
+ *
+ * Lookups may come from concurrent sample readers; paging is serialized.
+ */
+class MP4TablePager
+{
+public:
+    static const uint32_t BLOCK_ROWS = 4096;
+    static const uint32_t NUM_BLOCKS = 4;
+
+    MP4TablePager( MP4File& file, uint64_t offset, uint32_t rowSize, uint32_t numRows );
+    ~MP4TablePager();
+
+    uint32_t GetNumRows() {
+        return m_numRows;
+    }
+
+    template<class type, int size> type GetValue( uint32_t index, uint32_t offset ) {
+        if( index >= m_numRows ) {
+            ostringstream msg;
+            msg << "illegal array index: " << index << " of " << m_numRows;
+            throw new PLATFORM_EXCEPTION(msg.str().c_str(), ERANGE);
+        }
+
+        if( m_mapped )
+            return MP4DecodeBigEndian<type, size>( m_mapped + (uint64_t)index * m_rowSize + offset );
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+        const uint32_t block = index / BLOCK_ROWS;
+        if( block != m_lastBlock->index )
+            LoadBlock( block );
+        return MP4DecodeBigEndian<type, size>( m_lastBlock->data + (index % BLOCK_ROWS) * m_rowSize + offset );
+    }
+
+private:
+    struct Block {
+        uint32_t index;
+        uint64_t lastUse;
+        uint8_t* data;
+    };
+
+    void LoadBlock( uint32_t block );
+
+private:
+    MP4File&       m_file;
+    uint64_t       m_offset;
+    uint32_t       m_rowSize;
+    uint32_t       m_numRows;
+    const uint8_t* m_mapped;
+
+    std::mutex m_mutex;
+    Block      m_blocks[NUM_BLOCKS];
+    Block*     m_lastBlock;
+    uint64_t   m_useCount;
+
+private:
+    MP4TablePager();
+    MP4TablePager( const MP4TablePager &src );
+    MP4TablePager &operator= ( const MP4TablePager &src );
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+}} // namespace mp4v2::impl
+
+#endif // MP4V2_IMPL_MP4TABLEPAGER_H
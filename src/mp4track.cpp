@@ -44,6 +44,11 @@ MP4Track::MP4Track(MP4File& file, MP4Atom& trakAtom)
     m_lastStsdIndex = 0;
     m_lastSampleFile = NULL;
 
+    m_accessPattern = MP4_ACCESS_RANDOM;
+    m_prefetchChunkId = 0;
+    m_prefetchNextChunkId = 0;
+    m_prefetchSampleId = MP4_INVALID_SAMPLE_ID;
+
     m_cachedReadSampleId = MP4_INVALID_SAMPLE_ID;
     m_pCachedReadSample = NULL;
     m_cachedReadSampleSize = 0;
@@ -71,6 +76,17 @@ MP4Track::MP4Track(MP4File& file, MP4Atom& trakAtom)
     m_cachedSfoSampleId = MP4_INVALID_SAMPLE_ID;
     m_cachedSfoSampleOffset = 0;
 
+    m_sfoIndexInterval = 16;
+    m_sfoIndexSampleId = 1;
+    m_sfoIndexChunkId = 1;
+    m_sfoIndexStscIndex = 0;
+
+    m_pFragmentIndex = NULL;
+    m_pendingFragmentsEndTime = 0;
+    m_fragmentStartTime = 0;
+    m_randomAccessStride = 1;
+    m_randomAccessCandidates = 0;
+
     bool success = true;
 
     MP4Integer32Property* pTrackIdProperty;
@@ -323,10 +339,12 @@ MP4Track::MP4Track(MP4File& file, MP4Atom& trakAtom)
 
 MP4Track::~MP4Track()
 {
+    delete m_pFragmentIndex;
     MP4Free(m_pCachedReadSample);
     m_pCachedReadSample = NULL;
     MP4Free(m_pChunkBuffer);
     m_pChunkBuffer = NULL;
+    m_File.TrackBufferMemory( -(int64_t)m_chunkBufferSize );
 }
 
 const char* MP4Track::GetType()
@@ -386,8 +404,12 @@ void MP4Track::ReadSample(
     MP4Duration*  pRenderingOffset,
     bool*         pIsSyncSample,
     bool*         hasDependencyFlags, 
-    uint32_t*     dependencyFlags )
+    uint32_t*     dependencyFlags,
+    bool*         pIsMapped )
 {
+    if( pIsMapped )
+        *pIsMapped = false;
+
     if( sampleId == MP4_INVALID_SAMPLE_ID ) {
         *pNumBytes = 0;
         log.errorf("%s: \"%s\": invalid sample id = 0",
@@ -400,11 +422,21 @@ void MP4Track::ReadSample(
         return;
     }
 
+    // the table lookups below update per-track caches
+    std::unique_lock<std::mutex> lock( m_readMutex );
+
+    // fragment samples carry their dependencies in the sample flags
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+
     if( hasDependencyFlags )
-        *hasDependencyFlags = !m_sdtpLog.empty();
+        *hasDependencyFlags = !m_sdtpLog.empty() || fragmentSample != (uint32_t)-1;
 
     if( dependencyFlags ) {
-        if( m_sdtpLog.empty() ) {
+        if( fragmentSample != (uint32_t)-1 ) {
+            *dependencyFlags = MP4FragmentIndex::DependencyFlags(
+                m_pFragmentIndex->GetSampleFlags(fragmentSample));
+        }
+        else if( m_sdtpLog.empty() ) {
             *dependencyFlags = 0;
         }
         else {
@@ -450,17 +482,24 @@ void MP4Track::ReadSample(
     log.verbose3f("\"%s\": ReadSample: track %u id %u offset 0x%" PRIx64 " size %u (0x%x)",
                   GetFile().GetFilename().c_str(), m_trackId, sampleId, fileOffset, *pNumBytes, *pNumBytes);
 
+    // callers that can live with a read-only buffer they must not free
+    // get a pointer straight into the mapped file
+    const uint8_t* mapped = NULL;
+    if (pIsMapped && *ppBytes == NULL)
+        mapped = m_File.GetMappedBytes( fileOffset, *pNumBytes, fin );
+
     bool bufferMalloc = false;
-    if (*ppBytes == NULL) {
+    if (mapped) {
+        *ppBytes = (uint8_t*)mapped;
+        *pIsMapped = true;
+    }
+    else if (*ppBytes == NULL) {
         *ppBytes = (uint8_t*)MP4Malloc(*pNumBytes);
         bufferMalloc = true;
     }
 
     uint64_t oldPos = m_File.GetPosition( fin ); // only used in mode == 'w'
     try {
-        m_File.SetPosition( fileOffset, fin );
-        m_File.ReadBytes( *ppBytes, *pNumBytes, fin );
-
         if (pStartTime || pDuration) {
             GetSampleTimes(sampleId, pStartTime, pDuration);
 
@@ -480,6 +519,22 @@ void MP4Track::ReadSample(
             log.verbose3f("\"%s\": ReadSample:  isSyncSample %u",
                           GetFile().GetFilename().c_str(), *pIsSyncSample);
         }
+
+        if (!mapped) {
+            MP4Prefetcher* prefetcher = NULL;
+            if( !fin && m_accessPattern != MP4_ACCESS_RANDOM ) {
+                prefetcher = m_File.GetPrefetcher();
+                SchedulePrefetch( sampleId );
+            }
+
+            // with a positionless provider the data read itself needs no
+            // lock, so readers of other samples are not held up by the I/O
+            if( !fin && !m_File.IsWriteMode() )
+                lock.unlock();
+
+            if( !prefetcher || !prefetcher->Read( m_trackId, fileOffset, *ppBytes, *pNumBytes ))
+                m_File.ReadBytesAt( fileOffset, *ppBytes, *pNumBytes, fin );
+        }
     }
 
     catch (Exception*) {
@@ -487,6 +542,10 @@ void MP4Track::ReadSample(
             MP4Free( *ppBytes );
             *ppBytes = NULL;
         }
+        else if( mapped ) {
+            *ppBytes = NULL;
+            *pIsMapped = false;
+        }
 
         if( m_File.IsWriteMode() )
             m_File.SetPosition( oldPos, fin );
@@ -498,6 +557,109 @@ void MP4Track::ReadSample(
         m_File.SetPosition( oldPos, fin );
 }
 
+uint32_t MP4Track::ReadSamples(
+    MP4SampleId    firstSampleId,
+    uint32_t       numSamples,
+    uint8_t*       pBytes,
+    uint32_t       numBytes,
+    MP4SampleInfo* pSampleInfo )
+{
+    if( firstSampleId == MP4_INVALID_SAMPLE_ID )
+        throw new EXCEPTION("invalid sample id");
+
+    if( !m_hasSampleTables )
+        return 0;
+
+    uint32_t numTrackSamples = GetNumberOfSamples();
+    if( firstSampleId > numTrackSamples )
+        return 0;
+    numSamples = min( numSamples, numTrackSamples - firstSampleId + 1 );
+
+    std::unique_lock<std::mutex> lock( m_readMutex );
+
+    // make sure nothing we are about to read is still in the chunk buffer
+    if( m_pChunkBuffer && firstSampleId + numSamples > m_writeSampleId - m_chunkSamples )
+        WriteChunkBuffer();
+
+    // a run is a stretch of samples laid out back to back in one file
+    struct Run {
+        File*    file;
+        uint64_t fileOffset;
+        uint32_t bufferOffset;
+        uint32_t size;
+    };
+    vector<Run> runs;
+
+    uint32_t used = 0;
+    uint32_t count = 0;
+    for( ; count < numSamples; count++ ) {
+        MP4SampleId sampleId = firstSampleId + count;
+
+        uint32_t sampleSize = GetSampleSize( sampleId );
+        if( sampleSize > numBytes - used )
+            break;
+
+        File* fin = GetSampleFile( sampleId );
+        if( fin == (File*)-1 )
+            throw new EXCEPTION("sample file could not be opened");
+
+        uint64_t fileOffset = GetSampleFileOffset( sampleId );
+        if( fileOffset == ((uint64_t)-1) )
+            throw new EXCEPTION("sample offset could not be determined");
+
+        MP4SampleInfo& info = pSampleInfo[count];
+        info.offset = used;
+        info.numBytes = sampleSize;
+        GetSampleTimes( sampleId, &info.startTime, &info.duration );
+        info.renderingOffset = GetSampleRenderingOffset( sampleId );
+        info.isSyncSample = IsSyncSample( sampleId );
+        info.dependencyFlags = sampleId <= m_sdtpLog.size() ? (uint8_t)m_sdtpLog[sampleId-1] : 0;
+        uint32_t fragmentSample = GetFragmentSample( sampleId );
+        if( fragmentSample != (uint32_t)-1 )
+            info.dependencyFlags = MP4FragmentIndex::DependencyFlags( m_pFragmentIndex->GetSampleFlags( fragmentSample ));
+
+        if( !runs.empty() ) {
+            Run& last = runs.back();
+            if( last.file == fin && last.fileOffset + last.size == fileOffset ) {
+                last.size += sampleSize;
+                used += sampleSize;
+                continue;
+            }
+        }
+
+        Run run = { fin, fileOffset, used, sampleSize };
+        runs.push_back( run );
+        used += sampleSize;
+    }
+
+    log.verbose3f("\"%s\": ReadSamples: track %u ids %u-%u in %u reads",
+                  GetFile().GetFilename().c_str(), m_trackId, firstSampleId,
+                  firstSampleId + count - 1, (uint32_t)runs.size());
+
+    // as in ReadSample() the I/O needs no lock for the file itself
+    bool external = false;
+    for( size_t i = 0; i < runs.size(); i++ )
+        external = external || runs[i].file != NULL;
+    if( !external && !m_File.IsWriteMode() )
+        lock.unlock();
+
+    uint64_t oldPos = m_File.GetPosition(); // only used in mode == 'w'
+    try {
+        for( size_t i = 0; i < runs.size(); i++ )
+            m_File.ReadBytesAt( runs[i].fileOffset, pBytes + runs[i].bufferOffset, runs[i].size, runs[i].file );
+    }
+    catch( Exception* ) {
+        if( m_File.IsWriteMode() )
+            m_File.SetPosition( oldPos );
+        throw;
+    }
+
+    if( m_File.IsWriteMode() )
+        m_File.SetPosition( oldPos );
+
+    return count;
+}
+
 void MP4Track::ReadSampleFragment(
     MP4SampleId sampleId,
     uint32_t sampleOffset,
@@ -546,6 +708,12 @@ void MP4Track::WriteSample(
         throw new EXCEPTION("no sample data");
     }
 
+    if (m_File.IsFragmentedWrite()) {
+        WriteFragmentSample(pBytes, numBytes, duration, renderingOffset,
+                            isSyncSample, 0);
+        return;
+    }
+
     if (m_isAmr == AMR_UNINITIALIZED ) {
         // figure out if this is an AMR audio track
         if (m_trakAtom.FindAtom("trak.mdia.minf.stbl.stsd.samr") ||
@@ -575,16 +743,8 @@ void MP4Track::WriteSample(
     }
 
     // append sample bytes to chunk buffer
-    if( m_sizeOfDataInChunkBuffer + numBytes > m_chunkBufferSize ) {
-        m_pChunkBuffer = (uint8_t*)MP4Realloc(m_pChunkBuffer, m_chunkBufferSize + numBytes);
-        if (m_pChunkBuffer == NULL) 
-            return;	
-        
-        m_chunkBufferSize += numBytes;
-    }
-
-    memcpy(&m_pChunkBuffer[m_sizeOfDataInChunkBuffer], pBytes, numBytes);
-    m_sizeOfDataInChunkBuffer += numBytes;
+    if (!AppendToChunkBuffer(pBytes, numBytes))
+        return;
     m_chunkSamples++;
     m_chunkDuration += duration;
 
@@ -616,13 +776,307 @@ void MP4Track::WriteSampleDependency(
     bool           isSyncSample,
     uint32_t       dependencyFlags )
 {
+    if (m_File.IsFragmentedWrite()) {
+        // fragments carry these in their sample flags rather than an sdtp
+        WriteFragmentSample(pBytes, numBytes, duration, renderingOffset,
+                            isSyncSample, dependencyFlags);
+        return;
+    }
+
     m_sdtpLog.push_back( dependencyFlags ); // record dependency flags for processing at finish
     WriteSample( pBytes, numBytes, duration, renderingOffset, isSyncSample );
 }
 
+// false if there is still no buffer, as for an empty first sample
+bool MP4Track::AppendToChunkBuffer(const uint8_t* pBytes, uint32_t numBytes)
+{
+    if( m_sizeOfDataInChunkBuffer + numBytes > m_chunkBufferSize ) {
+        m_pChunkBuffer = (uint8_t*)MP4Realloc(m_pChunkBuffer, m_chunkBufferSize + numBytes);
+        if (m_pChunkBuffer == NULL)
+            return false;
+
+        m_chunkBufferSize += numBytes;
+        m_File.TrackBufferMemory( numBytes );
+    }
+
+    memcpy(&m_pChunkBuffer[m_sizeOfDataInChunkBuffer], pBytes, numBytes);
+    m_sizeOfDataInChunkBuffer += numBytes;
+    return true;
+}
+
+void MP4Track::WriteFragmentSample(
+    const uint8_t* pBytes,
+    uint32_t       numBytes,
+    MP4Duration    duration,
+    MP4Duration    renderingOffset,
+    bool           isSyncSample,
+    uint32_t       dependencyFlags )
+{
+    if (pBytes == NULL && numBytes > 0) {
+        throw new EXCEPTION("no sample data");
+    }
+
+    if (duration == MP4_INVALID_DURATION) {
+        duration = GetFixedSampleDuration();
+    }
+    if (duration > 0xFFFFFFFF) {
+        throw new EXCEPTION("sample duration does not fit a movie fragment");
+    }
+
+    // the sample tables stay empty; the next moof describes the samples
+    // buffered here, see GenerateTrackFragment(); unlike WriteSample() an
+    // empty sample is kept, as it still has its entry in the trun
+    if (!AppendToChunkBuffer(pBytes, numBytes) && numBytes > 0) {
+        throw new EXCEPTION("cannot buffer sample");
+    }
+    m_chunkSamples++;
+    m_chunkDuration += duration;
+
+    FragmentSample sample;
+    sample.size = numBytes;
+    sample.duration = (uint32_t)duration;
+    sample.flags = (dependencyFlags & 0xFF) << 20;
+    if (!isSyncSample) {
+        sample.flags |= 0x00010000; // sample_is_non_sync_sample
+    }
+    sample.renderingOffset = (int32_t)renderingOffset;
+    m_fragmentSamples.push_back(sample);
+
+    UpdateModificationTimes();
+
+    m_writeSampleId++;
+}
+
+MP4Integer32Property* MP4Track::GenerateTrackFragment(MP4Atom& moofAtom)
+{
+    const uint32_t numSamples = (uint32_t)m_fragmentSamples.size();
+    ASSERT(numSamples > 0);
+
+    // values all samples share go in tfhd, the others in trun columns;
+    // a leading sync sample may differ in flags from the rest
+    const FragmentSample& first = m_fragmentSamples[0];
+    const FragmentSample& second = m_fragmentSamples[numSamples > 1 ? 1 : 0];
+    bool sameDuration = true;
+    bool sameSize = true;
+    bool sameFlags = true;
+    bool hasRenderingOffsets = false;
+    bool hasNegativeRenderingOffsets = false;
+    for (uint32_t i = 1; i < numSamples; i++) {
+        const FragmentSample& sample = m_fragmentSamples[i];
+        sameDuration = sameDuration && sample.duration == first.duration;
+        sameSize = sameSize && sample.size == first.size;
+        sameFlags = sameFlags && sample.flags == second.flags;
+    }
+    for (uint32_t i = 0; i < numSamples; i++) {
+        hasRenderingOffsets = hasRenderingOffsets || m_fragmentSamples[i].renderingOffset != 0;
+        hasNegativeRenderingOffsets = hasNegativeRenderingOffsets || m_fragmentSamples[i].renderingOffset < 0;
+    }
+
+    uint32_t tfhdFlags = 0x020000;  // default-base-is-moof
+    uint32_t trunFlags = 0x01;      // data-offset-present
+    if (sameDuration) {
+        tfhdFlags |= 0x08;
+    } else {
+        trunFlags |= 0x100;
+    }
+    if (sameSize) {
+        tfhdFlags |= 0x10;
+    } else {
+        trunFlags |= 0x200;
+    }
+    if (sameFlags) {
+        tfhdFlags |= 0x20;
+        if (first.flags != second.flags) {
+            trunFlags |= 0x04;
+        }
+    } else {
+        trunFlags |= 0x400;
+    }
+    if (hasRenderingOffsets) {
+        trunFlags |= 0x800;
+    }
+
+    MP4Atom* pTrafAtom = MP4Atom::CreateAtom(m_File, &moofAtom, "traf");
+    moofAtom.AddChildAtom(pTrafAtom);
+
+    MP4Atom* pTfhdAtom = MP4Atom::CreateAtom(m_File, pTrafAtom, "tfhd");
+    pTrafAtom->AddChildAtom(pTfhdAtom);
+    pTfhdAtom->SetFlags(tfhdFlags);
+    pTfhdAtom->Generate();
+
+    MP4IntegerProperty* pProperty = NULL;
+    pTfhdAtom->FindProperty("tfhd.trackId", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(m_trackId);
+    if (pTfhdAtom->FindProperty("tfhd.defaultSampleDuration", (MP4Property**)&pProperty)) {
+        pProperty->SetValue(first.duration);
+    }
+    if (pTfhdAtom->FindProperty("tfhd.defaultSampleSize", (MP4Property**)&pProperty)) {
+        pProperty->SetValue(first.size);
+    }
+    if (pTfhdAtom->FindProperty("tfhd.defaultSampleFlags", (MP4Property**)&pProperty)) {
+        pProperty->SetValue(second.flags);
+    }
+
+    MP4Atom* pTfdtAtom = MP4Atom::CreateAtom(m_File, pTrafAtom, "tfdt");
+    pTrafAtom->AddChildAtom(pTfdtAtom);
+    pTfdtAtom->Generate();
+    pTfdtAtom->FindProperty("tfdt.baseMediaDecodeTime", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(m_fragmentStartTime);
+
+    MP4Atom* pTrunAtom = MP4Atom::CreateAtom(m_File, pTrafAtom, "trun");
+    pTrafAtom->AddChildAtom(pTrunAtom);
+    pTrunAtom->SetFlags(trunFlags);
+    pTrunAtom->Generate();
+    if (hasNegativeRenderingOffsets) {
+        // version 1 makes the composition time offsets signed
+        pTrunAtom->FindProperty("trun.version", (MP4Property**)&pProperty);
+        ASSERT(pProperty);
+        pProperty->SetValue(1);
+    }
+
+    if (pTrunAtom->FindProperty("trun.firstSampleFlags", (MP4Property**)&pProperty)) {
+        pProperty->SetValue(first.flags);
+    }
+
+    MP4Integer32Property* pSampleCount = NULL;
+    pTrunAtom->FindProperty("trun.sampleCount", (MP4Property**)&pSampleCount);
+    ASSERT(pSampleCount);
+
+    MP4Integer32Property* pDuration = NULL;
+    MP4Integer32Property* pSize = NULL;
+    MP4Integer32Property* pFlags = NULL;
+    MP4Integer32Property* pRenderingOffset = NULL;
+    pTrunAtom->FindProperty("trun.samples.sampleDuration", (MP4Property**)&pDuration);
+    pTrunAtom->FindProperty("trun.samples.sampleSize", (MP4Property**)&pSize);
+    pTrunAtom->FindProperty("trun.samples.sampleFlags", (MP4Property**)&pFlags);
+    pTrunAtom->FindProperty("trun.samples.sampleCompositionTimeOffset", (MP4Property**)&pRenderingOffset);
+    for (uint32_t i = 0; i < numSamples; i++) {
+        const FragmentSample& sample = m_fragmentSamples[i];
+        pSampleCount->IncrementValue();
+        if (pDuration) {
+            pDuration->AddValue(sample.duration);
+        }
+        if (pSize) {
+            pSize->AddValue(sample.size);
+        }
+        if (pFlags) {
+            pFlags->AddValue(sample.flags);
+        }
+        if (pRenderingOffset) {
+            pRenderingOffset->AddValue((uint32_t)sample.renderingOffset);
+        }
+    }
+
+    // filled in by the file once the size of the moof is known
+    MP4Integer32Property* pDataOffset = NULL;
+    pTrunAtom->FindProperty("trun.dataOffset", (MP4Property**)&pDataOffset);
+    ASSERT(pDataOffset);
+    return pDataOffset;
+}
+
+MP4Timestamp MP4Track::GetFragmentPresentationTime()
+{
+    MP4Timestamp earliest = m_fragmentStartTime;
+    MP4Timestamp decodeTime = m_fragmentStartTime;
+    for (size_t i = 0; i < m_fragmentSamples.size(); i++) {
+        int64_t time = (int64_t)decodeTime + m_fragmentSamples[i].renderingOffset;
+        MP4Timestamp presentationTime = time > 0 ? (MP4Timestamp)time : 0;
+        if (i == 0 || presentationTime < earliest) {
+            earliest = presentationTime;
+        }
+        decodeTime += m_fragmentSamples[i].duration;
+    }
+    return earliest;
+}
+
+bool MP4Track::IsFragmentSyncStart()
+{
+    return !m_fragmentSamples.empty() &&
+           MP4FragmentIndex::IsSyncSampleFlags(m_fragmentSamples[0].flags);
+}
+
+// random access points a tfra written holds at most
+static const uint32_t s_randomAccessCapacity = 1024;
+
+void MP4Track::AddFragmentRandomAccessPoint(uint64_t moofOffset, uint32_t trafNumber)
+{
+    if (!IsFragmentSyncStart()) {
+        return;
+    }
+
+    // every m_randomAccessStride-th point from the first is kept, and
+    // when they fill the table every other one of them
+    if (m_randomAccessCandidates++ % m_randomAccessStride != 0) {
+        return;
+    }
+    if (m_randomAccessPoints.size() == s_randomAccessCapacity) {
+        for (size_t i = 0; i < s_randomAccessCapacity / 2; i++) {
+            m_randomAccessPoints[i] = m_randomAccessPoints[2 * i];
+        }
+        m_randomAccessPoints.resize(s_randomAccessCapacity / 2);
+        m_randomAccessStride *= 2;
+        if ((m_randomAccessCandidates - 1) % m_randomAccessStride != 0) {
+            return;
+        }
+    }
+
+    int64_t time = (int64_t)m_fragmentStartTime + m_fragmentSamples[0].renderingOffset;
+
+    RandomAccessPoint point;
+    point.time = time > 0 ? (MP4Timestamp)time : 0;
+    point.moofOffset = moofOffset;
+    point.trafNumber = trafNumber;
+    m_randomAccessPoints.push_back(point);
+}
+
+MP4Atom* MP4Track::GenerateRandomAccessTable(MP4Atom& mfraAtom)
+{
+    if (m_randomAccessPoints.empty()) {
+        return NULL;
+    }
+
+    MP4Atom* pTfraAtom = MP4Atom::CreateAtom(m_File, &mfraAtom, "tfra");
+    pTfraAtom->Generate();
+
+    MP4IntegerProperty* pProperty = NULL;
+    pTfraAtom->FindProperty("tfra.trackId", (MP4Property**)&pProperty);
+    ASSERT(pProperty);
+    pProperty->SetValue(m_trackId);
+
+    // Generate() chose 64-bit times and offsets and one-byte numbers
+    MP4Integer32Property* pCount = NULL;
+    MP4Integer64Property* pTime = NULL;
+    MP4Integer64Property* pMoofOffset = NULL;
+    MP4Integer8Property* pTrafNumber = NULL;
+    MP4Integer8Property* pTrunNumber = NULL;
+    MP4Integer8Property* pSampleNumber = NULL;
+    pTfraAtom->FindProperty("tfra.numberOfEntry", (MP4Property**)&pCount);
+    pTfraAtom->FindProperty("tfra.entries.time", (MP4Property**)&pTime);
+    pTfraAtom->FindProperty("tfra.entries.moofOffset", (MP4Property**)&pMoofOffset);
+    pTfraAtom->FindProperty("tfra.entries.trafNumber", (MP4Property**)&pTrafNumber);
+    pTfraAtom->FindProperty("tfra.entries.trunNumber", (MP4Property**)&pTrunNumber);
+    pTfraAtom->FindProperty("tfra.entries.sampleNumber", (MP4Property**)&pSampleNumber);
+    ASSERT(pCount && pTime && pMoofOffset && pTrafNumber && pTrunNumber && pSampleNumber);
+
+    for (size_t i = 0; i < m_randomAccessPoints.size(); i++) {
+        const RandomAccessPoint& point = m_randomAccessPoints[i];
+        pCount->IncrementValue();
+        pTime->AddValue(point.time);
+        pMoofOffset->AddValue(point.moofOffset);
+        pTrafNumber->AddValue((uint8_t)point.trafNumber);
+        pTrunNumber->AddValue(1);
+        pSampleNumber->AddValue(1);
+    }
+    return pTfraAtom;
+}
+
 void MP4Track::WriteChunkBuffer()
 {
-    if (m_sizeOfDataInChunkBuffer == 0 || !m_hasSampleTables) {
+    // a fragment may hold nothing but empty samples
+    if (m_File.IsFragmentedWrite() ? m_chunkSamples == 0
+            : (m_sizeOfDataInChunkBuffer == 0 || !m_hasSampleTables)) {
         return;
     }
 
@@ -636,11 +1090,18 @@ void MP4Track::WriteChunkBuffer()
                   m_trackId, chunkOffset, m_sizeOfDataInChunkBuffer,
                   m_sizeOfDataInChunkBuffer, m_chunkSamples);
 
-    UpdateSampleToChunk(m_writeSampleId,
-                        m_pChunkCountProperty->GetValue() + 1,
-                        m_chunkSamples);
+    if (m_File.IsFragmentedWrite()) {
+        // the moof just written describes these samples; only the buffer
+        // itself is kept for the next fragment
+        m_fragmentStartTime += m_chunkDuration;
+        m_fragmentSamples.clear();
+    } else {
+        UpdateSampleToChunk(m_writeSampleId,
+                            m_pChunkCountProperty->GetValue() + 1,
+                            m_chunkSamples);
 
-    UpdateChunkOffsets(chunkOffset);
+        UpdateChunkOffsets(chunkOffset);
+    }
 
     // note: we do not free our chunk buffer; we reuse it, expanding as needed.
     // It gets zapped when this class goes out of scope
@@ -756,14 +1217,265 @@ bool MP4Track::IsChunkFull(MP4SampleId sampleId)
 
 uint32_t MP4Track::GetNumberOfSamples()
 {
-    if (m_pStszSampleCountProperty == NULL) {
-        return 0;
+    uint32_t numSamples = 0;
+    if (m_pStszSampleCountProperty != NULL) {
+        numSamples = m_pStszSampleCountProperty->GetValue();
+    }
+    if (GetFragmentIndex() != NULL) {
+        numSamples += m_pFragmentIndex->GetNumberOfSamples();
+    }
+    return numSamples;
+}
+
+// The index among the fragment samples of a sample past the end of the
+// sample tables, or (uint32_t)-1 for a sample of the tables
+uint32_t MP4Track::GetFragmentSample(MP4SampleId sampleId)
+{
+    uint32_t numTableSamples = 0;
+    if (m_pStszSampleCountProperty != NULL) {
+        numTableSamples = m_pStszSampleCountProperty->GetValue();
+    }
+    if (sampleId <= numTableSamples || GetFragmentIndex() == NULL) {
+        return (uint32_t)-1;
     }
-    return m_pStszSampleCountProperty->GetValue();
+    return sampleId - numTableSamples - 1;
+}
+
+// Sample numbers in the fragments count every sample before them, so
+// fragments left on disk when the file was opened are all read first
+MP4FragmentIndex* MP4Track::GetFragmentIndex()
+{
+    if (m_File.HasPendingFragments()) {
+        m_File.IndexPendingFragments();
+    }
+    return m_pFragmentIndex;
+}
+
+// The track's defaults for its fragments
+MP4Atom* MP4Track::FindTrexAtom()
+{
+    MP4Atom* pMvexAtom = m_File.FindAtom("moov.mvex");
+    uint32_t numChildren = pMvexAtom ? pMvexAtom->GetNumberOfChildAtoms() : 0;
+    for (uint32_t i = 0; i < numChildren; i++) {
+        MP4Atom* pAtom = pMvexAtom->GetChildAtom(i);
+        MP4Integer32Property* pTrackIdProperty = NULL;
+        if (ATOMID(pAtom->GetType()) == ATOMID("trex") &&
+                pAtom->FindProperty("trex.trackId", (MP4Property**)&pTrackIdProperty) &&
+                pTrackIdProperty->GetValue() == m_trackId) {
+            return pAtom;
+        }
+    }
+    return NULL;
+}
+
+uint64_t MP4Track::AddTrackFragment(MP4Atom& trafAtom,
+                                    uint64_t moofOffset, uint64_t dataOffset)
+{
+    if (m_pFragmentIndex == NULL) {
+        MP4Atom* pTrexAtom = FindTrexAtom();
+        if (pTrexAtom == NULL) {
+            m_trakAtom.LogAtomError(SPECIFICATION_ERROR, "Track fragments without trex defaults", MP4_LOG_WARNING);
+        }
+
+        // fragments carry on from the end of the sample tables
+        MP4Timestamp startTime = 0;
+        if (BuildSttsIndex()) {
+            startTime = m_sttsIndex.back().startTime;
+        }
+
+        m_pFragmentIndex = new MP4FragmentIndex(pTrexAtom, startTime);
+    }
+
+    return m_pFragmentIndex->AddTrackFragment(trafAtom, moofOffset, dataOffset);
+}
+
+void MP4Track::AddRandomAccessPoint(MP4Timestamp time, uint64_t moofOffset)
+{
+    RandomAccessPoint point;
+    point.time = time;
+    point.moofOffset = moofOffset;
+    point.trafNumber = 0;
+
+    vector<RandomAccessPoint>::iterator it = m_randomAccessPoints.end();
+    while (it != m_randomAccessPoints.begin() && (it - 1)->time > time) {
+        --it;
+    }
+    m_randomAccessPoints.insert(it, point);
+}
+
+// The sample playing at when in the fragments left on disk, with index
+// holding the fragment it is in; (uint32_t)-1 if there is none
+uint32_t MP4Track::FindPendingFragmentSample(MP4Timestamp when,
+                                             MP4FragmentIndex& index)
+{
+    // the last random access point at or before when
+    uint32_t point = 0;
+    for (uint32_t count = (uint32_t)m_randomAccessPoints.size(); count > 0; ) {
+        const uint32_t half = count / 2;
+        if (m_randomAccessPoints[point + half].time <= when) {
+            point += half + 1;
+            count -= half + 1;
+        }
+        else {
+            count = half;
+        }
+    }
+    if (point > 0) {
+        point--;
+    }
+
+    while (true) {
+        bool early;
+        uint32_t sample = FindPendingFragmentSample(
+            when, m_randomAccessPoints[point].moofOffset, index, &early);
+
+        // the times of a sidx or tfra are presentation times, which may
+        // run ahead of the decode times searched here
+        if (sample == (uint32_t)-1 && early && point > 0) {
+            point--;
+            continue;
+        }
+        return sample;
+    }
+}
+
+// The sample playing at when in the fragments from the moof at moofOffset
+// on, with index holding the fragment it is in; (uint32_t)-1 if there is
+// none, and then *pEarly tells whether the first fragment of the track
+// already starts after when
+uint32_t MP4Track::FindPendingFragmentSample(MP4Timestamp when, uint64_t moofOffset,
+                                             MP4FragmentIndex& index, bool* pEarly)
+{
+    MP4Atom* pTrexAtom = FindTrexAtom();
+
+    *pEarly = false;
+    bool first = true;
+    for (MP4Atom* pMoofAtom = m_File.ReadPendingFragment(moofOffset);
+            pMoofAtom != NULL;
+            pMoofAtom = m_File.ReadPendingFragment(m_File.GetNextPendingFragment(*pMoofAtom))) {
+        index = MP4FragmentIndex(pTrexAtom, 0);
+        if (!m_File.IndexPendingFragment(*pMoofAtom, m_trackId, index)) {
+            return (uint32_t)-1;
+        }
+        if (index.GetNumberOfSamples() == 0) {
+            continue;
+        }
+
+        MP4Timestamp startTime;
+        index.GetSampleTimes(0, &startTime, NULL);
+        if (when < startTime) {
+            *pEarly = first;
+            return (uint32_t)-1;
+        }
+        first = false;
+
+        uint32_t sample = index.GetSampleFromTime(when);
+        if (sample != (uint32_t)-1) {
+            return sample;
+        }
+    }
+    return (uint32_t)-1;
+}
+
+// The decode end of the fragments left on disk, from the last one with
+// samples of the track; 0 if that cannot be told without reading them all.
+// Concurrent readers may both work it out, to the same result.
+MP4Timestamp MP4Track::GetPendingFragmentsEndTime()
+{
+    MP4Timestamp endTime = m_pendingFragmentsEndTime.load(std::memory_order_acquire);
+    if (endTime != 0 || m_randomAccessPoints.empty()) {
+        return endTime;
+    }
+
+    MP4Atom* pTrexAtom = FindTrexAtom();
+    for (MP4Atom* pMoofAtom = m_File.ReadPendingFragment(m_randomAccessPoints.back().moofOffset);
+            pMoofAtom != NULL;
+            pMoofAtom = m_File.ReadPendingFragment(m_File.GetNextPendingFragment(*pMoofAtom))) {
+        MP4FragmentIndex index(pTrexAtom, 0);
+        if (!m_File.IndexPendingFragment(*pMoofAtom, m_trackId, index)) {
+            return 0;
+        }
+        if (index.GetNumberOfSamples() > 0) {
+            endTime = index.GetEndTime();
+        }
+    }
+    m_pendingFragmentsEndTime.store(endTime, std::memory_order_release);
+    return endTime;
+}
+
+// Reads the sample playing at when without numbering the samples, which
+// would take reading every fragment before it; false if the sample is
+// not in the fragments left on disk or they cannot be searched by time
+bool MP4Track::ReadPendingFragmentSample(
+    MP4Timestamp  when,
+    uint8_t**     ppBytes,
+    uint32_t*     pNumBytes,
+    MP4Timestamp* pStartTime,
+    MP4Duration*  pDuration,
+    MP4Duration*  pRenderingOffset,
+    bool*         pIsSyncSample)
+{
+    if (!m_File.HasPendingFragments() || m_randomAccessPoints.empty()) {
+        return false;
+    }
+
+    // samples of the sample tables are numbered as usual
+    if (BuildSttsIndex() && when < m_sttsIndex.back().startTime) {
+        return false;
+    }
+
+    MP4FragmentIndex index(NULL, 0);
+    uint32_t sample = FindPendingFragmentSample(when, index);
+    if (sample == (uint32_t)-1) {
+        return false;
+    }
+
+    uint32_t sampleSize = index.GetSampleSize(sample);
+    if (*ppBytes != NULL && *pNumBytes < sampleSize) {
+        std::string errorMsg = std::string("sample buffer is too small. Expected = ") + std::to_string(sampleSize) +
+                                           " Actual = " + std::to_string(*pNumBytes);
+        log.errorf("%s: \"%s\": %s",
+                   __FUNCTION__, GetFile().GetFilename().c_str(), errorMsg.c_str());
+        *pNumBytes = 0;
+        return true;
+    }
+
+    bool bufferMalloc = false;
+    if (*ppBytes == NULL) {
+        *ppBytes = (uint8_t*)MP4Malloc(sampleSize);
+        bufferMalloc = true;
+    }
+    try {
+        m_File.ReadBytesAt(index.GetSampleFileOffset(sample), *ppBytes, sampleSize);
+    }
+    catch (Exception*) {
+        if (bufferMalloc) {
+            MP4Free(*ppBytes);
+            *ppBytes = NULL;
+        }
+        throw;
+    }
+    *pNumBytes = sampleSize;
+
+    if (pStartTime || pDuration) {
+        index.GetSampleTimes(sample, pStartTime, pDuration);
+    }
+    if (pRenderingOffset) {
+        *pRenderingOffset = index.GetSampleRenderingOffset(sample);
+    }
+    if (pIsSyncSample) {
+        *pIsSyncSample = index.IsSyncSample(sample);
+    }
+    return true;
 }
 
 uint32_t MP4Track::GetSampleSize(MP4SampleId sampleId)
 {
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        return m_pFragmentIndex->GetSampleSize(fragmentSample);
+    }
+
     if (m_pStszFixedSampleSizeProperty != NULL) {
         uint32_t fixedSampleSize =
             m_pStszFixedSampleSizeProperty->GetValue();
@@ -791,17 +1503,22 @@ uint32_t MP4Track::GetSampleSize(MP4SampleId sampleId)
 
 uint32_t MP4Track::GetMaxSampleSize()
 {
+    uint32_t maxFragmentSampleSize = 0;
+    if (GetFragmentIndex() != NULL) {
+        maxFragmentSampleSize = m_pFragmentIndex->GetMaxSampleSize();
+    }
+
     if (m_pStszFixedSampleSizeProperty != NULL) {
         uint32_t fixedSampleSize =
             m_pStszFixedSampleSizeProperty->GetValue();
 
         if (fixedSampleSize != 0) {
-            return fixedSampleSize * m_bytesPerSample;
+            return max(fixedSampleSize * m_bytesPerSample, maxFragmentSampleSize);
         }
     }
 
     if (m_pStszSampleSizeProperty == NULL) {
-        return 0;
+        return maxFragmentSampleSize;
     }
 
     uint32_t maxSampleSize = 0;
@@ -813,11 +1530,16 @@ uint32_t MP4Track::GetMaxSampleSize()
             maxSampleSize = sampleSize;
         }
     }
-    return maxSampleSize * m_bytesPerSample;
+    return max(maxSampleSize * m_bytesPerSample, maxFragmentSampleSize);
 }
 
 uint64_t MP4Track::GetTotalOfSampleSizes()
 {
+    uint64_t fragmentSampleSizes = 0;
+    if (GetFragmentIndex() != NULL) {
+        fragmentSampleSizes = m_pFragmentIndex->GetTotalOfSampleSizes();
+    }
+
     uint64_t retval;
     if (m_pStszFixedSampleSizeProperty != NULL) {
         uint32_t fixedSampleSize =
@@ -827,13 +1549,13 @@ uint64_t MP4Track::GetTotalOfSampleSizes()
         if (fixedSampleSize != 0) {
             retval = m_bytesPerSample;
             retval *= fixedSampleSize;
-            retval *= GetNumberOfSamples();
-            return retval;
+            retval *= m_pStszSampleCountProperty->GetValue();
+            return retval + fragmentSampleSizes;
         }
     }
 
     if (m_pStszSampleSizeProperty == NULL) {
-        return 0;
+        return fragmentSampleSizes;
     }
 
     // else non-fixed sample size, sum them
@@ -844,7 +1566,7 @@ uint64_t MP4Track::GetTotalOfSampleSizes()
             m_pStszSampleSizeProperty->GetValue(sid - 1);
         totalSampleSizes += sampleSize;
     }
-    return totalSampleSizes * m_bytesPerSample;
+    return totalSampleSizes * m_bytesPerSample + fragmentSampleSizes;
 }
 
 void MP4Track::SampleSizePropertyAddValue (uint32_t size)
@@ -1017,13 +1739,28 @@ uint32_t MP4Track::GetMaxBitrate()
     return maxBytesPerSec * 8;
 }
 
+// number of leading values of a sorted table column that are <= value
+static uint32_t CountNotAbove(MP4Integer32Property* pProperty, uint32_t count, uint32_t value)
+{
+    uint32_t first = 0;
+    while (count > 0) {
+        uint32_t half = count / 2;
+        if (pProperty->GetValue(first + half) <= value) {
+            first += half + 1;
+            count -= half + 1;
+        } else {
+            count = half;
+        }
+    }
+    return first;
+}
+
 uint32_t MP4Track::GetSampleStscIndex(MP4SampleId sampleId)
 {
     if (m_pStscCountProperty == NULL || m_pStscFirstSampleProperty == NULL) {
         return ((uint32_t)-1);
     }
 
-    uint32_t stscIndex;
     uint32_t numStscs = m_pStscCountProperty->GetValue();
 
     if (numStscs == 0) {
@@ -1031,25 +1768,16 @@ uint32_t MP4Track::GetSampleStscIndex(MP4SampleId sampleId)
         //throw new EXCEPTION("No data chunks exist");
     }
 
-    for (stscIndex = 0; stscIndex < numStscs; stscIndex++) {
-        if (sampleId < m_pStscFirstSampleProperty->GetValue(stscIndex)) {
-            if (stscIndex == 0) {
-                std::string errorMsg = std::string("First stsc entry 'firstSample' must be greater than sampleID. Expected = ") +
-                                       std::to_string(sampleId) + ", Actual = " + std::to_string(m_pStscFirstSampleProperty->GetValue(stscIndex));
+    uint32_t stscIndex = CountNotAbove(m_pStscFirstSampleProperty, numStscs, sampleId);
+    if (stscIndex == 0) {
+        std::string errorMsg = std::string("First stsc entry 'firstSample' must be greater than sampleID. Expected = ") +
+                               std::to_string(sampleId) + ", Actual = " + std::to_string(m_pStscFirstSampleProperty->GetValue(0));
 
-                m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stsc", stscIndex), errorMsg);
-                return ((uint32_t)-1);
-            }
-
-            stscIndex -= 1;
-            break;
-        }
-    }
-    if (stscIndex == numStscs) {
-        stscIndex -= 1;
+        m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stsc", 0), errorMsg);
+        return ((uint32_t)-1);
     }
 
-    return stscIndex;
+    return stscIndex - 1;
 }
 
 const char* MP4Track::GetSampleFileURL(MP4SampleId sampleId)
@@ -1176,6 +1904,11 @@ File* MP4Track::GetSampleFile( MP4SampleId sampleId )
         return file;
     }
 
+    // LATER honor the data reference of the fragment's sample description
+    if (GetFragmentSample( sampleId ) != (uint32_t)-1) {
+        return NULL;
+    }
+
     uint32_t stscIndex = GetSampleStscIndex( sampleId );
     if (stscIndex == ((uint32_t)-1)) {
         return file;
@@ -1227,6 +1960,11 @@ uint64_t MP4Track::GetSampleFileOffset(MP4SampleId sampleId)
         return ((uint64_t)-1);
     }
 
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        return m_pFragmentIndex->GetSampleFileOffset(fragmentSample);
+    }
+
     uint32_t stscIndex = GetSampleStscIndex(sampleId);
     if (stscIndex == ((uint32_t)-1)) {
         return ((uint64_t)-1);
@@ -1270,6 +2008,22 @@ uint64_t MP4Track::GetSampleFileOffset(MP4SampleId sampleId)
         sampleOffset = m_cachedSfoSampleOffset;
     }
 
+    // random access far into a chunk starts from the closest checkpoint
+    if (sampleId - startSample > m_sfoIndexInterval) {
+        if (m_pStszFixedSampleSizeProperty != NULL &&
+                m_pStszFixedSampleSizeProperty->GetValue() != 0) {
+            sampleOffset = (sampleId - firstSampleInChunk) * GetSampleSize(sampleId);
+            startSample = sampleId;
+        } else if (ExtendSampleOffsetIndex(sampleId)) {
+            uint32_t checkpoint = (sampleId - 1) / m_sfoIndexInterval;
+            MP4SampleId checkpointSample = checkpoint * m_sfoIndexInterval + 1;
+            if (checkpointSample > startSample) {
+                startSample = checkpointSample;
+                sampleOffset = m_sfoIndex[checkpoint];
+            }
+        }
+    }
+
     for (MP4SampleId i = startSample; i < sampleId; i++) {
         sampleOffset += GetSampleSize(i);
     }
@@ -1281,6 +2035,64 @@ uint64_t MP4Track::GetSampleFileOffset(MP4SampleId sampleId)
     return chunkOffset + sampleOffset;
 }
 
+// Walk the chunks until m_sfoIndex holds the checkpoint for sampleId. The
+// index only grows, so it stays valid while samples are being added.
+bool MP4Track::ExtendSampleOffsetIndex(MP4SampleId sampleId)
+{
+    if (m_sfoIndexInterval == 0 || !m_hasSampleTables) {
+        return false;
+    }
+
+    uint32_t numStscs = m_pStscCountProperty->GetValue();
+    uint32_t numChunks = GetNumberOfChunks();
+    uint32_t numSamples = GetNumberOfSamples();
+
+    while (m_sfoIndexSampleId <= sampleId) {
+        if (numStscs == 0 || m_sfoIndexChunkId > numChunks) {
+            return false;
+        }
+        while (m_sfoIndexStscIndex + 1 < numStscs &&
+                m_pStscFirstChunkProperty->GetValue(m_sfoIndexStscIndex + 1) <= m_sfoIndexChunkId) {
+            m_sfoIndexStscIndex++;
+        }
+
+        uint32_t samplesPerChunk =
+            m_pStscSamplesPerChunkProperty->GetValue(m_sfoIndexStscIndex);
+        if (m_sfoIndexSampleId + samplesPerChunk - 1 > numSamples) {
+            return false;
+        }
+
+        uint32_t sampleOffset = 0;
+        for (uint32_t i = 0; i < samplesPerChunk; i++) {
+            MP4SampleId sid = m_sfoIndexSampleId + i;
+            if ((sid - 1) % m_sfoIndexInterval == 0) {
+                m_sfoIndex.push_back(sampleOffset);
+            }
+            sampleOffset += GetSampleSize(sid);
+        }
+
+        m_sfoIndexSampleId += samplesPerChunk;
+        m_sfoIndexChunkId++;
+    }
+    return true;
+}
+
+uint32_t MP4Track::GetSampleOffsetIndexInterval()
+{
+    return m_sfoIndexInterval;
+}
+
+void MP4Track::SetSampleOffsetIndexInterval( uint32_t interval )
+{
+    std::lock_guard<std::mutex> lock( m_readMutex );
+
+    m_sfoIndexInterval = interval;
+    m_sfoIndex.clear();
+    m_sfoIndexSampleId = 1;
+    m_sfoIndexChunkId = 1;
+    m_sfoIndexStscIndex = 0;
+}
+
 void MP4Track::UpdateSampleToChunk(MP4SampleId sampleId,
                                    MP4ChunkId chunkId, uint32_t samplesPerChunk)
 {
@@ -1357,6 +2169,12 @@ void MP4Track::SetFixedSampleDuration(MP4Duration duration)
 void MP4Track::GetSampleTimes(MP4SampleId sampleId,
                               MP4Timestamp* pStartTime, MP4Duration* pDuration)
 {
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        m_pFragmentIndex->GetSampleTimes(fragmentSample, pStartTime, pDuration);
+        return;
+    }
+
     if (m_pSttsCountProperty == NULL || m_pSttsSampleCountProperty == NULL || m_pSttsSampleDeltaProperty == NULL) {
         if (pStartTime) {
             *pStartTime = MP4_INVALID_TIMESTAMP;
@@ -1368,43 +2186,70 @@ void MP4Track::GetSampleTimes(MP4SampleId sampleId,
     }
 
     uint32_t numStts = m_pSttsCountProperty->GetValue();
-    MP4SampleId sid;
-    MP4Duration elapsed;
+    uint32_t sttsIndex = numStts;
+    MP4SampleId sid = 1;
+    MP4Duration elapsed = 0;
 
+    // sequential access stays within the cached entry or moves to the next
+    if (m_cachedSttsSid != MP4_INVALID_SAMPLE_ID && sampleId >= m_cachedSttsSid
+            && m_cachedSttsIndex < numStts) {
+        sttsIndex = m_cachedSttsIndex;
+        sid = m_cachedSttsSid;
+        elapsed = m_cachedSttsElapsed;
+        for (uint32_t i = 0; i < 2 && sttsIndex < numStts; i++) {
+            MP4SampleId sampleCount = m_pSttsSampleCountProperty->GetValue(sttsIndex);
+            if (sampleId <= sid + sampleCount - 1) {
+                break;
+            }
+            sid += sampleCount;
+            elapsed += sampleCount * (MP4Duration)m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
+            sttsIndex++;
+        }
+        if (sttsIndex < numStts &&
+                sampleId > sid + m_pSttsSampleCountProperty->GetValue(sttsIndex) - 1) {
+            sttsIndex = numStts;
+        }
+    }
 
-    if (m_cachedSttsSid != MP4_INVALID_SAMPLE_ID && sampleId >= m_cachedSttsSid) {
-        sid   = m_cachedSttsSid;
-        elapsed   = m_cachedSttsElapsed;
-    } else {
-        m_cachedSttsIndex = 0;
-        sid   = 1;
-        elapsed   = 0;
+    // anything else is a binary search for the last entry starting at or
+    // before sampleId
+    if (sttsIndex == numStts && BuildSttsIndex()) {
+        vector<SttsIndexEntry>::iterator it = m_sttsIndex.begin();
+        uint32_t count = numStts;
+        while (count > 0) {
+            uint32_t half = count / 2;
+            if (it[half + 1].sampleId <= sampleId) {
+                it += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        if (sampleId >= it->sampleId && sampleId < m_sttsIndex[numStts].sampleId) {
+            sttsIndex = (uint32_t)(it - m_sttsIndex.begin());
+            sid = it->sampleId;
+            elapsed = it->startTime;
+        }
     }
 
-    for (uint32_t sttsIndex = m_cachedSttsIndex; sttsIndex < numStts; sttsIndex++) {
-        MP4SampleId sampleCount =
-            m_pSttsSampleCountProperty->GetValue(sttsIndex);
+    if (sttsIndex < numStts) {
         MP4Duration sampleDelta =
             m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
 
-        if (sampleId <= sid + sampleCount - 1) {
-            if (pStartTime) {
-                *pStartTime = (sampleId - sid);
-                *pStartTime *= sampleDelta;
-                *pStartTime += elapsed;
-            }
-            if (pDuration) {
-                *pDuration = sampleDelta;
-            }
+        if (pStartTime) {
+            *pStartTime = (sampleId - sid);
+            *pStartTime *= sampleDelta;
+            *pStartTime += elapsed;
+        }
+        if (pDuration) {
+            *pDuration = sampleDelta;
+        }
 
-            m_cachedSttsIndex = sttsIndex;
-            m_cachedSttsSid = sid;
-            m_cachedSttsElapsed = elapsed;
+        m_cachedSttsIndex = sttsIndex;
+        m_cachedSttsSid = sid;
+        m_cachedSttsElapsed = elapsed;
 
-            return;
-        }
-        sid += sampleCount;
-        elapsed += sampleCount * sampleDelta;
+        return;
     }
 
     if (pStartTime) {
@@ -1428,10 +2273,39 @@ MP4SampleId MP4Track::GetSampleIdFromTime(
     }
 
     uint32_t numStts = m_pSttsCountProperty->GetValue();
-    MP4SampleId sid = 1;
-    MP4Duration elapsed = 0;
 
-    for (uint32_t sttsIndex = 0; sttsIndex < numStts; sttsIndex++) {
+    // past the sample tables, into the movie fragments
+    if (BuildSttsIndex() && when >= m_sttsIndex[numStts].startTime &&
+            GetFragmentIndex() != NULL) {
+        uint32_t fragmentSample = m_pFragmentIndex->GetSampleFromTime(when);
+        if (fragmentSample != (uint32_t)-1) {
+            MP4SampleId sampleId = GetNumberOfSamples() -
+                                   m_pFragmentIndex->GetNumberOfSamples() + fragmentSample + 1;
+            if (wantSyncSample) {
+                return GetNextSyncSample(sampleId);
+            }
+            return sampleId;
+        }
+    }
+
+    // the first entry ending at or after when
+    uint32_t sttsIndex = numStts;
+    if (BuildSttsIndex()) {
+        uint32_t first = 0;
+        uint32_t count = numStts;
+        while (count > 0) {
+            uint32_t half = count / 2;
+            if (m_sttsIndex[first + half + 1].startTime < when) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        sttsIndex = first;
+    }
+
+    if (sttsIndex < numStts) {
         MP4SampleId sampleCount =
             m_pSttsSampleCountProperty->GetValue(sttsIndex);
         MP4Duration sampleDelta =
@@ -1441,10 +2315,10 @@ MP4SampleId MP4Track::GetSampleIdFromTime(
             m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stts", sttsIndex), "Invalid sample duration = 0");
         }
 
-        MP4Duration d = when - elapsed;
+        MP4Duration d = when - m_sttsIndex[sttsIndex].startTime;
 
         if (d <= sampleCount * sampleDelta) {
-            MP4SampleId sampleId = sid;
+            MP4SampleId sampleId = m_sttsIndex[sttsIndex].sampleId;
             if (sampleDelta) {
                 sampleId += (d / sampleDelta);
             }
@@ -1454,9 +2328,6 @@ MP4SampleId MP4Track::GetSampleIdFromTime(
             }
             return sampleId;
         }
-
-        sid += sampleCount;
-        elapsed += sampleCount * sampleDelta;
     }
 
     std::string errorMsg = std::string("Sample time ") + std::to_string(when) + " out of range";
@@ -1466,6 +2337,36 @@ MP4SampleId MP4Track::GetSampleIdFromTime(
     return MP4_INVALID_SAMPLE_ID;
 }
 
+// Make sure m_sttsIndex covers the current stts table
+bool MP4Track::BuildSttsIndex()
+{
+    if (m_pSttsCountProperty == NULL || m_pSttsSampleCountProperty == NULL || m_pSttsSampleDeltaProperty == NULL) {
+        return false;
+    }
+
+    uint32_t numStts = m_pSttsCountProperty->GetValue();
+    if (m_sttsIndex.size() == (size_t)numStts + 1) {
+        return true;
+    }
+
+    m_sttsIndex.resize((size_t)numStts + 1);
+
+    MP4SampleId sid = 1;
+    MP4Timestamp elapsed = 0;
+    for (uint32_t sttsIndex = 0; sttsIndex < numStts; sttsIndex++) {
+        m_sttsIndex[sttsIndex].sampleId = sid;
+        m_sttsIndex[sttsIndex].startTime = elapsed;
+
+        MP4SampleId sampleCount =
+            m_pSttsSampleCountProperty->GetValue(sttsIndex);
+        sid += sampleCount;
+        elapsed += sampleCount * (MP4Duration)m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
+    }
+    m_sttsIndex[numStts].sampleId = sid;
+    m_sttsIndex[numStts].startTime = elapsed;
+    return true;
+}
+
 void MP4Track::UpdateSampleTimes(MP4Duration duration)
 {
     if (m_pSttsCountProperty == NULL || m_pSttsSampleCountProperty == NULL || m_pSttsSampleDeltaProperty == NULL) {
@@ -1474,6 +2375,11 @@ void MP4Track::UpdateSampleTimes(MP4Duration duration)
 
     uint32_t numStts = m_pSttsCountProperty->GetValue();
 
+    ResetPresentationIndex();
+
+    // keep an existing index in step, otherwise it is built when needed
+    bool haveIndex = (m_sttsIndex.size() == (size_t)numStts + 1);
+
     // if duration == duration of last entry
     if (numStts
             && duration == m_pSttsSampleDeltaProperty->GetValue(numStts-1)) {
@@ -1485,6 +2391,17 @@ void MP4Track::UpdateSampleTimes(MP4Duration duration)
         m_pSttsSampleCountProperty->AddValue(1);
         m_pSttsSampleDeltaProperty->AddValue(duration);
         m_pSttsCountProperty->IncrementValue();;
+
+        if (haveIndex) {
+            m_sttsIndex.push_back(m_sttsIndex.back());
+        }
+    }
+
+    if (haveIndex) {
+        m_sttsIndex.back().sampleId++;
+        m_sttsIndex.back().startTime += duration;
+    } else {
+        m_sttsIndex.clear();
     }
 }
 
@@ -1496,30 +2413,57 @@ uint32_t MP4Track::GetSampleCttsIndex(MP4SampleId sampleId,
     }
 
     uint32_t numCtts = m_pCttsCountProperty->GetValue();
-    MP4SampleId sid;
+    uint32_t cttsIndex = numCtts;
+    MP4SampleId sid = 1;
 
-    if (m_cachedCttsSid != MP4_INVALID_SAMPLE_ID && sampleId >= m_cachedCttsSid) {
-        sid   = m_cachedCttsSid;
-    } else {
-        m_cachedCttsIndex = 0;
-        sid = 1;
+    // sequential access stays within the cached entry or moves to the next
+    if (m_cachedCttsSid != MP4_INVALID_SAMPLE_ID && sampleId >= m_cachedCttsSid
+            && m_cachedCttsIndex < numCtts) {
+        cttsIndex = m_cachedCttsIndex;
+        sid = m_cachedCttsSid;
+        for (uint32_t i = 0; i < 2 && cttsIndex < numCtts; i++) {
+            MP4SampleId sampleCount = m_pCttsSampleCountProperty->GetValue(cttsIndex);
+            if (sampleId <= sid + sampleCount - 1) {
+                break;
+            }
+            sid += sampleCount;
+            cttsIndex++;
+        }
+        if (cttsIndex < numCtts &&
+                sampleId > sid + m_pCttsSampleCountProperty->GetValue(cttsIndex) - 1) {
+            cttsIndex = numCtts;
+        }
     }
 
-    for (uint32_t cttsIndex = m_cachedCttsIndex; cttsIndex < numCtts; cttsIndex++) {
-        MP4SampleId sampleCount =
-            m_pCttsSampleCountProperty->GetValue(cttsIndex);
-
-        if (sampleId <= sid + sampleCount - 1) {
-            if (pFirstSampleId) {
-                *pFirstSampleId = sid;
+    // anything else is a binary search over the first sample of each entry
+    if (cttsIndex == numCtts) {
+        if (m_cttsIndex.size() != (size_t)numCtts + 1) {
+            m_cttsIndex.resize((size_t)numCtts + 1);
+            MP4SampleId first = 1;
+            for (uint32_t i = 0; i < numCtts; i++) {
+                m_cttsIndex[i] = first;
+                first += m_pCttsSampleCountProperty->GetValue(i);
             }
+            m_cttsIndex[numCtts] = first;
+        }
 
-            m_cachedCttsIndex = cttsIndex;
-            m_cachedCttsSid = sid;
+        uint32_t k = (uint32_t)(std::upper_bound(m_cttsIndex.begin(),
+                                m_cttsIndex.begin() + numCtts, sampleId) - m_cttsIndex.begin());
+        if (k > 0 && sampleId < m_cttsIndex[numCtts]) {
+            cttsIndex = k - 1;
+            sid = m_cttsIndex[cttsIndex];
+        }
+    }
 
-            return cttsIndex;
+    if (cttsIndex < numCtts) {
+        if (pFirstSampleId) {
+            *pFirstSampleId = sid;
         }
-        sid += sampleCount;
+
+        m_cachedCttsIndex = cttsIndex;
+        m_cachedCttsSid = sid;
+
+        return cttsIndex;
     }
 
     std::string errorMsg = std::string("Sample ID ") + std::to_string(sampleId) + " out of range";
@@ -1528,8 +2472,136 @@ uint32_t MP4Track::GetSampleCttsIndex(MP4SampleId sampleId,
     return ((uint32_t)-1);
 }
 
+// Forget the ctts and presentation order indexes after the tables change
+void MP4Track::ResetPresentationIndex()
+{
+    if (!m_cttsIndex.empty()) {
+        vector<MP4SampleId>().swap(m_cttsIndex);
+    }
+    if (!m_presentationOrder.empty()) {
+        vector<PresentationEntry>().swap(m_presentationOrder);
+    }
+}
+
+// Sort the samples by composition time, that is decoding time plus the
+// ctts offset, taken as signed as in version 1 ctts
+bool MP4Track::BuildPresentationIndex()
+{
+    if (m_pSttsCountProperty == NULL || m_pSttsSampleCountProperty == NULL || m_pSttsSampleDeltaProperty == NULL) {
+        return false;
+    }
+
+    uint32_t numSamples = GetNumberOfSamples();
+    if (m_presentationOrder.size() == numSamples) {
+        return numSamples != 0;
+    }
+
+    vector<PresentationEntry> order(numSamples);
+
+    uint32_t numTableSamples = numSamples;
+    if (m_pFragmentIndex != NULL) {
+        numTableSamples -= m_pFragmentIndex->GetNumberOfSamples();
+    }
+
+    uint32_t numStts = m_pSttsCountProperty->GetValue();
+    uint32_t sttsIndex = 0;
+    uint32_t sttsLeft = 0;
+    MP4Duration sampleDelta = 0;
+    int64_t decodeTime = 0;
+
+    uint32_t numCtts = (m_pCttsCountProperty && m_pCttsSampleOffsetProperty)
+                       ? m_pCttsCountProperty->GetValue() : 0;
+    uint32_t cttsIndex = 0;
+    uint32_t cttsLeft = 0;
+    int32_t offset = 0;
+
+    for (uint32_t i = 0; i < numTableSamples; i++) {
+        while (sttsLeft == 0 && sttsIndex < numStts) {
+            sttsLeft = m_pSttsSampleCountProperty->GetValue(sttsIndex);
+            sampleDelta = m_pSttsSampleDeltaProperty->GetValue(sttsIndex);
+            sttsIndex++;
+        }
+        while (cttsLeft == 0 && cttsIndex < numCtts) {
+            cttsLeft = m_pCttsSampleCountProperty->GetValue(cttsIndex);
+            offset = (int32_t)m_pCttsSampleOffsetProperty->GetValue(cttsIndex);
+            cttsIndex++;
+        }
+        if (sttsLeft == 0) {
+            m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stts", numStts),
+                                    "Fewer stts entries than samples");
+            return false;
+        }
+
+        order[i].time = max(decodeTime + (cttsLeft ? offset : 0), (int64_t)0);
+        order[i].sampleId = i + 1;
+
+        decodeTime += sampleDelta;
+        sttsLeft--;
+        if (cttsLeft) {
+            cttsLeft--;
+        }
+    }
+
+    // fragment samples carry their own times and offsets
+    for (uint32_t i = numTableSamples; i < numSamples; i++) {
+        MP4Timestamp startTime;
+        m_pFragmentIndex->GetSampleTimes(i - numTableSamples, &startTime, NULL);
+        offset = (int32_t)m_pFragmentIndex->GetSampleRenderingOffset(i - numTableSamples);
+
+        order[i].time = max((int64_t)startTime + offset, (int64_t)0);
+        order[i].sampleId = i + 1;
+    }
+
+    std::sort(order.begin(), order.end());
+    m_presentationOrder.swap(order);
+    return numSamples != 0;
+}
+
+MP4SampleId MP4Track::GetSampleIdFromPresentationTime(MP4Timestamp when)
+{
+    if (!BuildPresentationIndex()) {
+        return MP4_INVALID_SAMPLE_ID;
+    }
+
+    // the last sample to start at or before when, if it still shows then
+    PresentationEntry key = { when, numeric_limits<MP4SampleId>::max() };
+    vector<PresentationEntry>::iterator it =
+        std::upper_bound(m_presentationOrder.begin(), m_presentationOrder.end(), key);
+    if (it == m_presentationOrder.begin()) {
+        return MP4_INVALID_SAMPLE_ID;
+    }
+    --it;
+
+    if (it + 1 == m_presentationOrder.end()) {
+        MP4Duration duration;
+        GetSampleTimes(it->sampleId, NULL, &duration);
+        if (duration == MP4_INVALID_DURATION || when >= it->time + duration) {
+            return MP4_INVALID_SAMPLE_ID;
+        }
+    }
+    return it->sampleId;
+}
+
+uint32_t MP4Track::GetPresentationOrder(MP4SampleId* pSampleIds, uint32_t maxSampleIds)
+{
+    if (!BuildPresentationIndex()) {
+        return 0;
+    }
+
+    uint32_t numSamples = (uint32_t)m_presentationOrder.size();
+    for (uint32_t i = 0; i < numSamples && i < maxSampleIds; i++) {
+        pSampleIds[i] = m_presentationOrder[i].sampleId;
+    }
+    return numSamples;
+}
+
 MP4Duration MP4Track::GetSampleRenderingOffset(MP4SampleId sampleId)
 {
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        return m_pFragmentIndex->GetSampleRenderingOffset(fragmentSample);
+    }
+
     if (m_pCttsCountProperty == NULL) {
         return 0;
     }
@@ -1548,6 +2620,8 @@ MP4Duration MP4Track::GetSampleRenderingOffset(MP4SampleId sampleId)
 void MP4Track::UpdateRenderingOffsets(MP4SampleId sampleId,
                                       MP4Duration renderingOffset)
 {
+    ResetPresentationIndex();
+
     // if ctts atom doesn't exist
     if (m_pCttsCountProperty == NULL) {
 
@@ -1604,6 +2678,8 @@ void MP4Track::UpdateRenderingOffsets(MP4SampleId sampleId,
 void MP4Track::SetSampleRenderingOffset(MP4SampleId sampleId,
                                         MP4Duration renderingOffset)
 {
+    ResetPresentationIndex();
+
     // check if any ctts entries exist
     if (m_pCttsCountProperty == NULL
             || m_pCttsCountProperty->GetValue() == 0) {
@@ -1700,62 +2776,125 @@ void MP4Track::SetSampleRenderingOffset(MP4SampleId sampleId,
 
 bool MP4Track::IsSyncSample(MP4SampleId sampleId)
 {
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        return m_pFragmentIndex->IsSyncSample(fragmentSample);
+    }
+
     if (m_pStssCountProperty == NULL) {
         return true;
     }
 
     uint32_t numStss = m_pStssCountProperty->GetValue();
-    if (numStss == 0) {
-        return false;
-    }
 
-    uint32_t stssLIndex = 0;
-    uint32_t stssRIndex = numStss - 1;
-
-    while (stssRIndex >= stssLIndex) {
-        uint32_t stssIndex = (stssRIndex + stssLIndex) >> 1;
-        MP4SampleId syncSampleId =
-            m_pStssSampleProperty->GetValue(stssIndex);
+    // the last sync sample at or before sampleId, if there is one
+    uint32_t stssIndex = CountNotAbove(m_pStssSampleProperty, numStss, sampleId);
+    return stssIndex > 0 && m_pStssSampleProperty->GetValue(stssIndex - 1) == sampleId;
+}
 
-        if (sampleId == syncSampleId) {
-            return true;
+// N.B. "next" is inclusive of this sample id
+MP4SampleId MP4Track::GetNextSyncSample(MP4SampleId sampleId)
+{
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        uint32_t syncSample = m_pFragmentIndex->GetNextSyncSample(fragmentSample);
+        if (syncSample == (uint32_t)-1) {
+            return MP4_INVALID_SAMPLE_ID;
         }
+        return sampleId + (syncSample - fragmentSample);
+    }
 
-        if (stssLIndex == stssRIndex)
-            break;
+    if (m_pStssCountProperty == NULL) {
+        return sampleId;
+    }
 
-        if (sampleId > syncSampleId) {
-            stssLIndex = stssIndex + 1;
-        } else {
-            stssRIndex = stssIndex - 1;
+    uint32_t numStss = m_pStssCountProperty->GetValue();
+
+    // the first sync sample at or after sampleId
+    uint32_t stssIndex = (sampleId == 0) ? 0 :
+        CountNotAbove(m_pStssSampleProperty, numStss, sampleId - 1);
+    if (stssIndex < numStss) {
+        return m_pStssSampleProperty->GetValue(stssIndex);
+    }
+
+    // none left in the sample tables, carry on into the fragments
+    if (GetFragmentIndex() != NULL) {
+        uint32_t syncSample = m_pFragmentIndex->GetNextSyncSample(0);
+        if (syncSample != (uint32_t)-1) {
+            return GetNumberOfSamples() - m_pFragmentIndex->GetNumberOfSamples() + syncSample + 1;
         }
     }
 
-    return false;
+    // LATER check stsh for alternate sample
+
+    return MP4_INVALID_SAMPLE_ID;
 }
 
-// N.B. "next" is inclusive of this sample id
-MP4SampleId MP4Track::GetNextSyncSample(MP4SampleId sampleId)
+// N.B. "prev" is inclusive of this sample id
+MP4SampleId MP4Track::GetPrevSyncSample(MP4SampleId sampleId)
 {
+    uint32_t fragmentSample = GetFragmentSample(sampleId);
+    if (fragmentSample != (uint32_t)-1) {
+        uint32_t syncSample = m_pFragmentIndex->GetPrevSyncSample(fragmentSample);
+        if (syncSample != (uint32_t)-1) {
+            return sampleId - (fragmentSample - syncSample);
+        }
+
+        // none in the fragments so far, go back into the sample tables
+        sampleId -= fragmentSample + 1;
+        if (sampleId == MP4_INVALID_SAMPLE_ID) {
+            return MP4_INVALID_SAMPLE_ID;
+        }
+    }
+
     if (m_pStssCountProperty == NULL) {
         return sampleId;
     }
 
     uint32_t numStss = m_pStssCountProperty->GetValue();
 
-    for (uint32_t stssIndex = 0; stssIndex < numStss; stssIndex++) {
-        MP4SampleId syncSampleId =
-            m_pStssSampleProperty->GetValue(stssIndex);
+    // one past the last sync sample at or before sampleId
+    uint32_t stssIndex = CountNotAbove(m_pStssSampleProperty, numStss, sampleId);
+    if (stssIndex > 0) {
+        return m_pStssSampleProperty->GetValue(stssIndex - 1);
+    }
 
-        if (sampleId > syncSampleId) {
-            continue;
-        }
-        return syncSampleId;
+    return MP4_INVALID_SAMPLE_ID;
+}
+
+uint32_t MP4Track::GetSyncSampleList(MP4SampleId* pSampleIds, uint32_t maxSampleIds)
+{
+    uint32_t numTableSamples = GetNumberOfSamples();
+    if (m_pFragmentIndex != NULL) {
+        numTableSamples -= m_pFragmentIndex->GetNumberOfSamples();
     }
 
-    // LATER check stsh for alternate sample
+    uint32_t numSyncSamples = 0;
+    if (m_pStssCountProperty == NULL) {
+        // without stss every sample is a sync sample
+        for (uint32_t i = 0; i < numTableSamples && i < maxSampleIds; i++) {
+            pSampleIds[i] = i + 1;
+        }
+        numSyncSamples = numTableSamples;
+    } else {
+        uint32_t numStss = m_pStssCountProperty->GetValue();
+        for (uint32_t i = 0; i < numStss && i < maxSampleIds; i++) {
+            pSampleIds[i] = m_pStssSampleProperty->GetValue(i);
+        }
+        numSyncSamples = numStss;
+    }
 
-    return MP4_INVALID_SAMPLE_ID;
+    if (m_pFragmentIndex != NULL) {
+        for (uint32_t i = m_pFragmentIndex->GetNextSyncSample(0);
+                i != (uint32_t)-1;
+                i = m_pFragmentIndex->GetNextSyncSample(i + 1)) {
+            if (numSyncSamples < maxSampleIds) {
+                pSampleIds[numSyncSamples] = numTableSamples + i + 1;
+            }
+            numSyncSamples++;
+        }
+    }
+    return numSyncSamples;
 }
 
 void MP4Track::UpdateSyncSamples(MP4SampleId sampleId, bool isSyncSample)
@@ -1810,6 +2949,23 @@ uint64_t MP4Track::GetDuration()
     if (m_pMediaDurationProperty == NULL) {
         return MP4_INVALID_DURATION;
     }
+
+    // samples written as fragments never reach mdhd
+    if (m_File.IsFragmentedWrite()) {
+        return m_fragmentStartTime + m_chunkDuration;
+    }
+
+    // mdhd of a fragmented file need not cover the fragments, nor need
+    // those left on disk be read to learn where they end
+    if (m_File.HasPendingFragments()) {
+        MP4Timestamp endTime = GetPendingFragmentsEndTime();
+        if (endTime != 0) {
+            return max(m_pMediaDurationProperty->GetValue(), endTime);
+        }
+    }
+    if (GetFragmentIndex() != NULL) {
+        return max(m_pMediaDurationProperty->GetValue(), m_pFragmentIndex->GetEndTime());
+    }
     return m_pMediaDurationProperty->GetValue();
 }
 
@@ -1873,7 +3029,6 @@ uint32_t MP4Track::GetChunkStscIndex(MP4ChunkId chunkId)
         return ((uint32_t)-1);
     }
 
-    uint32_t stscIndex;
     uint32_t numStscs = m_pStscCountProperty->GetValue();
     if (numStscs == 0) {
         return ((uint32_t)-1);
@@ -1881,18 +3036,13 @@ uint32_t MP4Track::GetChunkStscIndex(MP4ChunkId chunkId)
 
     ASSERT(chunkId);
 
-    for (stscIndex = 0; stscIndex < numStscs; stscIndex++) {
-        if (chunkId < m_pStscFirstChunkProperty->GetValue(stscIndex)) {
-            if (stscIndex == 0) {
-                std::string errorMsg = std::string("First stsc entry 'firstChunk' must be greater than chunkID. Expected = ") +
-                                       std::to_string(chunkId) + ", Actual = " + std::to_string(m_pStscFirstChunkProperty->GetValue(stscIndex));
-
-                m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stsc", stscIndex), errorMsg);
-                return ((uint32_t)-1);
-            }
+    uint32_t stscIndex = CountNotAbove(m_pStscFirstChunkProperty, numStscs, chunkId);
+    if (stscIndex == 0) {
+        std::string errorMsg = std::string("First stsc entry 'firstChunk' must be greater than chunkID. Expected = ") +
+                               std::to_string(chunkId) + ", Actual = " + std::to_string(m_pStscFirstChunkProperty->GetValue(0));
 
-            break;
-        }
+        m_trakAtom.LogAtomError(INVALID_TABLE_ENTRY_ERROR("stsc", 0), errorMsg);
+        return ((uint32_t)-1);
     }
     return stscIndex - 1;
 }
@@ -1959,6 +3109,93 @@ uint32_t MP4Track::GetChunkSize(MP4ChunkId chunkId)
     return chunkSize;
 }
 
+MP4ChunkId MP4Track::GetSampleChunkId(MP4SampleId sampleId)
+{
+    uint32_t stscIndex = GetSampleStscIndex(sampleId);
+    if (stscIndex == ((uint32_t)-1)) {
+        return 0;
+    }
+
+    uint32_t samplesPerChunk =
+        m_pStscSamplesPerChunkProperty->GetValue(stscIndex);
+    if (samplesPerChunk == 0) {
+        return 0;
+    }
+
+    return m_pStscFirstChunkProperty->GetValue(stscIndex) +
+           ((sampleId - m_pStscFirstSampleProperty->GetValue(stscIndex)) / samplesPerChunk);
+}
+
+// Queue the ranges a reader following m_accessPattern will want after
+// sampleId, and drop what it has left behind. Called with m_readMutex held.
+// Left behind is whatever was requested before the current window, as
+// chunk offsets need not grow with the chunk id.
+void MP4Track::SchedulePrefetch(MP4SampleId sampleId)
+{
+    // how far ahead to look, and the largest range worth holding in memory
+    static const uint32_t depth   = 4;
+    static const uint32_t maxSize = 16 * 1024 * 1024;
+
+    MP4Prefetcher* prefetcher = m_File.GetPrefetcher();
+    if (!prefetcher || !m_pChunkOffsetProperty) {
+        return;
+    }
+
+    if (m_accessPattern == MP4_ACCESS_SEQUENTIAL) {
+        // LATER read ahead by fragment, these samples are not in chunks
+        if (GetFragmentSample(sampleId) != (uint32_t)-1) {
+            return;
+        }
+
+        MP4ChunkId chunkId = GetSampleChunkId(sampleId);
+        if (chunkId == 0 || chunkId == m_prefetchChunkId) {
+            return;
+        }
+
+        // a jump restarts the window, otherwise only its far end is new
+        if (chunkId < m_prefetchChunkId || chunkId > m_prefetchNextChunkId) {
+            m_prefetchNextChunkId = chunkId;
+        }
+        m_prefetchChunkId = chunkId;
+
+        MP4ChunkId lastChunkId = min(chunkId + depth, GetNumberOfChunks());
+        for (; m_prefetchNextChunkId <= lastChunkId; m_prefetchNextChunkId++) {
+            uint32_t chunkSize = GetChunkSize(m_prefetchNextChunkId);
+            if (chunkSize <= maxSize) {
+                prefetcher->Request(m_trackId,
+                                    m_pChunkOffsetProperty->GetValue(m_prefetchNextChunkId - 1),
+                                    chunkSize);
+            }
+        }
+
+        // this chunk and the ones after it
+        prefetcher->Retire(m_trackId, depth + 1);
+    }
+    else if (m_accessPattern == MP4_ACCESS_KEYFRAMES_ONLY) {
+        if (sampleId == m_prefetchSampleId) {
+            return;
+        }
+        m_prefetchSampleId = sampleId;
+
+        MP4SampleId syncSampleId = sampleId;
+        for (uint32_t i = 0; i < depth; i++) {
+            syncSampleId = GetNextSyncSample(syncSampleId + 1);
+            if (syncSampleId == MP4_INVALID_SAMPLE_ID ||
+                syncSampleId > GetNumberOfSamples()) {
+                break;
+            }
+
+            uint32_t sampleSize = GetSampleSize(syncSampleId);
+            if (sampleSize <= maxSize) {
+                prefetcher->Request(m_trackId, GetSampleFileOffset(syncSampleId), sampleSize);
+            }
+        }
+
+        // this sample, requested as one ahead before, and the ones after it
+        prefetcher->Retire(m_trackId, depth + 1);
+    }
+}
+
 void MP4Track::ReadChunk(MP4ChunkId chunkId,
                          uint8_t** ppChunk, uint32_t* pChunkSize)
 {
@@ -2077,6 +3314,7 @@ MP4EditId MP4Track::AddEdit(MP4EditId editId)
     m_pElstReservedProperty->InsertValue(0, editId - 1);
 
     m_pElstCountProperty->IncrementValue();
+    ResetEditIndex();
 
     return editId;
 }
@@ -2098,6 +3336,7 @@ void MP4Track::DeleteEdit(MP4EditId editId)
     m_pElstReservedProperty->DeleteValue(editId - 1);
 
     m_pElstCountProperty->IncrementValue(-1);
+    ResetEditIndex();
 
     // clean up if last edit is deleted
     if (m_pElstCountProperty->GetValue() == 0) {
@@ -2140,14 +3379,38 @@ MP4Duration MP4Track::GetEditTotalDuration(
         return MP4_INVALID_DURATION;
     }
 
-    MP4Duration totalDuration = 0;
+    BuildEditIndex();
+    return m_editIndex[editId - 1];
+}
 
-    for (MP4EditId eid = 1; eid <= editId; eid++) {
-        totalDuration +=
-            m_pElstDurationProperty->GetValue(eid - 1);
+void MP4Track::ResetEditIndex()
+{
+    m_editIndex.clear();
+}
+
+void MP4Track::PropertyChanged(MP4Property* pProperty)
+{
+    // the edit index holds the sums of the edit durations
+    if (pProperty && (pProperty == m_pElstDurationProperty || pProperty == m_pElstCountProperty)) {
+        ResetEditIndex();
+    }
+}
+
+// Make sure m_editIndex holds the end of each edit in the edit timeline
+void MP4Track::BuildEditIndex()
+{
+    uint32_t numEdits = m_pElstCountProperty ? m_pElstCountProperty->GetValue() : 0;
+    if (m_editIndex.size() == numEdits) {
+        return;
     }
 
-    return totalDuration;
+    m_editIndex.resize(numEdits);
+
+    MP4Duration totalDuration = 0;
+    for (uint32_t i = 0; i < numEdits; i++) {
+        totalDuration += m_pElstDurationProperty->GetValue(i);
+        m_editIndex[i] = totalDuration;
+    }
 }
 
 MP4SampleId MP4Track::GetSampleIdFromEditTime(
@@ -2163,23 +3426,17 @@ MP4SampleId MP4Track::GetSampleIdFromEditTime(
     }
 
     if (numEdits) {
-        MP4Duration editElapsedDuration = 0;
+        BuildEditIndex();
 
-        for (MP4EditId editId = 1; editId <= numEdits; editId++) {
-            // remember edit segment's start time (in edit timeline)
-            MP4Timestamp editStartTime =
-                (MP4Timestamp)editElapsedDuration;
-
-            // accumulate edit segment's duration
-            editElapsedDuration +=
-                m_pElstDurationProperty->GetValue(editId - 1);
+        // the first edit segment ending after the specified edit time
+        MP4EditId editId = (MP4EditId)(std::upper_bound(m_editIndex.begin(),
+                           m_editIndex.end(), editWhen) - m_editIndex.begin()) + 1;
 
-            // check whether the specified edit
-            // time is within this edit segment
-            if (editWhen >= editElapsedDuration) {
-                // the specified time has not yet been reached
-                continue;
-            }
+        if (editId <= numEdits) {
+            // the edit segment's start and end time (in edit timeline)
+            MP4Timestamp editStartTime =
+                (editId > 1) ? m_editIndex[editId - 2] : 0;
+            MP4Duration editElapsedDuration = m_editIndex[editId - 1];
 
             // 'editWhen' is within this edit segment
 
@@ -2316,6 +3573,21 @@ void MP4Track::SetDurationPerChunk( MP4Duration duration )
     m_durationPerChunk = duration;
 }
 
+MP4TrackAccessPattern MP4Track::GetAccessPattern()
+{
+    return m_accessPattern;
+}
+
+void MP4Track::SetAccessPattern( MP4TrackAccessPattern pattern )
+{
+    std::lock_guard<std::mutex> lock( m_readMutex );
+
+    m_accessPattern = pattern;
+    m_prefetchChunkId = 0;
+    m_prefetchNextChunkId = 0;
+    m_prefetchSampleId = MP4_INVALID_SAMPLE_ID;
+}
+
 mp4v2::impl::Log& MP4Track::Logger()
 {
     return m_File.Logger();
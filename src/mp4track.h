@@ -40,6 +40,7 @@ typedef uint32_t MP4ChunkId;
 // forward declarations
 class MP4File;
 class MP4Atom;
+class MP4FragmentIndex;
 class MP4Property;
 class MP4IntegerProperty;
 class MP4StringProperty;
@@ -54,6 +55,8 @@ typedef MP4SizedIntegerProperty<uint64_t, 64> MP4Integer64Property;
 
 class MP4Track
 {
+    friend class MP4SampleCursor;
+
 public:
     MP4Track(MP4File& file, MP4Atom& trakAtom);
 
@@ -91,7 +94,8 @@ public:
         MP4Duration*  pRenderingOffset = NULL,
         bool*         pIsSyncSample = NULL,
         bool*         hasDependencyFlags = NULL,
-        uint32_t*     dependencyFlags = NULL );
+        uint32_t*     dependencyFlags = NULL,
+        bool*         pIsMapped = NULL );
 
     void WriteSample(
         const uint8_t* pBytes,
@@ -126,6 +130,12 @@ public:
                                MP4Timestamp* pStartTime, MP4Duration* pDuration);
 
     bool        IsSyncSample(MP4SampleId sampleId);
+    MP4SampleId GetNextSyncSample(MP4SampleId sampleId);
+    MP4SampleId GetPrevSyncSample(MP4SampleId sampleId);
+    uint32_t    GetSyncSampleList(MP4SampleId* pSampleIds, uint32_t maxSampleIds);
+
+    MP4SampleId GetSampleIdFromPresentationTime(MP4Timestamp when);
+    uint32_t    GetPresentationOrder(MP4SampleId* pSampleIds, uint32_t maxSampleIds);
 
     MP4SampleId GetSampleIdFromTime(
         MP4Timestamp when,
@@ -147,11 +157,22 @@ public:
     MP4Timestamp GetEditTotalDuration(
         MP4EditId editId);
 
+    // a property of the track was set outside of it, see
+    // MP4File::SetIntegerProperty()
+    void        PropertyChanged(MP4Property* pProperty);
+
     MP4SampleId GetSampleIdFromEditTime(
         MP4Timestamp editWhen,
         MP4Timestamp* pStartTime = NULL,
         MP4Duration* pDuration = NULL);
 
+    uint32_t ReadSamples(
+        MP4SampleId    firstSampleId,
+        uint32_t       numSamples,
+        uint8_t*       pBytes,
+        uint32_t       numBytes,
+        MP4SampleInfo* pSampleInfo );
+
     // special operation for use during hint track packet assembly
     void ReadSampleFragment(
         MP4SampleId sampleId,
@@ -174,20 +195,95 @@ public:
     MP4Duration GetDurationPerChunk();
     void        SetDurationPerChunk( MP4Duration );
 
+    MP4TrackAccessPattern GetAccessPattern();
+    void                  SetAccessPattern( MP4TrackAccessPattern );
+
+    uint32_t GetSampleOffsetIndexInterval();
+    void     SetSampleOffsetIndexInterval( uint32_t );
+
+    // index the samples of a traf of this track, see MP4FragmentIndex
+    uint64_t AddTrackFragment(MP4Atom& trafAtom,
+                              uint64_t moofOffset, uint64_t dataOffset);
+    MP4Atom* FindTrexAtom();
+
+    // where the moofs of the track start, from a sidx or tfra; lets the
+    // fragments left on disk by MP4File::IndexPendingFragments() be
+    // searched by time
+    void AddRandomAccessPoint(MP4Timestamp time, uint64_t moofOffset);
+    bool HasRandomAccessPoints() {
+        return !m_randomAccessPoints.empty();
+    }
+    bool ReadPendingFragmentSample(
+        MP4Timestamp  when,
+        uint8_t**     ppBytes,
+        uint32_t*     pNumBytes,
+        MP4Timestamp* pStartTime,
+        MP4Duration*  pDuration,
+        MP4Duration*  pRenderingOffset,
+        bool*         pIsSyncSample);
+
+    // movie fragment writing, see MP4File::WriteFragment(); the samples
+    // of the fragment wait in the chunk buffer
+    uint32_t GetFragmentSampleCount() {
+        return (uint32_t)m_fragmentSamples.size();
+    }
+    MP4Timestamp GetFragmentStartTime() {
+        return m_fragmentStartTime;
+    }
+    // for media segments written out of order, see MP4File::BeginMediaSegment()
+    void SetFragmentStartTime(MP4Timestamp startTime) {
+        m_fragmentStartTime = startTime;
+    }
+    MP4Duration GetFragmentDuration() {
+        return m_chunkDuration;
+    }
+    const uint8_t* GetFragmentData() {
+        return m_pChunkBuffer;
+    }
+    uint32_t GetFragmentDataSize() {
+        return m_sizeOfDataInChunkBuffer;
+    }
+    MP4Integer32Property* GenerateTrackFragment(MP4Atom& moofAtom);
+    void WriteChunkBuffer();
+
+    // the earliest presentation time of the buffered fragment, and
+    // whether it opens with a sync sample; see MP4File::WriteSegmentIndex()
+    MP4Timestamp GetFragmentPresentationTime();
+    bool IsFragmentSyncStart();
+
+    // random access points of the fragments written, for the tfra that
+    // MP4File::WriteRandomAccessIndex() puts in the mfra; past
+    // s_randomAccessCapacity of them only every other one is kept
+    void AddFragmentRandomAccessPoint(uint64_t moofOffset, uint32_t trafNumber);
+    MP4Atom* GenerateRandomAccessTable(MP4Atom& mfraAtom);
+
     mp4v2::impl::Log& Logger();
     const mp4v2::impl::Log& Logger() const;
 
 protected:
     bool        InitEditListProperties();
-
+    void        BuildEditIndex();
+    void        ResetEditIndex();
+
+    uint32_t    GetFragmentSample(MP4SampleId sampleId);
+    MP4FragmentIndex* GetFragmentIndex();
+    uint32_t    FindPendingFragmentSample(MP4Timestamp when,
+                                          MP4FragmentIndex& index);
+    uint32_t    FindPendingFragmentSample(MP4Timestamp when, uint64_t moofOffset,
+                                          MP4FragmentIndex& index, bool* pEarly);
+    MP4Timestamp GetPendingFragmentsEndTime();
     File*       GetSampleFile( MP4SampleId sampleId );
     uint64_t    GetSampleFileOffset(MP4SampleId sampleId);
     uint32_t    GetSampleStscIndex(MP4SampleId sampleId);
     uint32_t    GetChunkStscIndex(MP4ChunkId chunkId);
     uint32_t    GetChunkSize(MP4ChunkId chunkId);
+    MP4ChunkId  GetSampleChunkId(MP4SampleId sampleId);
+    bool        ExtendSampleOffsetIndex(MP4SampleId sampleId);
+    void        SchedulePrefetch(MP4SampleId sampleId);
     uint32_t    GetSampleCttsIndex(MP4SampleId sampleId,
                                    MP4SampleId* pFirstSampleId = NULL);
-    MP4SampleId GetNextSyncSample(MP4SampleId sampleId);
+    void        ResetPresentationIndex();
+    bool        BuildPresentationIndex();
 
     void UpdateSampleSizes(MP4SampleId sampleId,
                            uint32_t numBytes);
@@ -196,6 +292,7 @@ protected:
                              MP4ChunkId chunkId, uint32_t samplesPerChunk);
     void UpdateChunkOffsets(uint64_t chunkOffset);
     void UpdateSampleTimes(MP4Duration duration);
+    bool BuildSttsIndex();
     void UpdateRenderingOffsets(MP4SampleId sampleId,
                                 MP4Duration renderingOffset);
     void UpdateSyncSamples(MP4SampleId sampleId,
@@ -208,7 +305,10 @@ protected:
 
     void UpdateModificationTimes();
 
-    void WriteChunkBuffer();
+    bool AppendToChunkBuffer(const uint8_t* pBytes, uint32_t numBytes);
+    void WriteFragmentSample(const uint8_t* pBytes, uint32_t numBytes,
+                             MP4Duration duration, MP4Duration renderingOffset,
+                             bool isSyncSample, uint32_t dependencyFlags);
 
     void CalculateBytesPerSample();
 
@@ -224,6 +324,15 @@ protected:
     File*       m_lastSampleFile;
     std::string m_lastSampleFileURL;
 
+    // serializes table lookups of concurrent sample reads
+    std::mutex  m_readMutex;
+
+    // prefetch state, see SchedulePrefetch()
+    MP4TrackAccessPattern m_accessPattern;
+    MP4ChunkId  m_prefetchChunkId;
+    MP4ChunkId  m_prefetchNextChunkId;
+    MP4SampleId m_prefetchSampleId;
+
     // for efficient construction of hint track packets
     MP4SampleId m_cachedReadSampleId;
     uint8_t*    m_pCachedReadSample;
@@ -283,9 +392,32 @@ protected:
     MP4SampleId m_cachedSttsSid;
     MP4Timestamp    m_cachedSttsElapsed;
 
+    // for random timestamp access, the first sample and start time of each
+    // stts entry plus one past the end, built on the first random access
+    struct SttsIndexEntry {
+        MP4SampleId  sampleId;
+        MP4Timestamp startTime;
+    };
+    vector<SttsIndexEntry> m_sttsIndex;
+
     uint32_t    m_cachedCttsIndex;
     MP4SampleId m_cachedCttsSid;
 
+    // for random rendering offset access, the first sample of each ctts
+    // entry plus one past the end, built on the first random access
+    vector<MP4SampleId> m_cttsIndex;
+
+    // all samples sorted by composition time, built on first use
+    struct PresentationEntry {
+        MP4Timestamp time;
+        MP4SampleId  sampleId;
+
+        bool operator<( const PresentationEntry& other ) const {
+            return time < other.time || (time == other.time && sampleId < other.sampleId);
+        }
+    };
+    vector<PresentationEntry> m_presentationOrder;
+
     MP4Integer32Property* m_pCttsCountProperty;
     MP4Integer32Property* m_pCttsSampleCountProperty;
     MP4Integer32Property* m_pCttsSampleOffsetProperty;
@@ -299,12 +431,48 @@ protected:
     MP4Integer16Property* m_pElstRateProperty;
     MP4Integer16Property* m_pElstReservedProperty;
 
+    // the end of each edit in the edit timeline, built on first use
+    vector<MP4Duration>   m_editIndex;
+
     // for improved sample file offset query performance
     MP4ChunkId  m_cachedSfoChunkId;
     MP4SampleId m_cachedSfoSampleId;
     uint32_t    m_cachedSfoSampleOffset;
 
+    // for random sample file offset queries, the offset within its chunk
+    // of every m_sfoIndexInterval-th sample, extended on demand
+    uint32_t         m_sfoIndexInterval;
+    vector<uint32_t> m_sfoIndex;
+    MP4SampleId      m_sfoIndexSampleId;    // first sample not yet indexed
+    MP4ChunkId       m_sfoIndexChunkId;     // the chunk it starts
+    uint32_t         m_sfoIndexStscIndex;   // the stsc entry of that chunk
+
     string m_sdtpLog; // records frame types for H264 samples
+
+    // samples in movie fragments, numbered on from the sample tables
+    MP4FragmentIndex* m_pFragmentIndex;
+
+    // samples buffered for the next movie fragment when writing one,
+    // and the decode time it starts at
+    struct FragmentSample {
+        uint32_t size;
+        uint32_t duration;
+        uint32_t flags;
+        int32_t  renderingOffset;
+    };
+    vector<FragmentSample> m_fragmentSamples;
+    MP4Timestamp           m_fragmentStartTime;
+
+    // the tfra entries of the track, written or read, in time order
+    struct RandomAccessPoint {
+        MP4Timestamp time;
+        uint64_t     moofOffset;
+        uint32_t     trafNumber;
+    };
+    vector<RandomAccessPoint> m_randomAccessPoints;
+    uint32_t                  m_randomAccessStride;     // written ones kept
+    uint32_t                  m_randomAccessCandidates; // written so far
+    std::atomic<MP4Timestamp> m_pendingFragmentsEndTime;  // 0 until known
 };
 
 typedef MP4Array<MP4Track*> MP4TrackArray;
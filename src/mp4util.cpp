@@ -22,6 +22,12 @@
 
 #include "src/impl.h"
 
+#if !defined( __BIG_ENDIAN__ ) && defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ))
+#   include <immintrin.h>
+#elif !defined( __BIG_ENDIAN__ ) && ( defined( __ARM_NEON ) || defined( __ARM_NEON__ ))
+#   include <arm_neon.h>
+#endif
+
 namespace mp4v2 { namespace impl {
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -276,6 +282,155 @@ MP4Timestamp MP4GetAbsTimestamp() {
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Big-endian table conversion
+//
+// Sample tables are arrays of big-endian 32-bit or 64-bit integers, and
+// swapping them a vector at a time is several times faster than the
+// scalar loop. The x86 variants are picked at run time so that the
+// library itself does not require SSSE3 or AVX2.
+
+#if !defined( __BIG_ENDIAN__ ) && defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ))
+#   define MP4V2_SWAP_X86
+#elif !defined( __BIG_ENDIAN__ ) && ( defined( __ARM_NEON ) || defined( __ARM_NEON__ ))
+#   define MP4V2_SWAP_NEON
+#endif
+
+typedef void (*ConvertFunc)( const uint8_t*, uint8_t*, uint32_t );
+
+static void convert32Scalar( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    for( uint32_t i = 0; i < count; i++ ) {
+        uint32_t value;
+        memcpy( &value, src + 4 * i, 4 );
+        value = MP4V2_NTOHL( value );
+        memcpy( dst + 4 * i, &value, 4 );
+    }
+}
+
+static void convert64Scalar( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    for( uint32_t i = 0; i < count; i++ ) {
+        const uint64_t value = MP4DecodeBigEndian<uint64_t, 64>( src + 8 * i );
+        memcpy( dst + 8 * i, &value, 8 );
+    }
+}
+
+#if defined( MP4V2_SWAP_X86 )
+
+__attribute__((target("ssse3")))
+static void convert32Ssse3( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    const __m128i order = _mm_setr_epi8( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    uint32_t i = 0;
+    for( ; i + 4 <= count; i += 4 ) {
+        const __m128i v = _mm_loadu_si128( (const __m128i*)(src + 4 * i) );
+        _mm_storeu_si128( (__m128i*)(dst + 4 * i), _mm_shuffle_epi8( v, order ));
+    }
+    convert32Scalar( src + 4 * i, dst + 4 * i, count - i );
+}
+
+__attribute__((target("ssse3")))
+static void convert64Ssse3( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    const __m128i order = _mm_setr_epi8( 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
+    uint32_t i = 0;
+    for( ; i + 2 <= count; i += 2 ) {
+        const __m128i v = _mm_loadu_si128( (const __m128i*)(src + 8 * i) );
+        _mm_storeu_si128( (__m128i*)(dst + 8 * i), _mm_shuffle_epi8( v, order ));
+    }
+    convert64Scalar( src + 8 * i, dst + 8 * i, count - i );
+}
+
+__attribute__((target("avx2")))
+static void convert32Avx2( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    const __m256i order = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+    uint32_t i = 0;
+    for( ; i + 8 <= count; i += 8 ) {
+        const __m256i v = _mm256_loadu_si256( (const __m256i*)(src + 4 * i) );
+        _mm256_storeu_si256( (__m256i*)(dst + 4 * i), _mm256_shuffle_epi8( v, order ));
+    }
+    convert32Scalar( src + 4 * i, dst + 4 * i, count - i );
+}
+
+__attribute__((target("avx2")))
+static void convert64Avx2( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    const __m256i order = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
+    uint32_t i = 0;
+    for( ; i + 4 <= count; i += 4 ) {
+        const __m256i v = _mm256_loadu_si256( (const __m256i*)(src + 8 * i) );
+        _mm256_storeu_si256( (__m256i*)(dst + 8 * i), _mm256_shuffle_epi8( v, order ));
+    }
+    convert64Scalar( src + 8 * i, dst + 8 * i, count - i );
+}
+
+#elif defined( MP4V2_SWAP_NEON )
+
+static void convert32Neon( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    uint32_t i = 0;
+    for( ; i + 4 <= count; i += 4 )
+        vst1q_u8( dst + 4 * i, vrev32q_u8( vld1q_u8( src + 4 * i )));
+    convert32Scalar( src + 4 * i, dst + 4 * i, count - i );
+}
+
+static void convert64Neon( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    uint32_t i = 0;
+    for( ; i + 2 <= count; i += 2 )
+        vst1q_u8( dst + 8 * i, vrev64q_u8( vld1q_u8( src + 8 * i )));
+    convert64Scalar( src + 8 * i, dst + 8 * i, count - i );
+}
+
+#endif
+
+static ConvertFunc selectConvert32()
+{
+#if defined( MP4V2_SWAP_X86 )
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ))
+        return convert32Avx2;
+    if( __builtin_cpu_supports( "ssse3" ))
+        return convert32Ssse3;
+#elif defined( MP4V2_SWAP_NEON )
+    return convert32Neon;
+#endif
+    return convert32Scalar;
+}
+
+static ConvertFunc selectConvert64()
+{
+#if defined( MP4V2_SWAP_X86 )
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ))
+        return convert64Avx2;
+    if( __builtin_cpu_supports( "ssse3" ))
+        return convert64Ssse3;
+#elif defined( MP4V2_SWAP_NEON )
+    return convert64Neon;
+#endif
+    return convert64Scalar;
+}
+
+void MP4ConvertBigEndian32( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    static const ConvertFunc convert = selectConvert32();
+    convert( src, dst, count );
+}
+
+void MP4ConvertBigEndian64( const uint8_t* src, uint8_t* dst, uint32_t count )
+{
+    static const ConvertFunc convert = selectConvert64();
+    convert( src, dst, count );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 uint32_t STRTOINT32( const char* s )
 {
 #if defined( MP4V2_INTSTRING_ALIGNMENT )
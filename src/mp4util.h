@@ -113,6 +113,39 @@ char* MP4ToBase64(const uint8_t* pData, uint32_t dataSize);
 
 const char* MP4NormalizeTrackType(const char* type);
 
+// The MP4IOStats latency histogram bucket of an operation that took
+// duration nanoseconds: bucket 0 is under 1us, bucket i covers
+// [2^(i-1), 2^i) us and the last one everything slower.
+inline uint32_t MP4IOLatencyBucket(uint64_t duration) {
+    uint32_t bucket = 0;
+    for (uint64_t us = duration / 1000; us && bucket < MP4_IO_LATENCY_BUCKETS - 1; us >>= 1)
+        bucket++;
+    return bucket;
+}
+
+// Convert count 32-bit or 64-bit integers between big-endian (file) and
+// host byte order. src and dst may be the same buffer. Uses SSSE3/AVX2 or
+// NEON where the CPU has them.
+void MP4ConvertBigEndian32(const uint8_t* src, uint8_t* dst, uint32_t count);
+void MP4ConvertBigEndian64(const uint8_t* src, uint8_t* dst, uint32_t count);
+
+// a big-endian integer of size bits at p
+template<class type, int size> inline type MP4DecodeBigEndian(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < size / 8; i++) {
+        value = (value << 8) | p[i];
+    }
+    return (type)value;
+}
+
+template<class type, int size> inline void MP4EncodeBigEndian(type value, uint8_t* p) {
+    uint64_t v = value;
+    for (int i = size / 8 - 1; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 }} // namespace mp4v2::impl
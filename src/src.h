@@ -27,9 +27,15 @@ namespace mp4v2 { namespace impl {
 #include "log.h"
 #include "mp4util.h"
 #include "mp4array.h"
+#include "mp4prefetcher.h"
 #include "mp4track.h"
+#include "mp4samplecursor.h"
 #include "mp4file.h"
+#include "mp4segmenter.h"
+#include "mp4packedarray.h"
+#include "mp4tablepager.h"
 #include "mp4property.h"
+#include "mp4fragmentindex.h"
 #include "mp4container.h"
 
 #include "mp4atom.h"
@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// blockcache reads a file with its moov at the end through a custom file
+// provider that logs every call, without the block cache and with it, and
+// checks the cache turns the small reads of parsing into a few block
+// reads, fetches adjacent missing blocks with one read and counts what
+// the provider saw
+
+#include "testutil.h"
+#include <algorithm>
+
+static const uint32_t numSamples = 300;
+static const uint32_t bigSampleId = 150;
+static const uint32_t blockSize = 4096;
+
+static uint32_t sampleSize(uint32_t i)
+{
+    return i + 1 == bigSampleId ? 200000 : 100 + (i * 7919) % 3000;
+}
+
+// what the provider was asked to do
+struct ProviderRead
+{
+    int64_t offset;
+    int64_t size;
+    int64_t numRead;
+};
+
+static std::vector<ProviderRead> providerReads;
+static uint64_t providerBytes = 0;
+static uint32_t providerSeeks = 0;
+
+struct LoggedFile
+{
+    FILE*   file;
+    int64_t pos;
+};
+
+static void* loggedOpen(const char* name, MP4FileMode mode)
+{
+    if (mode != FILEMODE_READ) {
+        return NULL;
+    }
+    FILE* file = fopen(name, "rb");
+    if (!file) {
+        return NULL;
+    }
+    LoggedFile* handle = new LoggedFile;
+    handle->file = file;
+    handle->pos = 0;
+    return handle;
+}
+
+static int loggedSeek(void* handle, int64_t pos)
+{
+    LoggedFile* logged = (LoggedFile*)handle;
+    providerSeeks++;
+    if (fseeko(logged->file, (off_t)pos, SEEK_SET)) {
+        return 1;
+    }
+    logged->pos = pos;
+    return 0;
+}
+
+static int loggedRead(void* handle, void* buffer, int64_t size, int64_t* nin, int64_t)
+{
+    LoggedFile* logged = (LoggedFile*)handle;
+    ProviderRead read;
+    read.offset = logged->pos;
+    read.size = size;
+
+    *nin = (int64_t)fread(buffer, 1, (size_t)size, logged->file);
+    read.numRead = *nin;
+    providerReads.push_back(read);
+    providerBytes += *nin;
+    logged->pos += *nin;
+    return ferror(logged->file) ? 1 : 0;
+}
+
+static int loggedWrite(void*, const void*, int64_t, int64_t*, int64_t)
+{
+    return 1;
+}
+
+static int loggedClose(void* handle)
+{
+    LoggedFile* logged = (LoggedFile*)handle;
+    fclose(logged->file);
+    delete logged;
+    return 0;
+}
+
+static const MP4FileProvider loggedProvider = {
+    loggedOpen, loggedSeek, loggedRead, loggedWrite, loggedClose
+};
+
+static void resetLog()
+{
+    providerReads.clear();
+    providerBytes = 0;
+    providerSeeks = 0;
+}
+
+// without MP4_CREATE_OPTIMIZE the moov is written after the mdat
+static bool createFile(const char* fileName)
+{
+    MP4FileHandle hFile = MP4Create(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return false;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId trackId = MP4AddTrack(hFile, MP4_VIDEO_TRACK_TYPE, 90000);
+
+    std::vector<uint8_t> buf(200000);
+    for (uint32_t i = 0; i < numSamples; i++) {
+        fillSample(&buf[0], sampleSize(i), i);
+        MP4WriteSample(hFile, trackId, &buf[0], sampleSize(i), 3000, 0, i % 30 == 0);
+    }
+    MP4Close(hFile);
+    return true;
+}
+
+static bool checkSample(MP4FileHandle hFile, MP4SampleId sampleId)
+{
+    uint8_t* pBytes = NULL;
+    uint32_t numBytes = 0;
+    if (!MP4ReadSample(hFile, 1, sampleId, &pBytes, &numBytes)) {
+        return false;
+    }
+    std::vector<uint8_t> expected(sampleSize(sampleId - 1));
+    fillSample(&expected[0], (uint32_t)expected.size(), sampleId - 1);
+    bool same = numBytes == expected.size() && memcmp(pBytes, &expected[0], numBytes) == 0;
+    MP4Free(pBytes);
+    return same;
+}
+
+// opens the file and reads every sample, returning the provider reads
+static size_t readAll(const char* fileName, MP4BlockCacheStats* stats)
+{
+    resetLog();
+    MP4FileHandle hFile = MP4ReadProvider(fileName, &loggedProvider);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot read %s", fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return 0;
+    }
+    CHECK(MP4GetTrackNumberOfSamples(hFile, 1) == numSamples, "%u samples", MP4GetTrackNumberOfSamples(hFile, 1));
+    for (MP4SampleId sampleId = 1; sampleId <= numSamples; sampleId++) {
+        CHECK(checkSample(hFile, sampleId), "sample %u", sampleId);
+    }
+    if (stats) {
+        CHECK(MP4GetBlockCacheStats(hFile, stats), "no block cache stats");
+    } else {
+        MP4BlockCacheStats unused;
+        CHECK(!MP4GetBlockCacheStats(hFile, &unused), "block cache stats without a block cache");
+    }
+    MP4Close(hFile);
+    return providerReads.size();
+}
+
+int main()
+{
+    const char* fileName = "blockcache.mp4";
+    if (!createFile(fileName)) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+    std::vector<uint8_t> bytes;
+    CHECK(readFile(fileName, bytes) && bytes.size() > 600000, "cannot read back %s", fileName);
+    uint64_t numBlocks = (bytes.size() + blockSize - 1) / blockSize;
+
+    // the provider sees every small read of the parser and of the samples
+    MP4SetReadBufferSize(0);
+    MP4SetBlockCache(0, 0);
+    size_t uncachedReads = readAll(fileName, NULL);
+
+    // with room for the whole file every block is fetched at most once,
+    // those a read needs together; without read-ahead the samples read in
+    // order still fetch about a block at a time
+    MP4SetBlockCache(blockSize, numBlocks * blockSize);
+    MP4BlockCacheStats stats;
+    memset(&stats, 0, sizeof(stats));
+    size_t cachedReads = readAll(fileName, &stats);
+    CHECK(cachedReads > 0 && cachedReads <= numBlocks && cachedReads * 3 < uncachedReads,
+          "%u provider reads with the cache, %u without", (unsigned)cachedReads, (unsigned)uncachedReads);
+    CHECK(providerSeeks <= cachedReads, "%u provider seeks for %u reads", providerSeeks, (unsigned)cachedReads);
+    CHECK(stats.reads == cachedReads && stats.bytesRead == providerBytes,
+          "stats count %llu reads of %llu bytes, the provider %u of %llu",
+          (unsigned long long)stats.reads, (unsigned long long)stats.bytesRead,
+          (unsigned)cachedReads, (unsigned long long)providerBytes);
+    CHECK(stats.misses <= numBlocks && stats.evictions == 0, "%llu misses, %llu evictions of %llu blocks",
+          (unsigned long long)stats.misses, (unsigned long long)stats.evictions, (unsigned long long)numBlocks);
+    CHECK(stats.hits > stats.misses * 2, "hit rate %llu / %llu",
+          (unsigned long long)stats.hits, (unsigned long long)(stats.hits + stats.misses));
+    // whole blocks, but for the rest of a short read
+    for (size_t i = 0; i < providerReads.size(); i++) {
+        const ProviderRead& read = providerReads[i];
+        bool rest = i > 0 && providerReads[i - 1].numRead < providerReads[i - 1].size &&
+                    read.offset == providerReads[i - 1].offset + providerReads[i - 1].numRead;
+        CHECK(rest || (read.offset % blockSize == 0 && read.size % blockSize == 0),
+              "provider read %u of %lld bytes at %lld is not whole blocks", (unsigned)i,
+              (long long)read.size, (long long)read.offset);
+    }
+
+    // a sample spanning many blocks nobody has read yet is one provider
+    // read, and reading it again none
+    MP4FileHandle hFile = MP4ReadProvider(fileName, &loggedProvider);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot reopen %s", fileName);
+    if (hFile != MP4_INVALID_FILE_HANDLE) {
+        MP4BlockCacheStats before, after;
+        MP4GetBlockCacheStats(hFile, &before);
+        std::vector<uint8_t> bigSample(sampleSize(bigSampleId - 1));
+        fillSample(&bigSample[0], (uint32_t)bigSample.size(), bigSampleId - 1);
+        uint64_t offset = std::search(bytes.begin(), bytes.end(), bigSample.begin(), bigSample.end()) - bytes.begin();
+        resetLog();
+        CHECK(checkSample(hFile, bigSampleId), "big sample");
+        CHECK(providerReads.size() == 1 && providerReads[0].offset <= (int64_t)offset &&
+              providerReads[0].offset + providerReads[0].size >= (int64_t)(offset + sampleSize(bigSampleId - 1)),
+              "big sample in %u provider reads", (unsigned)providerReads.size());
+        MP4GetBlockCacheStats(hFile, &after);
+        CHECK(after.reads == before.reads + 1 &&
+              after.misses - before.misses >= sampleSize(bigSampleId - 1) / blockSize,
+              "big sample: %llu reads, %llu misses", (unsigned long long)(after.reads - before.reads),
+              (unsigned long long)(after.misses - before.misses));
+
+        resetLog();
+        CHECK(checkSample(hFile, bigSampleId), "big sample again");
+        MP4GetBlockCacheStats(hFile, &before);
+        CHECK(providerReads.empty() && before.hits - after.hits >= sampleSize(bigSampleId - 1) / blockSize,
+              "big sample again: %u provider reads", (unsigned)providerReads.size());
+        MP4Close(hFile);
+    }
+
+    // with room for a few blocks the samples still read back, at the cost
+    // of blocks evicted and fetched again
+    MP4SetBlockCache(blockSize, 4 * blockSize);
+    memset(&stats, 0, sizeof(stats));
+    readAll(fileName, &stats);
+    CHECK(stats.evictions > 0 && stats.misses > numBlocks, "%llu misses, %llu evictions with 4 blocks",
+          (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+
+    MP4SetBlockCache(0, 0);
+    MP4SetReadBufferSize(64 * 1024);
+    remove(fileName);
+
+    printf("%u provider reads with the cache, %u without, %d failures\n",
+           (unsigned)cachedReads, (unsigned)uncachedReads, failures);
+    return failures ? 1 : 0;
+}
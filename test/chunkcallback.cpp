@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// chunkcallback writes a fragmented file in chunks with MP4SetChunkCallback()
+// and checks the chunks handed to the callback against the file
+
+#include "testutil.h"
+
+struct Chunk
+{
+    std::vector<uint8_t>  bytes;
+    std::vector<uint64_t> pieceSizes;
+    MP4ChunkInfo          info;
+};
+
+static void chunkCallback(void* userData, const MP4ChunkInfo* info)
+{
+    std::vector<Chunk>& chunks = *(std::vector<Chunk>*)userData;
+    chunks.push_back(Chunk());
+    for (uint32_t i = 0; i < info->numPieces; i++) {
+        const MP4ChunkPiece& piece = info->pieces[i];
+        chunks.back().bytes.insert(chunks.back().bytes.end(), piece.bytes, piece.bytes + piece.numBytes);
+        chunks.back().pieceSizes.push_back(piece.numBytes);
+    }
+    chunks.back().info = *info;
+    chunks.back().info.pieces = NULL;
+}
+
+int main(int argc, char** argv)
+{
+    const char* fileName = argc > 1 ? argv[1] : "chunkcallback.mp4";
+    const uint32_t numVideoSamples = 150;   // 5 seconds at 30 fps
+
+    std::vector<Chunk> chunks;
+
+    MP4FileHandle hFile = MP4CreateEx(fileName, MP4_CREATE_FRAGMENTED);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId videoTrack = MP4AddVideoTrack(hFile, 90000, 3000, 320, 240, MP4_MPEG4_VIDEO_TYPE);
+    MP4TrackId audioTrack = MP4AddTrack(hFile, MP4_AUDIO_TRACK_TYPE, 48000);
+    MP4SetFragmentDuration(hFile, 2000);
+    MP4SetChunkDuration(hFile, 500);
+    MP4SetChunkCallback(hFile, chunkCallback, &chunks);
+
+    uint8_t buf[4096];
+    uint32_t numAudioSamples = 0;
+    for (uint32_t i = 0; i < numVideoSamples; i++) {
+        uint32_t size = 100 + (i * 37) % 3000;
+        fillSample(buf, size, i);
+        MP4WriteSample(hFile, videoTrack, buf, size, 3000, 0, i % 30 == 0);
+
+        // audio up to the end of the video sample
+        while ((uint64_t)numAudioSamples * 1024 * 90000 < (uint64_t)(i + 1) * 3000 * 48000) {
+            fillSample(buf, 20, 1000000 + numAudioSamples);
+            MP4WriteSample(hFile, audioTrack, buf, 20, 1024, 0, true);
+            numAudioSamples++;
+        }
+    }
+    MP4Close(hFile);
+
+    std::vector<uint8_t> fileBytes;
+    if (!readFile(fileName, fileBytes)) {
+        printf("FAIL cannot reopen %s\n", fileName);
+        return 1;
+    }
+
+    // the init segment first, then moofs numbered from 1, back to back
+    CHECK(chunks.size() > 2, "%u chunks", (unsigned)chunks.size());
+    uint64_t offset = 0;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        const Chunk& chunk = chunks[i];
+        CHECK(chunk.info.numBytes == chunk.bytes.size(), "chunk %u size", (unsigned)i);
+        CHECK(chunk.info.fileOffset == offset, "chunk %u at %llu, expected %llu",
+              (unsigned)i, (unsigned long long)chunk.info.fileOffset, (unsigned long long)offset);
+        CHECK(chunk.info.isInitSegment == (i == 0), "chunk %u init", (unsigned)i);
+        if (offset + chunk.bytes.size() > fileBytes.size()) {
+            CHECK(false, "chunk %u past the end of the file", (unsigned)i);
+            break;
+        }
+
+        if (chunk.info.isInitSegment) {
+            CHECK(chunk.pieceSizes.size() == 1, "init segment in %u pieces", (unsigned)chunk.pieceSizes.size());
+
+            // the free atom reserved at its end is overwritten by the sidx
+            size_t end = 0;
+            while (end + 8 <= chunk.bytes.size() && memcmp(&chunk.bytes[end + 4], "free", 4) != 0) {
+                end += readUInt32(&chunk.bytes[end]);
+            }
+            CHECK(end < chunk.bytes.size(), "no free atom in the init segment");
+            CHECK(memcmp(&chunk.bytes[0], &fileBytes[0], end) == 0, "init segment differs");
+            CHECK(memcmp(&fileBytes[end + 4], "sidx", 4) == 0, "no sidx after the moov");
+        }
+        else {
+            CHECK(memcmp(&chunk.bytes[0], &fileBytes[offset], chunk.bytes.size()) == 0,
+                  "chunk %u differs from the file", (unsigned)i);
+            CHECK(memcmp(&fileBytes[offset + 4], "moof", 4) == 0, "chunk %u is no moof", (unsigned)i);
+            CHECK(chunk.info.sequenceNumber == (uint32_t)i, "chunk %u has sequence number %u",
+                  (unsigned)i, chunk.info.sequenceNumber);
+            // moof.mfhd.sequenceNumber
+            CHECK(readUInt32(&fileBytes[offset + 20]) == chunk.info.sequenceNumber,
+                  "chunk %u moof has sequence number %u", (unsigned)i, readUInt32(&fileBytes[offset + 20]));
+
+            // the moof and the mdat header, then the sample data of the
+            // video track and of the audio track, either of which may be
+            // left out if the track has no samples in the chunk
+            uint64_t headerSize = chunk.pieceSizes.empty() ? 0 : chunk.pieceSizes[0];
+            CHECK(chunk.pieceSizes.size() == 2 || chunk.pieceSizes.size() == 3, "chunk %u in %u pieces", (unsigned)i, (unsigned)chunk.pieceSizes.size());
+            CHECK(headerSize == readUInt32(&chunk.bytes[0]) + 8 && headerSize <= chunk.bytes.size() &&
+                  memcmp(&chunk.bytes[headerSize - 4], "mdat", 4) == 0 &&
+                  readUInt32(&chunk.bytes[headerSize - 8]) == chunk.bytes.size() - headerSize + 8,
+                  "chunk %u does not start with the moof and mdat header", (unsigned)i);
+        }
+        offset += chunk.bytes.size();
+    }
+
+    // and only the mfra after them
+    CHECK(offset + 8 <= fileBytes.size() && memcmp(&fileBytes[offset + 4], "mfra", 4) == 0,
+          "no mfra after the chunks");
+    CHECK(offset + 8 <= fileBytes.size() && offset + readUInt32(&fileBytes[offset]) == fileBytes.size(),
+          "file does not end with the mfra");
+
+    // the samples read back as written
+    hFile = MP4Read(fileName);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot read %s", fileName);
+    if (hFile != MP4_INVALID_FILE_HANDLE) {
+        CHECK(MP4GetTrackNumberOfSamples(hFile, videoTrack) == numVideoSamples, "video samples");
+        CHECK(MP4GetTrackNumberOfSamples(hFile, audioTrack) == numAudioSamples, "audio samples");
+        for (uint32_t i = 0; i < numVideoSamples; i++) {
+            uint8_t* pBytes = NULL;
+            uint32_t numBytes = 0;
+            bool isSyncSample = false;
+            if (!MP4ReadSample(hFile, videoTrack, i + 1, &pBytes, &numBytes, NULL, NULL, NULL, &isSyncSample)) {
+                CHECK(false, "cannot read video sample %u", i + 1);
+                continue;
+            }
+            uint32_t size = 100 + (i * 37) % 3000;
+            fillSample(buf, size, i);
+            CHECK(numBytes == size && memcmp(pBytes, buf, size) == 0, "video sample %u", i + 1);
+            CHECK(isSyncSample == (i % 30 == 0), "video sample %u sync", i + 1);
+            MP4Free(pBytes);
+        }
+        MP4Close(hFile);
+    }
+
+    remove(fileName);
+
+    printf("%u chunks, %d failures\n", (unsigned)chunks.size(), failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,156 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// directio writes the same two-track file with and without
+// MP4_CREATE_DIRECT_IO, in the working directory and, on Linux, on tmpfs
+// where O_DIRECT may be refused, and checks both come out byte for byte
+// the same and read back as written
+
+#include "testutil.h"
+
+static const uint32_t numVideoSamples = 120;
+
+// mostly small, odd sizes with now and then one larger than the write
+// buffer of the file provider
+static uint32_t videoSampleSize(uint32_t i)
+{
+    return i % 40 == 7 ? 1500000 + i : 1 + (i * 7919) % 40000;
+}
+
+static bool writeFile(const string& fileName, uint32_t flags)
+{
+    MP4FileHandle hFile = MP4CreateEx(fileName.c_str(), flags);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return false;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId videoTrack = MP4AddTrack(hFile, MP4_VIDEO_TRACK_TYPE, 90000);
+    MP4TrackId audioTrack = MP4AddTrack(hFile, MP4_AUDIO_TRACK_TYPE, 48000);
+
+    std::vector<uint8_t> buf(1600000);
+    uint32_t numAudioSamples = 0;
+    for (uint32_t i = 0; i < numVideoSamples; i++) {
+        fillSample(&buf[0], videoSampleSize(i), i);
+        MP4WriteSample(hFile, videoTrack, &buf[0], videoSampleSize(i), 3000, 0, i % 30 == 0);
+
+        while ((uint64_t)numAudioSamples * 1024 * 90000 < (uint64_t)(i + 1) * 3000 * 48000) {
+            fillSample(&buf[0], 33, 1000000 + numAudioSamples);
+            MP4WriteSample(hFile, audioTrack, &buf[0], 33, 1024, 0, true);
+            numAudioSamples++;
+        }
+    }
+
+    // so that the two files can be compared byte for byte, but for the
+    // modification time of the mvhd that MP4Close() sets, see clearMovieTime()
+    MP4SetIntegerProperty(hFile, "moov.mvhd.creationTime", 0);
+    MP4SetIntegerProperty(hFile, "moov.mvhd.modificationTime", 0);
+    for (MP4TrackId trackId = videoTrack; trackId <= audioTrack; trackId++) {
+        MP4SetTrackIntegerProperty(hFile, trackId, "tkhd.creationTime", 0);
+        MP4SetTrackIntegerProperty(hFile, trackId, "tkhd.modificationTime", 0);
+        MP4SetTrackIntegerProperty(hFile, trackId, "mdia.mdhd.creationTime", 0);
+        MP4SetTrackIntegerProperty(hFile, trackId, "mdia.mdhd.modificationTime", 0);
+    }
+
+    MP4Close(hFile);
+    return true;
+}
+
+// zeroes the modification time of the mvhd, the first atom of the moov
+static bool clearMovieTime(std::vector<uint8_t>& bytes)
+{
+    for (size_t offset = 0; offset + 8 <= bytes.size(); ) {
+        uint32_t size = readUInt32(&bytes[offset]);
+        if (size < 8) {
+            return false;
+        }
+        if (memcmp(&bytes[offset + 4], "moov", 4) == 0 && offset + 8 + 28 <= bytes.size() &&
+                memcmp(&bytes[offset + 12], "mvhd", 4) == 0) {
+            // after the version, flags and creation time
+            uint8_t* mvhd = &bytes[offset + 8];
+            uint32_t timeSize = mvhd[8] == 1 ? 8 : 4;
+            memset(&mvhd[12 + timeSize], 0, timeSize);
+            return true;
+        }
+        offset += size;
+    }
+    return false;
+}
+
+static void checkSamples(const string& fileName)
+{
+    MP4FileHandle hFile = MP4Read(fileName.c_str());
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot read %s", fileName.c_str());
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return;
+    }
+
+    CHECK(MP4GetTrackNumberOfSamples(hFile, 1) == numVideoSamples, "%s: %u video samples",
+          fileName.c_str(), MP4GetTrackNumberOfSamples(hFile, 1));
+    std::vector<uint8_t> buf(1600000);
+    for (uint32_t i = 0; i < numVideoSamples; i++) {
+        uint8_t* pBytes = NULL;
+        uint32_t numBytes = 0;
+        if (!MP4ReadSample(hFile, 1, i + 1, &pBytes, &numBytes)) {
+            CHECK(false, "%s: cannot read video sample %u", fileName.c_str(), i + 1);
+            continue;
+        }
+        fillSample(&buf[0], videoSampleSize(i), i);
+        CHECK(numBytes == videoSampleSize(i) && memcmp(pBytes, &buf[0], numBytes) == 0,
+              "%s: video sample %u", fileName.c_str(), i + 1);
+        MP4Free(pBytes);
+    }
+    MP4Close(hFile);
+}
+
+static void testDirectory(const string& directory)
+{
+    string bufferedFileName = directory + "directio-buffered.mp4";
+    string directFileName = directory + "directio-direct.mp4";
+
+    // a directory that cannot be written to is skipped
+    FILE* probe = fopen(bufferedFileName.c_str(), "wb");
+    if (!probe) {
+        printf("skipping %s\n", directory.c_str());
+        return;
+    }
+    fclose(probe);
+
+    CHECK(writeFile(bufferedFileName, 0), "cannot create %s", bufferedFileName.c_str());
+    CHECK(writeFile(directFileName, MP4_CREATE_DIRECT_IO), "cannot create %s", directFileName.c_str());
+
+    std::vector<uint8_t> buffered, direct;
+    CHECK(readFile(bufferedFileName, buffered), "cannot reopen %s", bufferedFileName.c_str());
+    CHECK(readFile(directFileName, direct), "cannot reopen %s", directFileName.c_str());
+    CHECK(clearMovieTime(buffered) && clearMovieTime(direct), "%s: no mvhd", directory.c_str());
+    CHECK(buffered.size() > 4000000 && direct == buffered, "%s: %u bytes direct, %u buffered",
+          directory.c_str(), (unsigned)direct.size(), (unsigned)buffered.size());
+
+    checkSamples(directFileName);
+
+    remove(bufferedFileName.c_str());
+    remove(directFileName.c_str());
+}
+
+int main()
+{
+    testDirectory("");
+#if defined( __linux__ )
+    testDirectory("/dev/shm/");
+#endif
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
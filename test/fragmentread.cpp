@@ -0,0 +1,536 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// fragmentread writes a track with samples of its own, with sdtp, and
+// appends movie fragments to it by hand: truns that lean on trex and tfhd
+// defaults or carry every column, sample data out of trun order, and the
+// three ways a traf can set the base of its data offsets. It then checks
+// the sample iterator, walking across the moov and moof boundaries and
+// seeking into the middle of truns, and the sample readers against what
+// was written, dependency flags included
+
+#include "testutil.h"
+
+// what sample i (from 0) should read back as
+struct Expected
+{
+    uint64_t     offset;
+    uint32_t     size;
+    MP4Timestamp startTime;
+    MP4Duration  duration;
+    MP4Duration  renderingOffset;
+    bool         isSyncSample;
+    uint32_t     dependencyFlags;
+};
+
+static std::vector<Expected> expected;
+static MP4Timestamp endTime = 0;
+
+// sample flags of 8.8.3.1 of ISO/IEC 14496-12
+static const uint32_t syncFlags    = 0x02800000; // depends on no other, others depend on it
+static const uint32_t nonSyncFlags = 0x01410000; // depends on others, none on it, non-sync
+
+// the sdtp byte the flags carry
+static uint32_t dependencyFlags(uint32_t flags)
+{
+    return (flags >> 20) & 0xff;
+}
+
+static const uint32_t numMoovSamples = 10;
+
+static bool createFile(const char* fileName)
+{
+    MP4FileHandle hFile = MP4Create(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return false;
+    }
+    MP4SetTimeScale(hFile, 90000);
+    MP4TrackId trackId = MP4AddTrack(hFile, MP4_VIDEO_TRACK_TYPE, 90000);
+
+    uint8_t buf[1000];
+    for (uint32_t i = 0; i < numMoovSamples; i++) {
+        Expected sample;
+        sample.offset = 0;      // not known until the file is read back
+        sample.size = 100 + i * 13;
+        sample.startTime = endTime;
+        sample.duration = 3000;
+        sample.renderingOffset = i % 2 ? 0 : 3000;
+        sample.isSyncSample = i == 0 || i == 6;
+        sample.dependencyFlags = sample.isSyncSample ? 0x24 : 0x18;
+        expected.push_back(sample);
+        endTime += sample.duration;
+
+        fillSample(buf, sample.size, i);
+        MP4WriteSampleDependency(hFile, trackId, buf, sample.size, sample.duration, sample.renderingOffset,
+                                 sample.isSyncSample, sample.dependencyFlags);
+    }
+    MP4Close(hFile);
+    return true;
+}
+
+// box writing, sizes are patched in when a box ends
+
+static void put32(std::vector<uint8_t>& bytes, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        bytes.push_back((uint8_t)(value >> shift));
+    }
+}
+
+static void put64(std::vector<uint8_t>& bytes, uint64_t value)
+{
+    put32(bytes, (uint32_t)(value >> 32));
+    put32(bytes, (uint32_t)value);
+}
+
+static void patch32(std::vector<uint8_t>& bytes, size_t at, uint32_t value)
+{
+    for (int k = 0; k < 4; k++) {
+        bytes[at + k] = (uint8_t)(value >> (24 - 8 * k));
+    }
+}
+
+static size_t beginBox(std::vector<uint8_t>& bytes, const char* type)
+{
+    size_t start = bytes.size();
+    put32(bytes, 0);
+    bytes.insert(bytes.end(), type, type + 4);
+    return start;
+}
+
+static size_t beginFullBox(std::vector<uint8_t>& bytes, const char* type, uint8_t version, uint32_t flags)
+{
+    size_t start = beginBox(bytes, type);
+    put32(bytes, ((uint32_t)version << 24) | flags);
+    return start;
+}
+
+static void endBox(std::vector<uint8_t>& bytes, size_t start)
+{
+    patch32(bytes, start, (uint32_t)(bytes.size() - start));
+}
+
+// trex defaults
+static const uint32_t trexDuration = 3000;
+static const uint32_t trexFlags = nonSyncFlags;
+
+// gives the moov an mvex with the trex of the track; the moov comes after
+// the mdat, so no chunk offset moves
+static bool addMovieExtends(std::vector<uint8_t>& bytes)
+{
+    size_t offset = 0;
+    while (offset + 8 <= bytes.size() && memcmp(&bytes[offset + 4], "moov", 4) != 0) {
+        uint32_t size = readUInt32(&bytes[offset]);
+        if (size < 8) {
+            return false;
+        }
+        offset += size;
+    }
+    if (offset + 8 > bytes.size()) {
+        return false;
+    }
+    size_t moovSize = readUInt32(&bytes[offset]);
+
+    std::vector<uint8_t> mvex;
+    size_t mvexStart = beginBox(mvex, "mvex");
+    size_t trex = beginFullBox(mvex, "trex", 0, 0);
+    put32(mvex, 1);             // track id
+    put32(mvex, 1);             // sample description index
+    put32(mvex, trexDuration);
+    put32(mvex, 0);             // size
+    put32(mvex, trexFlags);
+    endBox(mvex, trex);
+    endBox(mvex, mvexStart);
+
+    bytes.insert(bytes.begin() + offset + moovSize, mvex.begin(), mvex.end());
+    patch32(bytes, offset, (uint32_t)(moovSize + mvex.size()));
+    return true;
+}
+
+// a trun as written, its columns empty unless its flags carry them
+struct Trun
+{
+    uint32_t              flags;
+    uint32_t              firstSampleFlags;
+    std::vector<uint32_t> durations;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> sampleFlags;
+    std::vector<uint32_t> renderingOffsets;
+
+    uint32_t numSamples() const { return (uint32_t)sizes.size(); }
+    size_t   dataOffsetAt;      // where its data offset is, to patch
+    uint64_t dataStart;         // absolute offset of its first sample
+};
+
+static const uint32_t trunDataOffset       = 0x001;
+static const uint32_t trunFirstSampleFlags = 0x004;
+static const uint32_t trunDuration         = 0x100;
+static const uint32_t trunSize             = 0x200;
+static const uint32_t trunFlags            = 0x400;
+static const uint32_t trunRenderingOffset  = 0x800;
+
+static void writeTrun(std::vector<uint8_t>& bytes, Trun& trun)
+{
+    size_t start = beginFullBox(bytes, "trun", 0, trun.flags);
+    put32(bytes, trun.numSamples());
+    trun.dataOffsetAt = bytes.size();
+    if (trun.flags & trunDataOffset) {
+        put32(bytes, 0);
+    }
+    if (trun.flags & trunFirstSampleFlags) {
+        put32(bytes, trun.firstSampleFlags);
+    }
+    for (uint32_t i = 0; i < trun.numSamples(); i++) {
+        if (trun.flags & trunDuration) {
+            put32(bytes, trun.durations[i]);
+        }
+        if (trun.flags & trunSize) {
+            put32(bytes, trun.sizes[i]);
+        }
+        if (trun.flags & trunFlags) {
+            put32(bytes, trun.sampleFlags[i]);
+        }
+        if (trun.flags & trunRenderingOffset) {
+            put32(bytes, trun.renderingOffsets[i]);
+        }
+    }
+    endBox(bytes, start);
+}
+
+// the samples of a trun, in decoding order, and its data in the mdat
+static void expectTrun(const Trun& trun, uint32_t defaultDuration, uint32_t defaultFlags)
+{
+    uint64_t offset = trun.dataStart;
+    for (uint32_t i = 0; i < trun.numSamples(); i++) {
+        uint32_t flags = defaultFlags;
+        if (trun.flags & trunFlags) {
+            flags = trun.sampleFlags[i];
+        } else if (i == 0 && (trun.flags & trunFirstSampleFlags)) {
+            flags = trun.firstSampleFlags;
+        }
+
+        Expected sample;
+        sample.offset = offset;
+        sample.size = trun.sizes[i];
+        sample.startTime = endTime;
+        sample.duration = (trun.flags & trunDuration) ? trun.durations[i] : defaultDuration;
+        sample.renderingOffset = (trun.flags & trunRenderingOffset) ? trun.renderingOffsets[i] : 0;
+        sample.isSyncSample = (flags & 0x00010000) == 0;
+        sample.dependencyFlags = dependencyFlags(flags);
+        expected.push_back(sample);
+
+        endTime += sample.duration;
+        offset += sample.size;
+    }
+}
+
+static void writeTrunData(std::vector<uint8_t>& bytes, const Trun& trun, uint32_t firstSample)
+{
+    for (uint32_t i = 0; i < trun.numSamples(); i++) {
+        std::vector<uint8_t> data(trun.sizes[i]);
+        fillSample(&data[0], trun.sizes[i], firstSample + i);
+        bytes.insert(bytes.end(), data.begin(), data.end());
+    }
+}
+
+static uint32_t sequenceNumber = 0;
+
+// a moof with one traf of the truns and the mdat of their data, which
+// holds the truns in the order given by dataOrder; the data offsets are
+// counted from the moof, from baseDataOffset if there is one, or, for
+// tfhdFlags without either flag, from the moof as the first traf
+static void appendFragment(std::vector<uint8_t>& bytes, uint32_t tfhdFlags, std::vector<Trun>& truns,
+                           const std::vector<size_t>& dataOrder, bool hasTfdt,
+                           uint32_t defaultDuration, uint32_t defaultFlags)
+{
+    size_t moofStart = bytes.size();
+    size_t moof = beginBox(bytes, "moof");
+    size_t mfhd = beginFullBox(bytes, "mfhd", 0, 0);
+    put32(bytes, ++sequenceNumber);
+    endBox(bytes, mfhd);
+
+    size_t traf = beginBox(bytes, "traf");
+    size_t tfhd = beginFullBox(bytes, "tfhd", 0, tfhdFlags);
+    put32(bytes, 1);
+    size_t baseDataOffsetAt = bytes.size();
+    if (tfhdFlags & 0x01) {
+        put64(bytes, 0);
+    }
+    if (tfhdFlags & 0x08) {
+        put32(bytes, defaultDuration);
+    }
+    if (tfhdFlags & 0x20) {
+        put32(bytes, defaultFlags);
+    }
+    endBox(bytes, tfhd);
+    if (hasTfdt) {
+        size_t tfdt = beginFullBox(bytes, "tfdt", 1, 0);
+        put64(bytes, endTime);
+        endBox(bytes, tfdt);
+    }
+    for (size_t i = 0; i < truns.size(); i++) {
+        writeTrun(bytes, truns[i]);
+    }
+    endBox(bytes, traf);
+    endBox(bytes, moof);
+
+    // the data of the truns, where the samples expect it
+    size_t mdat = beginBox(bytes, "mdat");
+    uint64_t base = moofStart;
+    if (tfhdFlags & 0x01) {
+        base = bytes.size();
+        patch32(bytes, baseDataOffsetAt, (uint32_t)(base >> 32));
+        patch32(bytes, baseDataOffsetAt + 4, (uint32_t)base);
+    }
+    std::vector<uint32_t> firstSamples(truns.size());
+    uint32_t firstSample = (uint32_t)expected.size();
+    for (size_t i = 0; i < truns.size(); i++) {
+        firstSamples[i] = firstSample;
+        firstSample += truns[i].numSamples();
+    }
+    for (size_t k = 0; k < dataOrder.size(); k++) {
+        Trun& trun = truns[dataOrder[k]];
+        trun.dataStart = bytes.size();
+        if (trun.flags & trunDataOffset) {
+            patch32(bytes, trun.dataOffsetAt, (uint32_t)(trun.dataStart - base));
+        }
+        writeTrunData(bytes, trun, firstSamples[dataOrder[k]]);
+    }
+    endBox(bytes, mdat);
+
+    for (size_t i = 0; i < truns.size(); i++) {
+        expectTrun(truns[i], defaultDuration, defaultFlags);
+    }
+}
+
+static bool appendFragments(const char* fileName)
+{
+    std::vector<uint8_t> bytes;
+    if (!readFile(fileName, bytes) || !addMovieExtends(bytes)) {
+        return false;
+    }
+
+    // default-base-is-moof, the data of the second trun ahead of that of
+    // the first; the first carries every column, the second leans on the
+    // tfhd defaults but for the flags of its first sample
+    {
+        std::vector<Trun> truns(2);
+        truns[0].flags = trunDataOffset | trunDuration | trunSize | trunFlags | trunRenderingOffset;
+        uint32_t durations[4] = { 3000, 3000, 1500, 4500 };
+        uint32_t sizes[4] = { 200, 210, 220, 230 };
+        uint32_t flags[4] = { syncFlags, nonSyncFlags, nonSyncFlags & ~0x00400000, nonSyncFlags };
+        uint32_t renderingOffsets[4] = { 3000, 0, 6000, 0 };
+        truns[0].durations.assign(durations, durations + 4);
+        truns[0].sizes.assign(sizes, sizes + 4);
+        truns[0].sampleFlags.assign(flags, flags + 4);
+        truns[0].renderingOffsets.assign(renderingOffsets, renderingOffsets + 4);
+
+        truns[1].flags = trunDataOffset | trunFirstSampleFlags | trunSize;
+        truns[1].firstSampleFlags = syncFlags;
+        uint32_t sizes1[3] = { 300, 310, 320 };
+        truns[1].sizes.assign(sizes1, sizes1 + 3);
+
+        std::vector<size_t> dataOrder;
+        dataOrder.push_back(1);
+        dataOrder.push_back(0);
+        appendFragment(bytes, 0x020000 | 0x08 | 0x20, truns, dataOrder, false, 3003, nonSyncFlags);
+    }
+
+    // an explicit base data offset and a tfdt; the second trun has no
+    // data offset and follows on from the first, the trex defaults apply
+    {
+        std::vector<Trun> truns(2);
+        truns[0].flags = trunDataOffset | trunSize | trunFlags;
+        uint32_t sizes[5] = { 400, 401, 402, 403, 404 };
+        uint32_t flags[5] = { nonSyncFlags, nonSyncFlags, syncFlags, nonSyncFlags, nonSyncFlags };
+        truns[0].sizes.assign(sizes, sizes + 5);
+        truns[0].sampleFlags.assign(flags, flags + 5);
+
+        truns[1].flags = trunSize;
+        uint32_t sizes1[2] = { 500, 510 };
+        truns[1].sizes.assign(sizes1, sizes1 + 2);
+
+        std::vector<size_t> dataOrder;
+        dataOrder.push_back(0);
+        dataOrder.push_back(1);
+        appendFragment(bytes, 0x01, truns, dataOrder, true, trexDuration, trexFlags);
+    }
+
+    // neither, so the first traf counts from the moof
+    {
+        std::vector<Trun> truns(1);
+        truns[0].flags = trunDataOffset | trunFirstSampleFlags | trunSize;
+        truns[0].firstSampleFlags = syncFlags;
+        uint32_t sizes[4] = { 600, 610, 620, 630 };
+        truns[0].sizes.assign(sizes, sizes + 4);
+
+        std::vector<size_t> dataOrder(1, 0);
+        appendFragment(bytes, 0, truns, dataOrder, true, trexDuration, trexFlags);
+    }
+
+    FILE* file = fopen(fileName, "wb");
+    if (!file) {
+        return false;
+    }
+    bool written = fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+    fclose(file);
+    return written;
+}
+
+static void checkRecord(const MP4SampleRecord& record, MP4SampleId sampleId, const char* what)
+{
+    const Expected& sample = expected[sampleId - 1];
+    CHECK(record.sampleId == sampleId, "%s: sample %u, expected %u", what, record.sampleId, sampleId);
+    CHECK(record.offset == sample.offset && record.numBytes == sample.size,
+          "%s: sample %u at %llu of %u bytes, expected %llu of %u", what, sampleId,
+          (unsigned long long)record.offset, record.numBytes, (unsigned long long)sample.offset, sample.size);
+    CHECK(record.startTime == sample.startTime && record.duration == sample.duration &&
+          record.renderingOffset == sample.renderingOffset &&
+          record.presentationTime == sample.startTime + sample.renderingOffset,
+          "%s: sample %u at %llu for %llu", what, sampleId, (unsigned long long)record.startTime,
+          (unsigned long long)record.duration);
+    CHECK(record.isSyncSample == sample.isSyncSample && record.dependencyFlags == sample.dependencyFlags,
+          "%s: sample %u sync %d flags 0x%02x, expected %d 0x%02x", what, sampleId, record.isSyncSample,
+          record.dependencyFlags, sample.isSyncSample, sample.dependencyFlags);
+    CHECK(record.sampleDescriptionIndex == 1, "%s: sample %u description %u", what, sampleId,
+          record.sampleDescriptionIndex);
+}
+
+static void checkIterator(MP4FileHandle hFile)
+{
+    const uint32_t numSamples = (uint32_t)expected.size();
+    MP4SampleIterator* iterator = MP4SampleIteratorCreate(hFile, 1);
+    CHECK(iterator != NULL, "no iterator");
+    if (!iterator) {
+        return;
+    }
+
+    // the whole track in order, the sample tables and then the fragments
+    MP4SampleRecord record;
+    MP4SampleId sampleId = 1;
+    while (MP4SampleIteratorNext(iterator, &record)) {
+        if (sampleId > numSamples) {
+            CHECK(false, "sample %u past the end", record.sampleId);
+            break;
+        }
+        checkRecord(record, sampleId++, "walk");
+    }
+    CHECK(sampleId == numSamples + 1, "walk ended at sample %u of %u", sampleId, numSamples);
+
+    // from every sample to the end, last first so that the fragment
+    // index is looked up backwards, then forwards
+    for (MP4SampleId from = numSamples; from >= 1; from--) {
+        CHECK(MP4SampleIteratorSeek(iterator, from), "cannot seek to sample %u", from);
+        for (sampleId = from; MP4SampleIteratorNext(iterator, &record); sampleId++) {
+            checkRecord(record, sampleId, "seek");
+        }
+        CHECK(sampleId == numSamples + 1, "from sample %u the walk ended at %u", from, sampleId);
+    }
+
+    // into the middle of truns and straight across a moof
+    static const MP4SampleId seeks[] = { 12, 16, numMoovSamples, 21, 5, 19, 25 };
+    for (size_t k = 0; k < sizeof(seeks) / sizeof(seeks[0]); k++) {
+        CHECK(MP4SampleIteratorSeek(iterator, seeks[k]), "cannot seek to sample %u", seeks[k]);
+        for (sampleId = seeks[k]; sampleId < seeks[k] + 3 && sampleId <= numSamples; sampleId++) {
+            CHECK(MP4SampleIteratorNext(iterator, &record), "nothing after seeking to %u", seeks[k]);
+            checkRecord(record, sampleId, "short seek");
+        }
+    }
+
+    CHECK(!MP4SampleIteratorSeek(iterator, numSamples + 1) && !MP4SampleIteratorNext(iterator, &record),
+          "seek past the end");
+    MP4SampleIteratorDestroy(iterator);
+}
+
+static void checkReads(MP4FileHandle hFile)
+{
+    const uint32_t numSamples = (uint32_t)expected.size();
+
+    // backwards, then forwards
+    for (uint32_t n = 0; n < 2 * numSamples; n++) {
+        MP4SampleId sampleId = n < numSamples ? numSamples - n : n - numSamples + 1;
+        const Expected& sample = expected[sampleId - 1];
+
+        MP4SampleView view;
+        if (!MP4ReadSampleView(hFile, 1, sampleId, &view)) {
+            CHECK(false, "cannot read sample %u", sampleId);
+            continue;
+        }
+        std::vector<uint8_t> data(sample.size);
+        fillSample(&data[0], sample.size, sampleId - 1);
+        CHECK(view.numBytes == sample.size && memcmp(view.bytes, &data[0], sample.size) == 0,
+              "sample %u data", sampleId);
+        CHECK(view.startTime == sample.startTime && view.duration == sample.duration &&
+              view.renderingOffset == sample.renderingOffset && view.isSyncSample == sample.isSyncSample,
+              "sample %u read at %llu for %llu", sampleId, (unsigned long long)view.startTime,
+              (unsigned long long)view.duration);
+        CHECK(view.hasDependencyFlags && view.dependencyFlags == sample.dependencyFlags,
+              "sample %u read with flags 0x%02x", sampleId, view.dependencyFlags);
+        MP4ReleaseSampleView(hFile, &view);
+
+        CHECK(MP4GetSampleIdFromTime(hFile, 1, sample.startTime + sample.duration - 1) == sampleId,
+              "time %llu: sample %u", (unsigned long long)(sample.startTime + sample.duration - 1),
+              MP4GetSampleIdFromTime(hFile, 1, sample.startTime + sample.duration - 1));
+
+        MP4SampleId prevSync = MP4_INVALID_SAMPLE_ID, nextSync = MP4_INVALID_SAMPLE_ID;
+        for (MP4SampleId id = sampleId; id >= 1 && prevSync == MP4_INVALID_SAMPLE_ID; id--) {
+            prevSync = expected[id - 1].isSyncSample ? id : MP4_INVALID_SAMPLE_ID;
+        }
+        for (MP4SampleId id = sampleId; id <= numSamples && nextSync == MP4_INVALID_SAMPLE_ID; id++) {
+            nextSync = expected[id - 1].isSyncSample ? id : MP4_INVALID_SAMPLE_ID;
+        }
+        CHECK(MP4GetPrevSyncSample(hFile, 1, sampleId) == prevSync &&
+              MP4GetNextSyncSample(hFile, 1, sampleId) == nextSync, "sync samples around %u: %u and %u",
+              sampleId, MP4GetPrevSyncSample(hFile, 1, sampleId), MP4GetNextSyncSample(hFile, 1, sampleId));
+    }
+}
+
+int main()
+{
+    const char* fileName = "fragmentread.mp4";
+    if (!createFile(fileName) || !appendFragments(fileName)) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+
+    MP4FileHandle hFile = MP4Read(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        printf("FAIL cannot read %s\n", fileName);
+        return 1;
+    }
+
+    // the offsets of the samples in the moov were left to the library
+    uint32_t numSamples = MP4GetTrackNumberOfSamples(hFile, 1);
+    CHECK(numSamples == expected.size(), "%u samples, expected %u", numSamples, (unsigned)expected.size());
+    MP4SampleIterator* iterator = MP4SampleIteratorCreate(hFile, 1);
+    MP4SampleRecord record;
+    for (uint32_t i = 0; i < numMoovSamples && iterator && MP4SampleIteratorNext(iterator, &record); i++) {
+        expected[i].offset = record.offset;
+        CHECK(i == 0 || record.offset >= expected[i - 1].offset + expected[i - 1].size,
+              "sample %u overlaps the one before", i + 1);
+    }
+    MP4SampleIteratorDestroy(iterator);
+
+    if (numSamples == expected.size()) {
+        checkIterator(hFile);
+        checkReads(hFile);
+    }
+    MP4Close(hFile);
+    remove(fileName);
+
+    printf("%u samples, %u fragments, %d failures\n", numSamples, sequenceNumber, failures);
+    return failures ? 1 : 0;
+}
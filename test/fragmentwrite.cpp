@@ -0,0 +1,165 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// fragmentwrite writes a file with MP4_CREATE_FRAGMENTED, reads it back,
+// then cuts it short in the middle of its last fragment and checks that
+// only the samples of that fragment are lost
+
+#include "testutil.h"
+
+static const uint32_t numVideoSamples = 170;   // fragments of 60, 60 and 50
+static const uint32_t syncInterval    = 30;
+
+static uint32_t videoSampleSize(uint32_t i)
+{
+    return 100 + (i * 37) % 3000;
+}
+
+// checks the first numVideo and numAudio samples of the file, which must
+// have exactly those
+static void checkSamples(const char* fileName, MP4TrackId videoTrack, uint32_t numVideo,
+                         MP4TrackId audioTrack, uint32_t numAudio)
+{
+    MP4FileHandle hFile = MP4Read(fileName);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot read %s", fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return;
+    }
+
+    CHECK(MP4GetTrackNumberOfSamples(hFile, videoTrack) == numVideo, "%s: %u video samples, expected %u",
+          fileName, MP4GetTrackNumberOfSamples(hFile, videoTrack), numVideo);
+    CHECK(MP4GetTrackNumberOfSamples(hFile, audioTrack) == numAudio, "%s: %u audio samples, expected %u",
+          fileName, MP4GetTrackNumberOfSamples(hFile, audioTrack), numAudio);
+
+    uint8_t buf[4096];
+    for (uint32_t i = 0; i < numVideo; i++) {
+        uint8_t* pBytes = NULL;
+        uint32_t numBytes = 0;
+        MP4Timestamp startTime = 0;
+        MP4Duration duration = 0;
+        bool isSyncSample = false;
+        if (!MP4ReadSample(hFile, videoTrack, i + 1, &pBytes, &numBytes,
+                           &startTime, &duration, NULL, &isSyncSample)) {
+            CHECK(false, "%s: cannot read video sample %u", fileName, i + 1);
+            continue;
+        }
+        fillSample(buf, videoSampleSize(i), i);
+        CHECK(numBytes == videoSampleSize(i) && memcmp(pBytes, buf, numBytes) == 0,
+              "%s: video sample %u bytes", fileName, i + 1);
+        CHECK(startTime == (MP4Timestamp)i * 3000 && duration == 3000,
+              "%s: video sample %u time %llu", fileName, i + 1, (unsigned long long)startTime);
+        CHECK(isSyncSample == (i % syncInterval == 0), "%s: video sample %u sync", fileName, i + 1);
+        MP4Free(pBytes);
+    }
+    for (uint32_t i = 0; i < numAudio; i++) {
+        uint8_t* pBytes = NULL;
+        uint32_t numBytes = 0;
+        MP4Timestamp startTime = 0;
+        if (!MP4ReadSample(hFile, audioTrack, i + 1, &pBytes, &numBytes, &startTime)) {
+            CHECK(false, "%s: cannot read audio sample %u", fileName, i + 1);
+            continue;
+        }
+        fillSample(buf, 20, 1000000 + i);
+        CHECK(numBytes == 20 && memcmp(pBytes, buf, numBytes) == 0, "%s: audio sample %u bytes", fileName, i + 1);
+        CHECK(startTime == (MP4Timestamp)i * 1024, "%s: audio sample %u time", fileName, i + 1);
+        MP4Free(pBytes);
+    }
+
+    MP4Close(hFile);
+}
+
+int main()
+{
+    const char* fileName = "fragmentwrite.mp4";
+    const char* cutFileName = "fragmentwrite-cut.mp4";
+
+    MP4FileHandle hFile = MP4CreateEx(fileName, MP4_CREATE_FRAGMENTED);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId videoTrack = MP4AddVideoTrack(hFile, 90000, 3000, 320, 240, MP4_MPEG4_VIDEO_TYPE);
+    MP4TrackId audioTrack = MP4AddTrack(hFile, MP4_AUDIO_TRACK_TYPE, 48000);
+    MP4SetFragmentDuration(hFile, 2000);
+
+    // fragments start at every other sync sample; what was written before
+    // the last one starts is what a cut in the last fragment leaves
+    uint8_t buf[4096];
+    uint32_t numAudioSamples = 0;
+    uint32_t lastFragmentVideo = 0;
+    uint32_t lastFragmentAudio = 0;
+    for (uint32_t i = 0; i < numVideoSamples; i++) {
+        if (i % (2 * syncInterval) == 0) {
+            lastFragmentVideo = i;
+            lastFragmentAudio = numAudioSamples;
+        }
+        fillSample(buf, videoSampleSize(i), i);
+        MP4WriteSample(hFile, videoTrack, buf, videoSampleSize(i), 3000, 0, i % syncInterval == 0);
+
+        // audio up to the end of the video sample
+        while ((uint64_t)numAudioSamples * 1024 * 90000 < (uint64_t)(i + 1) * 3000 * 48000) {
+            fillSample(buf, 20, 1000000 + numAudioSamples);
+            MP4WriteSample(hFile, audioTrack, buf, 20, 1024, 0, true);
+            numAudioSamples++;
+        }
+    }
+    MP4Close(hFile);
+
+    checkSamples(fileName, videoTrack, numVideoSamples, audioTrack, numAudioSamples);
+
+    std::vector<uint8_t> fileBytes;
+    if (!readFile(fileName, fileBytes)) {
+        printf("FAIL cannot reopen %s\n", fileName);
+        return 1;
+    }
+
+    // the last moof and the mdat after it
+    uint32_t numFragments = 0;
+    uint64_t lastMoof = 0;
+    for (uint64_t offset = 0; offset + 8 <= fileBytes.size(); ) {
+        uint32_t size = readUInt32(&fileBytes[offset]);
+        if (size < 8) {
+            break;
+        }
+        if (memcmp(&fileBytes[offset + 4], "moof", 4) == 0) {
+            lastMoof = offset;
+            numFragments++;
+        }
+        offset += size;
+    }
+    CHECK(numFragments == 3, "%u fragments", numFragments);
+
+    uint64_t mdat = lastMoof + readUInt32(&fileBytes[lastMoof]);
+    CHECK(mdat + 8 <= fileBytes.size() && memcmp(&fileBytes[mdat + 4], "mdat", 4) == 0, "no mdat after the last moof");
+    uint64_t cut = mdat + readUInt32(&fileBytes[mdat]) / 2;
+
+    FILE* file = fopen(cutFileName, "wb");
+    if (!file || fwrite(&fileBytes[0], 1, (size_t)cut, file) != cut) {
+        printf("FAIL cannot write %s\n", cutFileName);
+        return 1;
+    }
+    fclose(file);
+
+    checkSamples(cutFileName, videoTrack, lastFragmentVideo, audioTrack, lastFragmentAudio);
+
+    remove(fileName);
+    remove(cutFileName);
+
+    printf("%u fragments, cut at %llu of %llu bytes, %d failures\n", numFragments,
+           (unsigned long long)cut, (unsigned long long)fileBytes.size(), failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// lazyfragments writes a fragmented file of more fragments than its sidx
+// has references and its tfra entries, checks both indexes against the
+// moofs, then opens it with MP4_READ_LAZY and checks that a seek with
+// MP4ReadSampleFromTime() reads only the moofs of the sidx reference the
+// sample is in
+
+#include "testutil.h"
+
+static const uint32_t numFragments       = 1100;
+static const uint32_t samplesPerFragment = 3;
+static const uint32_t sampleDuration     = 3000;    // of 90000
+static const uint32_t fragmentDuration   = samplesPerFragment * sampleDuration;
+
+// what the sidx and the tfra are thinned to for numFragments, see
+// MP4CreateEx()
+static const uint32_t fragmentsPerReference = 4;
+static const uint32_t fragmentsPerPoint     = 2;
+
+static uint32_t sampleSize(uint32_t i)
+{
+    return 200 + (i * 37) % 800;
+}
+
+struct Read
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+static void traceCallback(void* userData, MP4IOOp op, int64_t offset, int64_t size, uint64_t)
+{
+    if (op == MP4_IO_OP_READ && size > 0) {
+        Read read = { (uint64_t)offset, (uint64_t)size };
+        ((std::vector<Read>*)userData)->push_back(read);
+    }
+}
+
+// the offset of the first root atom of type at or after offset, or the
+// size of the file
+static uint64_t findAtom(const std::vector<uint8_t>& bytes, uint64_t offset, const char* type)
+{
+    while (offset + 8 <= bytes.size()) {
+        uint32_t size = readUInt32(&bytes[offset]);
+        if (memcmp(&bytes[offset + 4], type, 4) == 0) {
+            return offset;
+        }
+        if (size < 8) {
+            break;
+        }
+        offset += size;
+    }
+    return bytes.size();
+}
+
+static void checkSegmentIndex(const std::vector<uint8_t>& bytes, const std::vector<uint64_t>& moofs)
+{
+    uint64_t sidx = findAtom(bytes, 0, "sidx");
+    CHECK(sidx + 44 <= bytes.size() && bytes[sidx + 8] == 1, "no version 1 sidx");
+    if (sidx + 44 > bytes.size()) {
+        return;
+    }
+
+    const uint8_t* p = &bytes[sidx + 12];
+    CHECK(readUInt32(p) == 1 && readUInt32(p + 4) == 90000, "sidx of track %u, timescale %u",
+          readUInt32(p), readUInt32(p + 4));
+    CHECK(readUInt64(p + 8) == 0, "sidx earliest presentation time");
+    uint64_t firstOffset = readUInt64(p + 16);
+    uint32_t numReferences = ((uint32_t)p[26] << 8) | p[27];
+    const uint32_t expected = (numFragments + fragmentsPerReference - 1) / fragmentsPerReference;
+    CHECK(numReferences == expected, "%u sidx references, expected %u", numReferences, expected);
+    if (numReferences != expected || sidx + 40 + 12 * (uint64_t)numReferences > bytes.size()) {
+        return;
+    }
+
+    uint64_t sidxEnd = sidx + readUInt32(&bytes[sidx]);
+    CHECK(sidxEnd + firstOffset == moofs[0], "first reference at %llu, first moof at %llu",
+          (unsigned long long)(sidxEnd + firstOffset), (unsigned long long)moofs[0]);
+
+    for (uint32_t i = 0; i < numReferences; i++) {
+        const uint8_t* reference = p + 28 + 12 * i;
+        uint32_t first = i * fragmentsPerReference;
+        uint32_t next = first + fragmentsPerReference < numFragments ? first + fragmentsPerReference
+                                                                      : numFragments;
+        uint64_t end = next < numFragments ? moofs[next] : findAtom(bytes, moofs[first], "mfra");
+
+        uint32_t size = readUInt32(reference) & 0x7FFFFFFF;
+        CHECK((readUInt32(reference) & 0x80000000) == 0 && size == end - moofs[first],
+              "sidx reference %u size %u, expected %llu", i, size, (unsigned long long)(end - moofs[first]));
+        CHECK(readUInt32(reference + 4) == (next - first) * fragmentDuration,
+              "sidx reference %u duration %u", i, readUInt32(reference + 4));
+        CHECK((readUInt32(reference + 8) >> 31) == 1, "sidx reference %u does not start with a SAP", i);
+    }
+}
+
+static void checkRandomAccessIndex(const std::vector<uint8_t>& bytes, const std::vector<uint64_t>& moofs)
+{
+    // the mfro at the end holds the size of the mfra
+    CHECK(bytes.size() > 16 && memcmp(&bytes[bytes.size() - 12], "mfro", 4) == 0, "no mfro");
+    uint64_t mfra = bytes.size() - readUInt32(&bytes[bytes.size() - 4]);
+    CHECK(mfra + 32 <= bytes.size() && memcmp(&bytes[mfra + 4], "mfra", 4) == 0 &&
+          memcmp(&bytes[mfra + 12], "tfra", 4) == 0, "no tfra in the mfra");
+    if (mfra + 32 > bytes.size()) {
+        return;
+    }
+
+    const uint8_t* tfra = &bytes[mfra + 8];
+    CHECK(tfra[8] == 1 && readUInt32(tfra + 12) == 1, "tfra version %u of track %u", tfra[8], readUInt32(tfra + 12));
+    uint32_t lengthSizes = readUInt32(tfra + 16);
+    uint32_t numEntries = readUInt32(tfra + 20);
+    uint32_t entrySize = 16 + ((lengthSizes >> 4) & 3) + ((lengthSizes >> 2) & 3) + (lengthSizes & 3) + 3;
+    const uint32_t expected = (numFragments + fragmentsPerPoint - 1) / fragmentsPerPoint;
+    CHECK(numEntries == expected, "%u tfra entries, expected %u", numEntries, expected);
+    if (numEntries != expected || 24 + (uint64_t)entrySize * numEntries > readUInt32(tfra)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < numEntries; i++) {
+        const uint8_t* entry = tfra + 24 + entrySize * i;
+        uint32_t fragment = i * fragmentsPerPoint;
+        CHECK(readUInt64(entry) == (uint64_t)fragment * fragmentDuration,
+              "tfra entry %u time %llu", i, (unsigned long long)readUInt64(entry));
+        CHECK(readUInt64(entry + 8) == moofs[fragment], "tfra entry %u moof at %llu, expected %llu",
+              i, (unsigned long long)readUInt64(entry + 8), (unsigned long long)moofs[fragment]);
+    }
+}
+
+// seeks to the middle of sample in a file of its own, as moofs once read
+// are kept
+static void checkSeek(const char* fileName, uint32_t sample, const std::vector<uint64_t>& moofs,
+                      uint64_t fragmentsEnd)
+{
+    std::vector<Read> reads;
+    MP4FileHandle hFile = MP4ReadEx(fileName, MP4_READ_LAZY);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE, "cannot read %s", fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return;
+    }
+    MP4SetIOTraceCallback(traceCallback, &reads, hFile);
+
+    MP4Timestamp when = (MP4Timestamp)sample * sampleDuration + sampleDuration / 2;
+    uint8_t* pBytes = NULL;
+    uint32_t numBytes = 0;
+    MP4Timestamp startTime = 0;
+    bool isSyncSample = false;
+    if (!MP4ReadSampleFromTime(hFile, 1, when, &pBytes, &numBytes, &startTime, NULL, NULL, &isSyncSample)) {
+        CHECK(false, "cannot read the sample at %llu", (unsigned long long)when);
+    }
+    else {
+        uint8_t buf[1024];
+        fillSample(buf, sampleSize(sample), sample);
+        CHECK(numBytes == sampleSize(sample) && memcmp(pBytes, buf, numBytes) == 0, "sample %u bytes", sample);
+        CHECK(startTime == (MP4Timestamp)sample * sampleDuration, "sample %u time %llu",
+              sample, (unsigned long long)startTime);
+        CHECK(isSyncSample == (sample % samplesPerFragment == 0), "sample %u sync", sample);
+    }
+    MP4Free(pBytes);
+    MP4Close(hFile);
+
+    // past deferred atoms of the moov, from the moof the sidx reference
+    // starts with to the end of the fragment of the sample
+    uint32_t fragment = sample / samplesPerFragment;
+    uint64_t start = moofs[fragment - fragment % fragmentsPerReference];
+    uint64_t end = fragment + 1 < numFragments ? moofs[fragment + 1] : fragmentsEnd;
+    uint64_t numRead = 0;
+    for (size_t i = 0; i < reads.size(); i++) {
+        if (reads[i].offset + reads[i].size <= moofs[0]) {
+            continue;
+        }
+        CHECK(reads[i].offset >= start && reads[i].offset + reads[i].size <= end,
+              "sample %u: read of %llu at %llu, outside %llu to %llu", sample,
+              (unsigned long long)reads[i].size, (unsigned long long)reads[i].offset,
+              (unsigned long long)start, (unsigned long long)end);
+        numRead += reads[i].size;
+    }
+    CHECK(!reads.empty() && numRead <= end - start, "sample %u: %llu bytes read", sample, (unsigned long long)numRead);
+}
+
+int main()
+{
+    const char* fileName = "lazyfragments.mp4";
+
+    MP4FileHandle hFile = MP4CreateEx(fileName, MP4_CREATE_FRAGMENTED);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId videoTrack = MP4AddVideoTrack(hFile, 90000, sampleDuration, 320, 240, MP4_MPEG4_VIDEO_TYPE);
+    MP4SetFragmentDuration(hFile, fragmentDuration / 90);
+
+    uint8_t buf[1024];
+    const uint32_t numSamples = numFragments * samplesPerFragment;
+    for (uint32_t i = 0; i < numSamples; i++) {
+        fillSample(buf, sampleSize(i), i);
+        MP4WriteSample(hFile, videoTrack, buf, sampleSize(i), sampleDuration, 0, i % samplesPerFragment == 0);
+    }
+    MP4Close(hFile);
+
+    std::vector<uint8_t> bytes;
+    if (!readFile(fileName, bytes)) {
+        printf("FAIL cannot reopen %s\n", fileName);
+        return 1;
+    }
+
+    std::vector<uint64_t> moofs;
+    for (uint64_t offset = findAtom(bytes, 0, "moof"); offset < bytes.size(); ) {
+        moofs.push_back(offset);
+        offset = findAtom(bytes, offset + readUInt32(&bytes[offset]), "moof");
+    }
+    CHECK(moofs.size() == numFragments, "%u fragments", (unsigned)moofs.size());
+    if (moofs.size() != numFragments) {
+        return 1;
+    }
+    uint64_t fragmentsEnd = findAtom(bytes, moofs.back(), "mfra");
+
+    checkSegmentIndex(bytes, moofs);
+    checkRandomAccessIndex(bytes, moofs);
+
+    // no read-ahead, so that the reads traced are those the seek needs
+    MP4SetReadBufferSize(0);
+
+    // the first sample, one in a reference of fragments folded together
+    // late, one in the last fragment of a reference and the last sample
+    const uint32_t samples[] = { 0, 1550, 3 * 1023 + 2, numSamples - 1 };
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        checkSeek(fileName, samples[i], moofs, fragmentsEnd);
+    }
+
+    // the open itself reads the moov, sidx and mfro but none of the moofs
+    MP4IOStats stats;
+    hFile = MP4ReadEx(fileName, MP4_READ_LAZY);
+    CHECK(hFile != MP4_INVALID_FILE_HANDLE && MP4GetIOStats(hFile, &stats), "cannot read %s", fileName);
+    if (hFile != MP4_INVALID_FILE_HANDLE) {
+        CHECK(stats.providerReadBytes < moofs[0] + 64, "%llu bytes read on open",
+              (unsigned long long)stats.providerReadBytes);
+        CHECK(MP4GetTrackNumberOfSamples(hFile, videoTrack) == numSamples, "%u samples once indexed",
+              MP4GetTrackNumberOfSamples(hFile, videoTrack));
+        MP4Close(hFile);
+    }
+
+    remove(fileName);
+
+    printf("%u fragments, %d failures\n", (unsigned)moofs.size(), failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// samplelookup writes a track whose stts, stsc, ctts, stss and elst all
+// have many entries and checks every indexed lookup of the library, for
+// every sample and in scrambled order, against a walk of the values the
+// track was written with: sample data and offsets, decoding times, sync
+// neighbours, presentation order and times, and edit times, the latter
+// also after an elst entry is changed through its property
+
+#include "testutil.h"
+#include <algorithm>
+
+static const uint32_t numSamples = 600;
+
+// what sample i (from 0) was written with
+struct Sample
+{
+    uint32_t     size;
+    MP4Duration  duration;
+    MP4Duration  renderingOffset;
+    bool         isSyncSample;
+    MP4Timestamp startTime;      // filled in by makeSamples()
+};
+
+// runs of durations, B-frame like rendering offsets within the runs of
+// equal durations, sync samples at irregular intervals and none first
+static std::vector<Sample> makeSamples()
+{
+    std::vector<Sample> samples(numSamples);
+    MP4Timestamp startTime = 0;
+    for (uint32_t i = 0; i < numSamples; i++) {
+        Sample& sample = samples[i];
+        sample.size = 50 + (i * 7919) % 700;
+
+        if (i < 100) {
+            sample.duration = 1000;
+        } else if (i < 250) {
+            sample.duration = 1001;
+        } else if (i < 252) {
+            sample.duration = 500;
+        } else if (i < 400) {
+            sample.duration = 1000 + (i % 3) * 10;
+        } else {
+            sample.duration = 2000;
+        }
+
+        // I P B B in decoding order, shown as I B B P
+        static const MP4Duration gop[4] = { 1, 3, 0, 0 };
+        bool inGop = i < 248 || i >= 400;
+        sample.renderingOffset = inGop ? gop[i % 4] * sample.duration : 0;
+
+        sample.isSyncSample = i % 30 == 5 || i == 47 || i == 48 || i == numSamples - 1;
+        sample.startTime = startTime;
+        startTime += sample.duration;
+    }
+    return samples;
+}
+
+struct Edit
+{
+    MP4Timestamp mediaStart;
+    MP4Duration  duration;
+};
+
+static bool createFile(const char* fileName, const std::vector<Sample>& samples, const std::vector<Edit>& edits)
+{
+    MP4FileHandle hFile = MP4Create(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return false;
+    }
+    MP4SetTimeScale(hFile, 90000);
+    MP4TrackId trackId = MP4AddTrack(hFile, MP4_VIDEO_TRACK_TYPE, 90000);
+
+    // chunks of a few samples, of one, of many and of a few again
+    std::vector<uint8_t> buf(1000);
+    for (uint32_t i = 0; i < numSamples; i++) {
+        if (i % 150 == 0) {
+            static const MP4Duration chunkDurations[4] = { 5000, 1, 20000, 3000 };
+            MP4SetTrackDurationPerChunk(hFile, trackId, chunkDurations[i / 150]);
+        }
+        const Sample& sample = samples[i];
+        fillSample(&buf[0], sample.size, i);
+        MP4WriteSample(hFile, trackId, &buf[0], sample.size, sample.duration,
+                       sample.renderingOffset, sample.isSyncSample);
+    }
+    for (size_t i = 0; i < edits.size(); i++) {
+        MP4AddTrackEdit(hFile, trackId, MP4_INVALID_EDIT_ID, edits[i].mediaStart, edits[i].duration);
+    }
+    MP4Close(hFile);
+    return true;
+}
+
+// the walks the indexes replace
+
+static MP4SampleId walkSampleFromTime(const std::vector<Sample>& samples, MP4Timestamp when)
+{
+    for (uint32_t i = 0; i < numSamples; i++) {
+        if (when < samples[i].startTime + samples[i].duration) {
+            return i + 1;
+        }
+    }
+    return MP4_INVALID_SAMPLE_ID;
+}
+
+static MP4SampleId walkNextSync(const std::vector<Sample>& samples, MP4SampleId sampleId)
+{
+    for (MP4SampleId id = sampleId; id >= 1 && id <= numSamples; id++) {
+        if (samples[id - 1].isSyncSample) {
+            return id;
+        }
+    }
+    return MP4_INVALID_SAMPLE_ID;
+}
+
+static MP4SampleId walkPrevSync(const std::vector<Sample>& samples, MP4SampleId sampleId)
+{
+    for (MP4SampleId id = std::min(sampleId, numSamples); id >= 1; id--) {
+        if (samples[id - 1].isSyncSample) {
+            return id;
+        }
+    }
+    return MP4_INVALID_SAMPLE_ID;
+}
+
+// stable, so ties stay in decoding order
+static std::vector<MP4SampleId> walkPresentationOrder(const std::vector<Sample>& samples)
+{
+    std::vector<MP4SampleId> order;
+    for (uint32_t i = 0; i < numSamples; i++) {
+        MP4Timestamp cts = samples[i].startTime + samples[i].renderingOffset;
+        size_t at = order.size();
+        while (at > 0 && samples[order[at - 1] - 1].startTime + samples[order[at - 1] - 1].renderingOffset > cts) {
+            at--;
+        }
+        order.insert(order.begin() + at, i + 1);
+    }
+    return order;
+}
+
+// the last sample in presentation order that starts at or before when
+static MP4SampleId walkSampleFromPresentationTime(const std::vector<Sample>& samples,
+                                                  const std::vector<MP4SampleId>& order, MP4Timestamp when)
+{
+    MP4SampleId found = MP4_INVALID_SAMPLE_ID;
+    for (size_t k = 0; k < order.size(); k++) {
+        const Sample& sample = samples[order[k] - 1];
+        if (sample.startTime + sample.renderingOffset > when) {
+            break;
+        }
+        found = order[k];
+    }
+    if (found == order.back()) {
+        const Sample& last = samples[found - 1];
+        if (when >= last.startTime + last.renderingOffset + last.duration) {
+            return MP4_INVALID_SAMPLE_ID;
+        }
+    }
+    return found;
+}
+
+static MP4SampleId walkSampleFromEditTime(const std::vector<Sample>& samples, const std::vector<Edit>& edits,
+                                          MP4Timestamp when, MP4Timestamp* pStartTime)
+{
+    MP4Timestamp editStart = 0;
+    for (size_t i = 0; i < edits.size(); i++) {
+        if (when < editStart + edits[i].duration) {
+            MP4Duration editOffset = when - editStart;
+            MP4Timestamp mediaWhen = edits[i].mediaStart + editOffset;
+            MP4SampleId sampleId = walkSampleFromTime(samples, mediaWhen);
+            if (sampleId != MP4_INVALID_SAMPLE_ID) {
+                // the sample starts in the edit timeline where it would
+                // naturally start, but not before the edit does
+                *pStartTime = when - std::min(editOffset, mediaWhen - samples[sampleId - 1].startTime);
+            }
+            return sampleId;
+        }
+        editStart += edits[i].duration;
+    }
+    return MP4_INVALID_SAMPLE_ID;
+}
+
+static uint64_t trackProperty(MP4FileHandle hFile, const char* name)
+{
+    uint64_t value = 0;
+    MP4GetTrackIntegerProperty(hFile, 1, name, &value);
+    return value;
+}
+
+static void checkSamples(MP4FileHandle hFile, const std::vector<Sample>& samples, uint32_t offsetIndexInterval)
+{
+    CHECK(MP4SetTrackSampleOffsetIndex(hFile, 1, offsetIndexInterval), "offset index interval %u", offsetIndexInterval);
+
+    // 263 is prime to 600, so this visits every sample out of order
+    for (uint32_t n = 0; n < numSamples; n++) {
+        uint32_t i = (n * 263) % numSamples;
+        MP4SampleId sampleId = i + 1;
+        const Sample& sample = samples[i];
+
+        uint8_t* pBytes = NULL;
+        uint32_t numBytes = 0;
+        MP4Timestamp startTime = 0;
+        MP4Duration duration = 0, renderingOffset = 0;
+        bool isSyncSample = false;
+        if (!MP4ReadSample(hFile, 1, sampleId, &pBytes, &numBytes, &startTime, &duration,
+                           &renderingOffset, &isSyncSample)) {
+            CHECK(false, "interval %u: cannot read sample %u", offsetIndexInterval, sampleId);
+            continue;
+        }
+        std::vector<uint8_t> expected(sample.size);
+        fillSample(&expected[0], sample.size, i);
+        CHECK(numBytes == sample.size && memcmp(pBytes, &expected[0], numBytes) == 0,
+              "interval %u: sample %u data", offsetIndexInterval, sampleId);
+        MP4Free(pBytes);
+
+        CHECK(startTime == sample.startTime && duration == sample.duration &&
+              renderingOffset == sample.renderingOffset && isSyncSample == sample.isSyncSample,
+              "sample %u read at %llu for %llu", sampleId, (unsigned long long)startTime,
+              (unsigned long long)duration);
+        CHECK(MP4GetSampleSize(hFile, 1, sampleId) == sample.size, "sample %u size", sampleId);
+        CHECK(MP4GetSampleTime(hFile, 1, sampleId) == sample.startTime &&
+              MP4GetSampleDuration(hFile, 1, sampleId) == sample.duration &&
+              MP4GetSampleRenderingOffset(hFile, 1, sampleId) == sample.renderingOffset &&
+              MP4GetSampleSync(hFile, 1, sampleId) == (sample.isSyncSample ? 1 : 0),
+              "sample %u times", sampleId);
+    }
+}
+
+static void checkTimes(MP4FileHandle hFile, const std::vector<Sample>& samples)
+{
+    const Sample& last = samples.back();
+    MP4Timestamp endTime = last.startTime + last.duration;
+    for (uint32_t n = 0; n < numSamples; n++) {
+        uint32_t i = (n * 263) % numSamples;
+        const Sample& sample = samples[i];
+        MP4Timestamp times[3] = { sample.startTime, sample.startTime + sample.duration / 2,
+                                  sample.startTime + sample.duration - 1 };
+        for (int k = 0; k < 3; k++) {
+            CHECK(MP4GetSampleIdFromTime(hFile, 1, times[k]) == i + 1, "time %llu: sample %u, expected %u",
+                  (unsigned long long)times[k], MP4GetSampleIdFromTime(hFile, 1, times[k]), i + 1);
+            CHECK(MP4GetSampleIdFromTime(hFile, 1, times[k], true) == walkNextSync(samples, i + 1),
+                  "time %llu: sync sample %u", (unsigned long long)times[k],
+                  MP4GetSampleIdFromTime(hFile, 1, times[k], true));
+        }
+    }
+    CHECK(MP4GetSampleIdFromTime(hFile, 1, endTime + 1) == MP4_INVALID_SAMPLE_ID, "time past the end");
+}
+
+static void checkSyncSamples(MP4FileHandle hFile, const std::vector<Sample>& samples)
+{
+    for (MP4SampleId sampleId = 1; sampleId <= numSamples + 1; sampleId++) {
+        MP4SampleId next = sampleId <= numSamples ? walkNextSync(samples, sampleId) : MP4_INVALID_SAMPLE_ID;
+        CHECK(MP4GetNextSyncSample(hFile, 1, sampleId) == next, "next sync of %u: %u, expected %u",
+              sampleId, MP4GetNextSyncSample(hFile, 1, sampleId), next);
+        CHECK(MP4GetPrevSyncSample(hFile, 1, sampleId) == walkPrevSync(samples, sampleId),
+              "previous sync of %u: %u, expected %u", sampleId, MP4GetPrevSyncSample(hFile, 1, sampleId),
+              walkPrevSync(samples, sampleId));
+    }
+
+    std::vector<MP4SampleId> expected;
+    for (uint32_t i = 0; i < numSamples; i++) {
+        if (samples[i].isSyncSample) {
+            expected.push_back(i + 1);
+        }
+    }
+    uint32_t numSyncSamples = MP4GetSyncSampleList(hFile, 1, NULL, 0);
+    std::vector<MP4SampleId> syncSamples(numSyncSamples + 1, MP4_INVALID_SAMPLE_ID);
+    CHECK(numSyncSamples == expected.size() &&
+          MP4GetSyncSampleList(hFile, 1, &syncSamples[0], numSyncSamples) == numSyncSamples,
+          "%u sync samples, expected %u", numSyncSamples, (unsigned)expected.size());
+    syncSamples.resize(numSyncSamples);
+    CHECK(syncSamples == expected, "sync sample list");
+
+    // a short array gets the first ones and the count of all
+    MP4SampleId firstTwo[2] = { 0, 0 };
+    CHECK(MP4GetSyncSampleList(hFile, 1, firstTwo, 2) == expected.size() &&
+          firstTwo[0] == expected[0] && firstTwo[1] == expected[1], "short sync sample list");
+}
+
+static void checkPresentation(MP4FileHandle hFile, const std::vector<Sample>& samples)
+{
+    std::vector<MP4SampleId> expected = walkPresentationOrder(samples);
+    std::vector<MP4SampleId> order(numSamples);
+    CHECK(MP4GetPresentationOrder(hFile, 1, NULL, 0) == numSamples &&
+          MP4GetPresentationOrder(hFile, 1, &order[0], numSamples) == numSamples && order == expected,
+          "presentation order");
+
+    for (uint32_t n = 0; n < numSamples; n++) {
+        uint32_t i = (n * 263) % numSamples;
+        MP4Timestamp cts = samples[i].startTime + samples[i].renderingOffset;
+        MP4Timestamp times[2] = { cts, cts + samples[i].duration / 2 };
+        for (int k = 0; k < 2; k++) {
+            MP4SampleId want = walkSampleFromPresentationTime(samples, expected, times[k]);
+            CHECK(MP4GetSampleIdFromPresentationTime(hFile, 1, times[k]) == want,
+                  "presentation time %llu: sample %u, expected %u", (unsigned long long)times[k],
+                  MP4GetSampleIdFromPresentationTime(hFile, 1, times[k]), want);
+        }
+    }
+
+    // the first sample is shown from its rendering offset on
+    CHECK(MP4GetSampleIdFromPresentationTime(hFile, 1, samples[0].renderingOffset - 1) == MP4_INVALID_SAMPLE_ID,
+          "presentation time before the first sample");
+}
+
+static void checkEdits(MP4FileHandle hFile, const std::vector<Sample>& samples, const std::vector<Edit>& edits)
+{
+    MP4Duration totalDuration = 0;
+    std::vector<MP4Timestamp> times;
+    for (size_t i = 0; i < edits.size(); i++) {
+        CHECK(MP4GetTrackEditTotalDuration(hFile, 1, (MP4EditId)(i + 1)) == totalDuration + edits[i].duration,
+              "edit %u ends at %llu", (unsigned)(i + 1),
+              (unsigned long long)MP4GetTrackEditTotalDuration(hFile, 1, (MP4EditId)(i + 1)));
+        times.push_back(totalDuration);
+        times.push_back(totalDuration + edits[i].duration / 3);
+        totalDuration += edits[i].duration;
+        times.push_back(totalDuration - 1);
+    }
+    times.push_back(totalDuration);
+    for (MP4Timestamp when = 0; when < totalDuration; when += 997) {
+        times.push_back(when);
+    }
+
+    for (size_t i = 0; i < times.size(); i++) {
+        MP4Timestamp wantStartTime = MP4_INVALID_TIMESTAMP;
+        MP4SampleId want = walkSampleFromEditTime(samples, edits, times[i], &wantStartTime);
+        MP4Timestamp startTime = MP4_INVALID_TIMESTAMP;
+        MP4SampleId sampleId = MP4GetSampleIdFromEditTime(hFile, 1, times[i], &startTime);
+        CHECK(sampleId == want && (want == MP4_INVALID_SAMPLE_ID || startTime == wantStartTime),
+              "edit time %llu: sample %u at %llu, expected %u at %llu", (unsigned long long)times[i],
+              sampleId, (unsigned long long)startTime, want, (unsigned long long)wantStartTime);
+    }
+}
+
+int main()
+{
+    const char* fileName = "samplelookup.mp4";
+    std::vector<Sample> samples = makeSamples();
+
+    std::vector<Edit> edits;
+    Edit edit;
+    edit.mediaStart = 0;      edit.duration = 30000;  edits.push_back(edit);
+    edit.mediaStart = 100500; edit.duration = 20000;  edits.push_back(edit);
+    edit.mediaStart = 250700; edit.duration = 1;      edits.push_back(edit);
+    edit.mediaStart = 50000;  edit.duration = 3000;   edits.push_back(edit);
+    edit.mediaStart = 400000; edit.duration = 150000; edits.push_back(edit);
+
+    if (!createFile(fileName, samples, edits)) {
+        printf("FAIL cannot create %s\n", fileName);
+        return 1;
+    }
+
+    MP4FileHandle hFile = MP4Modify(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        printf("FAIL cannot read %s\n", fileName);
+        return 1;
+    }
+
+    // tables with many entries, or the indexes have little to do
+    CHECK(MP4GetTrackNumberOfSamples(hFile, 1) == numSamples, "%u samples", MP4GetTrackNumberOfSamples(hFile, 1));
+    CHECK(trackProperty(hFile, "mdia.minf.stbl.stts.entryCount") > 100, "%llu stts entries",
+          (unsigned long long)trackProperty(hFile, "mdia.minf.stbl.stts.entryCount"));
+    CHECK(trackProperty(hFile, "mdia.minf.stbl.stsc.entryCount") >= 4, "%llu stsc entries",
+          (unsigned long long)trackProperty(hFile, "mdia.minf.stbl.stsc.entryCount"));
+    CHECK(trackProperty(hFile, "mdia.minf.stbl.ctts.entryCount") > 100, "%llu ctts entries",
+          (unsigned long long)trackProperty(hFile, "mdia.minf.stbl.ctts.entryCount"));
+    CHECK(trackProperty(hFile, "mdia.minf.stbl.stss.entryCount") > 20, "%llu stss entries",
+          (unsigned long long)trackProperty(hFile, "mdia.minf.stbl.stss.entryCount"));
+    CHECK(MP4GetTrackNumberOfEdits(hFile, 1) == edits.size(), "%u edits", MP4GetTrackNumberOfEdits(hFile, 1));
+
+    static const uint32_t intervals[4] = { 16, 1, 5, 0 };
+    for (int k = 0; k < 4; k++) {
+        checkSamples(hFile, samples, intervals[k]);
+    }
+    checkTimes(hFile, samples);
+    checkSyncSamples(hFile, samples);
+    checkPresentation(hFile, samples);
+    checkEdits(hFile, samples, edits);
+
+    // the edit index follows changes made through the elst properties
+    edits[1].duration = 45000;
+    CHECK(MP4SetTrackIntegerProperty(hFile, 1, "edts.elst.entries[1].segmentDuration", edits[1].duration),
+          "cannot set the duration of edit 2");
+    checkEdits(hFile, samples, edits);
+
+    MP4Close(hFile);
+    remove(fileName);
+
+    printf("%u samples, %u edits, %d failures\n", numSamples, (unsigned)edits.size(), failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// segment packages a small two-track file with MP4Segment() by one worker
+// and by four, checks the two sets of segments are byte for byte the same
+// and that their concatenation reads back with the samples of the source
+
+#include "testutil.h"
+
+// 20 seconds of video at 25 fps with a sync sample every 48, some closer
+// together, and B-frame like rendering offsets, and of audio beside it
+static bool createSource(const char* fileName)
+{
+    MP4FileHandle hFile = MP4Create(fileName);
+    if (hFile == MP4_INVALID_FILE_HANDLE) {
+        return false;
+    }
+    MP4SetTimeScale(hFile, 1000);
+    MP4TrackId videoTrack = MP4AddTrack(hFile, MP4_VIDEO_TRACK_TYPE, 90000);
+    MP4TrackId audioTrack = MP4AddTrack(hFile, MP4_AUDIO_TRACK_TYPE, 48000);
+
+    uint8_t buf[4096];
+    uint32_t numAudioSamples = 0;
+    for (uint32_t i = 0; i < 500; i++) {
+        bool isSyncSample = i % 48 == 0 || (i > 200 && i < 210 && i % 3 == 0);
+        uint32_t size = isSyncSample ? 3000 + i % 1000 : 200 + (i * 37) % 1500;
+        MP4Duration renderingOffset = i % 4 == 0 ? 3600 : i % 4 == 1 ? 10800 : 0;
+        fillSample(buf, size, i);
+        MP4WriteSampleDependency(hFile, videoTrack, buf, size, 3600, renderingOffset,
+                                 isSyncSample, isSyncSample ? 0x20 : 0x10);
+
+        // audio up to the end of the video sample
+        while ((uint64_t)numAudioSamples * 1024 * 90000 < (uint64_t)(i + 1) * 3600 * 48000) {
+            uint32_t audioSize = 100 + numAudioSamples % 50;
+            fillSample(buf, audioSize, 1000000 + numAudioSamples);
+            MP4WriteSample(hFile, audioTrack, buf, audioSize, 1024, 0, true);
+            numAudioSamples++;
+        }
+    }
+    MP4Close(hFile);
+    return true;
+}
+
+static string segmentFileName(const char* prefix, uint32_t segment)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s-%u.m4s", prefix, segment);
+    return name;
+}
+
+static void compareSamples(MP4FileHandle hSource, MP4FileHandle hFile)
+{
+    CHECK(MP4GetNumberOfTracks(hFile) == MP4GetNumberOfTracks(hSource), "%u tracks", MP4GetNumberOfTracks(hFile));
+
+    for (uint32_t i = 0; i < MP4GetNumberOfTracks(hSource); i++) {
+        MP4TrackId trackId = MP4FindTrackId(hSource, i);
+        uint32_t numSamples = MP4GetTrackNumberOfSamples(hSource, trackId);
+        CHECK(MP4GetTrackNumberOfSamples(hFile, trackId) == numSamples, "track %u: %u samples, expected %u",
+              trackId, MP4GetTrackNumberOfSamples(hFile, trackId), numSamples);
+
+        for (MP4SampleId sampleId = 1; sampleId <= numSamples; sampleId++) {
+            uint8_t* pSourceBytes = NULL;
+            uint8_t* pBytes = NULL;
+            uint32_t numSourceBytes = 0, numBytes = 0;
+            MP4Timestamp sourceStartTime = 0, startTime = 0;
+            MP4Duration sourceDuration = 0, duration = 0;
+            MP4Duration sourceRenderingOffset = 0, renderingOffset = 0;
+            bool sourceIsSyncSample = false, isSyncSample = false;
+            if (!MP4ReadSample(hSource, trackId, sampleId, &pSourceBytes, &numSourceBytes,
+                               &sourceStartTime, &sourceDuration, &sourceRenderingOffset, &sourceIsSyncSample) ||
+                !MP4ReadSample(hFile, trackId, sampleId, &pBytes, &numBytes,
+                               &startTime, &duration, &renderingOffset, &isSyncSample)) {
+                CHECK(false, "track %u: cannot read sample %u", trackId, sampleId);
+            }
+            else {
+                CHECK(numBytes == numSourceBytes && memcmp(pBytes, pSourceBytes, numBytes) == 0,
+                      "track %u: sample %u bytes", trackId, sampleId);
+                CHECK(startTime == sourceStartTime && duration == sourceDuration,
+                      "track %u: sample %u time %llu, expected %llu", trackId, sampleId,
+                      (unsigned long long)startTime, (unsigned long long)sourceStartTime);
+                CHECK(renderingOffset == sourceRenderingOffset, "track %u: sample %u rendering offset", trackId, sampleId);
+                CHECK(isSyncSample == sourceIsSyncSample, "track %u: sample %u sync", trackId, sampleId);
+            }
+            MP4Free(pSourceBytes);
+            MP4Free(pBytes);
+        }
+    }
+}
+
+int main()
+{
+    const char* sourceFileName = "segment.mp4";
+    const char* catFileName = "segment-cat.mp4";
+    const char* prefixes[] = { "segment-j1", "segment-j4" };
+    const uint32_t numWorkers[] = { 1, 4 };
+
+    if (!createSource(sourceFileName)) {
+        printf("FAIL cannot create %s\n", sourceFileName);
+        return 1;
+    }
+
+    uint32_t numSegments[2] = { 0, 0 };
+    for (int run = 0; run < 2; run++) {
+        string initFileName = string(prefixes[run]) + "-init.mp4";
+        string format = string(prefixes[run]) + "-%u.m4s";
+        CHECK(MP4Segment(sourceFileName, initFileName.c_str(), format.c_str(), 1000,
+                         numWorkers[run], &numSegments[run]),
+              "segmenting with %u workers", numWorkers[run]);
+    }
+    CHECK(numSegments[0] > 4 && numSegments[0] == numSegments[1], "%u and %u segments",
+          numSegments[0], numSegments[1]);
+
+    // the same bytes whatever the number of workers, and concatenated a
+    // fragmented file
+    std::vector<uint8_t> bytes[2];
+    FILE* catFile = fopen(catFileName, "wb");
+    CHECK(catFile != NULL, "cannot create %s", catFileName);
+    for (uint32_t segment = 0; segment <= numSegments[0]; segment++) {
+        for (int run = 0; run < 2; run++) {
+            string fileName = segment == 0 ? string(prefixes[run]) + "-init.mp4"
+                                           : segmentFileName(prefixes[run], segment);
+            CHECK(readFile(fileName, bytes[run]), "cannot read %s", fileName.c_str());
+            remove(fileName.c_str());
+        }
+        CHECK(bytes[0] == bytes[1], "segment %u differs between 1 and 4 workers", segment);
+        CHECK(segment == 0 || (bytes[1].size() > 8 && memcmp(&bytes[1][4], "moof", 4) == 0),
+              "segment %u does not start with a moof", segment);
+        if (catFile && !bytes[1].empty()) {
+            fwrite(&bytes[1][0], 1, bytes[1].size(), catFile);
+        }
+    }
+    if (catFile) {
+        fclose(catFile);
+    }
+
+    MP4FileHandle hSource = MP4Read(sourceFileName);
+    MP4FileHandle hFile = MP4Read(catFileName);
+    CHECK(hSource != MP4_INVALID_FILE_HANDLE && hFile != MP4_INVALID_FILE_HANDLE, "cannot read back");
+    if (hSource != MP4_INVALID_FILE_HANDLE && hFile != MP4_INVALID_FILE_HANDLE) {
+        compareSamples(hSource, hFile);
+    }
+    MP4Close(hSource);
+    MP4Close(hFile);
+
+    remove(sourceFileName);
+    remove(catFileName);
+
+    printf("%u segments, %d failures\n", numSegments[1], failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// helpers shared by the tests, each of which is a program of its own that
+// counts its failures and exits non-zero if there were any
+
+#ifndef MP4V2_TEST_TESTUTIL_H
+#define MP4V2_TEST_TESTUTIL_H
+
+#include <mp4v2/mp4v2.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using std::string;
+
+static int failures = 0;
+
+// counts a failure if cond does not hold and prints the first 20
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        if (failures++ < 20) { \
+            printf("FAIL %s: ", #cond); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } \
+} while (0)
+
+// sample data that tells one sample from another
+static inline void fillSample(uint8_t* buf, uint32_t size, uint32_t id)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        buf[i] = (uint8_t)(id * 7 + i);
+    }
+}
+
+static inline uint32_t readUInt32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t readUInt64(const uint8_t* p)
+{
+    return ((uint64_t)readUInt32(p) << 32) | readUInt32(p + 4);
+}
+
+static inline bool readFile(const string& fileName, std::vector<uint8_t>& bytes)
+{
+    FILE* file = fopen(fileName.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bytes.clear();
+    uint8_t buf[65536];
+    size_t numRead;
+    while ((numRead = fread(buf, 1, sizeof(buf), file)) > 0) {
+        bytes.insert(bytes.end(), buf, buf + numRead);
+    }
+    fclose(file);
+    return true;
+}
+
+#endif // MP4V2_TEST_TESTUTIL_H
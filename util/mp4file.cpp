@@ -35,7 +35,8 @@ private:
     enum FileLongCode {
         LC_LIST = _LC_MAX,
         LC_OPTIMIZE,
-        LC_DUMP
+        LC_DUMP,
+        LC_STATS
     };
 
 public:
@@ -51,8 +52,13 @@ private:
     bool actionOptimize ( JobContext& );
     bool actionDump     ( JobContext& );
 
+    void reportStats ( JobContext& );
+
+    static void traceIO( void*, MP4IOOp, int64_t, int64_t, uint64_t );
+
 private:
     Group _actionGroup;
+    bool  _stats;
 
     bool (FileUtility::*_action)( JobContext& );
 };
@@ -62,6 +68,7 @@ private:
 FileUtility::FileUtility( int argc, char** argv )
     : Utility      ( "mp4file", argc, argv )
     , _actionGroup ( "ACTIONS" )
+    , _stats       ( false )
     , _action      ( NULL )
 {
     // add standard options which make sense for this utility
@@ -73,6 +80,7 @@ FileUtility::FileUtility( int argc, char** argv )
     _group.add( STD_HELP );
     _group.add( STD_VERSION );
     _group.add( STD_VERSIONX );
+    _group.add( "stats", false, LC_STATS, "report I/O statistics for each file" );
 
     _actionGroup.add( "list",     false, LC_LIST,     "list (summary information)" );
     _actionGroup.add( "optimize", false, LC_OPTIMIZE, "optimize mp4 structure" );
@@ -99,6 +107,7 @@ FileUtility::actionDump( JobContext& job )
     if( !MP4Dump( job.fileHandle, _debugImplicits ))
         return herrf( "dump failed: %s\n", job.file.c_str() );
 
+    reportStats( job );
     return SUCCESS;
 }
 
@@ -152,6 +161,7 @@ FileUtility::actionList( JobContext& job )
            << '\n';
 
     verbose1f( "%s", report.str().c_str() );
+    reportStats( job );
     return SUCCESS;
 }
 
@@ -165,14 +175,46 @@ FileUtility::actionOptimize( JobContext& job )
     if( dryrunAbort() )
         return SUCCESS;
 
-    if( !MP4Optimize( job.file.c_str(), NULL ))
+    // MP4Optimize opens its files internally, so tally what the
+    // provider sees instead of asking a file handle
+    MP4IOStats stats;
+    memset( &stats, 0, sizeof(stats) );
+    if( _stats )
+        MP4SetIOTraceCallback( traceIO, &stats );
+
+    const bool ok = MP4Optimize( job.file.c_str(), NULL );
+    MP4SetIOTraceCallback( NULL );
+
+    if( !ok )
         return herrf( "optimize failed: %s\n", job.file.c_str() );
 
+    if( _stats )
+        outf( "%s: %s", job.file.c_str(), ioStatsReport( stats ).c_str() );
+
     return SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
+void
+FileUtility::reportStats( JobContext& job )
+{
+    if( !_stats )
+        return;
+
+    MP4IOStats stats;
+    if( MP4GetIOStats( job.fileHandle, &stats ))
+        outf( "%s: %s", job.file.c_str(), ioStatsReport( stats ).c_str() );
+}
+
+void
+FileUtility::traceIO( void* userData, MP4IOOp op, int64_t offset, int64_t size, uint64_t duration )
+{
+    ioStatsAccumulate( *(MP4IOStats*)userData, op, size, duration );
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 bool
 FileUtility::utility_job( JobContext& job )
 {
@@ -202,6 +244,10 @@ FileUtility::utility_option( int code, bool& handled )
             _action = &FileUtility::actionDump;
             break;
 
+        case LC_STATS:
+            _stats = true;
+            break;
+
         default:
             handled = false;
             break;
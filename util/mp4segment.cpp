@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+//  The contents of this file are subject to the Mozilla Public License
+//  Version 1.1 (the "License"); you may not use this file except in
+//  compliance with the License. You may obtain a copy of the License at
+//  http://www.mozilla.org/MPL/
+//
+//  Software distributed under the License is distributed on an "AS IS"
+//  basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See the
+//  License for the specific language governing rights and limitations
+//  under the License.
+//
+//  The Original Code is MP4v2.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// mp4segment packages an mp4 file as an init segment and media segments
+// of fragmented mp4, see MP4Segment()
+
+#include "util/impl.h"
+
+using namespace mp4v2::util;
+
+extern "C" int main( int argc, char** argv )
+{
+    const char* const usageString =
+        "[-d <seconds>] [-j <workers>] [-i <init-file>] [-o <segment-format>] [-v [<level>]] <file-name>";
+    double seconds = 4.0;
+    uint32_t numWorkers = 0;
+    string initFileName;
+    string segmentFileNameFormat;
+    MP4LogLevel verbosity = MP4_LOG_ERROR;
+
+    /* begin processing command line */
+    char* ProgName = argv[0];
+    while ( true ) {
+        int c = -1;
+        int option_index = 0;
+        static const prog::Option long_options[] = {
+            { "duration", prog::Option::REQUIRED_ARG, 0, 'd' },
+            { "jobs",     prog::Option::REQUIRED_ARG, 0, 'j' },
+            { "init",     prog::Option::REQUIRED_ARG, 0, 'i' },
+            { "output",   prog::Option::REQUIRED_ARG, 0, 'o' },
+            { "verbose",  prog::Option::OPTIONAL_ARG, 0, 'v' },
+            { "version",  prog::Option::NO_ARG,       0, 'V' },
+            { NULL, prog::Option::NO_ARG, 0, 0 }
+        };
+
+        c = prog::getOptionSingle( argc, argv, "d:j:i:o:v::V", long_options, &option_index );
+
+        if ( c == -1 )
+            break;
+
+        switch ( c ) {
+            case 'd':
+                if ( sscanf( prog::optarg, "%lf", &seconds ) != 1 || seconds <= 0 ) {
+                    fprintf( stderr,
+                             "%s: bad duration specified: %s\n",
+                             ProgName, prog::optarg );
+                    exit( 1 );
+                }
+                break;
+            case 'j':
+                if ( sscanf( prog::optarg, "%u", &numWorkers ) != 1 ) {
+                    fprintf( stderr,
+                             "%s: bad number of workers specified: %s\n",
+                             ProgName, prog::optarg );
+                    exit( 1 );
+                }
+                break;
+            case 'i':
+                initFileName = prog::optarg;
+                break;
+            case 'o':
+                segmentFileNameFormat = prog::optarg;
+                break;
+            case 'v':
+                verbosity = MP4_LOG_VERBOSE1;
+                if ( prog::optarg ) {
+                    uint32_t level;
+                    if ( sscanf( prog::optarg, "%u", &level ) == 1 ) {
+                        if ( level >= 2 ) {
+                            verbosity = MP4_LOG_VERBOSE2;
+                        }
+                        if ( level >= 3 ) {
+                            verbosity = MP4_LOG_VERBOSE3;
+                        }
+                        if ( level >= 4 ) {
+                            verbosity = MP4_LOG_VERBOSE4;
+                        }
+                    }
+                }
+                break;
+            case '?':
+                fprintf( stderr, "usage: %s %s\n", ProgName, usageString );
+                exit( 0 );
+            case 'V':
+                fprintf( stderr, "%s - %s\n", ProgName, MP4V2_PROJECT_name_formal );
+                exit( 0 );
+            default:
+                fprintf( stderr, "%s: unknown option specified, ignoring: %c\n",
+                         ProgName, c );
+        }
+    }
+
+    /* check that we have exactly one non-option argument */
+    if ( ( argc - prog::optind ) != 1 ) {
+        fprintf( stderr, "usage: %s %s\n", ProgName, usageString );
+        exit( 1 );
+    }
+
+    MP4LogSetLevel( verbosity );
+    if ( verbosity ) {
+        fprintf( stderr, "%s version %s\n", ProgName, MP4V2_PROJECT_version );
+    }
+
+    const char* fileName = argv[prog::optind];
+
+    /* segments go next to the file by default, named after it */
+    string base = fileName;
+    string::size_type dot = base.find_last_of( '.' );
+    string::size_type slash = base.find_last_of( "\\/" );
+    if ( dot != string::npos && ( slash == string::npos || dot > slash ) ) {
+        base.erase( dot );
+    }
+    if ( initFileName.empty() ) {
+        initFileName = base + "-init.mp4";
+    }
+    if ( segmentFileNameFormat.empty() ) {
+        for ( string::size_type i = 0; i < base.size(); i++ ) {
+            segmentFileNameFormat += base[i];
+            if ( base[i] == '%' ) {
+                segmentFileNameFormat += '%';
+            }
+        }
+        segmentFileNameFormat += "-%u.m4s";
+    }
+
+    /* end processing of command line */
+
+    uint32_t numSegments = 0;
+    if ( !MP4Segment( fileName, initFileName.c_str(), segmentFileNameFormat.c_str(),
+                      (MP4Duration)( seconds * 1000 + 0.5 ), numWorkers, &numSegments ) ) {
+        fprintf( stderr, "%s: segmenting %s failed\n", ProgName, fileName );
+        exit( 1 );
+    }
+
+    if ( verbosity ) {
+        fprintf( stderr, "%s: %s: %u segments\n", ProgName, fileName, numSegments );
+    }
+
+    return( 0 );
+}
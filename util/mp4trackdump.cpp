@@ -78,10 +78,11 @@ static void DumpTrack ( MP4FileHandle mp4file, MP4TrackId tid )
 extern "C" int main( int argc, char** argv )
 {
     const char* const usageString =
-        "[-l] [-t <track-id>] [-s <sample-id>] [-v [<level>]] <file-name>";
+        "[-l] [-t <track-id>] [-s <sample-id>] [-S] [-v [<level>]] <file-name>";
     MP4TrackId trackId = MP4_INVALID_TRACK_ID;
     MP4SampleId sampleId = MP4_INVALID_SAMPLE_ID;
     MP4LogLevel verbosity = MP4_LOG_ERROR;
+    bool stats = false;
 
     /* begin processing command line */
     ProgName = argv[0];
@@ -91,12 +92,13 @@ extern "C" int main( int argc, char** argv )
         static const prog::Option long_options[] = {
             { "track",   prog::Option::REQUIRED_ARG, 0, 't' },
             { "sample",  prog::Option::REQUIRED_ARG, 0, 's' },
+            { "stats",   prog::Option::NO_ARG,       0, 'S' },
             { "verbose", prog::Option::OPTIONAL_ARG, 0, 'v' },
             { "version", prog::Option::NO_ARG,       0, 'V' },
             { NULL, prog::Option::NO_ARG, 0, 0 }
         };
 
-        c = prog::getOptionSingle( argc, argv, "t:v::V", long_options, &option_index );
+        c = prog::getOptionSingle( argc, argv, "t:Sv::V", long_options, &option_index );
 
         if ( c == -1 )
             break;
@@ -109,6 +111,9 @@ extern "C" int main( int argc, char** argv )
                     exit( 1 );
                 }
                 break;
+            case 'S':
+                stats = true;
+                break;
             case 't':
                 if ( sscanf( prog::optarg, "%u", &trackId ) != 1 ) {
                     fprintf( stderr,
@@ -239,6 +244,13 @@ extern "C" int main( int argc, char** argv )
         }
     }
 
+    if ( stats ) {
+        MP4IOStats ioStats;
+        if ( MP4GetIOStats( mp4File, &ioStats ) ) {
+            printf( "%s", ioStatsReport( ioStats ).c_str() );
+        }
+    }
+
     MP4Close( mp4File );
 
     return( 0 );